@@ -0,0 +1,12 @@
+# process scan methods
+add_executable(
+    bench_proc
+
+    bench/bench_proc.c
+)
+
+target_link_libraries(
+    bench_proc
+
+    ${CMAKE_PROJECT_NAME}
+)
\ No newline at end of file
@@ -0,0 +1,160 @@
+/**
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#include <umgmt.h>
+
+#include <dirent.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// default number of scans per method
+#define BENCH_ITERATIONS 20
+
+static double bench_now(void);
+static size_t bench_scan_stdio(uid_t uid);
+static size_t bench_scan(um_proc_uid_t uid_type, uid_t uid);
+
+/**
+ * Compare ways of finding the processes of an user: the original fopen()/fgets() status parsing and the process scan
+ * with each UID type. Usage: bench_proc [iterations] [uid].
+ *
+ */
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : BENCH_ITERATIONS;
+    uid_t uid = argc > 2 ? (uid_t)strtoul(argv[2], NULL, 10) : getuid();
+    const char *const names[] = {"stdio", "real", "effective", "owner"};
+    double start = 0;
+    size_t found = 0;
+
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "usage: %s [iterations] [uid]\n", argv[0]);
+        return 1;
+    }
+
+    for (int method = 0; method < 4; method++)
+    {
+        start = bench_now();
+
+        for (int i = 0; i < iterations; i++)
+        {
+            found = method ? bench_scan((um_proc_uid_t)(method - 1), uid) : bench_scan_stdio(uid);
+        }
+
+        printf("%-10s %10.3f ms/scan %8zu processes\n", names[method], (bench_now() - start) * 1000 / iterations,
+               found);
+    }
+
+    return 0;
+}
+
+/**
+ * Get monotonic time.
+ *
+ * @return Time in seconds.
+ *
+ */
+static double bench_now(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * Count processes of the user by parsing each status file line by line with stdio.
+ *
+ * @param uid Real UID to look for.
+ *
+ * @return Number of found processes.
+ *
+ */
+static size_t bench_scan_stdio(uid_t uid)
+{
+    DIR *proc_d = opendir("/proc");
+    struct dirent *proc = NULL;
+    FILE *status_f = NULL;
+    char status_path[PATH_MAX] = {0};
+    char buf[1024] = {0};
+    unsigned long proc_ruid = 0;
+    size_t found = 0;
+
+    if (!proc_d)
+    {
+        return 0;
+    }
+
+    while ((proc = readdir(proc_d)) != NULL)
+    {
+        if (strspn(proc->d_name, "0123456789") != strlen(proc->d_name))
+        {
+            continue;
+        }
+
+        snprintf(status_path, sizeof(status_path), "/proc/%s/status", proc->d_name);
+        status_f = fopen(status_path, "r");
+        if (!status_f)
+        {
+            continue;
+        }
+
+        while (fgets(buf, sizeof(buf), status_f) == buf)
+        {
+            if (sscanf(buf, "Uid:\t%lu", &proc_ruid) == 1)
+            {
+                found += proc_ruid == uid;
+                break;
+            }
+        }
+
+        fclose(status_f);
+    }
+
+    closedir(proc_d);
+
+    return found;
+}
+
+/**
+ * Count processes of the user using the process scan.
+ *
+ * @param uid_type UID to match by.
+ * @param uid UID to look for.
+ *
+ * @return Number of found processes.
+ *
+ */
+static size_t bench_scan(um_proc_uid_t uid_type, uid_t uid)
+{
+    um_proc_scan_t *scan = um_proc_scan_new();
+    size_t found = 0;
+
+    if (!scan)
+    {
+        return 0;
+    }
+
+    um_proc_scan_set_uid_type(scan, uid_type);
+    if (!um_proc_scan_add_uid(scan, uid) && !um_proc_scan_run(scan))
+    {
+        um_proc_scan_get_pids(scan, uid, &found);
+    }
+
+    um_proc_scan_free(scan);
+
+    return found;
+}
\ No newline at end of file
@@ -17,5 +17,7 @@
 #include "umgmt/user.h"
 #include "umgmt/group.h"
 #include "umgmt/db.h"
+#include "umgmt/snapshot.h"
+#include "umgmt/proc.h"
 
 #endif // UMGMT_H
@@ -0,0 +1,174 @@
+/**
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "arena.h"
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// chunk sizes grow geometrically, so large loads need only a few allocations
+#define UM_ARENA_MIN_CHUNK_SIZE (64U * 1024U)
+#define UM_ARENA_MAX_CHUNK_SIZE (16U * 1024U * 1024U)
+
+typedef struct um_arena_chunk_s um_arena_chunk_t;
+
+struct um_arena_chunk_s
+{
+    um_arena_chunk_t *next; ///< Previously allocated chunk.
+    size_t size;            ///< Size of the data.
+    size_t used;            ///< Number of used data bytes.
+    max_align_t data[];     ///< Chunk data.
+};
+
+struct um_arena_s
+{
+    um_arena_chunk_t *head; ///< Chunk allocations are made from - links to the older chunks.
+    size_t chunk_size;      ///< Size of the next chunk.
+};
+
+static void *um_arena_alloc_aligned(um_arena_t *arena, size_t size, size_t alignment);
+
+/**
+ * Allocate new empty arena.
+ *
+ * @return New allocated arena - NULL on allocation failure.
+ *
+ */
+um_arena_t *um_arena_new(void)
+{
+    um_arena_t *arena = (um_arena_t *)malloc(sizeof(um_arena_t));
+
+    if (!arena)
+    {
+        return NULL;
+    }
+
+    *arena = (um_arena_t){0};
+    arena->chunk_size = UM_ARENA_MIN_CHUNK_SIZE;
+
+    return arena;
+}
+
+/**
+ * Allocate memory suitably aligned for any type.
+ *
+ * @param arena Arena to use.
+ * @param size Number of bytes to allocate.
+ *
+ * @return Allocated memory - NULL on allocation failure.
+ *
+ */
+void *um_arena_alloc(um_arena_t *arena, size_t size)
+{
+    return um_arena_alloc_aligned(arena, size, alignof(max_align_t));
+}
+
+/**
+ * Copy string into the arena.
+ *
+ * @param arena Arena to use.
+ * @param str String to copy.
+ *
+ * @return Copied string - NULL on allocation failure.
+ *
+ */
+char *um_arena_strdup(um_arena_t *arena, const char *str)
+{
+    size_t size = strlen(str) + 1;
+    char *copy = (char *)um_arena_alloc_aligned(arena, size, 1);
+
+    if (copy)
+    {
+        memcpy(copy, str, size);
+    }
+
+    return copy;
+}
+
+/**
+ * Free all memory allocated from the arena and the arena itself.
+ *
+ * @param arena Arena to free.
+ *
+ */
+void um_arena_free(um_arena_t *arena)
+{
+    um_arena_chunk_t *chunk = arena->head;
+
+    while (chunk)
+    {
+        um_arena_chunk_t *next = chunk->next;
+
+        free(chunk);
+        chunk = next;
+    }
+
+    free(arena);
+}
+
+/**
+ * Allocate memory with the given alignment, starting a new chunk if the current one is full.
+ *
+ * @param arena Arena to use.
+ * @param size Number of bytes to allocate.
+ * @param alignment Required alignment - power of two not larger than the alignment of max_align_t.
+ *
+ * @return Allocated memory - NULL on allocation failure.
+ *
+ */
+static void *um_arena_alloc_aligned(um_arena_t *arena, size_t size, size_t alignment)
+{
+    um_arena_chunk_t *chunk = arena->head;
+    size_t offset = 0;
+
+    if (chunk)
+    {
+        offset = (chunk->used + alignment - 1) & ~(alignment - 1);
+    }
+
+    if (!chunk || offset > chunk->size || chunk->size - offset < size)
+    {
+        size_t chunk_size = arena->chunk_size;
+
+        if (size > SIZE_MAX - sizeof(um_arena_chunk_t))
+        {
+            return NULL;
+        }
+
+        // oversized allocations get a chunk of their own
+        if (chunk_size < size)
+        {
+            chunk_size = size;
+        }
+
+        chunk = (um_arena_chunk_t *)malloc(sizeof(um_arena_chunk_t) + chunk_size);
+        if (!chunk)
+        {
+            return NULL;
+        }
+
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        chunk->next = arena->head;
+        arena->head = chunk;
+        offset = 0;
+
+        if (arena->chunk_size < UM_ARENA_MAX_CHUNK_SIZE)
+        {
+            arena->chunk_size *= 2;
+        }
+    }
+
+    chunk->used = offset + size;
+
+    return (char *)chunk->data + offset;
+}
\ No newline at end of file
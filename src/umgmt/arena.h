@@ -0,0 +1,86 @@
+/**
+ * @file arena.h
+ * @brief Internal API for bump allocation of users, groups and their data.
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#ifndef UMGMT_ARENA_H
+#define UMGMT_ARENA_H
+
+#include "types.h"
+
+#include <stddef.h>
+
+/**
+ * Arena - memory is allocated from large chunks and only released all at once.
+ */
+typedef struct um_arena_s um_arena_t;
+
+/**
+ * Allocate new empty arena.
+ *
+ * @return New allocated arena - NULL on allocation failure.
+ *
+ */
+um_arena_t *um_arena_new(void);
+
+/**
+ * Allocate memory suitably aligned for any type.
+ *
+ * @param arena Arena to use.
+ * @param size Number of bytes to allocate.
+ *
+ * @return Allocated memory - NULL on allocation failure.
+ *
+ */
+void *um_arena_alloc(um_arena_t *arena, size_t size);
+
+/**
+ * Copy string into the arena.
+ *
+ * @param arena Arena to use.
+ * @param str String to copy.
+ *
+ * @return Copied string - NULL on allocation failure.
+ *
+ */
+char *um_arena_strdup(um_arena_t *arena, const char *str);
+
+/**
+ * Free all memory allocated from the arena and the arena itself.
+ *
+ * @param arena Arena to free.
+ *
+ */
+void um_arena_free(um_arena_t *arena);
+
+/**
+ * Allocate new user in the arena.
+ * Strings set on the user are copied into the arena as well and nothing is freed before the arena itself.
+ *
+ * @param arena Arena to use.
+ *
+ * @return New allocated user.
+ *
+ */
+um_user_t *um_user_new_in(um_arena_t *arena);
+
+/**
+ * Allocate new group in the arena.
+ * Strings set on the group and member/admin elements are allocated in the arena as well and nothing is freed before
+ * the arena itself.
+ *
+ * @param arena Arena to use.
+ *
+ * @return New allocated group.
+ *
+ */
+um_group_t *um_group_new_in(um_arena_t *arena);
+
+#endif // UMGMT_ARENA_H
\ No newline at end of file
@@ -11,22 +11,237 @@
 #include "db.h"
 #include "user.h"
 #include "group.h"
-
+#include "idpool.h"
+#include "arena.h"
+#include "intern.h"
+#include "deferred.h"
+#include "owner.h"
+#include "dirty.h"
+#include "parser.h"
+#include "source.h"
+#include "loader.h"
+
+#include <errno.h>
+#include <fcntl.h>
 #include <gshadow.h>
+#include <linux/limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 #include <utlist.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// report allocation failures instead of exiting the process
+#define HASH_NONFATAL_OOM 1
+#include <uthash.h>
+
+// default range for new UIDs and GIDs - 65534 is reserved for nobody/nogroup
+#define UM_DB_ID_MIN 1000
+#define UM_DB_ID_MAX 65533
+
+// shadow dates are counted in days
+#define UM_DB_SECONDS_PER_DAY (24 * 60 * 60)
+
+typedef struct um_db_user_entry_s um_db_user_entry_t;
+typedef struct um_db_group_entry_s um_db_group_entry_t;
+typedef struct um_db_uid_node_s um_db_uid_node_t;
+typedef struct um_db_gid_node_s um_db_gid_node_t;
+typedef struct um_db_block_s um_db_block_t;
+typedef struct um_db_output_s um_db_output_t;
+
+/**
+ * Account file being replaced - new contents are written to a temporary file in the same directory.
+ */
+struct um_db_output_s
+{
+    const char *path;        ///< Path of the account file.
+    char tmp_path[PATH_MAX]; ///< Path of the temporary file - empty if not created.
+    FILE *file;              ///< Temporary file stream - NULL once synced.
+};
+
+/**
+ * Database user node - list element extended with index handles.
+ */
+struct um_db_user_entry_s
+{
+    um_user_element_t element;    ///< List element - must be the first member.
+    bool pooled;                  ///< Allocated in a batch block or the arena - freed with the database.
+    bool seen;                    ///< Read from the account file - cleared while the database is refreshed.
+    UT_hash_handle name_hh;       ///< Name index handle.
+    um_db_uid_node_t *uid_node;   ///< UID index node the user is chained to.
+    um_db_user_entry_t *uid_next; ///< Next user with the same UID.
+    um_db_user_entry_t *uid_prev; ///< Previous user with the same UID.
+};
+
+/**
+ * Database group node - list element extended with index handles.
+ */
+struct um_db_group_entry_s
+{
+    um_group_element_t element;    ///< List element - must be the first member.
+    bool pooled;                   ///< Allocated in a batch block or the arena - freed with the database.
+    bool seen;                     ///< Read from the account file - cleared while the database is refreshed.
+    UT_hash_handle name_hh;        ///< Name index handle.
+    um_db_gid_node_t *gid_node;    ///< GID index node the group is chained to.
+    um_db_group_entry_t *gid_next; ///< Next group with the same GID.
+    um_db_group_entry_t *gid_prev; ///< Previous group with the same GID.
+};
+
+/**
+ * UID index node - all users sharing one UID, in list order.
+ */
+struct um_db_uid_node_s
+{
+    uid_t uid;                ///< Index key.
+    um_db_user_entry_t *head; ///< Users with this UID.
+    size_t order;             ///< Position in the ordered UID index.
+    UT_hash_handle hh;        ///< UID index handle.
+};
+
+/**
+ * GID index node - all groups sharing one GID, in list order.
+ */
+struct um_db_gid_node_s
+{
+    gid_t gid;                 ///< Index key.
+    um_db_group_entry_t *head; ///< Groups with this GID.
+    size_t order;              ///< Position in the ordered GID index.
+    UT_hash_handle hh;         ///< GID index handle.
+};
+
+/**
+ * Storage for user or group nodes added in a single batch.
+ */
+struct um_db_block_s
+{
+    um_db_block_t *next; ///< Link to the next block.
+    max_align_t data[];  ///< Node array.
+};
 
 struct um_db_s
 {
     um_user_element_t *user_head;
     um_group_element_t *group_head;
+    um_db_user_entry_t *user_name_index;
+    um_db_group_entry_t *group_name_index;
+    um_db_uid_node_t *uid_index;
+    um_db_gid_node_t *gid_index;
+
+    // ordered indexes - index nodes sorted by ID, rebuilt on first use after a node is added or removed
+    um_db_uid_node_t **uid_order;
+    size_t uid_order_count;
+    bool uid_order_valid;
+    um_db_gid_node_t **gid_order;
+    size_t gid_order_count;
+    bool gid_order_valid;
+
+    // ID allocation - pools are built from the indexes on first use
+    um_db_id_policy_t id_policy;
+    uid_t uid_min;
+    uid_t uid_max;
+    gid_t gid_min;
+    gid_t gid_max;
+    um_id_pool_t *uid_pool;
+    um_id_pool_t *gid_pool;
+    um_id_pool_t *uid_reserved;
+    um_id_pool_t *gid_reserved;
+
+    // node storage of batch additions
+    um_db_block_t *blocks;
+
+    // threads used by UM_DB_LOAD_PARALLEL - 0 for the number of CPUs
+    unsigned int load_threads;
+
+    // account files changed by additions and deletions
+    unsigned int dirty;
+
+    // account file paths - NULL for the system default
+    char *paths[UM_DB_FILE_COUNT];
+
+    // status of the account files when they were last loaded or stored
+    struct stat sources[UM_DB_FILE_COUNT];
+
+    // shadow files not read by the load - dirty mask bits
+    unsigned int deferred;
+    unsigned int unavailable;
+    bool native;
+    bool loading_deferred;
+
+    // inotify descriptor watching the account file directories - -1 if not watched
+    int watch_fd;
+    bool watch_checked;
+
+    // storage of users and groups loaded with UM_DB_LOAD_ARENA
+    um_arena_t *arena;
+
+    // shared copies of repeated strings of users and groups in the database
+    um_intern_t *intern;
 };
 
-static int um_user_element_cmp_fn(void *d1, void *d2);
-static int um_group_element_cmp_fn(void *d1, void *d2);
+static um_db_user_entry_t *um_db_find_user_entry(const um_db_t *db, const char *name);
+static um_db_group_entry_t *um_db_find_group_entry(const um_db_t *db, const char *name);
+static int um_db_index_user_entry(um_db_t *db, um_db_user_entry_t *entry);
+static int um_db_index_group_entry(um_db_t *db, um_db_group_entry_t *entry);
+static void um_db_unindex_user_entry(um_db_t *db, um_db_user_entry_t *entry);
+static void um_db_unindex_group_entry(um_db_t *db, um_db_group_entry_t *entry);
+static um_db_uid_node_t *um_db_get_uid_node(um_db_t *db, uid_t uid);
+static um_db_gid_node_t *um_db_get_gid_node(um_db_t *db, gid_t gid);
+static void um_db_link_uid_entry(um_db_t *db, um_db_uid_node_t *node, um_db_user_entry_t *entry);
+static void um_db_link_gid_entry(um_db_t *db, um_db_gid_node_t *node, um_db_group_entry_t *entry);
+static void um_db_clear_indexes(um_db_t *db);
+static void um_db_remove_uid_node(um_db_t *db, um_db_uid_node_t *node);
+static void um_db_remove_gid_node(um_db_t *db, um_db_gid_node_t *node);
+static um_id_pool_t *um_db_get_uid_pool(um_db_t *db);
+static int um_db_build_uid_order(um_db_t *db);
+static int um_db_build_gid_order(um_db_t *db);
+static int um_db_compare_uid_nodes(const void *node1, const void *node2);
+static int um_db_compare_gid_nodes(const void *node1, const void *node2);
+static size_t um_db_find_uid_order(const um_db_t *db, uid_t uid);
+static size_t um_db_find_gid_order(const um_db_t *db, gid_t gid);
+static um_user_element_t *um_db_next_sorted_user(const um_db_t *db, const um_user_element_t *element);
+static um_group_element_t *um_db_next_sorted_group(const um_db_t *db, const um_group_element_t *element);
+static um_id_pool_t *um_db_get_gid_pool(um_db_t *db);
+static int um_db_next_id(const um_id_pool_t *pool, um_db_id_policy_t policy, id_t *id);
+static int um_db_find_free_run(const um_id_pool_t *pool, id_t from, size_t count, id_t *first);
+static int um_db_reserve_ids(um_id_pool_t *pool, um_id_pool_t *reserved, um_db_id_policy_t policy, id_t *ids,
+                             size_t count, bool contiguous);
+static void um_db_release_ids(um_id_pool_t *pool, um_id_pool_t *reserved, const id_t *ids, size_t count);
+static int um_db_insert_user(um_db_t *db, um_user_t *user, um_arena_t *arena);
+static int um_db_insert_group(um_db_t *db, um_group_t *group, um_arena_t *arena);
+static void *um_db_new_block(um_db_t *db, size_t size);
+static void um_db_free_block(um_db_t *db, void *data);
+static int um_db_output_open(um_db_output_t *file, const char *path);
+static int um_db_output_sync(um_db_output_t *file);
+static int um_db_output_commit(um_db_output_t *file);
+static void um_db_output_discard(um_db_output_t *file);
+static int um_db_sync_dir(const char *path);
+static bool um_db_same_dir(const char *path1, const char *path2);
+static bool um_db_has_custom_paths(const um_db_t *db);
+static const char *um_db_get_default_path(um_db_file_t file);
+static unsigned int um_db_collect_dirty(const um_db_t *db);
+static int um_db_load_nss(um_db_t *db, um_arena_t *arena, unsigned int files);
+static int um_db_load_files(um_db_t *db, um_arena_t *arena, unsigned int files);
+static int um_db_load_parallel(um_db_t *db, um_arena_t *arena, unsigned int files);
+static int um_db_load_passwd(um_db_t *db, const struct passwd *pwd, um_arena_t *arena);
+static int um_db_load_shadow(um_db_t *db, const struct spwd *spwd);
+static int um_db_load_group(um_db_t *db, const struct group *grp, um_arena_t *arena);
+static int um_db_load_gshadow(um_db_t *db, const struct sgrp *sgrp);
+static void um_db_clear_dirty(um_db_t *db);
+static void um_db_stat_source(um_db_t *db, um_db_file_t file);
+static bool um_db_source_changed(const um_db_t *db, um_db_file_t file);
+static bool um_db_watch_changed(um_db_t *db);
+static int um_db_update_user(um_user_t *user, const struct passwd *pwd);
+static int um_db_update_group(um_group_t *group, const struct group *grp);
+static int um_db_set_group_users(um_db_t *db, um_group_t *group, char *const *names, bool admin);
+static bool um_db_same_string(const char *str1, const char *str2);
+static size_t um_db_query_add(const um_db_user_query_t *query, long int today, um_user_t *user, um_user_t **users,
+                              size_t size, size_t count);
 
 /**
  * Allocate new database.
@@ -45,11 +260,26 @@ um_db_t *um_db_new(void)
 
     *new_db = (um_db_t){0};
 
+    new_db->intern = um_intern_new();
+    if (!new_db->intern)
+    {
+        free(new_db);
+        return NULL;
+    }
+
+    new_db->id_policy = UM_DB_ID_POLICY_NEXT_MAX;
+    new_db->uid_min = UM_DB_ID_MIN;
+    new_db->uid_max = UM_DB_ID_MAX;
+    new_db->gid_min = UM_DB_ID_MIN;
+    new_db->gid_max = UM_DB_ID_MAX;
+    new_db->watch_fd = -1;
+
     return new_db;
 }
 
 /**
  * Load database from the system.
+ * Data is read using the NSS functions - same as um_db_load_ex() without flags.
  *
  * @param db Database to load.
  *
@@ -58,277 +288,105 @@ um_db_t *um_db_new(void)
  */
 int um_db_load(um_db_t *db)
 {
-    int error = 0;
-
-    // temp data
-    um_user_t *tmp_user = NULL;
-    um_user_element_t *tmp_user_element = NULL, user_search_element = {0}, *user_found_element = NULL;
-    um_group_t *tmp_group = NULL;
-    um_group_element_t *tmp_group_element = NULL, group_search_element = {0}, *group_found_element = NULL;
-
-    // make sure no memory leak occurs
-    bool user_set = false;
-    bool group_set = false;
-
-    // passwd and shadow
-    struct passwd *pwd = NULL;
-    struct spwd *spwd = NULL;
-    struct group *grp = NULL;
-    struct sgrp *sgrp = NULL;
-
-    // files closed
-    bool passwd_closed = false, shadow_closed = false, gpasswd_closed = false, gshadow_closed = false;
-
-    // allocate search element data for later usage
-    user_search_element.user = um_user_new();
-    if (!user_search_element.user)
-    {
-        goto error_out;
-    }
-
-    group_search_element.group = um_group_new();
-    if (!group_search_element.group)
-    {
-        goto error_out;
-    }
-
-    // load /etc/passwd data and after that load /etc/shadow data
-    setpwent();
-
-    // /etc/passwd
-    while ((pwd = getpwent()) != NULL)
-    {
-        tmp_user = um_user_new();
-
-        if (!tmp_user)
-            goto error_out;
-
-        user_set = false;
-
-        // set passwd data
-        if (um_user_set_name(tmp_user, pwd->pw_name))
-            goto error_out;
-        if (um_user_set_password(tmp_user, pwd->pw_passwd))
-            goto error_out;
-        if (um_user_set_gecos(tmp_user, pwd->pw_gecos))
-            goto error_out;
-        if (um_user_set_home_path(tmp_user, pwd->pw_dir))
-            goto error_out;
-        if (um_user_set_shell_path(tmp_user, pwd->pw_shell))
-            goto error_out;
-
-        um_user_set_uid(tmp_user, pwd->pw_uid);
-        um_user_set_gid(tmp_user, pwd->pw_gid);
-
-        // create element
-        tmp_user_element = (um_user_element_t *)malloc(sizeof(um_user_element_t));
-        if (!tmp_user_element)
-            goto error_out;
-
-        tmp_user_element->user = tmp_user;
-        user_set = true;
-
-        // add the user to the list
-        LL_APPEND(db->user_head, tmp_user_element);
-    }
-
-    passwd_closed = true;
-    endpwent();
+    return um_db_load_ex(db, 0);
+}
 
-    setspent();
+/**
+ * Load database from the system.
+ * Shadow and gshadow entries are merged using the name index, so loading takes time linear in the total size of
+ * the account files: O(users + groups + group members and admins).
+ *
+ * By default the data is read using the getpwent() family of functions. With UM_DB_LOAD_NATIVE the account files are
+ * mapped and parsed directly, which avoids NSS and the copies made by libc, but only sees the local files. Databases
+ * with paths changed by um_db_set_root() or um_db_set_path() are always loaded this way.
+ *
+ * With UM_DB_LOAD_ARENA loaded users and groups, their strings, list nodes and member/admin elements are allocated in
+ * large chunks owned by the database, which are released only by um_db_free(). Memory of such users and groups
+ * deleted or modified later is not reused until then.
+ *
+ * Passwords, shells and password hash placeholders repeated across records (such as "x", "/bin/bash" or "!") are
+ * stored once per database - also when they are set later on users and groups in the database.
+ *
+ * Shadow and gshadow are not needed for names, IDs, home directories and shells, and reading them requires root
+ * privileges. UM_DB_LOAD_SKIP_SHADOW leaves them out - shadow fields and group admins stay unset and the files can
+ * not be stored. UM_DB_LOAD_DEFER_SHADOW reads each of them once, on the first use of a shadow getter or setter of a
+ * loaded user or group, or when the file is stored. With either flag group members are taken from the group file.
+ *
+ * UM_DB_LOAD_PARALLEL parses the account files directly in multiple threads - see um_db_set_load_threads().
+ *
+ * @param db Database to load.
+ * @param flags Bitwise OR of um_db_load_flags_t values.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_db_load_ex(um_db_t *db, unsigned int flags)
+{
+    int error = 0;
+    unsigned int files = UM_DIRTY_PASSWD | UM_DIRTY_SHADOW | UM_DIRTY_GROUP | UM_DIRTY_GSHADOW;
+    um_arena_t *arena = NULL;
 
-    // /etc/shadow
-    while ((spwd = getspent()) != NULL)
+    if (flags & UM_DB_LOAD_ARENA)
     {
-        // get user from the list
-        error = um_user_set_name(user_search_element.user, spwd->sp_namp);
-        if (error)
-        {
-            goto error_out;
-        }
-
-        user_found_element = NULL;
-        LL_SEARCH(db->user_head, user_found_element, &user_search_element, um_user_element_cmp_fn);
-
-        // set shadow data
-        if (user_found_element)
+        if (!db->arena)
         {
-            um_user_t *user = user_found_element->user;
-
-            if (um_user_set_password_hash(user, spwd->sp_pwdp))
-                goto error_out;
-
-            um_user_set_last_change(user, spwd->sp_lstchg);
-            um_user_set_change_min(user, spwd->sp_min);
-            um_user_set_change_max(user, spwd->sp_max);
-            um_user_set_warn_days(user, spwd->sp_warn);
-            um_user_set_inactive_days(user, spwd->sp_inact);
-            um_user_set_expiration(user, spwd->sp_expire);
-            um_user_set_flags(user, spwd->sp_flag);
+            db->arena = um_arena_new();
+            if (!db->arena)
+            {
+                return -1;
+            }
         }
-    }
-
-    shadow_closed = true;
-    endspent();
-
-    setgrent();
-
-    // /etc/group
-    while ((grp = getgrent()) != NULL)
-    {
-        tmp_group = um_group_new();
-
-        if (!tmp_group)
-            goto error_out;
-
-        group_set = false;
-
-        // set passwd data
-        if (um_group_set_name(tmp_group, grp->gr_name))
-            goto error_out;
-        if (um_group_set_password(tmp_group, grp->gr_passwd))
-            goto error_out;
-
-        um_group_set_gid(tmp_group, grp->gr_gid);
-
-        // create element
-        tmp_group_element = (um_group_element_t *)malloc(sizeof(um_group_element_t));
-        if (!tmp_group_element)
-            goto error_out;
 
-        tmp_group_element->group = tmp_group;
-        group_set = true;
-
-        // add the group to the list
-        LL_APPEND(db->group_head, tmp_group_element);
+        arena = db->arena;
     }
 
-    gpasswd_closed = true;
-    endgrent();
-
-    setsgent();
-
-    // /etc/gshadow
-    while ((sgrp = getsgent()) != NULL)
+    // files changed after this point are detected as newer than the loaded data
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
     {
-        // get group from the list
-        error = um_group_set_name(group_search_element.group, sgrp->sg_namp);
-        if (error)
-        {
-            goto error_out;
-        }
-
-        group_found_element = NULL;
-        LL_SEARCH(db->group_head, group_found_element, &group_search_element, um_group_element_cmp_fn);
-
-        // set shadow data
-        if (group_found_element)
-        {
-            um_group_t *group = group_found_element->group;
-
-            if (um_group_set_password_hash(group, sgrp->sg_passwd))
-                goto error_out;
-
-            // add admin and member lists
-
-            for (int i = 0; sgrp->sg_mem[i] != NULL; i++)
-            {
-                const char *member = sgrp->sg_mem[i];
-
-                error = um_user_set_name(user_search_element.user, member);
-                if (error)
-                {
-                    goto error_out;
-                }
-
-                LL_SEARCH(db->user_head, user_found_element, &user_search_element, um_user_element_cmp_fn);
-
-                if (user_found_element)
-                {
-                    error = um_group_add_member(group, user_found_element->user);
-                    if (error)
-                    {
-                        goto error_out;
-                    }
-                }
-            }
-
-            for (int i = 0; sgrp->sg_adm[i] != NULL; i++)
-            {
-                const char *admin = sgrp->sg_adm[i];
-
-                error = um_user_set_name(user_search_element.user, admin);
-                if (error)
-                {
-                    goto error_out;
-                }
-
-                user_found_element = NULL;
-                LL_SEARCH(db->user_head, user_found_element, &user_search_element, um_user_element_cmp_fn);
-
-                if (user_found_element)
-                {
-                    error = um_group_add_admin(group, user_found_element->user);
-                    if (error)
-                    {
-                        goto error_out;
-                    }
-                }
-            }
-        }
+        um_db_stat_source(db, (um_db_file_t)i);
     }
 
-    gshadow_closed = true;
-    endsgent();
-
-    goto out;
-
-error_out:
-    error = -1;
-    if (tmp_user && !user_set)
+    db->deferred = 0;
+    db->unavailable = 0;
+    if (flags & UM_DB_LOAD_SKIP_SHADOW)
     {
-        um_user_free(tmp_user);
+        db->unavailable = UM_DIRTY_SHADOW | UM_DIRTY_GSHADOW;
     }
-    if (tmp_group && !group_set)
+    else if (flags & UM_DB_LOAD_DEFER_SHADOW)
     {
-        um_group_free(tmp_group);
+        db->deferred = UM_DIRTY_SHADOW | UM_DIRTY_GSHADOW;
     }
+    files &= ~(db->deferred | db->unavailable);
 
-out:
-    if (!passwd_closed)
+    // NSS only knows about the system files
+    db->native = (flags & (UM_DB_LOAD_NATIVE | UM_DB_LOAD_PARALLEL)) || um_db_has_custom_paths(db);
+    if (flags & UM_DB_LOAD_PARALLEL)
     {
-        endpwent();
+        error = um_db_load_parallel(db, arena, files);
     }
-
-    if (!shadow_closed)
+    else if (db->native)
     {
-        endspent();
+        error = um_db_load_files(db, arena, files);
     }
-
-    if (!gpasswd_closed)
+    else
     {
-        endgrent();
+        error = um_db_load_nss(db, arena, files);
     }
 
-    if (!gshadow_closed)
+    if (error)
     {
-        endsgent();
+        return -1;
     }
 
-    if (user_search_element.user)
-    {
-        um_user_free(user_search_element.user);
-    }
-    if (group_search_element.group)
-    {
-        um_group_free(group_search_element.group);
-    }
+    // loaded data matches the files
+    um_db_clear_dirty(db);
 
-    return error;
+    return 0;
 }
 
 /**
  * Store database to the system.
+ * All account files are rewritten - same as um_db_store_ex() without flags.
  *
  * @param db Database to store.
  *
@@ -336,15 +394,50 @@ out:
  *
  */
 int um_db_store(um_db_t *db)
+{
+    return um_db_store_ex(db, 0);
+}
+
+/**
+ * Store database to the system.
+ * Each file is written to a temporary file in the same directory, synced to disk and renamed over the original, so
+ * readers never see a partially written file and a failed store leaves the original files in place. Previous
+ * contents are kept as backup files with a '-' suffix, same as in shadow-utils. Each directory containing the files
+ * is synced once after all files are renamed.
+ *
+ * With UM_DB_STORE_INCREMENTAL only the files containing users or groups changed since the last load or store are
+ * rewritten, files without changes are not touched at all.
+ *
+ * With UM_DB_STORE_SORTED users are written in UID order and groups in GID order, which keeps the files stable for
+ * diffs. Records sharing an ID keep their list order. The list order in the database is not changed.
+ *
+ * Shadow data deferred by UM_DB_LOAD_DEFER_SHADOW is read before its files are written. Storing fails if the
+ * shadow or gshadow file has to be written but was skipped or could not be read.
+ *
+ * @param db Database to store.
+ * @param flags Bitwise OR of um_db_store_flags_t values.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_db_store_ex(um_db_t *db, unsigned int flags)
 {
     int error = 0;
+    unsigned int dirty = UM_DIRTY_PASSWD | UM_DIRTY_SHADOW | UM_DIRTY_GROUP | UM_DIRTY_GSHADOW;
+    const unsigned int file_dirty[UM_DB_FILE_COUNT] = {
+        [UM_DB_FILE_PASSWD] = UM_DIRTY_PASSWD,
+        [UM_DB_FILE_SHADOW] = UM_DIRTY_SHADOW,
+        [UM_DB_FILE_GROUP] = UM_DIRTY_GROUP,
+        [UM_DB_FILE_GSHADOW] = UM_DIRTY_GSHADOW,
+    };
+    um_db_output_t files[UM_DB_FILE_COUNT] = {0};
     FILE *passwd_file = NULL;
     FILE *shadow_file = NULL;
     FILE *gpasswd_file = NULL;
     FILE *gshadow_file = NULL;
 
-    um_user_element_t *user_iter = NULL;
-    um_group_element_t *group_iter = NULL;
+    um_user_element_t *user_head = NULL, *user_iter = NULL;
+    um_group_element_t *group_head = NULL, *group_iter = NULL;
     const um_group_user_element_t *tmp_group_user = NULL;
 
     const char **members = NULL;
@@ -354,32 +447,48 @@ int um_db_store(um_db_t *db)
 
     size_t members_count = 0;
     size_t admins_count = 0;
+    bool sorted = flags & UM_DB_STORE_SORTED;
 
-    passwd_file = fopen("/etc/passwd", "w");
-    if (!passwd_file)
+    if (flags & UM_DB_STORE_INCREMENTAL)
     {
-        goto error_out;
+        dirty = um_db_collect_dirty(db);
+        if (!dirty)
+        {
+            return 0;
+        }
     }
 
-    shadow_file = fopen("/etc/shadow", "w");
-    if (!shadow_file)
+    // deferred shadow data has to be read before its files are replaced, skipped data cannot be written
+    if (um_db_load_deferred(db, dirty))
     {
-        goto error_out;
+        return -1;
     }
 
-    gpasswd_file = fopen("/etc/group", "w");
-    if (!gpasswd_file)
+    if (sorted && (um_db_build_uid_order(db) || um_db_build_gid_order(db)))
     {
-        goto error_out;
+        return -1;
     }
 
-    gshadow_file = fopen("/etc/gshadow", "w");
-    if (!gshadow_file)
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
     {
-        goto error_out;
+        if ((dirty & file_dirty[i]) && um_db_output_open(&files[i], um_db_get_path(db, (um_db_file_t)i)))
+        {
+            goto error_out;
+        }
     }
 
-    LL_FOREACH(db->user_head, user_iter)
+    passwd_file = files[UM_DB_FILE_PASSWD].file;
+    shadow_file = files[UM_DB_FILE_SHADOW].file;
+    gpasswd_file = files[UM_DB_FILE_GROUP].file;
+    gshadow_file = files[UM_DB_FILE_GSHADOW].file;
+
+    // skip lists which are not written to any file
+    user_head = sorted ? um_db_next_sorted_user(db, NULL) : db->user_head;
+    user_head = (passwd_file || shadow_file) ? user_head : NULL;
+    group_head = sorted ? um_db_next_sorted_group(db, NULL) : db->group_head;
+    group_head = (gpasswd_file || gshadow_file) ? group_head : NULL;
+
+    for (user_iter = user_head; user_iter; user_iter = sorted ? um_db_next_sorted_user(db, user_iter) : user_iter->next)
     {
         const um_user_t *user = user_iter->user;
 
@@ -408,19 +517,20 @@ int um_db_store(um_db_t *db)
         };
 
         // passwd
-        if (putpwent(&tmp_passwd, passwd_file))
+        if (passwd_file && putpwent(&tmp_passwd, passwd_file))
         {
             goto error_out;
         }
 
         // shadow
-        if (putspent(&tmp_spwd, shadow_file))
+        if (shadow_file && putspent(&tmp_spwd, shadow_file))
         {
             goto error_out;
         }
     }
 
-    LL_FOREACH(db->group_head, group_iter)
+    for (group_iter = group_head; group_iter;
+         group_iter = sorted ? um_db_next_sorted_group(db, group_iter) : group_iter->next)
     {
         const um_group_t *group = group_iter->group;
 
@@ -482,12 +592,12 @@ int um_db_store(um_db_t *db)
             .sg_mem = (char **)members,
         };
 
-        if (putgrent(&tmp_group, gpasswd_file))
+        if (gpasswd_file && putgrent(&tmp_group, gpasswd_file))
         {
             goto error_out;
         }
 
-        if (putsgent(&tmp_sgrp, gshadow_file))
+        if (gshadow_file && putsgent(&tmp_sgrp, gshadow_file))
         {
             goto error_out;
         }
@@ -499,6 +609,50 @@ int um_db_store(um_db_t *db)
         admins_allocated = false;
     }
 
+    // all data has to be on disk before any of the files is replaced
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        if (files[i].file && um_db_output_sync(&files[i]))
+        {
+            goto error_out;
+        }
+    }
+
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        if (files[i].tmp_path[0])
+        {
+            if (um_db_output_commit(&files[i]))
+            {
+                goto error_out;
+            }
+            um_db_stat_source(db, (um_db_file_t)i);
+        }
+    }
+
+    // make the renames durable - files usually share the directory, so it is synced once
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        bool synced = false;
+
+        if (!files[i].path)
+        {
+            continue;
+        }
+
+        for (int j = 0; j < i && !synced; j++)
+        {
+            synced = files[j].path && um_db_same_dir(files[i].path, files[j].path);
+        }
+
+        if (!synced && um_db_sync_dir(files[i].path))
+        {
+            goto error_out;
+        }
+    }
+
+    um_db_clear_dirty(db);
+
     goto out;
 
 error_out:
@@ -515,379 +669,3561 @@ out:
         free(admins);
     }
 
-    if (passwd_file)
+    // removes temporary files left after a failure
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
     {
-        fclose(passwd_file);
-    }
-
-    if (shadow_file)
-    {
-        fclose(shadow_file);
-    }
-
-    if (gpasswd_file)
-    {
-        fclose(gpasswd_file);
-    }
-
-    if (gshadow_file)
-    {
-        fclose(gshadow_file);
+        um_db_output_discard(&files[i]);
     }
 
     return error;
 }
 
 /**
- * Return the new UID which can be used for a new user.
+ * Reload account files changed since the database was last loaded, stored or refreshed.
+ * Files are compared by device, inode, size and modification time, and only the changed files are read again.
+ * Users and groups which are still in the files are updated in place - pointers to them and to their unchanged
+ * strings stay valid. Users and groups removed from the files are deleted.
  *
- * @param db Database to use.
+ * Changing passwd also reads shadow, group and gshadow again, since records of new users are merged from them.
+ * Changing group also reads gshadow. Files not read by the load because of UM_DB_LOAD_SKIP_SHADOW or
+ * UM_DB_LOAD_DEFER_SHADOW are not read by the refresh either.
+ *
+ * Once um_db_watch() is used, files are checked only after the watch reported a change in their directories.
  *
- * @return New UID.
+ * @param db Database to refresh.
+ * @param changed Set to true if any file was read again - can be NULL.
+ *
+ * @return Error code - 0 on success, -1 if the database has unstored changes or a file could not be read. After a
+ * read failure the database can be partially refreshed and the failed files are read again by the next refresh.
  *
  */
-uid_t um_db_get_new_uid(um_db_t *db)
+int um_db_refresh(um_db_t *db, bool *changed)
 {
-    um_user_element_t *user_iter = NULL;
-    gid_t max_uid = 0;
+    int error = 0;
+    unsigned int files = 0;
+    const unsigned int file_dirty[UM_DB_FILE_COUNT] = {
+        [UM_DB_FILE_PASSWD] = UM_DIRTY_PASSWD,
+        [UM_DB_FILE_SHADOW] = UM_DIRTY_SHADOW,
+        [UM_DB_FILE_GROUP] = UM_DIRTY_GROUP,
+        [UM_DB_FILE_GSHADOW] = UM_DIRTY_GSHADOW,
+    };
+    um_user_element_t *user_iter = NULL, *temp_user = NULL;
+    um_group_element_t *group_iter = NULL, *temp_group = NULL;
+    um_db_user_entry_t *user_entry = NULL;
+    um_db_group_entry_t *group_entry = NULL;
 
-    LL_FOREACH(db->user_head, user_iter)
+    if (changed)
+    {
+        *changed = false;
+    }
+
+    // local changes would be overwritten by the file contents
+    if (um_db_is_modified(db))
+    {
+        return -1;
+    }
+
+    if (!um_db_watch_changed(db))
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
     {
-        if (um_user_get_uid(user_iter->user) >= 1000 && um_user_get_uid(user_iter->user) < 65534 &&
-            um_user_get_uid(user_iter->user) > max_uid)
+        if (um_db_source_changed(db, (um_db_file_t)i))
         {
-            max_uid = um_user_get_uid(user_iter->user);
+            files |= file_dirty[i];
         }
     }
 
-    return max_uid + 1;
-}
-
-/**
+    // records of new users and groups are merged from the dependent files
+    if (files & UM_DIRTY_PASSWD)
+    {
+        files |= UM_DIRTY_SHADOW | UM_DIRTY_GROUP | UM_DIRTY_GSHADOW;
+    }
+    if (files & UM_DIRTY_GROUP)
+    {
+        files |= UM_DIRTY_GSHADOW;
+    }
+    files &= ~(db->deferred | db->unavailable);
+
+    if (!files)
+    {
+        return 0;
+    }
+
+    // files changed after this point are detected by the next refresh
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        if (files & file_dirty[i])
+        {
+            um_db_stat_source(db, (um_db_file_t)i);
+        }
+    }
+
+    // users are read first - group members are resolved against the refreshed users
+    if (files & UM_DIRTY_PASSWD)
+    {
+        DL_FOREACH(db->user_head, user_iter)
+        {
+            ((um_db_user_entry_t *)user_iter)->seen = false;
+        }
+    }
+
+    error = db->native ? um_db_load_files(db, db->arena, files & (UM_DIRTY_PASSWD | UM_DIRTY_SHADOW))
+                       : um_db_load_nss(db, db->arena, files & (UM_DIRTY_PASSWD | UM_DIRTY_SHADOW));
+
+    if (!error && (files & UM_DIRTY_PASSWD))
+    {
+        DL_FOREACH_SAFE(db->user_head, user_iter, temp_user)
+        {
+            user_entry = (um_db_user_entry_t *)user_iter;
+            if (!user_entry->seen)
+            {
+                um_db_delete_user(db, um_user_get_name(user_iter->user));
+            }
+        }
+    }
+
+    if (!error && (files & UM_DIRTY_GROUP))
+    {
+        DL_FOREACH(db->group_head, group_iter)
+        {
+            ((um_db_group_entry_t *)group_iter)->seen = false;
+        }
+    }
+
+    if (!error)
+    {
+        error = db->native ? um_db_load_files(db, db->arena, files & (UM_DIRTY_GROUP | UM_DIRTY_GSHADOW))
+                           : um_db_load_nss(db, db->arena, files & (UM_DIRTY_GROUP | UM_DIRTY_GSHADOW));
+    }
+
+    if (!error && (files & UM_DIRTY_GROUP))
+    {
+        DL_FOREACH_SAFE(db->group_head, group_iter, temp_group)
+        {
+            group_entry = (um_db_group_entry_t *)group_iter;
+            if (!group_entry->seen)
+            {
+                um_db_delete_group(db, um_group_get_name(group_iter->group));
+            }
+        }
+    }
+
+    if (error)
+    {
+        // read the files again next time
+        for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+        {
+            if (files & file_dirty[i])
+            {
+                db->sources[i] = (struct stat){0};
+            }
+        }
+        db->watch_checked = false;
+    }
+
+    // refreshed data matches the files
+    um_db_clear_dirty(db);
+
+    if (changed)
+    {
+        *changed = true;
+    }
+
+    return error ? -1 : 0;
+}
+
+/**
+ * Watch the directories of the account files for changes using inotify.
+ * The returned descriptor becomes readable when any of the files may have changed and can be polled by the caller
+ * before calling um_db_refresh(), which also consumes the pending events. The descriptor is owned by the database and
+ * closed by um_db_free() - calling the function again replaces it, which is needed after changing the file paths.
+ *
+ * @param db Database to use.
+ *
+ * @return Watch descriptor - -1 on failure.
+ *
+ */
+int um_db_watch(um_db_t *db)
+{
+    char dir[PATH_MAX] = {0};
+    const char *path = NULL;
+    const char *slash = NULL;
+    bool watched = false;
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        path = um_db_get_path(db, (um_db_file_t)i);
+        slash = strrchr(path, '/');
+
+        // directories shared with a previous file are already watched
+        watched = false;
+        for (int j = 0; j < i; j++)
+        {
+            if (um_db_same_dir(path, um_db_get_path(db, (um_db_file_t)j)))
+            {
+                watched = true;
+                break;
+            }
+        }
+
+        if (watched)
+        {
+            continue;
+        }
+
+        if (!slash)
+        {
+            strcpy(dir, ".");
+        }
+        else if (slash == path)
+        {
+            strcpy(dir, "/");
+        }
+        else if ((size_t)(slash - path) < sizeof(dir))
+        {
+            memcpy(dir, path, (size_t)(slash - path));
+            dir[slash - path] = '\0';
+        }
+        else
+        {
+            close(fd);
+            return -1;
+        }
+
+        // files are replaced by renames, so the directory is watched instead of the file itself
+        if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ATTRIB) < 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+
+    if (db->watch_fd >= 0)
+    {
+        close(db->watch_fd);
+    }
+
+    db->watch_fd = fd;
+    db->watch_checked = false;
+
+    return fd;
+}
+
+/**
+ * Return the new UID which can be used for a new user.
+ * The UID is chosen from the UID range according to the ID policy. UIDs changed by um_user_set_uid() on stored users
+ * are taken into account.
+ *
+ * @param db Database to use.
+ *
+ * @return New UID - (uid_t)-1 if the range is exhausted or on allocation failure.
+ *
+ */
+uid_t um_db_get_new_uid(um_db_t *db)
+{
+    id_t uid = 0;
+    um_id_pool_t *pool = um_db_get_uid_pool(db);
+
+    if (!pool || um_db_next_id(pool, db->id_policy, &uid))
+    {
+        return (uid_t)-1;
+    }
+
+    return (uid_t)uid;
+}
+
+/**
  * Return the new GID which can be used for a new user/group.
+ * The GID is chosen from the GID range according to the ID policy, considering GIDs of all groups - including GIDs
+ * changed by um_group_set_gid() on stored groups.
+ *
+ * @param db Database to use.
+ *
+ * @return New GID - (gid_t)-1 if the range is exhausted or on allocation failure.
+ *
+ */
+gid_t um_db_get_new_gid(um_db_t *db)
+{
+    id_t gid = 0;
+    um_id_pool_t *pool = um_db_get_gid_pool(db);
+
+    if (!pool || um_db_next_id(pool, db->id_policy, &gid))
+    {
+        return (gid_t)-1;
+    }
+
+    return (gid_t)gid;
+}
+
+/**
+ * Set the policy used for choosing new UIDs and GIDs.
+ *
+ * @param db Database to use.
+ * @param policy Policy to set - UM_DB_ID_POLICY_NEXT_MAX by default.
+ *
+ */
+void um_db_set_id_policy(um_db_t *db, um_db_id_policy_t policy)
+{
+    db->id_policy = policy;
+}
+
+/**
+ * Set the range new UIDs are chosen from - [1000, 65533] by default.
+ *
+ * @param db Database to use.
+ * @param min First UID of the range.
+ * @param max Last UID of the range.
+ *
+ * @return Error code - 0 on success, -1 if the range is empty or larger than 2^24 IDs.
+ *
+ */
+int um_db_set_uid_range(um_db_t *db, uid_t min, uid_t max)
+{
+    if (min > max || max - min >= UM_ID_POOL_MAX_SIZE)
+    {
+        return -1;
+    }
+
+    db->uid_min = min;
+    db->uid_max = max;
+
+    // rebuilt for the new range on next use
+    if (db->uid_pool)
+    {
+        um_id_pool_free(db->uid_pool);
+        db->uid_pool = NULL;
+    }
+
+    // reservations belong to the old range
+    if (db->uid_reserved)
+    {
+        um_id_pool_free(db->uid_reserved);
+        db->uid_reserved = NULL;
+    }
+
+    return 0;
+}
+
+/**
+ * Set the range new GIDs are chosen from - [1000, 65533] by default.
+ *
+ * @param db Database to use.
+ * @param min First GID of the range.
+ * @param max Last GID of the range.
+ *
+ * @return Error code - 0 on success, -1 if the range is empty or larger than 2^24 IDs.
+ *
+ */
+int um_db_set_gid_range(um_db_t *db, gid_t min, gid_t max)
+{
+    if (min > max || max - min >= UM_ID_POOL_MAX_SIZE)
+    {
+        return -1;
+    }
+
+    db->gid_min = min;
+    db->gid_max = max;
+
+    // rebuilt for the new range on next use
+    if (db->gid_pool)
+    {
+        um_id_pool_free(db->gid_pool);
+        db->gid_pool = NULL;
+    }
+
+    // reservations belong to the old range
+    if (db->gid_reserved)
+    {
+        um_id_pool_free(db->gid_reserved);
+        db->gid_reserved = NULL;
+    }
+
+    return 0;
+}
+
+/**
+ * Set the number of threads used by um_db_load_ex() with UM_DB_LOAD_PARALLEL.
+ * The four account files are parsed concurrently and files larger than 1 MiB are split into chunks at line
+ * boundaries, one per thread at most. Records are merged in file order, so the result is the same as with a
+ * sequential load.
+ *
+ * @param db Database to use.
+ * @param threads Maximum number of threads including the calling one - 0 for the number of online CPUs (default).
+ *
+ */
+void um_db_set_load_threads(um_db_t *db, unsigned int threads)
+{
+    db->load_threads = threads;
+}
+
+/**
+ * Set the root directory for the account files of the database.
+ * Files are loaded from and stored to the usual /etc paths under the root - useful for chroots and container images.
+ *
+ * @param db Database to use.
+ * @param root Root directory - NULL to use the system files.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_db_set_root(um_db_t *db, const char *root)
+{
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        char path[PATH_MAX] = {0};
+        const char *default_path = um_db_get_default_path((um_db_file_t)i);
+
+        if (!root)
+        {
+            if (um_db_set_path(db, (um_db_file_t)i, NULL))
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        if (snprintf(path, sizeof(path), "%s%s", root, default_path) >= (int)sizeof(path) ||
+            um_db_set_path(db, (um_db_file_t)i, path))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Set the path of a single account file of the database.
+ *
+ * @param db Database to use.
+ * @param file Account file to set the path for.
+ * @param path Path of the file - NULL to use the system file.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_db_set_path(um_db_t *db, um_db_file_t file, const char *path)
+{
+    char *new_path = NULL;
+
+    if (file >= UM_DB_FILE_COUNT)
+    {
+        return -1;
+    }
+
+    if (path)
+    {
+        new_path = strdup(path);
+        if (!new_path)
+        {
+            return -1;
+        }
+    }
+
+    free(db->paths[file]);
+    db->paths[file] = new_path;
+
+    return 0;
+}
+
+/**
+ * Get the path of an account file of the database.
+ *
+ * @param db Database to use.
+ * @param file Account file to get the path for.
+ *
+ * @return Path of the file.
+ *
+ */
+const char *um_db_get_path(const um_db_t *db, um_db_file_t file)
+{
+    return db->paths[file] ? db->paths[file] : um_db_get_default_path(file);
+}
+
+/**
+ * Get the status of an account file at the time the database was last loaded or stored.
+ * Files are checked before they are read, so a file changed during the load never looks unchanged.
+ *
+ * @param db Database to use.
+ * @param file Account file to get the status for.
+ *
+ * @return File status - all zero if the file did not exist.
+ *
+ */
+const struct stat *um_db_get_source_stat(const um_db_t *db, um_db_file_t file)
+{
+    return &db->sources[file];
+}
+
+/**
+ * Check if the database has changes which are not stored to the account files.
+ *
+ * @param db Database to check.
+ *
+ * @return True if any user, group or the lists changed since the last load or store.
+ *
+ */
+bool um_db_is_modified(const um_db_t *db)
+{
+    return um_db_collect_dirty(db) != 0;
+}
+
+/**
+ * Read account files deferred by UM_DB_LOAD_DEFER_SHADOW into the users and groups loaded with the database.
+ * Each file is read at most once - files which failed to load stay unavailable.
+ *
+ * @param db Database to use.
+ * @param files Dirty mask bits of the files to read - UM_DIRTY_SHADOW and UM_DIRTY_GSHADOW.
+ *
+ * @return Error code - 0 on success, -1 if any of the files is unavailable.
+ *
+ */
+int um_db_load_deferred(um_db_t *db, unsigned int files)
+{
+    unsigned int pending = db->deferred & files;
+    int error = 0;
+
+    // setters used while merging the records must not start another read
+    if (db->loading_deferred)
+    {
+        return 0;
+    }
+
+    if (pending)
+    {
+        db->loading_deferred = true;
+        if (db->native)
+        {
+            error = um_db_load_files(db, NULL, pending);
+        }
+        else
+        {
+            error = um_db_load_nss(db, NULL, pending);
+        }
+        db->loading_deferred = false;
+
+        db->deferred &= ~pending;
+        if (error)
+        {
+            db->unavailable |= pending;
+        }
+    }
+
+    return (db->unavailable & files) ? -1 : 0;
+}
+
+/**
+ * Reserve UIDs for users which will be added later.
+ * Reserved UIDs are skipped by um_db_get_new_uid() and further reservations until a user with the UID is added or the
+ * UID is released. All UIDs are chosen in a single pass over the UID pool.
+ *
+ * @param db Database to use.
+ * @param uids Array to fill with reserved UIDs.
+ * @param count Number of UIDs to reserve.
+ * @param contiguous Reserve a single run of consecutive UIDs - otherwise UIDs are chosen according to the ID policy.
+ *
+ * @return Error code - 0 on success, -1 if not enough UIDs are free or on allocation failure - nothing is reserved.
+ *
+ */
+int um_db_reserve_uids(um_db_t *db, uid_t *uids, size_t count, bool contiguous)
+{
+    um_id_pool_t *pool = um_db_get_uid_pool(db);
+
+    if (!pool)
+    {
+        return -1;
+    }
+
+    if (!db->uid_reserved)
+    {
+        db->uid_reserved = um_id_pool_new(db->uid_min, db->uid_max);
+        if (!db->uid_reserved)
+        {
+            return -1;
+        }
+    }
+
+    return um_db_reserve_ids(pool, db->uid_reserved, db->id_policy, uids, count, contiguous);
+}
+
+/**
+ * Reserve GIDs for groups which will be added later.
+ * Reserved GIDs are skipped by um_db_get_new_gid() and further reservations until a group with the GID is added or the
+ * GID is released. All GIDs are chosen in a single pass over the GID pool.
+ *
+ * @param db Database to use.
+ * @param gids Array to fill with reserved GIDs.
+ * @param count Number of GIDs to reserve.
+ * @param contiguous Reserve a single run of consecutive GIDs - otherwise GIDs are chosen according to the ID policy.
+ *
+ * @return Error code - 0 on success, -1 if not enough GIDs are free or on allocation failure - nothing is reserved.
+ *
+ */
+int um_db_reserve_gids(um_db_t *db, gid_t *gids, size_t count, bool contiguous)
+{
+    um_id_pool_t *pool = um_db_get_gid_pool(db);
+
+    if (!pool)
+    {
+        return -1;
+    }
+
+    if (!db->gid_reserved)
+    {
+        db->gid_reserved = um_id_pool_new(db->gid_min, db->gid_max);
+        if (!db->gid_reserved)
+        {
+            return -1;
+        }
+    }
+
+    return um_db_reserve_ids(pool, db->gid_reserved, db->id_policy, gids, count, contiguous);
+}
+
+/**
+ * Release reserved UIDs which were not used for new users.
+ * UIDs which are not reserved are ignored.
+ *
+ * @param db Database to use.
+ * @param uids UIDs to release.
+ * @param count Number of UIDs.
+ *
+ */
+void um_db_release_uids(um_db_t *db, const uid_t *uids, size_t count)
+{
+    if (db->uid_reserved)
+    {
+        um_db_release_ids(db->uid_pool, db->uid_reserved, uids, count);
+    }
+}
+
+/**
+ * Release reserved GIDs which were not used for new groups.
+ * GIDs which are not reserved are ignored.
+ *
+ * @param db Database to use.
+ * @param gids GIDs to release.
+ * @param count Number of GIDs.
+ *
+ */
+void um_db_release_gids(um_db_t *db, const gid_t *gids, size_t count)
+{
+    if (db->gid_reserved)
+    {
+        um_db_release_ids(db->gid_pool, db->gid_reserved, gids, count);
+    }
+}
+
+/**
+ * Add a new user to the database.
+ * User will be handled by the database from this point on - do not free user data after adding user to the database.
+ *
+ * @param db Database to use.
+ * @param name User to search for.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_db_add_user(um_db_t *db, um_user_t *user)
+{
+    if (um_db_insert_user(db, user, NULL))
+    {
+        // free user data immediately
+        um_user_free(user);
+        return -1;
+    }
+
+    db->dirty |= UM_DIRTY_PASSWD | UM_DIRTY_SHADOW;
+
+    return 0;
+}
+
+/**
+ * Add a new group to the database.
+ * Group will be handled by the database from this point on - do not free group data after adding user to the database.
+ *
+ * @param db Database to use.
+ * @param name Group to add.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_db_add_group(um_db_t *db, um_group_t *group)
+{
+    if (um_db_insert_group(db, group, NULL))
+    {
+        // free group data immediately
+        um_group_free(group);
+        return -1;
+    }
+
+    db->dirty |= UM_DIRTY_GROUP | UM_DIRTY_GSHADOW;
+
+    return 0;
+}
+
+/**
+ * Add multiple users to the database.
+ * Nodes for the whole batch are allocated at once and indexes are updated in the same pass. Added users are handled by
+ * the database from this point on. Users which could not be added stay owned by the caller.
+ *
+ * @param db Database to use.
+ * @param users Users to add.
+ * @param count Number of users.
+ * @param errors Array of count per-user error codes - 0 if the user was added, can be NULL.
+ *
+ * @return Error code - 0 if all users were added, -1 if any of them failed.
+ *
+ */
+int um_db_add_users(um_db_t *db, um_user_t **users, size_t count, int *errors)
+{
+    int error = 0;
+    size_t added = 0;
+    um_db_user_entry_t *entries = NULL;
+
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    entries = (um_db_user_entry_t *)um_db_new_block(db, count * sizeof(um_db_user_entry_t));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int user_error = -1;
+
+        if (entries)
+        {
+            um_db_user_entry_t *entry = &entries[i];
+
+            *entry = (um_db_user_entry_t){0};
+            entry->element.user = users[i];
+            entry->pooled = true;
+            entry->seen = true;
+
+            if (!um_db_index_user_entry(db, entry))
+            {
+                DL_APPEND(db->user_head, &entry->element);
+                um_user_set_intern(users[i], db->intern);
+                um_user_set_owner(users[i], db);
+                db->dirty |= UM_DIRTY_PASSWD | UM_DIRTY_SHADOW;
+                user_error = 0;
+                ++added;
+            }
+        }
+
+        if (user_error)
+        {
+            error = -1;
+        }
+
+        if (errors)
+        {
+            errors[i] = user_error;
+        }
+    }
+
+    // nothing references the block if no user was added
+    if (entries && !added)
+    {
+        um_db_free_block(db, entries);
+    }
+
+    return error;
+}
+
+/**
+ * Add multiple groups to the database.
+ * Nodes for the whole batch are allocated at once and indexes are updated in the same pass. Added groups are handled
+ * by the database from this point on. Groups which could not be added stay owned by the caller.
+ *
+ * @param db Database to use.
+ * @param groups Groups to add.
+ * @param count Number of groups.
+ * @param errors Array of count per-group error codes - 0 if the group was added, can be NULL.
+ *
+ * @return Error code - 0 if all groups were added, -1 if any of them failed.
+ *
+ */
+int um_db_add_groups(um_db_t *db, um_group_t **groups, size_t count, int *errors)
+{
+    int error = 0;
+    size_t added = 0;
+    um_db_group_entry_t *entries = NULL;
+
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    entries = (um_db_group_entry_t *)um_db_new_block(db, count * sizeof(um_db_group_entry_t));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int group_error = -1;
+
+        if (entries)
+        {
+            um_db_group_entry_t *entry = &entries[i];
+
+            *entry = (um_db_group_entry_t){0};
+            entry->element.group = groups[i];
+            entry->pooled = true;
+            entry->seen = true;
+
+            if (!um_db_index_group_entry(db, entry))
+            {
+                DL_APPEND(db->group_head, &entry->element);
+                um_group_set_intern(groups[i], db->intern);
+                um_group_set_owner(groups[i], db);
+                db->dirty |= UM_DIRTY_GROUP | UM_DIRTY_GSHADOW;
+                group_error = 0;
+                ++added;
+            }
+        }
+
+        if (group_error)
+        {
+            error = -1;
+        }
+
+        if (errors)
+        {
+            errors[i] = group_error;
+        }
+    }
+
+    // nothing references the block if no group was added
+    if (entries && !added)
+    {
+        um_db_free_block(db, entries);
+    }
+
+    return error;
+}
+
+/**
+ * Get the user from the database.
+ *
+ * @param db Database to use.
+ * @param name User to search for.
+ *
+ * @return Abstract user type - NULL if not found.
+ *
+ */
+um_user_t *um_db_get_user(um_db_t *db, const char *name)
+{
+    um_db_user_entry_t *entry = um_db_find_user_entry(db, name);
+
+    return entry ? entry->element.user : NULL;
+}
+
+/**
+ * Get the group from the database.
+ *
+ * @param db Database to use.
+ * @param name Group to search for.
+ *
+ * @return Abstract group type - NULL if not found.
+ *
+ */
+um_group_t *um_db_get_group(um_db_t *db, const char *name)
+{
+    um_db_group_entry_t *entry = um_db_find_group_entry(db, name);
+
+    return entry ? entry->element.group : NULL;
+}
+
+/**
+ * Get the user with the given UID from the database.
+ * If more users share the UID, the first one in list order is returned - same as getpwuid().
+ *
+ * @param db Database to use.
+ * @param uid UID to search for.
+ *
+ * @return Abstract user type - NULL if not found.
+ *
+ */
+um_user_t *um_db_get_user_by_uid(um_db_t *db, uid_t uid)
+{
+    um_db_uid_node_t *node = NULL;
+
+    HASH_FIND(hh, db->uid_index, &uid, sizeof(uid_t), node);
+
+    return node ? node->head->element.user : NULL;
+}
+
+/**
+ * Get the group with the given GID from the database.
+ * If more groups share the GID, the first one in list order is returned - same as getgrgid().
+ *
+ * @param db Database to use.
+ * @param gid GID to search for.
+ *
+ * @return Abstract group type - NULL if not found.
+ *
+ */
+um_group_t *um_db_get_group_by_gid(um_db_t *db, gid_t gid)
+{
+    um_db_gid_node_t *node = NULL;
+
+    HASH_FIND(hh, db->gid_index, &gid, sizeof(gid_t), node);
+
+    return node ? node->head->element.group : NULL;
+}
+
+/**
+ * Get all users with the given UID from the database, in list order.
+ *
+ * @param db Database to use.
+ * @param uid UID to search for.
+ * @param users Array to fill with found users - can be NULL if size is 0.
+ * @param size Size of the users array.
+ *
+ * @return Number of users with the given UID - can be larger than size, in which case only size users are stored.
+ *
+ */
+size_t um_db_get_users_by_uid(um_db_t *db, uid_t uid, um_user_t **users, size_t size)
+{
+    um_db_uid_node_t *node = NULL;
+    um_db_user_entry_t *iter = NULL;
+    size_t count = 0;
+
+    HASH_FIND(hh, db->uid_index, &uid, sizeof(uid_t), node);
+
+    if (node)
+    {
+        DL_FOREACH2(node->head, iter, uid_next)
+        {
+            if (count < size)
+            {
+                users[count] = iter->element.user;
+            }
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Get all groups with the given GID from the database, in list order.
+ *
+ * @param db Database to use.
+ * @param gid GID to search for.
+ * @param groups Array to fill with found groups - can be NULL if size is 0.
+ * @param size Size of the groups array.
+ *
+ * @return Number of groups with the given GID - can be larger than size, in which case only size groups are stored.
+ *
+ */
+size_t um_db_get_groups_by_gid(um_db_t *db, gid_t gid, um_group_t **groups, size_t size)
+{
+    um_db_gid_node_t *node = NULL;
+    um_db_group_entry_t *iter = NULL;
+    size_t count = 0;
+
+    HASH_FIND(hh, db->gid_index, &gid, sizeof(gid_t), node);
+
+    if (node)
+    {
+        DL_FOREACH2(node->head, iter, gid_next)
+        {
+            if (count < size)
+            {
+                groups[count] = iter->element.group;
+            }
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Find users matching the query, without allocations.
+ * Indexes are used where the query allows it - group queries check only the members of the group, UID ranges are
+ * looked up in the ordered UID index and returned in UID order. Other queries check all users in list order.
+ * Group queries match the member list only - admins of the group listed in gshadow do not match unless they are also
+ * members, same as for the supplementary groups of a user.
+ *
+ * @param db Database to use.
+ * @param query Criteria to match.
+ * @param users Array to fill with found users - can be NULL if size is 0.
+ * @param size Size of the users array.
+ *
+ * @return Number of matching users - can be larger than size, in which case only size users are stored.
+ *
+ */
+size_t um_db_query_users(um_db_t *db, const um_db_user_query_t *query, um_user_t **users, size_t size)
+{
+    um_db_group_entry_t *group_entry = NULL;
+    const um_group_user_element_t *member = NULL;
+    um_db_user_entry_t *iter = NULL;
+    um_user_element_t *element = NULL;
+    long int today = query->today ? query->today : (long int)(time(NULL) / UM_DB_SECONDS_PER_DAY);
+    size_t count = 0;
+
+    // only the members of the group can match
+    if (query->match & UM_DB_QUERY_GROUP)
+    {
+        group_entry = um_db_find_group_entry(db, query->group);
+        if (!group_entry)
+        {
+            return 0;
+        }
+
+        DL_FOREACH(um_group_get_members_head(group_entry->element.group), member)
+        {
+            count = um_db_query_add(query, today, member->user, users, size, count);
+        }
+
+        return count;
+    }
+
+    // only the range of the ordered UID index can match, the list is scanned if the index can not be built
+    if ((query->match & UM_DB_QUERY_UID_RANGE) && !um_db_build_uid_order(db))
+    {
+        for (size_t i = um_db_find_uid_order(db, query->uid_min);
+             i < db->uid_order_count && db->uid_order[i]->uid <= query->uid_max; i++)
+        {
+            DL_FOREACH2(db->uid_order[i]->head, iter, uid_next)
+            {
+                count = um_db_query_add(query, today, iter->element.user, users, size, count);
+            }
+        }
+
+        return count;
+    }
+
+    DL_FOREACH(db->user_head, element)
+    {
+        count = um_db_query_add(query, today, element->user, users, size, count);
+    }
+
+    return count;
+}
+
+/**
+ * Get all users with UIDs in the range from the database, sorted by UID and in list order for equal UIDs.
+ * Users are found in the ordered UID index in O(log n + k) time - the index is rebuilt on first use after UIDs were
+ * added to or removed from the database.
+ *
+ * @param db Database to use.
+ * @param min First UID of the range.
+ * @param max Last UID of the range.
+ * @param users Array to fill with found users - can be NULL if size is 0.
+ * @param size Size of the users array.
+ * @param count Set to the number of users in the range - can be larger than size, only size users are stored.
+ *
+ * @return Error code - 0 on success, -1 if the index could not be built.
+ *
+ */
+int um_db_get_users_by_uid_range(um_db_t *db, uid_t min, uid_t max, um_user_t **users, size_t size, size_t *count)
+{
+    um_db_user_entry_t *iter = NULL;
+
+    *count = 0;
+
+    if (um_db_build_uid_order(db))
+    {
+        return -1;
+    }
+
+    for (size_t i = um_db_find_uid_order(db, min); i < db->uid_order_count && db->uid_order[i]->uid <= max; i++)
+    {
+        DL_FOREACH2(db->uid_order[i]->head, iter, uid_next)
+        {
+            if (*count < size)
+            {
+                users[*count] = iter->element.user;
+            }
+            ++*count;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Get all groups with GIDs in the range from the database, sorted by GID and in list order for equal GIDs.
+ * Groups are found in the ordered GID index in O(log n + k) time - the index is rebuilt on first use after GIDs were
+ * added to or removed from the database.
+ *
+ * @param db Database to use.
+ * @param min First GID of the range.
+ * @param max Last GID of the range.
+ * @param groups Array to fill with found groups - can be NULL if size is 0.
+ * @param size Size of the groups array.
+ * @param count Set to the number of groups in the range - can be larger than size, only size groups are stored.
+ *
+ * @return Error code - 0 on success, -1 if the index could not be built.
+ *
+ */
+int um_db_get_groups_by_gid_range(um_db_t *db, gid_t min, gid_t max, um_group_t **groups, size_t size, size_t *count)
+{
+    um_db_group_entry_t *iter = NULL;
+
+    *count = 0;
+
+    if (um_db_build_gid_order(db))
+    {
+        return -1;
+    }
+
+    for (size_t i = um_db_find_gid_order(db, min); i < db->gid_order_count && db->gid_order[i]->gid <= max; i++)
+    {
+        DL_FOREACH2(db->gid_order[i]->head, iter, gid_next)
+        {
+            if (*count < size)
+            {
+                groups[*count] = iter->element.group;
+            }
+            ++*count;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Get the list of groups the user is a member or an admin of.
+ * Each element holds the group and its role, the list is linked using the user_next link. Lookup takes time
+ * proportional to the number of the user's groups.
+ *
+ * @param db Database to use.
+ * @param name User to search for.
+ *
+ * @return Group list head - NULL if the user is not found or has no groups.
+ *
+ */
+const um_group_user_element_t *um_db_get_user_groups(const um_db_t *db, const char *name)
+{
+    um_db_user_entry_t *entry = um_db_find_user_entry(db, name);
+
+    return entry ? um_user_get_groups_head(entry->element.user) : NULL;
+}
+
+/**
+ * Delete user from the database.
+ * The user is also removed from all groups it belongs to, in time proportional to the number of its groups.
+ *
+ * @param db Database to use.
+ * @param name User to search for.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_db_delete_user(um_db_t *db, const char *name)
+{
+    um_db_user_entry_t *entry = um_db_find_user_entry(db, name);
+
+    if (entry)
+    {
+        // remove from index and list
+        um_db_unindex_user_entry(db, entry);
+        DL_DELETE(db->user_head, &entry->element);
+        um_user_set_owner(entry->element.user, NULL);
+
+        // free data - group files are marked by the removed memberships
+        um_user_free(entry->element.user);
+        db->dirty |= UM_DIRTY_PASSWD | UM_DIRTY_SHADOW;
+        if (!entry->pooled)
+        {
+            free(entry);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Delete group from the database.
+ *
+ * @param db Database to use.
+ * @param name Group to search for.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_db_delete_group(um_db_t *db, const char *name)
+{
+    um_db_group_entry_t *entry = um_db_find_group_entry(db, name);
+
+    if (entry)
+    {
+        // remove from index and list
+        um_db_unindex_group_entry(db, entry);
+        DL_DELETE(db->group_head, &entry->element);
+        um_group_set_owner(entry->element.group, NULL);
+
+        // free data
+        um_group_free(entry->element.group);
+        db->dirty |= UM_DIRTY_GROUP | UM_DIRTY_GSHADOW;
+        if (!entry->pooled)
+        {
+            free(entry);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Rebuild database indexes from the user and group lists.
+ * Setters of stored users and groups keep the indexes in sync - this is only needed after a setter failed to update
+ * them.
+ *
+ * @param db Database to use.
+ *
+ * @return Error code - 0 on success, -1 if a name is missing or duplicated after the change.
+ *
+ */
+int um_db_reindex(um_db_t *db)
+{
+    int error = 0;
+    um_user_element_t *user_iter = NULL;
+    um_group_element_t *group_iter = NULL;
+
+    um_db_clear_indexes(db);
+
+    LL_FOREACH(db->user_head, user_iter)
+    {
+        if (um_db_index_user_entry(db, (um_db_user_entry_t *)user_iter))
+        {
+            error = -1;
+        }
+    }
+
+    LL_FOREACH(db->group_head, group_iter)
+    {
+        if (um_db_index_group_entry(db, (um_db_group_entry_t *)group_iter))
+        {
+            error = -1;
+        }
+    }
+
+    return error;
+}
+
+/**
+ * Get users list head.
+ *
+ * @param db Database to use.
+ *
+ * @return Users list head.
+ *
+ */
+const um_user_element_t *um_db_get_user_list_head(const um_db_t *db)
+{
+    return db->user_head;
+}
+
+/**
+ * Get group list head.
+ *
+ * @param db Database to use.
+ *
+ * @return Group list head.
+ *
+ */
+const um_group_element_t *um_db_get_group_list_head(const um_db_t *db)
+{
+    return db->group_head;
+}
+
+/**
+ * Free database data.
+ *
+ * @param db Database to free.
+ *
+ */
+void um_db_free(um_db_t *db)
+{
+    um_user_element_t *user_iter = NULL, *temp_user = NULL;
+    um_group_element_t *group_iter = NULL, *temp_group = NULL;
+    um_db_block_t *block_iter = NULL, *temp_block = NULL;
+
+    um_db_clear_indexes(db);
+    free(db->uid_order);
+    free(db->gid_order);
+
+    if (db->uid_reserved)
+    {
+        um_id_pool_free(db->uid_reserved);
+    }
+
+    if (db->gid_reserved)
+    {
+        um_id_pool_free(db->gid_reserved);
+    }
+
+    // groups go first - freeing them unlinks the memberships from the users
+    DL_FOREACH_SAFE(db->group_head, group_iter, temp_group)
+    {
+        um_group_free(group_iter->group);
+        DL_DELETE(db->group_head, group_iter);
+        if (!((um_db_group_entry_t *)group_iter)->pooled)
+        {
+            free(group_iter);
+        }
+    }
+
+    DL_FOREACH_SAFE(db->user_head, user_iter, temp_user)
+    {
+        um_user_free(user_iter->user);
+        DL_DELETE(db->user_head, user_iter);
+        if (!((um_db_user_entry_t *)user_iter)->pooled)
+        {
+            free(user_iter);
+        }
+    }
+
+    LL_FOREACH_SAFE(db->blocks, block_iter, temp_block)
+    {
+        free(block_iter);
+    }
+
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        free(db->paths[i]);
+    }
+
+    // users and groups are freed above, their memory is released with the arena
+    if (db->arena)
+    {
+        um_arena_free(db->arena);
+    }
+
+    // shared strings are released last - users and groups above could reference them
+    um_intern_free(db->intern);
+
+    if (db->watch_fd >= 0)
+    {
+        close(db->watch_fd);
+    }
+
+    free(db);
+}
+
+/**
+ * Find the database node of the user with the given name.
+ *
+ * @param db Database to use.
+ * @param name User name.
+ *
+ * @return User node - NULL if not found.
+ *
+ */
+static um_db_user_entry_t *um_db_find_user_entry(const um_db_t *db, const char *name)
+{
+    um_db_user_entry_t *entry = NULL;
+
+    if (name)
+    {
+        HASH_FIND(name_hh, db->user_name_index, name, (unsigned)strlen(name), entry);
+    }
+
+    return entry;
+}
+
+/**
+ * Find the database node of the group with the given name.
+ *
+ * @param db Database to use.
+ * @param name Group name.
+ *
+ * @return Group node - NULL if not found.
+ *
+ */
+static um_db_group_entry_t *um_db_find_group_entry(const um_db_t *db, const char *name)
+{
+    um_db_group_entry_t *entry = NULL;
+
+    if (name)
+    {
+        HASH_FIND(name_hh, db->group_name_index, name, (unsigned)strlen(name), entry);
+    }
+
+    return entry;
+}
+
+/**
+ * Add user node to the name and UID indexes.
+ * The name key points to the name owned by the user data - no copy is made.
+ *
+ * @param db Database to use.
+ * @param entry User node to index.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_db_index_user_entry(um_db_t *db, um_db_user_entry_t *entry)
+{
+    const char *name = um_user_get_name(entry->element.user);
+    uid_t uid = um_user_get_uid(entry->element.user);
+    um_db_uid_node_t *node = NULL;
+
+    if (!name || um_db_find_user_entry(db, name))
+    {
+        return -1;
+    }
+
+    node = um_db_get_uid_node(db, uid);
+    if (!node)
+    {
+        return -1;
+    }
+
+    HASH_ADD_KEYPTR(name_hh, db->user_name_index, name, (unsigned)strlen(name), entry);
+    if (!entry->name_hh.tbl)
+    {
+        if (!node->head)
+        {
+            um_db_remove_uid_node(db, node);
+        }
+        return -1;
+    }
+
+    entry->uid_node = node;
+    DL_APPEND2(node->head, entry, uid_prev, uid_next);
+
+    return 0;
+}
+
+/**
+ * Add group node to the name and GID indexes.
+ * The name key points to the name owned by the group data - no copy is made.
+ *
+ * @param db Database to use.
+ * @param entry Group node to index.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_db_index_group_entry(um_db_t *db, um_db_group_entry_t *entry)
+{
+    const char *name = um_group_get_name(entry->element.group);
+    gid_t gid = um_group_get_gid(entry->element.group);
+    um_db_gid_node_t *node = NULL;
+
+    if (!name || um_db_find_group_entry(db, name))
+    {
+        return -1;
+    }
+
+    node = um_db_get_gid_node(db, gid);
+    if (!node)
+    {
+        return -1;
+    }
+
+    HASH_ADD_KEYPTR(name_hh, db->group_name_index, name, (unsigned)strlen(name), entry);
+    if (!entry->name_hh.tbl)
+    {
+        if (!node->head)
+        {
+            um_db_remove_gid_node(db, node);
+        }
+        return -1;
+    }
+
+    entry->gid_node = node;
+    DL_APPEND2(node->head, entry, gid_prev, gid_next);
+
+    return 0;
+}
+
+/**
+ * Remove user node from all indexes.
+ *
+ * @param db Database to use.
+ * @param entry User node to remove.
+ *
+ */
+static void um_db_unindex_user_entry(um_db_t *db, um_db_user_entry_t *entry)
+{
+    um_db_uid_node_t *node = entry->uid_node;
+
+    HASH_DELETE(name_hh, db->user_name_index, entry);
+
+    DL_DELETE2(node->head, entry, uid_prev, uid_next);
+    if (!node->head)
+    {
+        um_db_remove_uid_node(db, node);
+    }
+
+    entry->uid_node = NULL;
+}
+
+/**
+ * Remove group node from all indexes.
+ *
+ * @param db Database to use.
+ * @param entry Group node to remove.
+ *
+ */
+static void um_db_unindex_group_entry(um_db_t *db, um_db_group_entry_t *entry)
+{
+    um_db_gid_node_t *node = entry->gid_node;
+
+    HASH_DELETE(name_hh, db->group_name_index, entry);
+
+    DL_DELETE2(node->head, entry, gid_prev, gid_next);
+    if (!node->head)
+    {
+        um_db_remove_gid_node(db, node);
+    }
+
+    entry->gid_node = NULL;
+}
+
+/**
+ * Find the UID index node, adding an empty one if the UID is not used yet.
+ *
+ * @param db Database to use.
+ * @param uid UID to search for.
+ *
+ * @return UID node - NULL on allocation failure.
+ *
+ */
+static um_db_uid_node_t *um_db_get_uid_node(um_db_t *db, uid_t uid)
+{
+    um_db_uid_node_t *node = NULL;
+
+    HASH_FIND(hh, db->uid_index, &uid, sizeof(uid_t), node);
+    if (node)
+    {
+        return node;
+    }
+
+    node = (um_db_uid_node_t *)malloc(sizeof(um_db_uid_node_t));
+    if (!node)
+    {
+        return NULL;
+    }
+
+    *node = (um_db_uid_node_t){0};
+    node->uid = uid;
+
+    HASH_ADD(hh, db->uid_index, uid, sizeof(uid_t), node);
+    if (!node->hh.tbl)
+    {
+        free(node);
+        return NULL;
+    }
+    db->uid_order_valid = false;
+
+    if (db->uid_pool)
+    {
+        um_id_pool_set(db->uid_pool, uid);
+    }
+
+    // the reservation is used up by the new user
+    if (db->uid_reserved)
+    {
+        um_id_pool_clear(db->uid_reserved, uid);
+    }
+
+    return node;
+}
+
+/**
+ * Find the GID index node, adding an empty one if the GID is not used yet.
+ *
+ * @param db Database to use.
+ * @param gid GID to search for.
+ *
+ * @return GID node - NULL on allocation failure.
+ *
+ */
+static um_db_gid_node_t *um_db_get_gid_node(um_db_t *db, gid_t gid)
+{
+    um_db_gid_node_t *node = NULL;
+
+    HASH_FIND(hh, db->gid_index, &gid, sizeof(gid_t), node);
+    if (node)
+    {
+        return node;
+    }
+
+    node = (um_db_gid_node_t *)malloc(sizeof(um_db_gid_node_t));
+    if (!node)
+    {
+        return NULL;
+    }
+
+    *node = (um_db_gid_node_t){0};
+    node->gid = gid;
+
+    HASH_ADD(hh, db->gid_index, gid, sizeof(gid_t), node);
+    if (!node->hh.tbl)
+    {
+        free(node);
+        return NULL;
+    }
+    db->gid_order_valid = false;
+
+    if (db->gid_pool)
+    {
+        um_id_pool_set(db->gid_pool, gid);
+    }
+
+    // the reservation is used up by the new group
+    if (db->gid_reserved)
+    {
+        um_id_pool_clear(db->gid_reserved, gid);
+    }
+
+    return node;
+}
+
+/**
+ * Link listed user node into the UID node, keeping users which share the UID in list order.
+ * The user list is walked back only while looking for a preceding user with the same UID.
+ *
+ * @param db Database to use.
+ * @param node UID node to link into.
+ * @param entry User node to link.
+ *
+ */
+static void um_db_link_uid_entry(um_db_t *db, um_db_uid_node_t *node, um_db_user_entry_t *entry)
+{
+    um_user_element_t *iter = &entry->element;
+
+    while (node->head && iter != db->user_head)
+    {
+        iter = iter->prev;
+        if (((um_db_user_entry_t *)iter)->uid_node == node)
+        {
+            DL_APPEND_ELEM2(node->head, (um_db_user_entry_t *)iter, entry, uid_prev, uid_next);
+            entry->uid_node = node;
+            return;
+        }
+    }
+
+    DL_PREPEND2(node->head, entry, uid_prev, uid_next);
+    entry->uid_node = node;
+}
+
+/**
+ * Link listed group node into the GID node, keeping groups which share the GID in list order.
+ * The group list is walked back only while looking for a preceding group with the same GID.
+ *
+ * @param db Database to use.
+ * @param node GID node to link into.
+ * @param entry Group node to link.
+ *
+ */
+static void um_db_link_gid_entry(um_db_t *db, um_db_gid_node_t *node, um_db_group_entry_t *entry)
+{
+    um_group_element_t *iter = &entry->element;
+
+    while (node->head && iter != db->group_head)
+    {
+        iter = iter->prev;
+        if (((um_db_group_entry_t *)iter)->gid_node == node)
+        {
+            DL_APPEND_ELEM2(node->head, (um_db_group_entry_t *)iter, entry, gid_prev, gid_next);
+            entry->gid_node = node;
+            return;
+        }
+    }
+
+    DL_PREPEND2(node->head, entry, gid_prev, gid_next);
+    entry->gid_node = node;
+}
+
+/**
+ * Move a stored user to new index keys. Called by the setters before the name or UID of the user is replaced,
+ * so the current name still finds the user.
+ * The name key points to the given string - the caller stores it as the new name of the user.
+ *
+ * @param db Database which stores the user.
+ * @param user User to use.
+ * @param name New name of the user.
+ * @param uid New UID of the user.
+ *
+ * @return Error code - 0 on success, -1 on allocation failure, missing name or a name used by another user.
+ *
+ */
+int um_db_rekey_user(um_db_t *db, um_user_t *user, const char *name, uid_t uid)
+{
+    um_db_user_entry_t *entry = um_db_find_user_entry(db, um_user_get_name(user));
+    um_db_user_entry_t *other = NULL;
+    um_db_uid_node_t *node = NULL, *old_node = NULL;
+    const char *old_name = NULL;
+
+    if (!entry || entry->element.user != user || !name)
+    {
+        return -1;
+    }
+
+    other = um_db_find_user_entry(db, name);
+    if (other && other != entry)
+    {
+        return -1;
+    }
+
+    // allocated before any key is moved, so a failure leaves the indexes untouched
+    node = um_db_get_uid_node(db, uid);
+    if (!node)
+    {
+        return -1;
+    }
+
+    if (other)
+    {
+        // same name in a new string - the key compares equal, so only the pointer changes
+        entry->name_hh.key = name;
+    }
+    else
+    {
+        old_name = (const char *)entry->name_hh.key;
+        HASH_DELETE(name_hh, db->user_name_index, entry);
+        HASH_ADD_KEYPTR(name_hh, db->user_name_index, name, (unsigned)strlen(name), entry);
+        if (!entry->name_hh.tbl)
+        {
+            // the table is allocated again only if this was the only user - um_db_reindex() recovers if the old
+            // key cannot be added back either
+            HASH_ADD_KEYPTR(name_hh, db->user_name_index, old_name, (unsigned)strlen(old_name), entry);
+            if (!node->head)
+            {
+                um_db_remove_uid_node(db, node);
+            }
+            return -1;
+        }
+    }
+
+    if (node != entry->uid_node)
+    {
+        old_node = entry->uid_node;
+        DL_DELETE2(old_node->head, entry, uid_prev, uid_next);
+        if (!old_node->head)
+        {
+            um_db_remove_uid_node(db, old_node);
+        }
+
+        um_db_link_uid_entry(db, node, entry);
+    }
+
+    return 0;
+}
+
+/**
+ * Move a stored group to new index keys. Called by the setters before the name or GID of the group is replaced,
+ * so the current name still finds the group.
+ * The name key points to the given string - the caller stores it as the new name of the group.
+ *
+ * @param db Database which stores the group.
+ * @param group Group to use.
+ * @param name New name of the group.
+ * @param gid New GID of the group.
+ *
+ * @return Error code - 0 on success, -1 on allocation failure, missing name or a name used by another group.
+ *
+ */
+int um_db_rekey_group(um_db_t *db, um_group_t *group, const char *name, gid_t gid)
+{
+    um_db_group_entry_t *entry = um_db_find_group_entry(db, um_group_get_name(group));
+    um_db_group_entry_t *other = NULL;
+    um_db_gid_node_t *node = NULL, *old_node = NULL;
+    const char *old_name = NULL;
+
+    if (!entry || entry->element.group != group || !name)
+    {
+        return -1;
+    }
+
+    other = um_db_find_group_entry(db, name);
+    if (other && other != entry)
+    {
+        return -1;
+    }
+
+    // allocated before any key is moved, so a failure leaves the indexes untouched
+    node = um_db_get_gid_node(db, gid);
+    if (!node)
+    {
+        return -1;
+    }
+
+    if (other)
+    {
+        // same name in a new string - the key compares equal, so only the pointer changes
+        entry->name_hh.key = name;
+    }
+    else
+    {
+        old_name = (const char *)entry->name_hh.key;
+        HASH_DELETE(name_hh, db->group_name_index, entry);
+        HASH_ADD_KEYPTR(name_hh, db->group_name_index, name, (unsigned)strlen(name), entry);
+        if (!entry->name_hh.tbl)
+        {
+            // the table is allocated again only if this was the only group - um_db_reindex() recovers if the old
+            // key cannot be added back either
+            HASH_ADD_KEYPTR(name_hh, db->group_name_index, old_name, (unsigned)strlen(old_name), entry);
+            if (!node->head)
+            {
+                um_db_remove_gid_node(db, node);
+            }
+            return -1;
+        }
+    }
+
+    if (node != entry->gid_node)
+    {
+        old_node = entry->gid_node;
+        DL_DELETE2(old_node->head, entry, gid_prev, gid_next);
+        if (!old_node->head)
+        {
+            um_db_remove_gid_node(db, old_node);
+        }
+
+        um_db_link_gid_entry(db, node, entry);
+    }
+
+    return 0;
+}
+
+/**
+ * Remove empty UID index node - its UID becomes free.
+ *
+ * @param db Database to use.
+ * @param node Node to remove.
+ *
+ */
+static void um_db_remove_uid_node(um_db_t *db, um_db_uid_node_t *node)
+{
+    if (db->uid_pool)
+    {
+        um_id_pool_clear(db->uid_pool, node->uid);
+    }
+
+    HASH_DELETE(hh, db->uid_index, node);
+    free(node);
+    db->uid_order_valid = false;
+}
+
+/**
+ * Remove empty GID index node - its GID becomes free.
+ *
+ * @param db Database to use.
+ * @param node Node to remove.
+ *
+ */
+static void um_db_remove_gid_node(um_db_t *db, um_db_gid_node_t *node)
+{
+    if (db->gid_pool)
+    {
+        um_id_pool_clear(db->gid_pool, node->gid);
+    }
+
+    HASH_DELETE(hh, db->gid_index, node);
+    free(node);
+    db->gid_order_valid = false;
+}
+
+/**
+ * Drop all index data - user and group nodes stay in their lists.
+ * Name keys are not accessed, so this is safe to call after renaming stored records.
+ *
+ * @param db Database to use.
+ *
+ */
+static void um_db_clear_indexes(um_db_t *db)
+{
+    um_db_uid_node_t *uid_iter = NULL, *uid_tmp = NULL;
+    um_db_gid_node_t *gid_iter = NULL, *gid_tmp = NULL;
+
+    HASH_CLEAR(name_hh, db->user_name_index);
+    HASH_CLEAR(name_hh, db->group_name_index);
+
+    HASH_ITER(hh, db->uid_index, uid_iter, uid_tmp)
+    {
+        HASH_DELETE(hh, db->uid_index, uid_iter);
+        free(uid_iter);
+    }
+
+    HASH_ITER(hh, db->gid_index, gid_iter, gid_tmp)
+    {
+        HASH_DELETE(hh, db->gid_index, gid_iter);
+        free(gid_iter);
+    }
+
+    db->uid_order_valid = false;
+    db->gid_order_valid = false;
+
+    // rebuilt from the new indexes on next use
+    if (db->uid_pool)
+    {
+        um_id_pool_free(db->uid_pool);
+        db->uid_pool = NULL;
+    }
+
+    if (db->gid_pool)
+    {
+        um_id_pool_free(db->gid_pool);
+        db->gid_pool = NULL;
+    }
+}
+
+/**
+ * Get the pool of used UIDs - built from the UID index on first use.
+ *
+ * @param db Database to use.
+ *
+ * @return UID pool - NULL on allocation failure.
+ *
+ */
+static um_id_pool_t *um_db_get_uid_pool(um_db_t *db)
+{
+    um_db_uid_node_t *iter = NULL, *tmp = NULL;
+
+    if (!db->uid_pool)
+    {
+        db->uid_pool = um_id_pool_new(db->uid_min, db->uid_max);
+        if (!db->uid_pool)
+        {
+            return NULL;
+        }
+
+        HASH_ITER(hh, db->uid_index, iter, tmp)
+        {
+            um_id_pool_set(db->uid_pool, iter->uid);
+        }
+
+        if (db->uid_reserved)
+        {
+            id_t uid = db->uid_min;
+
+            while (!um_id_pool_next_used(db->uid_reserved, uid, &uid))
+            {
+                um_id_pool_set(db->uid_pool, uid);
+                if (uid == db->uid_max)
+                {
+                    break;
+                }
+                ++uid;
+            }
+        }
+    }
+
+    return db->uid_pool;
+}
+
+/**
+ * Get the pool of used GIDs - built from the GID index on first use.
+ *
+ * @param db Database to use.
+ *
+ * @return GID pool - NULL on allocation failure.
+ *
+ */
+static um_id_pool_t *um_db_get_gid_pool(um_db_t *db)
+{
+    um_db_gid_node_t *iter = NULL, *tmp = NULL;
+
+    if (!db->gid_pool)
+    {
+        db->gid_pool = um_id_pool_new(db->gid_min, db->gid_max);
+        if (!db->gid_pool)
+        {
+            return NULL;
+        }
+
+        HASH_ITER(hh, db->gid_index, iter, tmp)
+        {
+            um_id_pool_set(db->gid_pool, iter->gid);
+        }
+
+        if (db->gid_reserved)
+        {
+            id_t gid = db->gid_min;
+
+            while (!um_id_pool_next_used(db->gid_reserved, gid, &gid))
+            {
+                um_id_pool_set(db->gid_pool, gid);
+                if (gid == db->gid_max)
+                {
+                    break;
+                }
+                ++gid;
+            }
+        }
+    }
+
+    return db->gid_pool;
+}
+
+/**
+ * Build the ordered UID index from the UID index unless it is up to date.
+ *
+ * @param db Database to use.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_db_build_uid_order(um_db_t *db)
+{
+    um_db_uid_node_t *iter = NULL, *tmp = NULL;
+    size_t count = HASH_COUNT(db->uid_index);
+    size_t i = 0;
+
+    if (db->uid_order_valid)
+    {
+        return 0;
+    }
+
+    if (count > db->uid_order_count || !db->uid_order)
+    {
+        um_db_uid_node_t **order = (um_db_uid_node_t **)realloc(db->uid_order, (count + 1) * sizeof(*order));
+
+        if (!order)
+        {
+            return -1;
+        }
+        db->uid_order = order;
+    }
+
+    HASH_ITER(hh, db->uid_index, iter, tmp)
+    {
+        db->uid_order[i++] = iter;
+    }
+    qsort(db->uid_order, count, sizeof(*db->uid_order), um_db_compare_uid_nodes);
+
+    for (i = 0; i < count; i++)
+    {
+        db->uid_order[i]->order = i;
+    }
+
+    db->uid_order_count = count;
+    db->uid_order_valid = true;
+
+    return 0;
+}
+
+/**
+ * Build the ordered GID index from the GID index unless it is up to date.
+ *
+ * @param db Database to use.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_db_build_gid_order(um_db_t *db)
+{
+    um_db_gid_node_t *iter = NULL, *tmp = NULL;
+    size_t count = HASH_COUNT(db->gid_index);
+    size_t i = 0;
+
+    if (db->gid_order_valid)
+    {
+        return 0;
+    }
+
+    if (count > db->gid_order_count || !db->gid_order)
+    {
+        um_db_gid_node_t **order = (um_db_gid_node_t **)realloc(db->gid_order, (count + 1) * sizeof(*order));
+
+        if (!order)
+        {
+            return -1;
+        }
+        db->gid_order = order;
+    }
+
+    HASH_ITER(hh, db->gid_index, iter, tmp)
+    {
+        db->gid_order[i++] = iter;
+    }
+    qsort(db->gid_order, count, sizeof(*db->gid_order), um_db_compare_gid_nodes);
+
+    for (i = 0; i < count; i++)
+    {
+        db->gid_order[i]->order = i;
+    }
+
+    db->gid_order_count = count;
+    db->gid_order_valid = true;
+
+    return 0;
+}
+
+/**
+ * Compare UID index nodes by UID for qsort().
+ *
+ * @param node1 Pointer to the first node.
+ * @param node2 Pointer to the second node.
+ *
+ * @return Negative, zero or positive value if the first UID is smaller, equal or larger.
+ *
+ */
+static int um_db_compare_uid_nodes(const void *node1, const void *node2)
+{
+    uid_t uid1 = (*(um_db_uid_node_t *const *)node1)->uid;
+    uid_t uid2 = (*(um_db_uid_node_t *const *)node2)->uid;
+
+    return (uid1 > uid2) - (uid1 < uid2);
+}
+
+/**
+ * Compare GID index nodes by GID for qsort().
+ *
+ * @param node1 Pointer to the first node.
+ * @param node2 Pointer to the second node.
+ *
+ * @return Negative, zero or positive value if the first GID is smaller, equal or larger.
+ *
+ */
+static int um_db_compare_gid_nodes(const void *node1, const void *node2)
+{
+    gid_t gid1 = (*(um_db_gid_node_t *const *)node1)->gid;
+    gid_t gid2 = (*(um_db_gid_node_t *const *)node2)->gid;
+
+    return (gid1 > gid2) - (gid1 < gid2);
+}
+
+/**
+ * Find the first position of the ordered UID index with a UID not smaller than the given one.
+ *
+ * @param db Database with a built ordered UID index.
+ * @param uid UID to search for.
+ *
+ * @return Position in the index - number of nodes if all UIDs are smaller.
+ *
+ */
+static size_t um_db_find_uid_order(const um_db_t *db, uid_t uid)
+{
+    size_t low = 0;
+    size_t high = db->uid_order_count;
+
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+
+        if (db->uid_order[mid]->uid < uid)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * Find the first position of the ordered GID index with a GID not smaller than the given one.
+ *
+ * @param db Database with a built ordered GID index.
+ * @param gid GID to search for.
+ *
+ * @return Position in the index - number of nodes if all GIDs are smaller.
+ *
+ */
+static size_t um_db_find_gid_order(const um_db_t *db, gid_t gid)
+{
+    size_t low = 0;
+    size_t high = db->gid_order_count;
+
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+
+        if (db->gid_order[mid]->gid < gid)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * Get the user following the given one in UID order.
+ *
+ * @param db Database with a built ordered UID index.
+ * @param element User list element - NULL to get the first user.
+ *
+ * @return Next user list element - NULL after the last user.
+ *
+ */
+static um_user_element_t *um_db_next_sorted_user(const um_db_t *db, const um_user_element_t *element)
+{
+    const um_db_user_entry_t *entry = (const um_db_user_entry_t *)element;
+    size_t next = entry ? entry->uid_node->order + 1 : 0;
+
+    // users sharing the UID first
+    if (entry && entry->uid_next)
+    {
+        return &entry->uid_next->element;
+    }
+
+    return next < db->uid_order_count ? &db->uid_order[next]->head->element : NULL;
+}
+
+/**
+ * Get the group following the given one in GID order.
+ *
+ * @param db Database with a built ordered GID index.
+ * @param element Group list element - NULL to get the first group.
+ *
+ * @return Next group list element - NULL after the last group.
+ *
+ */
+static um_group_element_t *um_db_next_sorted_group(const um_db_t *db, const um_group_element_t *element)
+{
+    const um_db_group_entry_t *entry = (const um_db_group_entry_t *)element;
+    size_t next = entry ? entry->gid_node->order + 1 : 0;
+
+    // groups sharing the GID first
+    if (entry && entry->gid_next)
+    {
+        return &entry->gid_next->element;
+    }
+
+    return next < db->gid_order_count ? &db->gid_order[next]->head->element : NULL;
+}
+
+/**
+ * Choose the next ID from the pool.
+ *
+ * @param pool Pool of used IDs.
+ * @param policy Policy to apply.
+ * @param id Chosen ID.
+ *
+ * @return Error code - 0 on success, -1 if all IDs are used.
+ *
+ */
+static int um_db_next_id(const um_id_pool_t *pool, um_db_id_policy_t policy, id_t *id)
+{
+    id_t last = 0;
+
+    if (policy == UM_DB_ID_POLICY_NEXT_MAX && !um_id_pool_last_used(pool, &last))
+    {
+        if (last < um_id_pool_get_max(pool))
+        {
+            *id = last + 1;
+            return 0;
+        }
+    }
+
+    // lowest free ID - also the fallback once the last ID of the range is used
+    return um_id_pool_next_free(pool, um_id_pool_get_min(pool), id);
+}
+
+/**
+ * Find the first run of consecutive free IDs which starts at or after the given ID.
+ *
+ * @param pool Pool of used IDs.
+ * @param from Lowest acceptable first ID.
+ * @param count Run length - must not be 0.
+ * @param first First ID of the found run.
+ *
+ * @return Error code - 0 on success, -1 if there is no such run.
+ *
+ */
+static int um_db_find_free_run(const um_id_pool_t *pool, id_t from, size_t count, id_t *first)
+{
+    id_t candidate = 0, used = 0;
+    const id_t max = um_id_pool_get_max(pool);
+
+    // jump from one free ID to the next used one - each step skips a whole used or free block
+    while (!um_id_pool_next_free(pool, from, &candidate))
+    {
+        if ((size_t)(max - candidate) < count - 1)
+        {
+            return -1;
+        }
+
+        if (um_id_pool_next_used(pool, candidate, &used) || (size_t)(used - candidate) >= count)
+        {
+            *first = candidate;
+            return 0;
+        }
+
+        if (used == max)
+        {
+            return -1;
+        }
+
+        from = used + 1;
+    }
+
+    return -1;
+}
+
+/**
+ * Reserve IDs from the pool - marks them as used and reserved.
+ *
+ * @param pool Pool of used IDs.
+ * @param reserved Pool of reserved IDs.
+ * @param policy Policy for choosing IDs.
+ * @param ids Array to fill with reserved IDs.
+ * @param count Number of IDs to reserve.
+ * @param contiguous Reserve a single run of consecutive IDs.
+ *
+ * @return Error code - 0 on success, -1 if not enough IDs are free - nothing is reserved.
+ *
+ */
+static int um_db_reserve_ids(um_id_pool_t *pool, um_id_pool_t *reserved, um_db_id_policy_t policy, id_t *ids,
+                             size_t count, bool contiguous)
+{
+    const id_t min = um_id_pool_get_min(pool);
+    const id_t max = um_id_pool_get_max(pool);
+    id_t last = 0;
+
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    if (count - 1 > (size_t)(max - min))
+    {
+        return -1;
+    }
+
+    if (contiguous)
+    {
+        id_t from = min;
+
+        // start above the highest used ID if the policy asks for it, wrap to the range start otherwise
+        if (policy == UM_DB_ID_POLICY_NEXT_MAX && !um_id_pool_last_used(pool, &last) && last < max)
+        {
+            from = last + 1;
+        }
+
+        if (um_db_find_free_run(pool, from, count, &ids[0]) &&
+            (from == min || um_db_find_free_run(pool, min, count, &ids[0])))
+        {
+            return -1;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            ids[i] = ids[0] + (id_t)i;
+            um_id_pool_set(pool, ids[i]);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (um_db_next_id(pool, policy, &ids[i]))
+            {
+                // roll back what was taken so far
+                for (size_t j = 0; j < i; j++)
+                {
+                    um_id_pool_clear(pool, ids[j]);
+                }
+                return -1;
+            }
+
+            um_id_pool_set(pool, ids[i]);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        um_id_pool_set(reserved, ids[i]);
+    }
+
+    return 0;
+}
+
+/**
+ * Release reserved IDs - IDs which are not reserved are ignored.
+ *
+ * @param pool Pool of used IDs - can be NULL if not built yet.
+ * @param reserved Pool of reserved IDs.
+ * @param ids IDs to release.
+ * @param count Number of IDs.
+ *
+ */
+static void um_db_release_ids(um_id_pool_t *pool, um_id_pool_t *reserved, const id_t *ids, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        // reserved IDs have no records - reservations are dropped once a record takes the ID
+        if (um_id_pool_is_set(reserved, ids[i]))
+        {
+            um_id_pool_clear(reserved, ids[i]);
+
+            if (pool)
+            {
+                um_id_pool_clear(pool, ids[i]);
+            }
+        }
+    }
+}
+
+/**
+ * Append user to the list and the indexes.
+ * User data is not freed on failure.
+ *
+ * @param db Database to use.
+ * @param user User to insert.
+ * @param arena Arena to allocate the list node in - NULL to use the heap.
+ *
+ * @return Error code - 0 on success, -1 on allocation failure, missing or duplicate name.
+ *
+ */
+static int um_db_insert_user(um_db_t *db, um_user_t *user, um_arena_t *arena)
+{
+    um_db_user_entry_t *entry = NULL;
+
+    if (arena)
+    {
+        entry = (um_db_user_entry_t *)um_arena_alloc(arena, sizeof(um_db_user_entry_t));
+    }
+    else
+    {
+        entry = (um_db_user_entry_t *)malloc(sizeof(um_db_user_entry_t));
+    }
+
+    if (!entry)
+    {
+        return -1;
+    }
+
+    *entry = (um_db_user_entry_t){0};
+    entry->element.user = user;
+    entry->pooled = arena != NULL;
+    entry->seen = true;
+
+    if (um_db_index_user_entry(db, entry))
+    {
+        if (!arena)
+        {
+            free(entry);
+        }
+        return -1;
+    }
+
+    DL_APPEND(db->user_head, &entry->element);
+    um_user_set_intern(user, db->intern);
+    um_user_set_owner(user, db);
+
+    return 0;
+}
+
+/**
+ * Append group to the list and the indexes.
+ * Group data is not freed on failure.
+ *
+ * @param db Database to use.
+ * @param group Group to insert.
+ * @param arena Arena to allocate the list node in - NULL to use the heap.
+ *
+ * @return Error code - 0 on success, -1 on allocation failure, missing or duplicate name.
+ *
+ */
+static int um_db_insert_group(um_db_t *db, um_group_t *group, um_arena_t *arena)
+{
+    um_db_group_entry_t *entry = NULL;
+
+    if (arena)
+    {
+        entry = (um_db_group_entry_t *)um_arena_alloc(arena, sizeof(um_db_group_entry_t));
+    }
+    else
+    {
+        entry = (um_db_group_entry_t *)malloc(sizeof(um_db_group_entry_t));
+    }
+
+    if (!entry)
+    {
+        return -1;
+    }
+
+    *entry = (um_db_group_entry_t){0};
+    entry->element.group = group;
+    entry->pooled = arena != NULL;
+    entry->seen = true;
+
+    if (um_db_index_group_entry(db, entry))
+    {
+        if (!arena)
+        {
+            free(entry);
+        }
+        return -1;
+    }
+
+    DL_APPEND(db->group_head, &entry->element);
+    um_group_set_intern(group, db->intern);
+    um_group_set_owner(group, db);
+
+    return 0;
+}
+
+/**
+ * Allocate block of node storage owned by the database.
+ *
+ * @param db Database to use.
+ * @param size Number of bytes to allocate.
+ *
+ * @return Block data - NULL on allocation failure.
+ *
+ */
+static void *um_db_new_block(um_db_t *db, size_t size)
+{
+    um_db_block_t *block = NULL;
+
+    if (size > SIZE_MAX - sizeof(um_db_block_t))
+    {
+        return NULL;
+    }
+
+    block = (um_db_block_t *)malloc(sizeof(um_db_block_t) + size);
+    if (!block)
+    {
+        return NULL;
+    }
+
+    LL_PREPEND(db->blocks, block);
+
+    return block->data;
+}
+
+/**
+ * Free block of node storage - no node in the block may be used.
+ *
+ * @param db Database to use.
+ * @param data Block data returned by um_db_new_block().
+ *
+ */
+static void um_db_free_block(um_db_t *db, void *data)
+{
+    um_db_block_t *block = (um_db_block_t *)((char *)data - offsetof(um_db_block_t, data));
+
+    LL_DELETE(db->blocks, block);
+    free(block);
+}
+
+/**
+ * Create temporary file for the new contents of the account file.
+ * The temporary file is created in the same directory with the mode and owner of the original file.
+ *
+ * @param file File to initialize.
+ * @param path Path of the account file.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_db_output_open(um_db_output_t *file, const char *path)
+{
+    int fd = -1;
+    struct stat st = {0};
+
+    *file = (um_db_output_t){0};
+    file->path = path;
+
+    if (snprintf(file->tmp_path, sizeof(file->tmp_path), "%s+XXXXXX", path) >= (int)sizeof(file->tmp_path))
+    {
+        file->tmp_path[0] = 0;
+        return -1;
+    }
+
+    fd = mkstemp(file->tmp_path);
+    if (fd < 0)
+    {
+        file->tmp_path[0] = 0;
+        return -1;
+    }
+
+    // keep mkstemp() mode (0600) for new files
+    if (!stat(path, &st) && (fchmod(fd, st.st_mode & 07777) || fchown(fd, st.st_uid, st.st_gid)))
+    {
+        close(fd);
+        return -1;
+    }
+
+    file->file = fdopen(fd, "w");
+    if (!file->file)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Flush and sync temporary file to disk and close it.
+ *
+ * @param file File to sync.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_db_output_sync(um_db_output_t *file)
+{
+    int error = 0;
+
+    if (fflush(file->file) || fsync(fileno(file->file)))
+    {
+        error = -1;
+    }
+
+    if (fclose(file->file))
+    {
+        error = -1;
+    }
+
+    file->file = NULL;
+
+    return error;
+}
+
+/**
+ * Keep the current account file as a backup and rename the temporary file over it.
+ *
+ * @param file Synced file to commit.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_db_output_commit(um_db_output_t *file)
+{
+    char backup_path[PATH_MAX] = {0};
+
+    if (snprintf(backup_path, sizeof(backup_path), "%s-", file->path) >= (int)sizeof(backup_path))
+    {
+        return -1;
+    }
+
+    // hard link keeps the original in place until the rename replaces it
+    if (unlink(backup_path) && errno != ENOENT)
+    {
+        return -1;
+    }
+
+    if (link(file->path, backup_path) && errno != ENOENT)
+    {
+        return -1;
+    }
+
+    if (rename(file->tmp_path, file->path))
+    {
+        return -1;
+    }
+
+    file->tmp_path[0] = 0;
+
+    return 0;
+}
+
+/**
+ * Close and remove temporary file if it still exists.
+ *
+ * @param file File to discard.
+ *
+ */
+static void um_db_output_discard(um_db_output_t *file)
+{
+    if (file->file)
+    {
+        fclose(file->file);
+        file->file = NULL;
+    }
+
+    if (file->tmp_path[0])
+    {
+        unlink(file->tmp_path);
+        file->tmp_path[0] = 0;
+    }
+}
+
+/**
+ * Sync the directory containing the given path to disk.
+ *
+ * @param path Path of a file in the directory.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_db_sync_dir(const char *path)
+{
+    int error = 0;
+    int fd = -1;
+    char dir_path[PATH_MAX] = {0};
+    const char *slash = strrchr(path, '/');
+
+    if (!slash)
+    {
+        strcpy(dir_path, ".");
+    }
+    else if (slash == path)
+    {
+        strcpy(dir_path, "/");
+    }
+    else if ((size_t)(slash - path) < sizeof(dir_path))
+    {
+        memcpy(dir_path, path, (size_t)(slash - path));
+    }
+    else
+    {
+        return -1;
+    }
+
+    fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    if (fsync(fd))
+    {
+        error = -1;
+    }
+
+    close(fd);
+
+    return error;
+}
+
+/**
+ * Collect the mask of account files which need to be rewritten.
+ * Takes time linear in the number of users and groups, but no file is accessed.
+ *
+ * @param db Database to use.
+ *
+ * @return Dirty mask.
+ *
+ */
+static unsigned int um_db_collect_dirty(const um_db_t *db)
+{
+    unsigned int dirty = db->dirty;
+    const um_user_element_t *user_iter = NULL;
+    const um_group_element_t *group_iter = NULL;
+
+    DL_FOREACH(db->user_head, user_iter)
+    {
+        dirty |= um_user_get_dirty(user_iter->user);
+    }
+
+    DL_FOREACH(db->group_head, group_iter)
+    {
+        dirty |= um_group_get_dirty(group_iter->group);
+    }
+
+    return dirty;
+}
+
+/**
+ * Mark all users, groups and the database itself as unchanged.
+ *
+ * @param db Database to use.
+ *
+ */
+static void um_db_clear_dirty(um_db_t *db)
+{
+    um_user_element_t *user_iter = NULL;
+    um_group_element_t *group_iter = NULL;
+
+    DL_FOREACH(db->user_head, user_iter)
+    {
+        um_user_clear_dirty(user_iter->user);
+    }
+
+    DL_FOREACH(db->group_head, group_iter)
+    {
+        um_group_clear_dirty(group_iter->group);
+    }
+
+    db->dirty = 0;
+}
+
+/**
+ * Load database using the NSS functions.
+ *
+ * @param db Database to load.
+ * @param arena Arena to allocate users and groups in - NULL to use the heap.
+ * @param files Dirty mask bits of the account files to read.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_db_load_nss(um_db_t *db, um_arena_t *arena, unsigned int files)
+{
+    int error = 0;
+    struct passwd *pwd = NULL;
+    struct spwd *spwd = NULL;
+    struct group *grp = NULL;
+    struct sgrp *sgrp = NULL;
+
+    // load /etc/passwd data and after that load /etc/shadow data
+    if (files & UM_DIRTY_PASSWD)
+    {
+        setpwent();
+        while (!error && (pwd = getpwent()) != NULL)
+        {
+            error = um_db_load_passwd(db, pwd, arena);
+        }
+        endpwent();
+    }
+
+    if (!error && (files & UM_DIRTY_SHADOW))
+    {
+        setspent();
+        while (!error && (spwd = getspent()) != NULL)
+        {
+            error = um_db_load_shadow(db, spwd);
+        }
+        endspent();
+    }
+
+    if (!error && (files & UM_DIRTY_GROUP))
+    {
+        setgrent();
+        while (!error && (grp = getgrent()) != NULL)
+        {
+            error = um_db_load_group(db, grp, arena);
+        }
+        endgrent();
+    }
+
+    if (!error && (files & UM_DIRTY_GSHADOW))
+    {
+        setsgent();
+        while (!error && (sgrp = getsgent()) != NULL)
+        {
+            error = um_db_load_gshadow(db, sgrp);
+        }
+        endsgent();
+    }
+
+    return error;
+}
+
+/**
+ * Load database by parsing the account files directly.
+ *
+ * @param db Database to load.
+ * @param arena Arena to allocate users and groups in - NULL to use the heap.
+ * @param files Dirty mask bits of the account files to read.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_db_load_files(um_db_t *db, um_arena_t *arena, unsigned int files)
+{
+    int error = 0;
+    int result = 0;
+    um_parser_t parser = {0};
+    struct passwd pwd = {0};
+    struct spwd spwd = {0};
+    struct group grp = {0};
+    struct sgrp sgrp = {0};
+
+    if (files & UM_DIRTY_PASSWD)
+    {
+        if (um_parser_open(&parser, um_db_get_path(db, UM_DB_FILE_PASSWD)))
+        {
+            return -1;
+        }
+
+        while (!error && (result = um_parser_next_passwd(&parser, &pwd)) > 0)
+        {
+            error = um_db_load_passwd(db, &pwd, arena);
+        }
+        um_parser_close(&parser);
+    }
+
+    if (!error && result >= 0 && (files & UM_DIRTY_SHADOW))
+    {
+        if (um_parser_open(&parser, um_db_get_path(db, UM_DB_FILE_SHADOW)))
+        {
+            return -1;
+        }
+
+        while (!error && (result = um_parser_next_shadow(&parser, &spwd)) > 0)
+        {
+            error = um_db_load_shadow(db, &spwd);
+        }
+        um_parser_close(&parser);
+    }
+
+    if (!error && result >= 0 && (files & UM_DIRTY_GROUP))
+    {
+        if (um_parser_open(&parser, um_db_get_path(db, UM_DB_FILE_GROUP)))
+        {
+            return -1;
+        }
+
+        while (!error && (result = um_parser_next_group(&parser, &grp)) > 0)
+        {
+            error = um_db_load_group(db, &grp, arena);
+        }
+        um_parser_close(&parser);
+    }
+
+    if (!error && result >= 0 && (files & UM_DIRTY_GSHADOW))
+    {
+        if (um_parser_open(&parser, um_db_get_path(db, UM_DB_FILE_GSHADOW)))
+        {
+            return -1;
+        }
+
+        while (!error && (result = um_parser_next_gshadow(&parser, &sgrp)) > 0)
+        {
+            error = um_db_load_gshadow(db, &sgrp);
+        }
+        um_parser_close(&parser);
+    }
+
+    return (error || result < 0) ? -1 : 0;
+}
+
+/**
+ * Check if the account file differs from the file read by the last load, store or refresh.
+ *
+ * @param db Database to use.
+ * @param file Account file to check.
+ *
+ * @return True if the device, inode, size or modification time changed or the file was removed or created.
+ *
+ */
+static bool um_db_source_changed(const um_db_t *db, um_db_file_t file)
+{
+    struct stat st = {0};
+    const struct stat *source = &db->sources[file];
+
+    if (stat(um_db_get_path(db, file), &st))
+    {
+        // missing files are recorded as all zero
+        st = (struct stat){0};
+    }
+
+    return st.st_dev != source->st_dev || st.st_ino != source->st_ino || st.st_size != source->st_size ||
+           st.st_mtim.tv_sec != source->st_mtim.tv_sec || st.st_mtim.tv_nsec != source->st_mtim.tv_nsec;
+}
+
+/**
+ * Consume pending events of the database watch.
  *
  * @param db Database to use.
  *
- * @return New GID.
+ * @return True if the account files have to be checked - the database is not watched, the watch reported an event or
+ * the files were not checked since the watch was set up.
  *
  */
-gid_t um_db_get_new_gid(um_db_t *db)
+static bool um_db_watch_changed(um_db_t *db)
 {
-    um_user_element_t *user_iter = NULL;
-    gid_t max_gid = 0;
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = !db->watch_checked;
+    ssize_t length = 0;
 
-    LL_FOREACH(db->user_head, user_iter)
+    if (db->watch_fd < 0)
     {
-        if (um_user_get_uid(user_iter->user) >= 1000 && um_user_get_uid(user_iter->user) < 65534 &&
-            um_user_get_gid(user_iter->user) > max_gid)
-        {
-            max_gid = um_user_get_gid(user_iter->user);
-        }
+        return true;
     }
 
-    return max_gid + 1;
+    while ((length = read(db->watch_fd, buffer, sizeof(buffer))) > 0)
+    {
+        changed = true;
+    }
+
+    // unexpected errors are handled by checking the files
+    if (length < 0 && errno != EAGAIN && errno != EINTR)
+    {
+        changed = true;
+    }
+
+    db->watch_checked = true;
+
+    return changed;
 }
 
 /**
- * Add a new user to the database.
- * User will be handled by the database from this point on - do not free user data after adding user to the database.
+ * Compare two optional strings.
  *
- * @param db Database to use.
- * @param name User to search for.
+ * @param str1 First string - can be NULL.
+ * @param str2 Second string - can be NULL.
+ *
+ * @return True if both strings are NULL or equal.
+ *
+ */
+static bool um_db_same_string(const char *str1, const char *str2)
+{
+    if (!str1 || !str2)
+    {
+        return str1 == str2;
+    }
+
+    return !strcmp(str1, str2);
+}
+
+/**
+ * Update user data from a passwd record. Only the changed fields are set, so unchanged strings are kept.
+ *
+ * @param user User to update.
+ * @param pwd Record to use.
  *
  * @return Error code - 0 on success.
  *
  */
-int um_db_add_user(um_db_t *db, um_user_t *user)
+static int um_db_update_user(um_user_t *user, const struct passwd *pwd)
 {
-    um_user_element_t *new_user = NULL;
+    // the setter moves the user in the UID index
+    if (um_user_set_uid(user, pwd->pw_uid))
+    {
+        return -1;
+    }
+    um_user_set_gid(user, pwd->pw_gid);
 
-    new_user = (um_user_element_t *)malloc(sizeof(um_user_element_t));
-    if (!new_user)
+    if (!um_db_same_string(um_user_get_password(user), pwd->pw_passwd) &&
+        um_user_set_password(user, pwd->pw_passwd))
+    {
+        return -1;
+    }
+
+    if (!um_db_same_string(um_user_get_gecos(user), pwd->pw_gecos) && um_user_set_gecos(user, pwd->pw_gecos))
     {
-        // free user data immediately
-        um_user_free(user);
         return -1;
     }
 
-    new_user->user = user;
-    new_user->next = NULL;
+    if (!um_db_same_string(um_user_get_home_path(user), pwd->pw_dir) && um_user_set_home_path(user, pwd->pw_dir))
+    {
+        return -1;
+    }
 
-    LL_APPEND(db->user_head, new_user);
+    if (!um_db_same_string(um_user_get_shell_path(user), pwd->pw_shell) &&
+        um_user_set_shell_path(user, pwd->pw_shell))
+    {
+        return -1;
+    }
 
     return 0;
 }
 
 /**
- * Add a new group to the database.
- * Group will be handled by the database from this point on - do not free group data after adding user to the database.
+ * Update group data from a group record. Only the changed fields are set, so unchanged strings are kept.
  *
- * @param db Database to use.
- * @param name Group to add.
+ * @param group Group to update.
+ * @param grp Record to use.
  *
  * @return Error code - 0 on success.
  *
  */
-int um_db_add_group(um_db_t *db, um_group_t *group)
+static int um_db_update_group(um_group_t *group, const struct group *grp)
 {
-    um_group_element_t *new_group = NULL;
-
-    new_group = (um_group_element_t *)malloc(sizeof(um_group_element_t));
-    if (!new_group)
+    // the setter moves the group in the GID index
+    if (um_group_set_gid(group, grp->gr_gid))
     {
-        // free user data immediately
-        um_group_free(group);
         return -1;
     }
 
-    new_group->group = group;
-    new_group->next = NULL;
-
-    LL_APPEND(db->group_head, new_group);
+    if (!um_db_same_string(um_group_get_password(group), grp->gr_passwd) &&
+        um_group_set_password(group, grp->gr_passwd))
+    {
+        return -1;
+    }
 
     return 0;
 }
 
 /**
- * Get the user from the database.
+ * Make the group member or admin list match the named users. Unknown users are ignored.
+ * Lists which already match are not changed - otherwise the list is rebuilt in the given order.
  *
  * @param db Database to use.
- * @param name User to search for.
+ * @param group Group to update.
+ * @param names NULL terminated list of user names.
+ * @param admin True to update the admin list instead of the member list.
  *
- * @return Abstract user type - NULL if not found.
+ * @return Error code - 0 on success.
  *
  */
-um_user_t *um_db_get_user(um_db_t *db, const char *name)
+static int um_db_set_group_users(um_db_t *db, um_group_t *group, char *const *names, bool admin)
 {
-    um_user_element_t search_element = {0}, *found_element = NULL;
+    bool deferred = db->deferred & UM_DIRTY_GSHADOW;
+    const um_group_user_element_t *iter = admin ? um_group_get_admin_head(group) : um_group_get_members_head(group);
+    um_db_user_entry_t *user_entry = NULL;
     um_user_t *user = NULL;
+    bool same = true;
 
-    search_element.user = um_user_new();
-    if (!search_element.user)
+    // compare in order - lists read from the same record match element by element
+    for (int i = 0; same && names[i] != NULL; i++)
     {
-        return NULL;
+        user_entry = um_db_find_user_entry(db, names[i]);
+
+        // users added after the load are not the admins named in the deferred file
+        if (!user_entry || (admin && deferred && um_user_get_deferred(user_entry->element.user) != db))
+        {
+            continue;
+        }
+
+        same = iter && iter->user == user_entry->element.user;
+        iter = iter ? iter->next : NULL;
     }
 
-    if (um_user_set_name(search_element.user, name))
+    if (same && !iter)
     {
-        goto out;
+        return 0;
     }
 
-    LL_SEARCH(db->user_head, found_element, &search_element, um_user_element_cmp_fn);
+    while ((iter = admin ? um_group_get_admin_head(group) : um_group_get_members_head(group)) != NULL)
+    {
+        user = iter->user;
+        if (admin ? um_group_remove_admin(group, user) : um_group_remove_member(group, user))
+        {
+            return -1;
+        }
+    }
 
-    if (found_element)
+    for (int i = 0; names[i] != NULL; i++)
     {
-        user = found_element->user;
+        user_entry = um_db_find_user_entry(db, names[i]);
+
+        if (!user_entry || (admin && deferred && um_user_get_deferred(user_entry->element.user) != db))
+        {
+            continue;
+        }
+
+        user = user_entry->element.user;
+        if (admin ? um_group_add_admin(group, user) : um_group_add_member(group, user))
+        {
+            return -1;
+        }
     }
 
-out:
-    // free temp user
-    um_user_free(search_element.user);
+    return 0;
+}
+
+/**
+ * Load database by parsing the account files in multiple threads and merging the records in file order.
+ *
+ * @param db Database to load.
+ * @param arena Arena to allocate users and groups in - NULL to use the heap.
+ * @param files Dirty mask bits of the files to read.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_db_load_parallel(um_db_t *db, um_arena_t *arena, unsigned int files)
+{
+    int error = 0;
+    const char *paths[UM_DB_FILE_COUNT] = {0};
+    um_loader_t *loader = um_loader_new(db->load_threads);
+
+    if (!loader)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        paths[i] = um_db_get_path(db, (um_db_file_t)i);
+    }
+
+    // dirty mask bits match the file order
+    error = um_loader_read(loader, paths, files);
+
+    for (size_t i = 0; !error && i < um_loader_get_count(loader, UM_DB_FILE_PASSWD); i++)
+    {
+        error = um_db_load_passwd(db, um_loader_get_passwd(loader, i), arena);
+    }
+
+    for (size_t i = 0; !error && i < um_loader_get_count(loader, UM_DB_FILE_SHADOW); i++)
+    {
+        error = um_db_load_shadow(db, um_loader_get_shadow(loader, i));
+    }
+
+    for (size_t i = 0; !error && i < um_loader_get_count(loader, UM_DB_FILE_GROUP); i++)
+    {
+        error = um_db_load_group(db, um_loader_get_group(loader, i), arena);
+    }
+
+    for (size_t i = 0; !error && i < um_loader_get_count(loader, UM_DB_FILE_GSHADOW); i++)
+    {
+        error = um_db_load_gshadow(db, um_loader_get_gshadow(loader, i));
+    }
+
+    um_loader_free(loader);
 
-    return user;
+    return error ? -1 : 0;
 }
 
 /**
- * Get the group from the database.
+ * Add user from a passwd record. The first record wins for duplicate names - same as getpwnam().
  *
  * @param db Database to use.
- * @param name Group to search for.
+ * @param pwd Record to add.
+ * @param arena Arena to allocate the user in - NULL to use the heap.
  *
- * @return Abstract group type - NULL if not found.
+ * @return Error code - 0 on success.
  *
  */
-um_group_t *um_db_get_group(um_db_t *db, const char *name)
+static int um_db_load_passwd(um_db_t *db, const struct passwd *pwd, um_arena_t *arena)
 {
-    um_group_element_t search_element = {0}, *found_element = NULL;
-    um_group_t *group = NULL;
+    um_db_user_entry_t *entry = um_db_find_user_entry(db, pwd->pw_name);
+    um_user_t *user = NULL;
 
-    search_element.group = um_group_new();
-    if (!search_element.group)
+    // users read again by a refresh are updated in place
+    if (entry)
     {
-        return NULL;
+        if (entry->seen)
+        {
+            return 0;
+        }
+
+        entry->seen = true;
+        return um_db_update_user(entry->element.user, pwd);
     }
 
-    if (um_group_set_name(search_element.group, name))
+    user = arena ? um_user_new_in(arena) : um_user_new();
+    if (!user)
     {
-        goto out;
+        return -1;
     }
 
-    LL_SEARCH(db->group_head, found_element, &search_element, um_group_element_cmp_fn);
+    um_user_set_intern(user, db->intern);
 
-    if (found_element)
+    um_user_set_uid(user, pwd->pw_uid);
+    um_user_set_gid(user, pwd->pw_gid);
+
+    // set passwd data and add the user to the list and the index
+    if (um_user_set_name(user, pwd->pw_name) || um_user_set_password(user, pwd->pw_passwd) ||
+        um_user_set_gecos(user, pwd->pw_gecos) || um_user_set_home_path(user, pwd->pw_dir) ||
+        um_user_set_shell_path(user, pwd->pw_shell) || um_db_insert_user(db, user, arena))
     {
-        group = found_element->group;
+        um_user_free(user);
+        return -1;
     }
 
-out:
-    // free temp user
-    um_group_free(search_element.group);
+    // set last - setters would read the deferred files
+    if (db->deferred)
+    {
+        um_user_set_deferred(user, db);
+    }
 
-    return group;
+    return 0;
 }
 
 /**
- * Delete user from the database.
+ * Merge shadow record into the user with the same name. Records without a user are ignored.
  *
  * @param db Database to use.
- * @param name User to search for.
+ * @param spwd Record to merge.
  *
  * @return Error code - 0 on success.
  *
  */
-int um_db_delete_user(um_db_t *db, const char *name)
+static int um_db_load_shadow(um_db_t *db, const struct spwd *spwd)
 {
-    int error = 0;
-    um_user_element_t search_element = {0}, *found_element = NULL;
+    um_db_user_entry_t *entry = um_db_find_user_entry(db, spwd->sp_namp);
+    um_user_t *user = NULL;
+    unsigned int dirty = 0;
 
-    search_element.user = um_user_new();
-    if (!search_element.user)
+    if (!entry)
     {
-        goto error_out;
+        return 0;
     }
 
-    if (um_user_set_name(search_element.user, name))
+    user = entry->element.user;
+
+    // deferred records belong only to users loaded with the database
+    if ((db->deferred & UM_DIRTY_SHADOW) && um_user_get_deferred(user) != db)
     {
-        goto error_out;
+        return 0;
     }
 
-    LL_SEARCH(db->user_head, found_element, &search_element, um_user_element_cmp_fn);
+    dirty = um_user_get_dirty(user);
 
-    if (found_element)
+    if (!um_db_same_string(um_user_get_password_hash(user), spwd->sp_pwdp) &&
+        um_user_set_password_hash(user, spwd->sp_pwdp))
     {
-        // free data
-        um_user_free(found_element->user);
+        return -1;
+    }
+
+    um_user_set_last_change(user, spwd->sp_lstchg);
+    um_user_set_change_min(user, spwd->sp_min);
+    um_user_set_change_max(user, spwd->sp_max);
+    um_user_set_warn_days(user, spwd->sp_warn);
+    um_user_set_inactive_days(user, spwd->sp_inact);
+    um_user_set_expiration(user, spwd->sp_expire);
+    um_user_set_flags(user, spwd->sp_flag);
+
+    // merged data matches the file
+    um_user_clear_dirty(user);
+    um_user_set_dirty(user, dirty);
+
+    return 0;
+}
+
+/**
+ * Add group from a group record. The first record wins for duplicate names - same as getgrnam().
+ * Members are taken from the gshadow record - from the group record if gshadow is not read with the database.
+ *
+ * @param db Database to use.
+ * @param grp Record to add.
+ * @param arena Arena to allocate the group in - NULL to use the heap.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_db_load_group(um_db_t *db, const struct group *grp, um_arena_t *arena)
+{
+    um_db_group_entry_t *entry = um_db_find_group_entry(db, grp->gr_name);
+    um_group_t *group = NULL;
+    bool members = (db->deferred | db->unavailable) & UM_DIRTY_GSHADOW;
+
+    // groups read again by a refresh are updated in place
+    if (entry)
+    {
+        if (entry->seen)
+        {
+            return 0;
+        }
+
+        entry->seen = true;
+        group = entry->element.group;
 
-        // remove from list
-        LL_DELETE(db->user_head, found_element);
+        if (um_db_update_group(group, grp) || (members && um_db_set_group_users(db, group, grp->gr_mem, false)))
+        {
+            return -1;
+        }
+
+        return 0;
     }
 
-    goto out;
+    group = arena ? um_group_new_in(arena) : um_group_new();
+    if (!group)
+    {
+        return -1;
+    }
 
-error_out:
-    error = -1;
+    um_group_set_intern(group, db->intern);
 
-out:
-    // free temp user
-    um_user_free(search_element.user);
+    um_group_set_gid(group, grp->gr_gid);
 
-    return error;
+    // set group data and add the group to the list and the index
+    if (um_group_set_name(group, grp->gr_name) || um_group_set_password(group, grp->gr_passwd) ||
+        um_db_insert_group(db, group, arena))
+    {
+        um_group_free(group);
+        return -1;
+    }
+
+    if (members && um_db_set_group_users(db, group, grp->gr_mem, false))
+    {
+        return -1;
+    }
+
+    // set last - setters would read the deferred file
+    if (db->deferred & UM_DIRTY_GSHADOW)
+    {
+        um_group_set_deferred(group, db);
+    }
+
+    return 0;
 }
 
 /**
- * Delete group from the database.
+ * Merge gshadow record into the group with the same name. Records without a group and unknown users are ignored.
  *
  * @param db Database to use.
- * @param name Group to search for.
+ * @param sgrp Record to merge.
  *
  * @return Error code - 0 on success.
  *
  */
-int um_db_delete_group(um_db_t *db, const char *name)
+static int um_db_load_gshadow(um_db_t *db, const struct sgrp *sgrp)
 {
-    int error = 0;
-    um_group_element_t search_element = {0}, *found_element = NULL;
+    um_db_group_entry_t *entry = um_db_find_group_entry(db, sgrp->sg_namp);
+    um_group_t *group = NULL;
+    bool deferred = db->deferred & UM_DIRTY_GSHADOW;
+    unsigned int dirty = 0;
 
-    search_element.group = um_group_new();
-    if (!search_element.group)
+    if (!entry)
     {
-        goto error_out;
+        return 0;
     }
 
-    if (um_group_set_name(search_element.group, name))
+    group = entry->element.group;
+
+    // deferred records belong only to groups loaded with the database
+    if (deferred && um_group_get_deferred(group) != db)
     {
-        goto error_out;
+        return 0;
     }
 
-    LL_SEARCH(db->group_head, found_element, &search_element, um_group_element_cmp_fn);
+    dirty = um_group_get_dirty(group);
 
-    if (found_element)
+    if (!um_db_same_string(um_group_get_password_hash(group), sgrp->sg_passwd) &&
+        um_group_set_password_hash(group, sgrp->sg_passwd))
     {
-        // free data
-        um_group_free(found_element->group);
+        return -1;
+    }
 
-        // remove from list
-        LL_DELETE(db->group_head, found_element);
+    // set admin and member lists - deferred groups already have the members from the group file
+    if ((!deferred && um_db_set_group_users(db, group, sgrp->sg_mem, false)) ||
+        um_db_set_group_users(db, group, sgrp->sg_adm, true))
+    {
+        return -1;
     }
 
-    goto out;
+    // merged data matches the file
+    um_group_clear_dirty(group);
+    um_group_set_dirty(group, dirty);
 
-error_out:
-    error = -1;
+    return 0;
+}
 
-out:
-    // free temp user
-    um_group_free(search_element.group);
+/**
+ * Check if two paths are in the same directory.
+ *
+ * @param path1 First path.
+ * @param path2 Second path.
+ *
+ * @return True if the directory parts of the paths are equal.
+ *
+ */
+static bool um_db_same_dir(const char *path1, const char *path2)
+{
+    const char *slash1 = strrchr(path1, '/');
+    const char *slash2 = strrchr(path2, '/');
+    size_t length1 = slash1 ? (size_t)(slash1 - path1) : 0;
+    size_t length2 = slash2 ? (size_t)(slash2 - path2) : 0;
 
-    return error;
+    return length1 == length2 && !strncmp(path1, path2, length1);
 }
 
 /**
- * Get users list head.
+ * Check if any account file path of the database was changed.
  *
  * @param db Database to use.
  *
- * @return Users list head.
+ * @return True if a path other than the system default is used.
  *
  */
-const um_user_element_t *um_db_get_user_list_head(const um_db_t *db)
+static bool um_db_has_custom_paths(const um_db_t *db)
 {
-    return db->user_head;
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        if (db->paths[i])
+        {
+            return true;
+        }
+    }
+
+    return false;
 }
 
 /**
- * Get group list head.
+ * Get the system path of an account file.
  *
- * @param db Database to use.
+ * @param file Account file.
  *
- * @return Group list head.
+ * @return System path of the file.
  *
  */
-const um_group_element_t *um_db_get_group_list_head(const um_db_t *db)
+static const char *um_db_get_default_path(um_db_file_t file)
 {
-    return db->group_head;
+    static const char *const default_paths[UM_DB_FILE_COUNT] = {
+        [UM_DB_FILE_PASSWD] = "/etc/passwd",
+        [UM_DB_FILE_SHADOW] = "/etc/shadow",
+        [UM_DB_FILE_GROUP] = "/etc/group",
+        [UM_DB_FILE_GSHADOW] = "/etc/gshadow",
+    };
+
+    return default_paths[file];
 }
 
 /**
- * Free database data.
+ * Remember the current status of an account file.
  *
- * @param db Database to free.
+ * @param db Database to use.
+ * @param file Account file to check.
  *
  */
-void um_db_free(um_db_t *db)
+static void um_db_stat_source(um_db_t *db, um_db_file_t file)
 {
-    um_user_element_t *user_iter = NULL, *temp_user = NULL;
-    um_group_element_t *group_iter = NULL, *temp_group = NULL;
+    if (stat(um_db_get_path(db, file), &db->sources[file]))
+    {
+        // missing files are recorded as such
+        db->sources[file] = (struct stat){0};
+    }
+}
+
+/**
+ * Store the user in the query results if it matches the query.
+ * Criteria are checked from the cheapest - shadow data is read last.
+ *
+ * @param query Criteria to match.
+ * @param today Current day in days since the epoch.
+ * @param user User to check.
+ * @param users Array of found users.
+ * @param size Size of the users array.
+ * @param count Number of users found so far.
+ *
+ * @return Number of users found including the user.
+ *
+ */
+static size_t um_db_query_add(const um_db_user_query_t *query, long int today, um_user_t *user, um_user_t **users,
+                              size_t size, size_t count)
+{
+    unsigned int match = query->match;
+    const char *str = NULL;
+    long int expiration = 0;
 
-    LL_FOREACH_SAFE(db->user_head, user_iter, temp_user)
+    if ((match & UM_DB_QUERY_UID_RANGE) &&
+        (um_user_get_uid(user) < query->uid_min || um_user_get_uid(user) > query->uid_max))
     {
-        um_user_free(user_iter->user);
-        LL_DELETE(db->user_head, user_iter);
-        free(user_iter);
+        return count;
     }
 
-    LL_FOREACH_SAFE(db->group_head, group_iter, temp_group)
+    if ((match & UM_DB_QUERY_GID) && um_user_get_gid(user) != query->gid)
     {
-        um_group_free(group_iter->group);
-        LL_DELETE(db->group_head, group_iter);
-        free(group_iter);
+        return count;
     }
 
-    free(db);
-}
+    if ((match & UM_DB_QUERY_SHELL) && !um_db_same_string(um_user_get_shell_path(user), query->shell))
+    {
+        return count;
+    }
 
-static int um_user_element_cmp_fn(void *d1, void *d2)
-{
-    um_user_element_t *u1 = d1;
-    um_user_element_t *u2 = d2;
+    str = um_user_get_home_path(user);
+    if ((match & UM_DB_QUERY_HOME_PREFIX) && (!str || strncmp(str, query->home_prefix, strlen(query->home_prefix))))
+    {
+        return count;
+    }
 
-    return strcmp(um_user_get_name(u1->user), um_user_get_name(u2->user));
-}
+    str = (match & UM_DB_QUERY_LOCKED) ? um_user_get_password_hash(user) : NULL;
+    if ((match & UM_DB_QUERY_LOCKED) && (str && *str == '!') != query->locked)
+    {
+        return count;
+    }
 
-static int um_group_element_cmp_fn(void *d1, void *d2)
-{
-    um_group_element_t *g1 = d1;
-    um_group_element_t *g2 = d2;
+    // unset and zero expiration dates never expire
+    expiration = (match & UM_DB_QUERY_EXPIRED) ? um_user_get_expiration(user) : 0;
+    if ((match & UM_DB_QUERY_EXPIRED) && (expiration > 0 && expiration <= today) != query->expired)
+    {
+        return count;
+    }
+
+    if (count < size)
+    {
+        users[count] = user;
+    }
 
-    return strcmp(um_group_get_name(g1->group), um_group_get_name(g2->group));
+    return count + 1;
 }
\ No newline at end of file
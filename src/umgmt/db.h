@@ -16,6 +16,81 @@
 #include "types.h"
 
 #include <pwd.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Policy for choosing new UIDs and GIDs.
+ */
+typedef enum um_db_id_policy_e
+{
+    UM_DB_ID_POLICY_NEXT_MAX,    ///< One above the highest ID in use - lowest free ID once the range end is reached.
+    UM_DB_ID_POLICY_LOWEST_FREE, ///< Lowest unused ID of the range.
+} um_db_id_policy_t;
+
+/**
+ * Account files backing the database.
+ */
+typedef enum um_db_file_e
+{
+    UM_DB_FILE_PASSWD,  ///< User data - /etc/passwd by default.
+    UM_DB_FILE_SHADOW,  ///< User shadow data - /etc/shadow by default.
+    UM_DB_FILE_GROUP,   ///< Group data - /etc/group by default.
+    UM_DB_FILE_GSHADOW, ///< Group shadow data - /etc/gshadow by default.
+    UM_DB_FILE_COUNT,   ///< Number of account files.
+} um_db_file_t;
+
+/**
+ * Flags changing the behavior of um_db_load_ex().
+ */
+typedef enum um_db_load_flags_e
+{
+    UM_DB_LOAD_NATIVE = 1 << 0,       ///< Parse the account files directly instead of using NSS.
+    UM_DB_LOAD_ARENA = 1 << 1,        ///< Allocate loaded users and groups in memory chunks owned by the database.
+    UM_DB_LOAD_SKIP_SHADOW = 1 << 2,  ///< Do not read shadow and gshadow - shadow data stays unset.
+    UM_DB_LOAD_DEFER_SHADOW = 1 << 3, ///< Read shadow and gshadow on the first access to shadow data.
+    UM_DB_LOAD_PARALLEL = 1 << 4,     ///< Parse the account files directly, using multiple threads.
+} um_db_load_flags_t;
+
+/**
+ * Flags changing the behavior of um_db_store_ex().
+ */
+typedef enum um_db_store_flags_e
+{
+    UM_DB_STORE_INCREMENTAL = 1 << 0, ///< Skip account files without changed users or groups.
+    UM_DB_STORE_SORTED = 1 << 1,      ///< Write users in UID order and groups in GID order.
+} um_db_store_flags_t;
+
+/**
+ * Criteria of um_db_query_users().
+ */
+typedef enum um_db_query_match_e
+{
+    UM_DB_QUERY_UID_RANGE = 1 << 0,   ///< UID in the range [uid_min, uid_max].
+    UM_DB_QUERY_GID = 1 << 1,         ///< Primary GID equal to gid.
+    UM_DB_QUERY_SHELL = 1 << 2,       ///< Shell path equal to shell.
+    UM_DB_QUERY_HOME_PREFIX = 1 << 3, ///< Home path starting with home_prefix.
+    UM_DB_QUERY_LOCKED = 1 << 4,      ///< Password hash locked by a '!' prefix, or not if locked is false.
+    UM_DB_QUERY_EXPIRED = 1 << 5,     ///< Account expired by the day given by today, or not if expired is false.
+    UM_DB_QUERY_GROUP = 1 << 6,       ///< Member of the group named group - group admins only if also members.
+} um_db_query_match_t;
+
+/**
+ * User query - users match if they meet all the selected criteria.
+ */
+typedef struct um_db_user_query_s
+{
+    unsigned int match;      ///< Bitwise OR of um_db_query_match_t values - criteria to check.
+    uid_t uid_min;           ///< First UID of the range.
+    uid_t uid_max;           ///< Last UID of the range.
+    gid_t gid;               ///< Primary GID.
+    const char *shell;       ///< Shell path.
+    const char *home_prefix; ///< Start of the home path.
+    bool locked;             ///< Match locked users - unlocked users if false.
+    bool expired;            ///< Match expired accounts - accounts which did not expire if false.
+    long int today;          ///< Current day in days since the epoch - 0 to use the system time.
+    const char *group;       ///< Name of the group.
+} um_db_user_query_t;
 
 /**
  * Allocate new database.
@@ -27,6 +102,7 @@ um_db_t *um_db_new(void);
 
 /**
  * Load database from the system.
+ * Data is read using the NSS functions - same as um_db_load_ex() without flags.
  *
  * @param db Database to load.
  *
@@ -35,8 +111,40 @@ um_db_t *um_db_new(void);
  */
 int um_db_load(um_db_t *db);
 
+/**
+ * Load database from the system.
+ * Shadow and gshadow entries are merged using the name index, so loading takes time linear in the total size of
+ * the account files: O(users + groups + group members and admins).
+ *
+ * By default the data is read using the getpwent() family of functions. With UM_DB_LOAD_NATIVE the account files are
+ * mapped and parsed directly, which avoids NSS and the copies made by libc, but only sees the local files. Databases
+ * with paths changed by um_db_set_root() or um_db_set_path() are always loaded this way.
+ *
+ * With UM_DB_LOAD_ARENA loaded users and groups, their strings, list nodes and member/admin elements are allocated in
+ * large chunks owned by the database, which are released only by um_db_free(). Memory of such users and groups
+ * deleted or modified later is not reused until then.
+ *
+ * Passwords, shells and password hash placeholders repeated across records (such as "x", "/bin/bash" or "!") are
+ * stored once per database - also when they are set later on users and groups in the database.
+ *
+ * Shadow and gshadow are not needed for names, IDs, home directories and shells, and reading them requires root
+ * privileges. UM_DB_LOAD_SKIP_SHADOW leaves them out - shadow fields and group admins stay unset and the files can
+ * not be stored. UM_DB_LOAD_DEFER_SHADOW reads each of them once, on the first use of a shadow getter or setter of a
+ * loaded user or group, or when the file is stored. With either flag group members are taken from the group file.
+ *
+ * UM_DB_LOAD_PARALLEL parses the account files directly in multiple threads - see um_db_set_load_threads().
+ *
+ * @param db Database to load.
+ * @param flags Bitwise OR of um_db_load_flags_t values.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_db_load_ex(um_db_t *db, unsigned int flags);
+
 /**
  * Store database to the system.
+ * All account files are rewritten - same as um_db_store_ex() without flags.
  *
  * @param db Database to store.
  *
@@ -45,29 +153,224 @@ int um_db_load(um_db_t *db);
  */
 int um_db_store(um_db_t *db);
 
+/**
+ * Store database to the system.
+ * Each file is written to a temporary file in the same directory, synced to disk and renamed over the original, so
+ * readers never see a partially written file and a failed store leaves the original files in place. Previous
+ * contents are kept as backup files with a '-' suffix, same as in shadow-utils. Each directory containing the files
+ * is synced once after all files are renamed.
+ *
+ * With UM_DB_STORE_INCREMENTAL only the files containing users or groups changed since the last load or store are
+ * rewritten, files without changes are not touched at all.
+ *
+ * With UM_DB_STORE_SORTED users are written in UID order and groups in GID order, which keeps the files stable for
+ * diffs. Records sharing an ID keep their list order. The list order in the database is not changed.
+ *
+ * Shadow data deferred by UM_DB_LOAD_DEFER_SHADOW is read before its files are written. Storing fails if the
+ * shadow or gshadow file has to be written but was skipped or could not be read.
+ *
+ * @param db Database to store.
+ * @param flags Bitwise OR of um_db_store_flags_t values.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_db_store_ex(um_db_t *db, unsigned int flags);
+
+/**
+ * Reload account files changed since the database was last loaded, stored or refreshed.
+ * Files are compared by device, inode, size and modification time, and only the changed files are read again.
+ * Users and groups which are still in the files are updated in place - pointers to them and to their unchanged
+ * strings stay valid. Users and groups removed from the files are deleted.
+ *
+ * Changing passwd also reads shadow, group and gshadow again, since records of new users are merged from them.
+ * Changing group also reads gshadow. Files not read by the load because of UM_DB_LOAD_SKIP_SHADOW or
+ * UM_DB_LOAD_DEFER_SHADOW are not read by the refresh either.
+ *
+ * Once um_db_watch() is used, files are checked only after the watch reported a change in their directories.
+ *
+ * @param db Database to refresh.
+ * @param changed Set to true if any file was read again - can be NULL.
+ *
+ * @return Error code - 0 on success, -1 if the database has unstored changes or a file could not be read. After a
+ * read failure the database can be partially refreshed and the failed files are read again by the next refresh.
+ *
+ */
+int um_db_refresh(um_db_t *db, bool *changed);
+
+/**
+ * Watch the directories of the account files for changes using inotify.
+ * The returned descriptor becomes readable when any of the files may have changed and can be polled by the caller
+ * before calling um_db_refresh(), which also consumes the pending events. The descriptor is owned by the database and
+ * closed by um_db_free() - calling the function again replaces it, which is needed after changing the file paths.
+ *
+ * @param db Database to use.
+ *
+ * @return Watch descriptor - -1 on failure.
+ *
+ */
+int um_db_watch(um_db_t *db);
+
 /**
  * Return the new UID which can be used for a new user.
+ * The UID is chosen from the UID range according to the ID policy. UIDs changed by um_user_set_uid() on stored users
+ * are taken into account.
  *
  * @param db Database to use.
  *
- * @return New UID.
+ * @return New UID - (uid_t)-1 if the range is exhausted or on allocation failure.
  *
  */
 uid_t um_db_get_new_uid(um_db_t *db);
 
 /**
  * Return the new GID which can be used for a new user/group.
+ * The GID is chosen from the GID range according to the ID policy, considering GIDs of all groups - including GIDs
+ * changed by um_group_set_gid() on stored groups.
  *
  * @param db Database to use.
  *
- * @return New GID.
+ * @return New GID - (gid_t)-1 if the range is exhausted or on allocation failure.
  *
  */
 gid_t um_db_get_new_gid(um_db_t *db);
 
+/**
+ * Set the policy used for choosing new UIDs and GIDs.
+ *
+ * @param db Database to use.
+ * @param policy Policy to set - UM_DB_ID_POLICY_NEXT_MAX by default.
+ *
+ */
+void um_db_set_id_policy(um_db_t *db, um_db_id_policy_t policy);
+
+/**
+ * Set the range new UIDs are chosen from - [1000, 65533] by default.
+ *
+ * @param db Database to use.
+ * @param min First UID of the range.
+ * @param max Last UID of the range.
+ *
+ * @return Error code - 0 on success, -1 if the range is empty or larger than 2^24 IDs.
+ *
+ */
+int um_db_set_uid_range(um_db_t *db, uid_t min, uid_t max);
+
+/**
+ * Set the range new GIDs are chosen from - [1000, 65533] by default.
+ *
+ * @param db Database to use.
+ * @param min First GID of the range.
+ * @param max Last GID of the range.
+ *
+ * @return Error code - 0 on success, -1 if the range is empty or larger than 2^24 IDs.
+ *
+ */
+int um_db_set_gid_range(um_db_t *db, gid_t min, gid_t max);
+
+/**
+ * Set the number of threads used by um_db_load_ex() with UM_DB_LOAD_PARALLEL.
+ * The four account files are parsed concurrently and files larger than 1 MiB are split into chunks at line
+ * boundaries, one per thread at most. Records are merged in file order, so the result is the same as with a
+ * sequential load.
+ *
+ * @param db Database to use.
+ * @param threads Maximum number of threads including the calling one - 0 for the number of online CPUs (default).
+ *
+ */
+void um_db_set_load_threads(um_db_t *db, unsigned int threads);
+
+/**
+ * Set the root directory for the account files of the database.
+ * Files are loaded from and stored to the usual /etc paths under the root - useful for chroots and container images.
+ *
+ * @param db Database to use.
+ * @param root Root directory - NULL to use the system files.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_db_set_root(um_db_t *db, const char *root);
+
+/**
+ * Set the path of a single account file of the database.
+ *
+ * @param db Database to use.
+ * @param file Account file to set the path for.
+ * @param path Path of the file - NULL to use the system file.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_db_set_path(um_db_t *db, um_db_file_t file, const char *path);
+
+/**
+ * Get the path of an account file of the database.
+ *
+ * @param db Database to use.
+ * @param file Account file to get the path for.
+ *
+ * @return Path of the file.
+ *
+ */
+const char *um_db_get_path(const um_db_t *db, um_db_file_t file);
+
+/**
+ * Reserve UIDs for users which will be added later.
+ * Reserved UIDs are skipped by um_db_get_new_uid() and further reservations until a user with the UID is added or the
+ * UID is released. All UIDs are chosen in a single pass over the UID pool.
+ *
+ * @param db Database to use.
+ * @param uids Array to fill with reserved UIDs.
+ * @param count Number of UIDs to reserve.
+ * @param contiguous Reserve a single run of consecutive UIDs - otherwise UIDs are chosen according to the ID policy.
+ *
+ * @return Error code - 0 on success, -1 if not enough UIDs are free or on allocation failure - nothing is reserved.
+ *
+ */
+int um_db_reserve_uids(um_db_t *db, uid_t *uids, size_t count, bool contiguous);
+
+/**
+ * Reserve GIDs for groups which will be added later.
+ * Reserved GIDs are skipped by um_db_get_new_gid() and further reservations until a group with the GID is added or the
+ * GID is released. All GIDs are chosen in a single pass over the GID pool.
+ *
+ * @param db Database to use.
+ * @param gids Array to fill with reserved GIDs.
+ * @param count Number of GIDs to reserve.
+ * @param contiguous Reserve a single run of consecutive GIDs - otherwise GIDs are chosen according to the ID policy.
+ *
+ * @return Error code - 0 on success, -1 if not enough GIDs are free or on allocation failure - nothing is reserved.
+ *
+ */
+int um_db_reserve_gids(um_db_t *db, gid_t *gids, size_t count, bool contiguous);
+
+/**
+ * Release reserved UIDs which were not used for new users.
+ * UIDs which are not reserved are ignored.
+ *
+ * @param db Database to use.
+ * @param uids UIDs to release.
+ * @param count Number of UIDs.
+ *
+ */
+void um_db_release_uids(um_db_t *db, const uid_t *uids, size_t count);
+
+/**
+ * Release reserved GIDs which were not used for new groups.
+ * GIDs which are not reserved are ignored.
+ *
+ * @param db Database to use.
+ * @param gids GIDs to release.
+ * @param count Number of GIDs.
+ *
+ */
+void um_db_release_gids(um_db_t *db, const gid_t *gids, size_t count);
+
 /**
  * Add a new user to the database.
  * User will be handled by the database from this point on - do not free user data after adding user to the database.
+ * Users without a name or with a name already present in the database are rejected and freed.
  *
  * @param db Database to use.
  * @param user User to search for.
@@ -80,6 +383,7 @@ int um_db_add_user(um_db_t *db, um_user_t *user);
 /**
  * Add a new group to the database.
  * Group will be handled by the database from this point on - do not free group data after adding user to the database.
+ * Groups without a name or with a name already present in the database are rejected and freed.
  *
  * @param db Database to use.
  * @param group Group to add.
@@ -89,8 +393,39 @@ int um_db_add_user(um_db_t *db, um_user_t *user);
  */
 int um_db_add_group(um_db_t *db, um_group_t *group);
 
+/**
+ * Add multiple users to the database.
+ * Nodes for the whole batch are allocated at once and indexes are updated in the same pass. Added users are handled by
+ * the database from this point on. Users which could not be added stay owned by the caller.
+ *
+ * @param db Database to use.
+ * @param users Users to add.
+ * @param count Number of users.
+ * @param errors Array of count per-user error codes - 0 if the user was added, can be NULL.
+ *
+ * @return Error code - 0 if all users were added, -1 if any of them failed.
+ *
+ */
+int um_db_add_users(um_db_t *db, um_user_t **users, size_t count, int *errors);
+
+/**
+ * Add multiple groups to the database.
+ * Nodes for the whole batch are allocated at once and indexes are updated in the same pass. Added groups are handled
+ * by the database from this point on. Groups which could not be added stay owned by the caller.
+ *
+ * @param db Database to use.
+ * @param groups Groups to add.
+ * @param count Number of groups.
+ * @param errors Array of count per-group error codes - 0 if the group was added, can be NULL.
+ *
+ * @return Error code - 0 if all groups were added, -1 if any of them failed.
+ *
+ */
+int um_db_add_groups(um_db_t *db, um_group_t **groups, size_t count, int *errors);
+
 /**
  * Get the user from the database.
+ * Lookup is done using the name index in constant time.
  *
  * @param db Database to use.
  * @param name User to search for.
@@ -102,6 +437,7 @@ um_user_t *um_db_get_user(um_db_t *db, const char *name);
 
 /**
  * Get the group from the database.
+ * Lookup is done using the name index in constant time.
  *
  * @param db Database to use.
  * @param name Group to search for.
@@ -111,8 +447,123 @@ um_user_t *um_db_get_user(um_db_t *db, const char *name);
  */
 um_group_t *um_db_get_group(um_db_t *db, const char *name);
 
+/**
+ * Get the user with the given UID from the database.
+ * If more users share the UID, the first one in list order is returned - same as getpwuid().
+ *
+ * @param db Database to use.
+ * @param uid UID to search for.
+ *
+ * @return Abstract user type - NULL if not found.
+ *
+ */
+um_user_t *um_db_get_user_by_uid(um_db_t *db, uid_t uid);
+
+/**
+ * Get the group with the given GID from the database.
+ * If more groups share the GID, the first one in list order is returned - same as getgrgid().
+ *
+ * @param db Database to use.
+ * @param gid GID to search for.
+ *
+ * @return Abstract group type - NULL if not found.
+ *
+ */
+um_group_t *um_db_get_group_by_gid(um_db_t *db, gid_t gid);
+
+/**
+ * Get all users with the given UID from the database, in list order.
+ *
+ * @param db Database to use.
+ * @param uid UID to search for.
+ * @param users Array to fill with found users - can be NULL if size is 0.
+ * @param size Size of the users array.
+ *
+ * @return Number of users with the given UID - can be larger than size, in which case only size users are stored.
+ *
+ */
+size_t um_db_get_users_by_uid(um_db_t *db, uid_t uid, um_user_t **users, size_t size);
+
+/**
+ * Get all groups with the given GID from the database, in list order.
+ *
+ * @param db Database to use.
+ * @param gid GID to search for.
+ * @param groups Array to fill with found groups - can be NULL if size is 0.
+ * @param size Size of the groups array.
+ *
+ * @return Number of groups with the given GID - can be larger than size, in which case only size groups are stored.
+ *
+ */
+size_t um_db_get_groups_by_gid(um_db_t *db, gid_t gid, um_group_t **groups, size_t size);
+
+/**
+ * Find users matching the query, without allocations.
+ * Indexes are used where the query allows it - group queries check only the members of the group, UID ranges are
+ * looked up in the ordered UID index and returned in UID order. Other queries check all users in list order.
+ * Group queries match the member list only - admins of the group listed in gshadow do not match unless they are also
+ * members, same as for the supplementary groups of a user.
+ *
+ * @param db Database to use.
+ * @param query Criteria to match.
+ * @param users Array to fill with found users - can be NULL if size is 0.
+ * @param size Size of the users array.
+ *
+ * @return Number of matching users - can be larger than size, in which case only size users are stored.
+ *
+ */
+size_t um_db_query_users(um_db_t *db, const um_db_user_query_t *query, um_user_t **users, size_t size);
+
+/**
+ * Get all users with UIDs in the range from the database, sorted by UID and in list order for equal UIDs.
+ * Users are found in the ordered UID index in O(log n + k) time - the index is rebuilt on first use after UIDs were
+ * added to or removed from the database.
+ *
+ * @param db Database to use.
+ * @param min First UID of the range.
+ * @param max Last UID of the range.
+ * @param users Array to fill with found users - can be NULL if size is 0.
+ * @param size Size of the users array.
+ * @param count Set to the number of users in the range - can be larger than size, only size users are stored.
+ *
+ * @return Error code - 0 on success, -1 if the index could not be built.
+ *
+ */
+int um_db_get_users_by_uid_range(um_db_t *db, uid_t min, uid_t max, um_user_t **users, size_t size, size_t *count);
+
+/**
+ * Get all groups with GIDs in the range from the database, sorted by GID and in list order for equal GIDs.
+ * Groups are found in the ordered GID index in O(log n + k) time - the index is rebuilt on first use after GIDs were
+ * added to or removed from the database.
+ *
+ * @param db Database to use.
+ * @param min First GID of the range.
+ * @param max Last GID of the range.
+ * @param groups Array to fill with found groups - can be NULL if size is 0.
+ * @param size Size of the groups array.
+ * @param count Set to the number of groups in the range - can be larger than size, only size groups are stored.
+ *
+ * @return Error code - 0 on success, -1 if the index could not be built.
+ *
+ */
+int um_db_get_groups_by_gid_range(um_db_t *db, gid_t min, gid_t max, um_group_t **groups, size_t size, size_t *count);
+
+/**
+ * Get the list of groups the user is a member or an admin of.
+ * Each element holds the group and its role, the list is linked using the user_next link. Lookup takes time
+ * proportional to the number of the user's groups.
+ *
+ * @param db Database to use.
+ * @param name User to search for.
+ *
+ * @return Group list head - NULL if the user is not found or has no groups.
+ *
+ */
+const um_group_user_element_t *um_db_get_user_groups(const um_db_t *db, const char *name);
+
 /**
  * Delete user from the database.
+ * The user is also removed from all groups it belongs to, in time proportional to the number of its groups.
  *
  * @param db Database to use.
  * @param name User to search for.
@@ -133,6 +584,18 @@ int um_db_delete_user(um_db_t *db, const char *name);
  */
 int um_db_delete_group(um_db_t *db, const char *name);
 
+/**
+ * Rebuild database indexes from the user and group lists.
+ * Setters of stored users and groups keep the indexes in sync - this is only needed after a setter failed to update
+ * them.
+ *
+ * @param db Database to use.
+ *
+ * @return Error code - 0 on success, -1 if a name is missing or duplicated after the change.
+ *
+ */
+int um_db_reindex(um_db_t *db);
+
 /**
  * Get users list head.
  *
@@ -0,0 +1,68 @@
+/**
+ * @file deferred.h
+ * @brief Internal API for shadow data read on first access.
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#ifndef UMGMT_DEFERRED_H
+#define UMGMT_DEFERRED_H
+
+#include "types.h"
+
+/**
+ * Read account files deferred by UM_DB_LOAD_DEFER_SHADOW into the users and groups loaded with the database.
+ * Each file is read at most once - files which failed to load stay unavailable.
+ *
+ * @param db Database to use.
+ * @param files Dirty mask bits of the files to read - UM_DIRTY_SHADOW and UM_DIRTY_GSHADOW.
+ *
+ * @return Error code - 0 on success, -1 if any of the files is unavailable.
+ *
+ */
+int um_db_load_deferred(um_db_t *db, unsigned int files);
+
+/**
+ * Set the database which holds deferred shadow data of the user.
+ *
+ * @param user User to use.
+ * @param db Database to read the data from on first access - NULL once the user does not wait for any data.
+ *
+ */
+void um_user_set_deferred(um_user_t *user, um_db_t *db);
+
+/**
+ * Get the database which holds deferred shadow data of the user.
+ *
+ * @param user User to use.
+ *
+ * @return Database set by um_user_set_deferred().
+ *
+ */
+um_db_t *um_user_get_deferred(const um_user_t *user);
+
+/**
+ * Set the database which holds deferred gshadow data of the group.
+ *
+ * @param group Group to use.
+ * @param db Database to read the data from on first access - NULL once the group does not wait for any data.
+ *
+ */
+void um_group_set_deferred(um_group_t *group, um_db_t *db);
+
+/**
+ * Get the database which holds deferred gshadow data of the group.
+ *
+ * @param group Group to use.
+ *
+ * @return Database set by um_group_set_deferred().
+ *
+ */
+um_db_t *um_group_get_deferred(const um_group_t *group);
+
+#endif // UMGMT_DEFERRED_H
\ No newline at end of file
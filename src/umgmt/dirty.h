@@ -0,0 +1,80 @@
+/**
+ * @file dirty.h
+ * @brief Internal API for tracking modified users and groups.
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#ifndef UMGMT_DIRTY_H
+#define UMGMT_DIRTY_H
+
+#include "types.h"
+
+/**
+ * Dirty mask bits - account files which need to be rewritten because of a change.
+ */
+#define UM_DIRTY_PASSWD (1U << 0)
+#define UM_DIRTY_SHADOW (1U << 1)
+#define UM_DIRTY_GROUP (1U << 2)
+#define UM_DIRTY_GSHADOW (1U << 3)
+
+/**
+ * Get the mask of account files changed since the user was last stored.
+ *
+ * @param user User to use.
+ *
+ * @return Dirty mask.
+ *
+ */
+unsigned int um_user_get_dirty(const um_user_t *user);
+
+/**
+ * Clear the dirty mask of the user.
+ *
+ * @param user User to use.
+ *
+ */
+void um_user_clear_dirty(um_user_t *user);
+
+/**
+ * Mark account files of the user as changed.
+ *
+ * @param user User to use.
+ * @param mask Dirty mask bits to set.
+ *
+ */
+void um_user_set_dirty(um_user_t *user, unsigned int mask);
+
+/**
+ * Mark account files of the group as changed.
+ *
+ * @param group Group to use.
+ * @param mask Dirty mask bits to set.
+ *
+ */
+void um_group_set_dirty(um_group_t *group, unsigned int mask);
+
+/**
+ * Get the mask of account files changed since the group was last stored.
+ *
+ * @param group Group to use.
+ *
+ * @return Dirty mask.
+ *
+ */
+unsigned int um_group_get_dirty(const um_group_t *group);
+
+/**
+ * Clear the dirty mask of the group.
+ *
+ * @param group Group to use.
+ *
+ */
+void um_group_clear_dirty(um_group_t *group);
+
+#endif // UMGMT_DIRTY_H
\ No newline at end of file
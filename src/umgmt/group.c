@@ -9,6 +9,15 @@
  *     https://opensource.org/licenses/BSD-3-Clause
  */
 #include "group.h"
+#include "arena.h"
+#include "deferred.h"
+#include "owner.h"
+#include "dirty.h"
+#include "intern.h"
+#include "membership.h"
+#include "user.h"
+#include "parser.h"
+#include "db.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -30,8 +39,35 @@ struct um_group_s
     char *password;
     gid_t gid;
     um_gshadow_data_t gshadow;
+    unsigned int dirty;
+    um_arena_t *arena;
+    um_intern_t *intern;
+    um_db_t *deferred;
+    um_db_t *owner;
 };
 
+/**
+ * Group cursor - the group view is reused for every group.
+ */
+struct um_group_iter_s
+{
+    um_parser_t group;   ///< Streamed group file.
+    um_parser_t gshadow; ///< Streamed gshadow file.
+    bool has_gshadow;    ///< Gshadow file is read.
+    size_t gshadow_pos;  ///< Number of gshadow records read since the start of the file.
+    um_group_t view;     ///< View of the current group.
+    char **members;      ///< Member names of the current group.
+    char **admins;       ///< Admin names of the current group.
+};
+
+static int um_group_add_user_element(um_group_t *group, um_group_user_element_t **head, um_user_t *user, bool admin);
+static int um_group_remove_user_element(um_group_t *group, const um_user_t *user, bool admin);
+static char *um_group_strdup(um_group_t *group, const char *str);
+static void um_group_release(um_group_t *group, char *str);
+static char *um_group_share(um_group_t *group, const char *str);
+static void um_group_load_deferred(const um_group_t *group);
+static int um_group_iter_find_gshadow(um_group_iter_t *iter, const char *name, struct sgrp *sgrp);
+
 /**
  * Allocate new group.
  *
@@ -51,6 +87,31 @@ um_group_t *um_group_new(void)
     return new_group;
 }
 
+/**
+ * Allocate new group in the arena.
+ * Strings set on the group and member/admin elements are allocated in the arena as well and nothing is freed before
+ * the arena itself.
+ *
+ * @param arena Arena to use.
+ *
+ * @return New allocated group.
+ *
+ */
+um_group_t *um_group_new_in(um_arena_t *arena)
+{
+    um_group_t *new_group = (um_group_t *)um_arena_alloc(arena, sizeof(um_group_t));
+
+    if (!new_group)
+    {
+        return NULL;
+    }
+
+    *new_group = (um_group_t){0};
+    new_group->arena = arena;
+
+    return new_group;
+}
+
 /**
  * Set the name for the group.
  *
@@ -62,21 +123,38 @@ um_group_t *um_group_new(void)
  */
 int um_group_set_name(um_group_t *group, const char *name)
 {
-    if (group->name)
-    {
-        free(group->name);
-        group->name = 0;
-    }
+    char *new_name = NULL;
+
+    // deferred records are matched by name
+    um_group_load_deferred(group);
 
     if (name)
     {
-        group->name = strdup(name);
-        if (!group->name)
+        new_name = um_group_strdup(group, name);
+        if (!new_name)
         {
             return -1;
         }
     }
 
+    // the name index of the database is moved to the new name while the old one can still be found
+    if (group->owner && um_db_rekey_group(group->owner, group, new_name, group->gid))
+    {
+        if (new_name)
+        {
+            um_group_release(group, new_name);
+        }
+        return -1;
+    }
+
+    group->dirty |= UM_DIRTY_GROUP | UM_DIRTY_GSHADOW;
+
+    if (group->name)
+    {
+        um_group_release(group, group->name);
+    }
+    group->name = new_name;
+
     return 0;
 }
 
@@ -91,15 +169,17 @@ int um_group_set_name(um_group_t *group, const char *name)
  */
 int um_group_set_password(um_group_t *group, const char *password)
 {
+    group->dirty |= UM_DIRTY_GROUP;
+
     if (group->password)
     {
-        free(group->password);
+        um_group_release(group, group->password);
         group->password = 0;
     }
 
     if (password)
     {
-        group->password = strdup(password);
+        group->password = um_group_share(group, password);
         if (!group->password)
         {
             return -1;
@@ -115,10 +195,20 @@ int um_group_set_password(um_group_t *group, const char *password)
  * @param group Group to use.
  * @param gid GID to set.
  *
+ * @return Error code - 0 on success, -1 if the GID index of the database storing the group could not be updated.
+ *
  */
-void um_group_set_gid(um_group_t *group, gid_t gid)
+int um_group_set_gid(um_group_t *group, gid_t gid)
 {
+    if (group->owner && um_db_rekey_group(group->owner, group, group->name, gid))
+    {
+        return -1;
+    }
+
+    group->dirty |= UM_DIRTY_GROUP;
     group->gid = gid;
+
+    return 0;
 }
 
 /**
@@ -132,15 +222,20 @@ void um_group_set_gid(um_group_t *group, gid_t gid)
  */
 int um_group_set_password_hash(um_group_t *group, const char *password_hash)
 {
+    um_group_load_deferred(group);
+    group->dirty |= UM_DIRTY_GSHADOW;
+
     if (group->gshadow.password_hash)
     {
-        free(group->gshadow.password_hash);
+        um_group_release(group, group->gshadow.password_hash);
         group->gshadow.password_hash = 0;
     }
 
     if (password_hash)
     {
-        group->gshadow.password_hash = strdup(password_hash);
+        // only placeholders such as "!" or "*" repeat across records, real hashes are salted
+        group->gshadow.password_hash =
+            strchr(password_hash, '$') ? um_group_strdup(group, password_hash) : um_group_share(group, password_hash);
         if (!group->gshadow.password_hash)
         {
             return -1;
@@ -152,6 +247,7 @@ int um_group_set_password_hash(um_group_t *group, const char *password_hash)
 
 /**
  * Add user to the group member list.
+ * The group is also added to the user's group list.
  *
  * @param group Group to use.
  * @param user User to add as a member.
@@ -159,26 +255,14 @@ int um_group_set_password_hash(um_group_t *group, const char *password_hash)
  * @return Error code - 0 on success.
  *
  */
-int um_group_add_member(um_group_t *group, const um_user_t *user)
+int um_group_add_member(um_group_t *group, um_user_t *user)
 {
-    um_group_user_element_t *new_element = (um_group_user_element_t *)malloc(sizeof(um_group_user_element_t));
-
-    if (!new_element)
-    {
-        return -1;
-    }
-
-    new_element->user = user;
-    new_element->next = NULL;
-
-    // add to both lists
-    LL_APPEND(group->gshadow.members_head, new_element);
-
-    return 0;
+    return um_group_add_user_element(group, &group->gshadow.members_head, user, false);
 }
 
 /**
  * Add user to the group admin list.
+ * The group is also added to the user's group list.
  *
  * @param group Group to use.
  * @param user User to add as a admin.
@@ -186,21 +270,45 @@ int um_group_add_member(um_group_t *group, const um_user_t *user)
  * @return Error code - 0 on success.
  *
  */
-int um_group_add_admin(um_group_t *group, const um_user_t *user)
+int um_group_add_admin(um_group_t *group, um_user_t *user)
 {
-    um_group_user_element_t *new_element = (um_group_user_element_t *)malloc(sizeof(um_group_user_element_t));
+    um_group_load_deferred(group);
 
-    if (!new_element)
-    {
-        return -1;
-    }
+    return um_group_add_user_element(group, &group->gshadow.admin_head, user, true);
+}
 
-    new_element->user = user;
-    new_element->next = NULL;
+/**
+ * Remove user from the group member list.
+ * The element is found by walking the user's group list, so removal takes O(groups of the user) time and does not
+ * depend on the group size.
+ *
+ * @param group Group to use.
+ * @param user User to remove.
+ *
+ * @return Error code - 0 on success, -1 if the user is not a member of the group.
+ *
+ */
+int um_group_remove_member(um_group_t *group, const um_user_t *user)
+{
+    return um_group_remove_user_element(group, user, false);
+}
 
-    LL_APPEND(group->gshadow.admin_head, new_element);
+/**
+ * Remove user from the group admin list.
+ * The element is found by walking the user's group list, so removal takes O(groups of the user) time and does not
+ * depend on the group size.
+ *
+ * @param group Group to use.
+ * @param user User to remove.
+ *
+ * @return Error code - 0 on success, -1 if the user is not an admin of the group.
+ *
+ */
+int um_group_remove_admin(um_group_t *group, const um_user_t *user)
+{
+    um_group_load_deferred(group);
 
-    return 0;
+    return um_group_remove_user_element(group, user, true);
 }
 
 /**
@@ -252,6 +360,8 @@ gid_t um_group_get_gid(const um_group_t *group)
  */
 const char *um_group_get_password_hash(const um_group_t *group)
 {
+    um_group_load_deferred(group);
+
     return group->gshadow.password_hash;
 }
 
@@ -278,9 +388,154 @@ const um_group_user_element_t *um_group_get_members_head(const um_group_t *group
  */
 const um_group_user_element_t *um_group_get_admin_head(const um_group_t *group)
 {
+    um_group_load_deferred(group);
+
     return group->gshadow.admin_head;
 }
 
+/**
+ * Open a cursor over the groups in the account files of the database, without loading the database.
+ * Only the paths of the database are used - see um_db_set_root() and um_db_set_path(). Files are read incrementally
+ * through fixed size buffers, so the memory used does not depend on the number of groups.
+ *
+ * Gshadow records are matched by name while reading - in constant time if gshadow lists the groups in the same order
+ * as group, and by a pass over gshadow otherwise.
+ *
+ * @param db Database with the paths of the account files.
+ * @param flags UM_DB_LOAD_SKIP_SHADOW to read only group - gshadow fields stay unset, other flags are ignored.
+ *
+ * @return New cursor - NULL if the files can not be opened.
+ *
+ */
+um_group_iter_t *um_group_iter_open(const um_db_t *db, unsigned int flags)
+{
+    um_group_iter_t *iter = (um_group_iter_t *)malloc(sizeof(um_group_iter_t));
+
+    if (!iter)
+    {
+        return NULL;
+    }
+
+    *iter = (um_group_iter_t){0};
+
+    if (um_parser_open_stream(&iter->group, um_db_get_path(db, UM_DB_FILE_GROUP)))
+    {
+        free(iter);
+        return NULL;
+    }
+
+    if (!(flags & UM_DB_LOAD_SKIP_SHADOW))
+    {
+        if (um_parser_open_stream(&iter->gshadow, um_db_get_path(db, UM_DB_FILE_GSHADOW)))
+        {
+            um_parser_close(&iter->group);
+            free(iter);
+            return NULL;
+        }
+        iter->has_gshadow = true;
+    }
+
+    return iter;
+}
+
+/**
+ * Read the next group.
+ * The group is a borrowed view valid until the next call or closing the cursor - it must not be modified, freed or
+ * added to a database. Its member and admin lists are empty, names are available through um_group_iter_get_members()
+ * and um_group_iter_get_admins().
+ *
+ * @param iter Cursor to use.
+ * @param group Set to the next group.
+ *
+ * @return 1 if a group was read, 0 after the last group, -1 on failure.
+ *
+ */
+int um_group_iter_next(um_group_iter_t *iter, const um_group_t **group)
+{
+    static char *empty[] = {NULL};
+    struct group grp = {0};
+    struct sgrp sgrp = {0};
+    int result = um_parser_next_group(&iter->group, &grp);
+
+    *group = NULL;
+
+    if (result <= 0)
+    {
+        return (result < 0 || iter->group.failed) ? -1 : 0;
+    }
+
+    // the view points into the read buffers
+    iter->view = (um_group_t){
+        .name = grp.gr_name,
+        .password = grp.gr_passwd,
+        .gid = grp.gr_gid,
+    };
+    iter->members = grp.gr_mem;
+    iter->admins = empty;
+
+    if (iter->has_gshadow)
+    {
+        result = um_group_iter_find_gshadow(iter, grp.gr_name, &sgrp);
+        if (result < 0)
+        {
+            return -1;
+        }
+
+        if (result > 0)
+        {
+            iter->view.gshadow.password_hash = sgrp.sg_passwd;
+            iter->members = sgrp.sg_mem;
+            iter->admins = sgrp.sg_adm;
+        }
+    }
+
+    *group = &iter->view;
+
+    return 1;
+}
+
+/**
+ * Get member names of the group read last - from gshadow if the group has a gshadow record.
+ *
+ * @param iter Cursor to use.
+ *
+ * @return NULL terminated name list valid until the next call of um_group_iter_next().
+ *
+ */
+const char *const *um_group_iter_get_members(const um_group_iter_t *iter)
+{
+    return (const char *const *)iter->members;
+}
+
+/**
+ * Get admin names of the group read last.
+ *
+ * @param iter Cursor to use.
+ *
+ * @return NULL terminated name list valid until the next call of um_group_iter_next().
+ *
+ */
+const char *const *um_group_iter_get_admins(const um_group_iter_t *iter)
+{
+    return (const char *const *)iter->admins;
+}
+
+/**
+ * Close the cursor and the account files.
+ *
+ * @param iter Cursor to close.
+ *
+ */
+void um_group_iter_close(um_group_iter_t *iter)
+{
+    um_parser_close(&iter->group);
+    if (iter->has_gshadow)
+    {
+        um_parser_close(&iter->gshadow);
+    }
+    free(iter);
+}
+
 /**
  * Free group data.
  *
@@ -291,32 +546,345 @@ void um_group_free(um_group_t *group)
 {
     um_group_user_element_t *iter = NULL, *tmp = NULL;
 
+    DL_FOREACH_SAFE(group->gshadow.members_head, iter, tmp)
+    {
+        um_group_drop_membership(iter);
+    }
+
+    DL_FOREACH_SAFE(group->gshadow.admin_head, iter, tmp)
+    {
+        um_group_drop_membership(iter);
+    }
+
+    // arena data is released together with the arena
+    if (group->arena)
+    {
+        return;
+    }
+
     if (group->name)
     {
-        free(group->name);
+        um_group_release(group, group->name);
     }
 
     if (group->password)
     {
-        free(group->password);
+        um_group_release(group, group->password);
     }
 
     if (group->gshadow.password_hash)
     {
-        free(group->gshadow.password_hash);
+        um_group_release(group, group->gshadow.password_hash);
     }
 
-    LL_FOREACH_SAFE(group->gshadow.members_head, iter, tmp)
+    free(group);
+}
+
+/**
+ * Remove group member/admin element from both the group and the user and free it.
+ *
+ * @param element Element to remove.
+ *
+ */
+void um_group_drop_membership(um_group_user_element_t *element)
+{
+    um_gshadow_data_t *gshadow = &element->group->gshadow;
+
+    if (element->admin)
     {
-        LL_DELETE(group->gshadow.members_head, iter);
-        free(iter);
+        DL_DELETE(gshadow->admin_head, element);
+    }
+    else
+    {
+        DL_DELETE(gshadow->members_head, element);
     }
 
-    LL_FOREACH_SAFE(group->gshadow.admin_head, iter, tmp)
+    um_user_unlink_membership(element);
+    element->group->dirty |= element->admin ? UM_DIRTY_GSHADOW : UM_DIRTY_GROUP | UM_DIRTY_GSHADOW;
+
+    if (!element->group->arena)
     {
-        LL_DELETE(group->gshadow.admin_head, iter);
-        free(iter);
+        free(element);
     }
+}
 
-    free(group);
+/**
+ * Mark account files of the group as changed.
+ *
+ * @param group Group to use.
+ * @param mask Dirty mask bits to set.
+ *
+ */
+void um_group_set_dirty(um_group_t *group, unsigned int mask)
+{
+    group->dirty |= mask;
+}
+
+/**
+ * Get the mask of account files changed since the group was last stored.
+ *
+ * @param group Group to use.
+ *
+ * @return Dirty mask.
+ *
+ */
+unsigned int um_group_get_dirty(const um_group_t *group)
+{
+    return group->dirty;
+}
+
+/**
+ * Clear the dirty mask of the group.
+ *
+ * @param group Group to use.
+ *
+ */
+void um_group_clear_dirty(um_group_t *group)
+{
+    group->dirty = 0;
+}
+
+/**
+ * Set the database which holds deferred gshadow data of the group.
+ *
+ * @param group Group to use.
+ * @param db Database to read the data from on first access - NULL once the group does not wait for any data.
+ *
+ */
+void um_group_set_deferred(um_group_t *group, um_db_t *db)
+{
+    group->deferred = db;
+}
+
+/**
+ * Get the database which holds deferred gshadow data of the group.
+ *
+ * @param group Group to use.
+ *
+ * @return Database set by um_group_set_deferred().
+ *
+ */
+um_db_t *um_group_get_deferred(const um_group_t *group)
+{
+    return group->deferred;
+}
+
+/**
+ * Set the database which stores the group.
+ *
+ * @param group Group to use.
+ * @param db Database whose indexes hold the group - NULL once the group is removed from it.
+ *
+ */
+void um_group_set_owner(um_group_t *group, um_db_t *db)
+{
+    group->owner = db;
+}
+
+/**
+ * Get the database which stores the group.
+ *
+ * @param group Group to use.
+ *
+ * @return Database set by um_group_set_owner().
+ *
+ */
+um_db_t *um_group_get_owner(const um_group_t *group)
+{
+    return group->owner;
+}
+
+/**
+ * Allocate member/admin element and link it into the group list and the user's group list.
+ *
+ * @param group Group to use.
+ * @param head Head of the group list to append to.
+ * @param user User to add.
+ * @param admin True if the list is the admin list.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_group_add_user_element(um_group_t *group, um_group_user_element_t **head, um_user_t *user, bool admin)
+{
+    um_group_user_element_t *new_element = NULL;
+
+    if (group->arena)
+    {
+        new_element = (um_group_user_element_t *)um_arena_alloc(group->arena, sizeof(um_group_user_element_t));
+    }
+    else
+    {
+        new_element = (um_group_user_element_t *)malloc(sizeof(um_group_user_element_t));
+    }
+
+    if (!new_element)
+    {
+        return -1;
+    }
+
+    *new_element = (um_group_user_element_t){0};
+    new_element->user = user;
+    new_element->group = group;
+    new_element->admin = admin;
+
+    DL_APPEND(*head, new_element);
+    um_user_link_membership(new_element);
+
+    group->dirty |= admin ? UM_DIRTY_GSHADOW : UM_DIRTY_GROUP | UM_DIRTY_GSHADOW;
+
+    return 0;
+}
+
+/**
+ * Find the element of the user in the group member/admin list and remove it.
+ * Finding the element walks the user's group list - O(groups of the user), only the unlink itself is O(1).
+ *
+ * @param group Group to use.
+ * @param user User to remove.
+ * @param admin True to remove from the admin list.
+ *
+ * @return Error code - 0 on success, -1 if the user is not in the list.
+ *
+ */
+static int um_group_remove_user_element(um_group_t *group, const um_user_t *user, bool admin)
+{
+    const um_group_user_element_t *iter = NULL;
+
+    for (iter = um_user_get_groups_head(user); iter; iter = iter->user_next)
+    {
+        if (iter->group == group && iter->admin == admin)
+        {
+            um_group_drop_membership((um_group_user_element_t *)iter);
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Copy string for the group - into the arena if the group was allocated in one.
+ *
+ * @param group Group to use.
+ * @param str String to copy.
+ *
+ * @return Copied string - NULL on allocation failure.
+ *
+ */
+static char *um_group_strdup(um_group_t *group, const char *str)
+{
+    return group->arena ? um_arena_strdup(group->arena, str) : strdup(str);
+}
+
+/**
+ * Free string of the group - strings in the arena or the interning table are left for their owner.
+ *
+ * @param group Group to use.
+ * @param str String to free.
+ *
+ */
+static void um_group_release(um_group_t *group, char *str)
+{
+    if (!group->arena && !(group->intern && um_intern_owns(group->intern, str)))
+    {
+        free(str);
+    }
+}
+
+/**
+ * Get shared copy of a frequently repeated string - private copy if the group has no interning table.
+ *
+ * @param group Group to use.
+ * @param str String to copy.
+ *
+ * @return Copied string - NULL on allocation failure.
+ *
+ */
+static char *um_group_share(um_group_t *group, const char *str)
+{
+    if (group->intern)
+    {
+        const char *shared = um_intern_string(group->intern, str);
+
+        if (shared)
+        {
+            return (char *)shared;
+        }
+    }
+
+    return um_group_strdup(group, str);
+}
+
+/**
+ * Share the password and password hash placeholders of the group using the table.
+ * Only values set after the call are shared.
+ *
+ * @param group Group to use.
+ * @param intern Table to use.
+ *
+ */
+void um_group_set_intern(um_group_t *group, um_intern_t *intern)
+{
+    group->intern = intern;
+}
+
+/**
+ * Read deferred gshadow data of the database the group was loaded with before the data is used.
+ * Getters cannot report errors - fields stay unset if the file failed to load.
+ *
+ * @param group Group to use.
+ *
+ */
+static void um_group_load_deferred(const um_group_t *group)
+{
+    if (group->deferred)
+    {
+        um_db_load_deferred(group->deferred, UM_DIRTY_GSHADOW);
+    }
+}
+
+/**
+ * Find the gshadow record of the group read by the cursor.
+ * Search starts after the previously found record and wraps around to the start of the file once, so files in the
+ * same order as group are read only once in total.
+ *
+ * @param iter Cursor to use.
+ * @param name Name of the group.
+ * @param sgrp Found record.
+ *
+ * @return 1 if the record was found, 0 if the group has no gshadow record, -1 on failure.
+ *
+ */
+static int um_group_iter_find_gshadow(um_group_iter_t *iter, const char *name, struct sgrp *sgrp)
+{
+    size_t start = iter->gshadow_pos;
+    int result = 0;
+
+    while ((result = um_parser_next_gshadow(&iter->gshadow, sgrp)) > 0)
+    {
+        iter->gshadow_pos++;
+        if (!strcmp(sgrp->sg_namp, name))
+        {
+            return 1;
+        }
+    }
+
+    if (result < 0 || iter->gshadow.failed || um_parser_rewind(&iter->gshadow))
+    {
+        return -1;
+    }
+
+    // records before the start position, the search ends where it started
+    iter->gshadow_pos = 0;
+    while (iter->gshadow_pos < start && (result = um_parser_next_gshadow(&iter->gshadow, sgrp)) > 0)
+    {
+        iter->gshadow_pos++;
+        if (!strcmp(sgrp->sg_namp, name))
+        {
+            return 1;
+        }
+    }
+
+    return (result < 0 || iter->gshadow.failed) ? -1 : 0;
 }
\ No newline at end of file
@@ -54,8 +54,10 @@ int um_group_set_password(um_group_t *group, const char *password);
  * @param group Group to use.
  * @param gid GID to set.
  *
+ * @return Error code - 0 on success, -1 if the GID index of the database storing the group could not be updated.
+ *
  */
-void um_group_set_gid(um_group_t *group, gid_t gid);
+int um_group_set_gid(um_group_t *group, gid_t gid);
 
 /**
  * Set the password hash for the group.
@@ -70,6 +72,7 @@ int um_group_set_password_hash(um_group_t *group, const char *password_hash);
 
 /**
  * Add user to the group member list.
+ * The group is also added to the user's group list.
  *
  * @param group Group to use.
  * @param user User to add as a member.
@@ -77,10 +80,11 @@ int um_group_set_password_hash(um_group_t *group, const char *password_hash);
  * @return Error code - 0 on success.
  *
  */
-int um_group_add_member(um_group_t *group, const um_user_t *user);
+int um_group_add_member(um_group_t *group, um_user_t *user);
 
 /**
  * Add user to the group admin list.
+ * The group is also added to the user's group list.
  *
  * @param group Group to use.
  * @param user User to add as a admin.
@@ -88,7 +92,33 @@ int um_group_add_member(um_group_t *group, const um_user_t *user);
  * @return Error code - 0 on success.
  *
  */
-int um_group_add_admin(um_group_t *group, const um_user_t *user);
+int um_group_add_admin(um_group_t *group, um_user_t *user);
+
+/**
+ * Remove user from the group member list.
+ * The element is found by walking the user's group list, so removal takes O(groups of the user) time and does not
+ * depend on the group size.
+ *
+ * @param group Group to use.
+ * @param user User to remove.
+ *
+ * @return Error code - 0 on success, -1 if the user is not a member of the group.
+ *
+ */
+int um_group_remove_member(um_group_t *group, const um_user_t *user);
+
+/**
+ * Remove user from the group admin list.
+ * The element is found by walking the user's group list, so removal takes O(groups of the user) time and does not
+ * depend on the group size.
+ *
+ * @param group Group to use.
+ * @param user User to remove.
+ *
+ * @return Error code - 0 on success, -1 if the user is not an admin of the group.
+ *
+ */
+int um_group_remove_admin(um_group_t *group, const um_user_t *user);
 
 /**
  * Get group name.
@@ -150,6 +180,64 @@ const um_group_user_element_t *um_group_get_members_head(const um_group_t *group
  */
 const um_group_user_element_t *um_group_get_admin_head(const um_group_t *group);
 
+/**
+ * Open a cursor over the groups in the account files of the database, without loading the database.
+ * Only the paths of the database are used - see um_db_set_root() and um_db_set_path(). Files are read incrementally
+ * through fixed size buffers, so the memory used does not depend on the number of groups.
+ *
+ * Gshadow records are matched by name while reading - in constant time if gshadow lists the groups in the same order
+ * as group, and by a pass over gshadow otherwise.
+ *
+ * @param db Database with the paths of the account files.
+ * @param flags UM_DB_LOAD_SKIP_SHADOW to read only group - gshadow fields stay unset, other flags are ignored.
+ *
+ * @return New cursor - NULL if the files can not be opened.
+ *
+ */
+um_group_iter_t *um_group_iter_open(const um_db_t *db, unsigned int flags);
+
+/**
+ * Read the next group.
+ * The group is a borrowed view valid until the next call or closing the cursor - it must not be modified, freed or
+ * added to a database. Its member and admin lists are empty, names are available through um_group_iter_get_members()
+ * and um_group_iter_get_admins().
+ *
+ * @param iter Cursor to use.
+ * @param group Set to the next group.
+ *
+ * @return 1 if a group was read, 0 after the last group, -1 on failure.
+ *
+ */
+int um_group_iter_next(um_group_iter_t *iter, const um_group_t **group);
+
+/**
+ * Get member names of the group read last - from gshadow if the group has a gshadow record.
+ *
+ * @param iter Cursor to use.
+ *
+ * @return NULL terminated name list valid until the next call of um_group_iter_next().
+ *
+ */
+const char *const *um_group_iter_get_members(const um_group_iter_t *iter);
+
+/**
+ * Get admin names of the group read last.
+ *
+ * @param iter Cursor to use.
+ *
+ * @return NULL terminated name list valid until the next call of um_group_iter_next().
+ *
+ */
+const char *const *um_group_iter_get_admins(const um_group_iter_t *iter);
+
+/**
+ * Close the cursor and the account files.
+ *
+ * @param iter Cursor to close.
+ *
+ */
+void um_group_iter_close(um_group_iter_t *iter);
+
 /**
  * Free group data.
  *
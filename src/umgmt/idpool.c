@@ -0,0 +1,562 @@
+/**
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "idpool.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// enough levels to summarize UM_ID_POOL_MAX_SIZE bits down to a single word
+#define UM_ID_POOL_LEVELS 4
+
+#define UM_ID_POOL_WORD_BITS 64
+#define UM_ID_POOL_ALL_SET (~(uint64_t)0)
+
+struct um_id_pool_s
+{
+    id_t min;
+    id_t max;
+    size_t levels;                         ///< Number of used levels - level 0 included.
+    size_t bits[UM_ID_POOL_LEVELS];        ///< Number of valid bits per level.
+    size_t words[UM_ID_POOL_LEVELS];       ///< Number of words per level.
+    uint64_t *used;                        ///< Level 0 - bit per ID, set if used.
+    uint64_t *full[UM_ID_POOL_LEVELS];     ///< Levels 1+ - bit per lower level word, set if the word is full.
+    uint64_t *nonempty[UM_ID_POOL_LEVELS]; ///< Levels 1+ - bit per lower level word, set if the word is not empty.
+};
+
+static uint64_t um_id_pool_valid_mask(size_t bits, size_t word);
+static uint64_t um_id_pool_bit(size_t index);
+static size_t um_id_pool_lowest_bit(uint64_t word);
+static size_t um_id_pool_highest_bit(uint64_t word);
+
+/**
+ * Allocate new ID pool with all IDs free.
+ *
+ * @param min First ID of the range.
+ * @param max Last ID of the range.
+ *
+ * @return New allocated pool - NULL on allocation failure or an invalid range.
+ *
+ */
+um_id_pool_t *um_id_pool_new(id_t min, id_t max)
+{
+    um_id_pool_t *new_pool = NULL;
+    uint64_t *data = NULL;
+    size_t total_words = 0;
+
+    if (min > max || max - min >= UM_ID_POOL_MAX_SIZE)
+    {
+        return NULL;
+    }
+
+    new_pool = (um_id_pool_t *)malloc(sizeof(um_id_pool_t));
+    if (!new_pool)
+    {
+        return NULL;
+    }
+
+    *new_pool = (um_id_pool_t){0};
+    new_pool->min = min;
+    new_pool->max = max;
+
+    // size each level until a single word summarizes the one below it
+    new_pool->bits[0] = (size_t)(max - min) + 1;
+    new_pool->words[0] = (new_pool->bits[0] + UM_ID_POOL_WORD_BITS - 1) / UM_ID_POOL_WORD_BITS;
+    new_pool->levels = 1;
+
+    while (new_pool->words[new_pool->levels - 1] > 1)
+    {
+        size_t level = new_pool->levels;
+
+        new_pool->bits[level] = new_pool->words[level - 1];
+        new_pool->words[level] = (new_pool->bits[level] + UM_ID_POOL_WORD_BITS - 1) / UM_ID_POOL_WORD_BITS;
+        new_pool->levels++;
+    }
+
+    total_words = new_pool->words[0];
+    for (size_t level = 1; level < new_pool->levels; level++)
+    {
+        total_words += 2 * new_pool->words[level];
+    }
+
+    data = (uint64_t *)calloc(total_words, sizeof(uint64_t));
+    if (!data)
+    {
+        free(new_pool);
+        return NULL;
+    }
+
+    new_pool->used = data;
+    data += new_pool->words[0];
+
+    for (size_t level = 1; level < new_pool->levels; level++)
+    {
+        new_pool->full[level] = data;
+        data += new_pool->words[level];
+        new_pool->nonempty[level] = data;
+        data += new_pool->words[level];
+
+        // padding bits past the last lower level word count as full so they are never searched
+        for (size_t word = 0; word < new_pool->words[level]; word++)
+        {
+            new_pool->full[level][word] = ~um_id_pool_valid_mask(new_pool->bits[level], word);
+        }
+    }
+
+    return new_pool;
+}
+
+/**
+ * Mark ID as used. IDs outside of the range are ignored.
+ *
+ * @param pool Pool to use.
+ * @param id ID to mark.
+ *
+ */
+void um_id_pool_set(um_id_pool_t *pool, id_t id)
+{
+    size_t index = 0, word = 0;
+    bool was_empty = false;
+
+    if (id < pool->min || id > pool->max)
+    {
+        return;
+    }
+
+    index = (size_t)(id - pool->min);
+    word = index / UM_ID_POOL_WORD_BITS;
+
+    if (pool->used[word] & um_id_pool_bit(index))
+    {
+        return;
+    }
+
+    was_empty = pool->used[word] == 0;
+    pool->used[word] |= um_id_pool_bit(index);
+
+    // propagate fullness up while words become full
+    if ((pool->used[word] | ~um_id_pool_valid_mask(pool->bits[0], word)) == UM_ID_POOL_ALL_SET)
+    {
+        index = word;
+        for (size_t level = 1; level < pool->levels; level++)
+        {
+            size_t upper = index / UM_ID_POOL_WORD_BITS;
+
+            pool->full[level][upper] |= um_id_pool_bit(index);
+            if (pool->full[level][upper] != UM_ID_POOL_ALL_SET)
+            {
+                break;
+            }
+            index = upper;
+        }
+    }
+
+    // propagate non-emptiness up while words stop being empty
+    if (was_empty)
+    {
+        index = word;
+        for (size_t level = 1; level < pool->levels; level++)
+        {
+            size_t upper = index / UM_ID_POOL_WORD_BITS;
+            bool upper_was_empty = pool->nonempty[level][upper] == 0;
+
+            pool->nonempty[level][upper] |= um_id_pool_bit(index);
+            if (!upper_was_empty)
+            {
+                break;
+            }
+            index = upper;
+        }
+    }
+}
+
+/**
+ * Mark ID as free. IDs outside of the range are ignored.
+ *
+ * @param pool Pool to use.
+ * @param id ID to mark.
+ *
+ */
+void um_id_pool_clear(um_id_pool_t *pool, id_t id)
+{
+    size_t index = 0, word = 0;
+    bool was_full = false;
+
+    if (id < pool->min || id > pool->max)
+    {
+        return;
+    }
+
+    index = (size_t)(id - pool->min);
+    word = index / UM_ID_POOL_WORD_BITS;
+
+    if (!(pool->used[word] & um_id_pool_bit(index)))
+    {
+        return;
+    }
+
+    was_full = (pool->used[word] | ~um_id_pool_valid_mask(pool->bits[0], word)) == UM_ID_POOL_ALL_SET;
+    pool->used[word] &= ~um_id_pool_bit(index);
+
+    // propagate non-fullness up while words stop being full
+    if (was_full)
+    {
+        index = word;
+        for (size_t level = 1; level < pool->levels; level++)
+        {
+            size_t upper = index / UM_ID_POOL_WORD_BITS;
+            bool upper_was_full = pool->full[level][upper] == UM_ID_POOL_ALL_SET;
+
+            pool->full[level][upper] &= ~um_id_pool_bit(index);
+            if (!upper_was_full)
+            {
+                break;
+            }
+            index = upper;
+        }
+    }
+
+    // propagate emptiness up while words become empty
+    if (pool->used[word] == 0)
+    {
+        index = word;
+        for (size_t level = 1; level < pool->levels; level++)
+        {
+            size_t upper = index / UM_ID_POOL_WORD_BITS;
+
+            pool->nonempty[level][upper] &= ~um_id_pool_bit(index);
+            if (pool->nonempty[level][upper] != 0)
+            {
+                break;
+            }
+            index = upper;
+        }
+    }
+}
+
+/**
+ * Check if ID is marked as used.
+ *
+ * @param pool Pool to use.
+ * @param id ID to check.
+ *
+ * @return True if the ID is in the range and used.
+ *
+ */
+bool um_id_pool_is_set(const um_id_pool_t *pool, id_t id)
+{
+    size_t index = 0;
+
+    if (id < pool->min || id > pool->max)
+    {
+        return false;
+    }
+
+    index = (size_t)(id - pool->min);
+
+    return (pool->used[index / UM_ID_POOL_WORD_BITS] & um_id_pool_bit(index)) != 0;
+}
+
+/**
+ * Find the lowest free ID which is not smaller than the given one.
+ *
+ * @param pool Pool to use.
+ * @param from Lowest acceptable ID.
+ * @param id Found ID.
+ *
+ * @return Error code - 0 on success, -1 if there is no free ID.
+ *
+ */
+int um_id_pool_next_free(const um_id_pool_t *pool, id_t from, id_t *id)
+{
+    size_t index = 0, level = 0;
+    uint64_t candidates = 0;
+
+    if (from > pool->max)
+    {
+        return -1;
+    }
+
+    if (from > pool->min)
+    {
+        index = (size_t)(from - pool->min);
+    }
+
+    // climb until a word with a free bit at or after the current position is found
+    for (;;)
+    {
+        size_t word = index / UM_ID_POOL_WORD_BITS;
+
+        if (word >= pool->words[level])
+        {
+            return -1;
+        }
+
+        if (level == 0)
+        {
+            candidates = ~pool->used[word] & um_id_pool_valid_mask(pool->bits[0], word);
+        }
+        else
+        {
+            candidates = ~pool->full[level][word];
+        }
+
+        candidates &= UM_ID_POOL_ALL_SET << (index % UM_ID_POOL_WORD_BITS);
+
+        if (candidates)
+        {
+            index = word * UM_ID_POOL_WORD_BITS + um_id_pool_lowest_bit(candidates);
+            break;
+        }
+
+        if (level + 1 == pool->levels)
+        {
+            return -1;
+        }
+
+        // continue with the next word one level up
+        level++;
+        index = word + 1;
+    }
+
+    // descend into the first non-full word of every level below
+    while (level > 0)
+    {
+        level--;
+
+        if (level == 0)
+        {
+            candidates = ~pool->used[index] & um_id_pool_valid_mask(pool->bits[0], index);
+        }
+        else
+        {
+            candidates = ~pool->full[level][index];
+        }
+
+        index = index * UM_ID_POOL_WORD_BITS + um_id_pool_lowest_bit(candidates);
+    }
+
+    *id = pool->min + (id_t)index;
+
+    return 0;
+}
+
+/**
+ * Find the lowest used ID which is not smaller than the given one.
+ *
+ * @param pool Pool to use.
+ * @param from Lowest acceptable ID.
+ * @param id Found ID.
+ *
+ * @return Error code - 0 on success, -1 if there is no used ID.
+ *
+ */
+int um_id_pool_next_used(const um_id_pool_t *pool, id_t from, id_t *id)
+{
+    size_t index = 0, level = 0;
+    uint64_t candidates = 0;
+
+    if (from > pool->max)
+    {
+        return -1;
+    }
+
+    if (from > pool->min)
+    {
+        index = (size_t)(from - pool->min);
+    }
+
+    // climb until a word with a used bit at or after the current position is found
+    for (;;)
+    {
+        size_t word = index / UM_ID_POOL_WORD_BITS;
+
+        if (word >= pool->words[level])
+        {
+            return -1;
+        }
+
+        candidates = level == 0 ? pool->used[word] : pool->nonempty[level][word];
+        candidates &= UM_ID_POOL_ALL_SET << (index % UM_ID_POOL_WORD_BITS);
+
+        if (candidates)
+        {
+            index = word * UM_ID_POOL_WORD_BITS + um_id_pool_lowest_bit(candidates);
+            break;
+        }
+
+        if (level + 1 == pool->levels)
+        {
+            return -1;
+        }
+
+        // continue with the next word one level up
+        level++;
+        index = word + 1;
+    }
+
+    // descend into the first non-empty word of every level below
+    while (level > 0)
+    {
+        level--;
+        candidates = level == 0 ? pool->used[index] : pool->nonempty[level][index];
+        index = index * UM_ID_POOL_WORD_BITS + um_id_pool_lowest_bit(candidates);
+    }
+
+    *id = pool->min + (id_t)index;
+
+    return 0;
+}
+
+/**
+ * Find the highest used ID in the range.
+ *
+ * @param pool Pool to use.
+ * @param id Found ID.
+ *
+ * @return Error code - 0 on success, -1 if no ID is used.
+ *
+ */
+int um_id_pool_last_used(const um_id_pool_t *pool, id_t *id)
+{
+    size_t index = 0;
+    size_t level = pool->levels - 1;
+
+    // the top level always consists of a single word
+    if (level == 0)
+    {
+        if (!pool->used[0])
+        {
+            return -1;
+        }
+
+        *id = pool->min + (id_t)um_id_pool_highest_bit(pool->used[0]);
+        return 0;
+    }
+
+    if (!pool->nonempty[level][0])
+    {
+        return -1;
+    }
+
+    index = um_id_pool_highest_bit(pool->nonempty[level][0]);
+
+    // descend into the last non-empty word of every level below
+    while (level > 1)
+    {
+        level--;
+        index = index * UM_ID_POOL_WORD_BITS + um_id_pool_highest_bit(pool->nonempty[level][index]);
+    }
+
+    index = index * UM_ID_POOL_WORD_BITS + um_id_pool_highest_bit(pool->used[index]);
+
+    *id = pool->min + (id_t)index;
+
+    return 0;
+}
+
+/**
+ * Get the first ID of the range.
+ *
+ * @param pool Pool to use.
+ *
+ * @return First ID.
+ *
+ */
+id_t um_id_pool_get_min(const um_id_pool_t *pool)
+{
+    return pool->min;
+}
+
+/**
+ * Get the last ID of the range.
+ *
+ * @param pool Pool to use.
+ *
+ * @return Last ID.
+ *
+ */
+id_t um_id_pool_get_max(const um_id_pool_t *pool)
+{
+    return pool->max;
+}
+
+/**
+ * Free pool data.
+ *
+ * @param pool Pool to free.
+ *
+ */
+void um_id_pool_free(um_id_pool_t *pool)
+{
+    // all levels share one allocation
+    free(pool->used);
+    free(pool);
+}
+
+/**
+ * Get mask of the bits of a word which map to valid positions on its level.
+ *
+ * @param bits Number of valid bits on the level.
+ * @param word Word index.
+ *
+ * @return Word mask.
+ *
+ */
+static uint64_t um_id_pool_valid_mask(size_t bits, size_t word)
+{
+    size_t first = word * UM_ID_POOL_WORD_BITS;
+
+    if (first + UM_ID_POOL_WORD_BITS <= bits)
+    {
+        return UM_ID_POOL_ALL_SET;
+    }
+
+    return (um_id_pool_bit(bits - first)) - 1;
+}
+
+/**
+ * Get the bit of the position inside of its word.
+ *
+ * @param index Position on the level.
+ *
+ * @return Single bit word.
+ *
+ */
+static uint64_t um_id_pool_bit(size_t index)
+{
+    return (uint64_t)1 << (index % UM_ID_POOL_WORD_BITS);
+}
+
+/**
+ * Get the position of the lowest set bit - word must not be 0.
+ *
+ * @param word Word to use.
+ *
+ * @return Bit position.
+ *
+ */
+static size_t um_id_pool_lowest_bit(uint64_t word)
+{
+    return (size_t)__builtin_ctzll(word);
+}
+
+/**
+ * Get the position of the highest set bit - word must not be 0.
+ *
+ * @param word Word to use.
+ *
+ * @return Bit position.
+ *
+ */
+static size_t um_id_pool_highest_bit(uint64_t word)
+{
+    return (size_t)(UM_ID_POOL_WORD_BITS - 1 - __builtin_clzll(word));
+}
\ No newline at end of file
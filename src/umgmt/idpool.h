@@ -0,0 +1,133 @@
+/**
+ * @file idpool.h
+ * @brief Internal API for tracking used IDs in a fixed range.
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#ifndef UMGMT_IDPOOL_H
+#define UMGMT_IDPOOL_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/**
+ * Largest number of IDs a pool can cover - bounds the bitmap to 2 MiB.
+ */
+#define UM_ID_POOL_MAX_SIZE (1U << 24)
+
+/**
+ * ID pool - hierarchical bitmap of used IDs in the range [min, max].
+ * Finding the lowest free or the highest used ID takes one word scan per level (at most 4 levels).
+ */
+typedef struct um_id_pool_s um_id_pool_t;
+
+/**
+ * Allocate new ID pool with all IDs free.
+ *
+ * @param min First ID of the range.
+ * @param max Last ID of the range.
+ *
+ * @return New allocated pool - NULL on allocation failure or an invalid range.
+ *
+ */
+um_id_pool_t *um_id_pool_new(id_t min, id_t max);
+
+/**
+ * Mark ID as used. IDs outside of the range are ignored.
+ *
+ * @param pool Pool to use.
+ * @param id ID to mark.
+ *
+ */
+void um_id_pool_set(um_id_pool_t *pool, id_t id);
+
+/**
+ * Mark ID as free. IDs outside of the range are ignored.
+ *
+ * @param pool Pool to use.
+ * @param id ID to mark.
+ *
+ */
+void um_id_pool_clear(um_id_pool_t *pool, id_t id);
+
+/**
+ * Check if ID is marked as used.
+ *
+ * @param pool Pool to use.
+ * @param id ID to check.
+ *
+ * @return True if the ID is in the range and used.
+ *
+ */
+bool um_id_pool_is_set(const um_id_pool_t *pool, id_t id);
+
+/**
+ * Find the lowest free ID which is not smaller than the given one.
+ *
+ * @param pool Pool to use.
+ * @param from Lowest acceptable ID.
+ * @param id Found ID.
+ *
+ * @return Error code - 0 on success, -1 if there is no free ID.
+ *
+ */
+int um_id_pool_next_free(const um_id_pool_t *pool, id_t from, id_t *id);
+
+/**
+ * Find the lowest used ID which is not smaller than the given one.
+ *
+ * @param pool Pool to use.
+ * @param from Lowest acceptable ID.
+ * @param id Found ID.
+ *
+ * @return Error code - 0 on success, -1 if there is no used ID.
+ *
+ */
+int um_id_pool_next_used(const um_id_pool_t *pool, id_t from, id_t *id);
+
+/**
+ * Find the highest used ID in the range.
+ *
+ * @param pool Pool to use.
+ * @param id Found ID.
+ *
+ * @return Error code - 0 on success, -1 if no ID is used.
+ *
+ */
+int um_id_pool_last_used(const um_id_pool_t *pool, id_t *id);
+
+/**
+ * Get the first ID of the range.
+ *
+ * @param pool Pool to use.
+ *
+ * @return First ID.
+ *
+ */
+id_t um_id_pool_get_min(const um_id_pool_t *pool);
+
+/**
+ * Get the last ID of the range.
+ *
+ * @param pool Pool to use.
+ *
+ * @return Last ID.
+ *
+ */
+id_t um_id_pool_get_max(const um_id_pool_t *pool);
+
+/**
+ * Free pool data.
+ *
+ * @param pool Pool to free.
+ *
+ */
+void um_id_pool_free(um_id_pool_t *pool);
+
+#endif // UMGMT_IDPOOL_H
\ No newline at end of file
@@ -0,0 +1,126 @@
+/**
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "intern.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// report allocation failures instead of exiting the process
+#define HASH_NONFATAL_OOM 1
+#include <uthash.h>
+
+typedef struct um_intern_entry_s um_intern_entry_t;
+
+struct um_intern_entry_s
+{
+    UT_hash_handle hh; ///< Table handle.
+    char str[];        ///< Shared string.
+};
+
+struct um_intern_s
+{
+    um_intern_entry_t *entries;
+};
+
+/**
+ * Allocate new empty interning table.
+ *
+ * @return New allocated table - NULL on allocation failure.
+ *
+ */
+um_intern_t *um_intern_new(void)
+{
+    um_intern_t *intern = (um_intern_t *)malloc(sizeof(um_intern_t));
+
+    if (!intern)
+    {
+        return NULL;
+    }
+
+    *intern = (um_intern_t){0};
+
+    return intern;
+}
+
+/**
+ * Get the shared copy of the string, adding it to the table if needed.
+ *
+ * @param intern Table to use.
+ * @param str String to intern.
+ *
+ * @return Shared copy of the string - NULL on allocation failure.
+ *
+ */
+const char *um_intern_string(um_intern_t *intern, const char *str)
+{
+    um_intern_entry_t *entry = NULL;
+    size_t length = strlen(str);
+
+    HASH_FIND(hh, intern->entries, str, (unsigned)length, entry);
+    if (entry)
+    {
+        return entry->str;
+    }
+
+    entry = (um_intern_entry_t *)malloc(sizeof(um_intern_entry_t) + length + 1);
+    if (!entry)
+    {
+        return NULL;
+    }
+
+    memcpy(entry->str, str, length + 1);
+
+    HASH_ADD_KEYPTR(hh, intern->entries, entry->str, (unsigned)length, entry);
+    if (!entry->hh.tbl)
+    {
+        free(entry);
+        return NULL;
+    }
+
+    return entry->str;
+}
+
+/**
+ * Check if the pointer is a shared copy owned by the table.
+ *
+ * @param intern Table to use.
+ * @param str String to check.
+ *
+ * @return True if the string is owned by the table.
+ *
+ */
+bool um_intern_owns(const um_intern_t *intern, const char *str)
+{
+    um_intern_entry_t *entry = NULL;
+
+    HASH_FIND(hh, intern->entries, str, (unsigned)strlen(str), entry);
+
+    return entry && entry->str == str;
+}
+
+/**
+ * Free the table and all shared copies.
+ *
+ * @param intern Table to free.
+ *
+ */
+void um_intern_free(um_intern_t *intern)
+{
+    um_intern_entry_t *iter = NULL, *tmp = NULL;
+
+    HASH_ITER(hh, intern->entries, iter, tmp)
+    {
+        HASH_DELETE(hh, intern->entries, iter);
+        free(iter);
+    }
+
+    free(intern);
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+/**
+ * @file intern.h
+ * @brief Internal API for sharing copies of frequently repeated strings.
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#ifndef UMGMT_INTERN_H
+#define UMGMT_INTERN_H
+
+#include "types.h"
+
+#include <stdbool.h>
+
+/**
+ * Interning table - holds a single shared copy of each added string until the table is freed.
+ */
+typedef struct um_intern_s um_intern_t;
+
+/**
+ * Allocate new empty interning table.
+ *
+ * @return New allocated table - NULL on allocation failure.
+ *
+ */
+um_intern_t *um_intern_new(void);
+
+/**
+ * Get the shared copy of the string, adding it to the table if needed.
+ *
+ * @param intern Table to use.
+ * @param str String to intern.
+ *
+ * @return Shared copy of the string - NULL on allocation failure.
+ *
+ */
+const char *um_intern_string(um_intern_t *intern, const char *str);
+
+/**
+ * Check if the pointer is a shared copy owned by the table.
+ *
+ * @param intern Table to use.
+ * @param str String to check.
+ *
+ * @return True if the string is owned by the table.
+ *
+ */
+bool um_intern_owns(const um_intern_t *intern, const char *str);
+
+/**
+ * Free the table and all shared copies.
+ *
+ * @param intern Table to free.
+ *
+ */
+void um_intern_free(um_intern_t *intern);
+
+/**
+ * Share the password, shell path and password hash placeholders of the user using the table.
+ * Only values set after the call are shared.
+ *
+ * @param user User to use.
+ * @param intern Table to use.
+ *
+ */
+void um_user_set_intern(um_user_t *user, um_intern_t *intern);
+
+/**
+ * Share the password and password hash placeholders of the group using the table.
+ * Only values set after the call are shared.
+ *
+ * @param group Group to use.
+ * @param intern Table to use.
+ *
+ */
+void um_group_set_intern(um_group_t *group, um_intern_t *intern);
+
+#endif // UMGMT_INTERN_H
\ No newline at end of file
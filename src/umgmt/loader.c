@@ -0,0 +1,639 @@
+/**
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "loader.h"
+#include "parser.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// initial capacity of the record and list arrays of a chunk
+#define UM_LOADER_INITIAL_CAPACITY 64
+
+typedef union um_loader_record_u um_loader_record_t;
+typedef struct um_loader_chunk_s um_loader_chunk_t;
+
+/**
+ * Parsed record of any account file.
+ */
+union um_loader_record_u
+{
+    struct passwd pwd;
+    struct spwd spwd;
+    struct group grp;
+    struct sgrp sgrp;
+};
+
+/**
+ * Part of an account file parsed by a single thread.
+ */
+struct um_loader_chunk_s
+{
+    um_parser_t parser;          ///< Parser of the chunk data - shares the mapping of the file.
+    um_db_file_t file;           ///< Account file the chunk belongs to.
+    um_loader_record_t *records; ///< Parsed records.
+    size_t count;                ///< Number of parsed records.
+    size_t capacity;             ///< Capacity of the record array.
+    char **names;                ///< Member and admin lists of the records - NULL terminated, stored in record order.
+    size_t names_count;          ///< Number of used list slots.
+    size_t names_capacity;       ///< Capacity of the list storage.
+    int error;                   ///< Parsing result - 0 on success.
+};
+
+struct um_loader_s
+{
+    unsigned int threads;
+    size_t chunk_size;
+
+    // mappings of the whole files and their chunks in file order
+    um_parser_t parsers[UM_DB_FILE_COUNT];
+    um_loader_chunk_t *chunks;
+    size_t chunk_count;
+
+    // merged records of each file
+    um_loader_record_t *records[UM_DB_FILE_COUNT];
+    size_t counts[UM_DB_FILE_COUNT];
+
+    // next chunk to parse - shared by the worker threads
+    pthread_mutex_t lock;
+    size_t next_chunk;
+};
+
+static size_t um_loader_plan_chunks(const um_loader_t *loader, const um_parser_t *parser);
+static int um_loader_add_chunks(um_loader_t *loader, um_db_file_t file, size_t count);
+static void *um_loader_worker(void *arg);
+static int um_loader_parse_chunk(um_loader_chunk_t *chunk);
+static int um_loader_push_record(um_loader_chunk_t *chunk, const um_loader_record_t *record);
+static int um_loader_push_names(um_loader_chunk_t *chunk, char *const *names);
+static void um_loader_link_names(um_loader_chunk_t *chunk);
+static char **um_loader_skip_list(char **names);
+static int um_loader_merge(um_loader_t *loader);
+
+/**
+ * Allocate new loader.
+ *
+ * @param threads Maximum number of threads parsing the files, including the calling thread - 0 for the number of
+ * online CPUs.
+ *
+ * @return New allocated loader - NULL on allocation failure.
+ *
+ */
+um_loader_t *um_loader_new(unsigned int threads)
+{
+    um_loader_t *loader = (um_loader_t *)malloc(sizeof(um_loader_t));
+    long int cpus = 0;
+
+    if (!loader)
+    {
+        return NULL;
+    }
+
+    *loader = (um_loader_t){0};
+
+    if (pthread_mutex_init(&loader->lock, NULL))
+    {
+        free(loader);
+        return NULL;
+    }
+
+    if (!threads)
+    {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (unsigned int)cpus : 1;
+    }
+
+    loader->threads = threads;
+    loader->chunk_size = UM_LOADER_CHUNK_SIZE;
+
+    return loader;
+}
+
+/**
+ * Set the size above which files are split into chunks.
+ *
+ * @param loader Loader to use.
+ * @param chunk_size Chunk size in bytes - UM_LOADER_CHUNK_SIZE by default.
+ *
+ */
+void um_loader_set_chunk_size(um_loader_t *loader, size_t chunk_size)
+{
+    loader->chunk_size = chunk_size ? chunk_size : 1;
+}
+
+/**
+ * Parse the account files. Can be called only once for each loader.
+ *
+ * @param loader Loader to use.
+ * @param paths Paths of the account files.
+ * @param files Files to parse - bit (1 << file) set for each um_db_file_t value to parse.
+ *
+ * @return Error code - 0 on success, -1 if a file could not be read.
+ *
+ */
+int um_loader_read(um_loader_t *loader, const char *const paths[UM_DB_FILE_COUNT], unsigned int files)
+{
+    size_t planned[UM_DB_FILE_COUNT] = {0};
+    size_t total = 0;
+    pthread_t *threads = NULL;
+    size_t started = 0;
+    size_t workers = 0;
+
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        if (!(files & (1U << i)))
+        {
+            continue;
+        }
+
+        if (um_parser_open(&loader->parsers[i], paths[i]))
+        {
+            return -1;
+        }
+
+        planned[i] = um_loader_plan_chunks(loader, &loader->parsers[i]);
+        total += planned[i];
+    }
+
+    if (total)
+    {
+        loader->chunks = (um_loader_chunk_t *)calloc(total, sizeof(um_loader_chunk_t));
+        if (!loader->chunks)
+        {
+            return -1;
+        }
+    }
+
+    // chunks are kept in file order, so merging them gives the same order as a sequential read
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        if (planned[i] && um_loader_add_chunks(loader, (um_db_file_t)i, planned[i]))
+        {
+            return -1;
+        }
+    }
+
+    // the calling thread parses chunks as well
+    workers = loader->chunk_count < loader->threads ? loader->chunk_count : loader->threads;
+    if (workers > 1)
+    {
+        threads = (pthread_t *)malloc((workers - 1) * sizeof(pthread_t));
+    }
+
+    // failing to start a thread only leaves more chunks for the others
+    for (size_t i = 0; threads && i < workers - 1; i++)
+    {
+        if (pthread_create(&threads[started], NULL, um_loader_worker, loader))
+        {
+            break;
+        }
+        started++;
+    }
+
+    um_loader_worker(loader);
+
+    for (size_t i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    for (size_t i = 0; i < loader->chunk_count; i++)
+    {
+        if (loader->chunks[i].error)
+        {
+            return -1;
+        }
+    }
+
+    return um_loader_merge(loader);
+}
+
+/**
+ * Get the number of records parsed from the account file.
+ *
+ * @param loader Loader to use.
+ * @param file Account file.
+ *
+ * @return Number of records.
+ *
+ */
+size_t um_loader_get_count(const um_loader_t *loader, um_db_file_t file)
+{
+    return loader->counts[file];
+}
+
+/**
+ * Get parsed passwd record.
+ *
+ * @param loader Loader to use.
+ * @param index Index of the record in the file.
+ *
+ * @return Parsed record.
+ *
+ */
+const struct passwd *um_loader_get_passwd(const um_loader_t *loader, size_t index)
+{
+    return &loader->records[UM_DB_FILE_PASSWD][index].pwd;
+}
+
+/**
+ * Get parsed shadow record.
+ *
+ * @param loader Loader to use.
+ * @param index Index of the record in the file.
+ *
+ * @return Parsed record.
+ *
+ */
+const struct spwd *um_loader_get_shadow(const um_loader_t *loader, size_t index)
+{
+    return &loader->records[UM_DB_FILE_SHADOW][index].spwd;
+}
+
+/**
+ * Get parsed group record.
+ *
+ * @param loader Loader to use.
+ * @param index Index of the record in the file.
+ *
+ * @return Parsed record.
+ *
+ */
+const struct group *um_loader_get_group(const um_loader_t *loader, size_t index)
+{
+    return &loader->records[UM_DB_FILE_GROUP][index].grp;
+}
+
+/**
+ * Get parsed gshadow record.
+ *
+ * @param loader Loader to use.
+ * @param index Index of the record in the file.
+ *
+ * @return Parsed record.
+ *
+ */
+const struct sgrp *um_loader_get_gshadow(const um_loader_t *loader, size_t index)
+{
+    return &loader->records[UM_DB_FILE_GSHADOW][index].sgrp;
+}
+
+/**
+ * Free the loader, its records and file mappings.
+ *
+ * @param loader Loader to free.
+ *
+ */
+void um_loader_free(um_loader_t *loader)
+{
+    // chunks only own their lists, the mappings are released with the file parsers
+    for (size_t i = 0; i < loader->chunk_count; i++)
+    {
+        um_parser_close(&loader->chunks[i].parser);
+        free(loader->chunks[i].records);
+        free(loader->chunks[i].names);
+    }
+    free(loader->chunks);
+
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        um_parser_close(&loader->parsers[i]);
+        free(loader->records[i]);
+    }
+
+    pthread_mutex_destroy(&loader->lock);
+
+    free(loader);
+}
+
+/**
+ * Choose the number of chunks for a file.
+ *
+ * @param loader Loader to use.
+ * @param parser Parser of the whole file.
+ *
+ * @return Number of chunks - one for files not larger than the chunk size, at most one per thread.
+ *
+ */
+static size_t um_loader_plan_chunks(const um_loader_t *loader, const um_parser_t *parser)
+{
+    size_t size = (size_t)(parser->end - parser->pos);
+    size_t count = size / loader->chunk_size + (size % loader->chunk_size ? 1 : 0);
+
+    if (!count)
+    {
+        return 1;
+    }
+
+    return count < loader->threads ? count : loader->threads;
+}
+
+/**
+ * Split a file into chunks and append them to the chunk array.
+ *
+ * @param loader Loader to use.
+ * @param file Account file to split.
+ * @param count Planned number of chunks.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_loader_add_chunks(um_loader_t *loader, um_db_file_t file, size_t count)
+{
+    um_parser_t *parsers = (um_parser_t *)malloc(count * sizeof(um_parser_t));
+    size_t used = 0;
+
+    if (!parsers)
+    {
+        return -1;
+    }
+
+    used = um_parser_split_chunks(&loader->parsers[file], parsers, count);
+
+    for (size_t i = 0; i < used; i++)
+    {
+        loader->chunks[loader->chunk_count].parser = parsers[i];
+        loader->chunks[loader->chunk_count].file = file;
+        loader->chunk_count++;
+    }
+
+    free(parsers);
+
+    return 0;
+}
+
+/**
+ * Parse chunks until none are left.
+ *
+ * @param arg Loader to use.
+ *
+ * @return Always NULL - errors are stored in the chunks.
+ *
+ */
+static void *um_loader_worker(void *arg)
+{
+    um_loader_t *loader = (um_loader_t *)arg;
+    size_t index = 0;
+
+    while (true)
+    {
+        pthread_mutex_lock(&loader->lock);
+        index = loader->next_chunk++;
+        pthread_mutex_unlock(&loader->lock);
+
+        if (index >= loader->chunk_count)
+        {
+            break;
+        }
+
+        loader->chunks[index].error = um_loader_parse_chunk(&loader->chunks[index]);
+    }
+
+    return NULL;
+}
+
+/**
+ * Parse all records of a chunk.
+ *
+ * @param chunk Chunk to parse.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_loader_parse_chunk(um_loader_chunk_t *chunk)
+{
+    um_loader_record_t record = {0};
+    int result = 0;
+
+    if (chunk->file == UM_DB_FILE_PASSWD)
+    {
+        while ((result = um_parser_next_passwd(&chunk->parser, &record.pwd)) > 0)
+        {
+            if (um_loader_push_record(chunk, &record))
+            {
+                return -1;
+            }
+        }
+    }
+    else if (chunk->file == UM_DB_FILE_SHADOW)
+    {
+        while ((result = um_parser_next_shadow(&chunk->parser, &record.spwd)) > 0)
+        {
+            if (um_loader_push_record(chunk, &record))
+            {
+                return -1;
+            }
+        }
+    }
+    else if (chunk->file == UM_DB_FILE_GROUP)
+    {
+        while ((result = um_parser_next_group(&chunk->parser, &record.grp)) > 0)
+        {
+            if (um_loader_push_record(chunk, &record) || um_loader_push_names(chunk, record.grp.gr_mem))
+            {
+                return -1;
+            }
+        }
+    }
+    else if (chunk->file == UM_DB_FILE_GSHADOW)
+    {
+        while ((result = um_parser_next_gshadow(&chunk->parser, &record.sgrp)) > 0)
+        {
+            if (um_loader_push_record(chunk, &record) || um_loader_push_names(chunk, record.sgrp.sg_adm) ||
+                um_loader_push_names(chunk, record.sgrp.sg_mem))
+            {
+                return -1;
+            }
+        }
+    }
+
+    if (result < 0)
+    {
+        return -1;
+    }
+
+    um_loader_link_names(chunk);
+
+    return 0;
+}
+
+/**
+ * Append a copy of the record to the chunk.
+ *
+ * @param chunk Chunk to use.
+ * @param record Record to append.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_loader_push_record(um_loader_chunk_t *chunk, const um_loader_record_t *record)
+{
+    um_loader_record_t *records = NULL;
+    size_t capacity = 0;
+
+    if (chunk->count == chunk->capacity)
+    {
+        capacity = chunk->capacity ? chunk->capacity * 2 : UM_LOADER_INITIAL_CAPACITY;
+        records = (um_loader_record_t *)realloc(chunk->records, capacity * sizeof(um_loader_record_t));
+        if (!records)
+        {
+            return -1;
+        }
+
+        chunk->records = records;
+        chunk->capacity = capacity;
+    }
+
+    chunk->records[chunk->count++] = *record;
+
+    return 0;
+}
+
+/**
+ * Append a copy of a name list to the chunk - the parser reuses its lists for the next record.
+ *
+ * @param chunk Chunk to use.
+ * @param names NULL terminated list to append.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_loader_push_names(um_loader_chunk_t *chunk, char *const *names)
+{
+    char **storage = NULL;
+    size_t count = 0;
+    size_t capacity = chunk->names_capacity;
+
+    while (names[count] != NULL)
+    {
+        count++;
+    }
+
+    while (chunk->names_count + count + 1 > capacity)
+    {
+        capacity = capacity ? capacity * 2 : UM_LOADER_INITIAL_CAPACITY;
+    }
+
+    if (capacity != chunk->names_capacity)
+    {
+        storage = (char **)realloc(chunk->names, capacity * sizeof(char *));
+        if (!storage)
+        {
+            return -1;
+        }
+
+        chunk->names = storage;
+        chunk->names_capacity = capacity;
+    }
+
+    memcpy(chunk->names + chunk->names_count, names, (count + 1) * sizeof(char *));
+    chunk->names_count += count + 1;
+
+    return 0;
+}
+
+/**
+ * Point the member and admin lists of the chunk records to the list storage, which no longer moves.
+ *
+ * @param chunk Chunk to use.
+ *
+ */
+static void um_loader_link_names(um_loader_chunk_t *chunk)
+{
+    char **names = chunk->names;
+
+    for (size_t i = 0; i < chunk->count; i++)
+    {
+        if (chunk->file == UM_DB_FILE_GROUP)
+        {
+            chunk->records[i].grp.gr_mem = names;
+            names = um_loader_skip_list(names);
+        }
+        else if (chunk->file == UM_DB_FILE_GSHADOW)
+        {
+            chunk->records[i].sgrp.sg_adm = names;
+            names = um_loader_skip_list(names);
+            chunk->records[i].sgrp.sg_mem = names;
+            names = um_loader_skip_list(names);
+        }
+    }
+}
+
+/**
+ * Skip a NULL terminated list in the list storage.
+ *
+ * @param names Start of the list.
+ *
+ * @return Start of the next list.
+ *
+ */
+static char **um_loader_skip_list(char **names)
+{
+    while (*names != NULL)
+    {
+        names++;
+    }
+
+    return names + 1;
+}
+
+/**
+ * Join the records of the chunks into one array per file, keeping the file order.
+ *
+ * @param loader Loader to use.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_loader_merge(um_loader_t *loader)
+{
+    um_loader_chunk_t *chunk = NULL;
+    size_t offsets[UM_DB_FILE_COUNT] = {0};
+
+    for (size_t i = 0; i < loader->chunk_count; i++)
+    {
+        loader->counts[loader->chunks[i].file] += loader->chunks[i].count;
+    }
+
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        if (!loader->counts[i])
+        {
+            continue;
+        }
+
+        loader->records[i] = (um_loader_record_t *)malloc(loader->counts[i] * sizeof(um_loader_record_t));
+        if (!loader->records[i])
+        {
+            return -1;
+        }
+    }
+
+    for (size_t i = 0; i < loader->chunk_count; i++)
+    {
+        chunk = &loader->chunks[i];
+
+        if (chunk->count)
+        {
+            memcpy(loader->records[chunk->file] + offsets[chunk->file], chunk->records,
+                   chunk->count * sizeof(um_loader_record_t));
+            offsets[chunk->file] += chunk->count;
+        }
+
+        // list storage is still referenced by the merged records
+        free(chunk->records);
+        chunk->records = NULL;
+    }
+
+    return 0;
+}
\ No newline at end of file
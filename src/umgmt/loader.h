@@ -0,0 +1,130 @@
+/**
+ * @file loader.h
+ * @brief Internal API for parsing account files concurrently.
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#ifndef UMGMT_LOADER_H
+#define UMGMT_LOADER_H
+
+#include "db.h"
+
+#include <grp.h>
+#include <gshadow.h>
+#include <pwd.h>
+#include <shadow.h>
+#include <stddef.h>
+
+/**
+ * Files larger than this are split into chunks parsed by different threads.
+ */
+#define UM_LOADER_CHUNK_SIZE (1U << 20)
+
+/**
+ * Account file loader - parses the files and chunks of large files in worker threads.
+ * Records are kept in file order and point into the file mappings, which stay valid until the loader is freed.
+ */
+typedef struct um_loader_s um_loader_t;
+
+/**
+ * Allocate new loader.
+ *
+ * @param threads Maximum number of threads parsing the files, including the calling thread - 0 for the number of
+ * online CPUs.
+ *
+ * @return New allocated loader - NULL on allocation failure.
+ *
+ */
+um_loader_t *um_loader_new(unsigned int threads);
+
+/**
+ * Set the size above which files are split into chunks.
+ *
+ * @param loader Loader to use.
+ * @param chunk_size Chunk size in bytes - UM_LOADER_CHUNK_SIZE by default.
+ *
+ */
+void um_loader_set_chunk_size(um_loader_t *loader, size_t chunk_size);
+
+/**
+ * Parse the account files. Can be called only once for each loader.
+ *
+ * @param loader Loader to use.
+ * @param paths Paths of the account files.
+ * @param files Files to parse - bit (1 << file) set for each um_db_file_t value to parse.
+ *
+ * @return Error code - 0 on success, -1 if a file could not be read.
+ *
+ */
+int um_loader_read(um_loader_t *loader, const char *const paths[UM_DB_FILE_COUNT], unsigned int files);
+
+/**
+ * Get the number of records parsed from the account file.
+ *
+ * @param loader Loader to use.
+ * @param file Account file.
+ *
+ * @return Number of records.
+ *
+ */
+size_t um_loader_get_count(const um_loader_t *loader, um_db_file_t file);
+
+/**
+ * Get parsed passwd record.
+ *
+ * @param loader Loader to use.
+ * @param index Index of the record in the file.
+ *
+ * @return Parsed record.
+ *
+ */
+const struct passwd *um_loader_get_passwd(const um_loader_t *loader, size_t index);
+
+/**
+ * Get parsed shadow record.
+ *
+ * @param loader Loader to use.
+ * @param index Index of the record in the file.
+ *
+ * @return Parsed record.
+ *
+ */
+const struct spwd *um_loader_get_shadow(const um_loader_t *loader, size_t index);
+
+/**
+ * Get parsed group record.
+ *
+ * @param loader Loader to use.
+ * @param index Index of the record in the file.
+ *
+ * @return Parsed record.
+ *
+ */
+const struct group *um_loader_get_group(const um_loader_t *loader, size_t index);
+
+/**
+ * Get parsed gshadow record.
+ *
+ * @param loader Loader to use.
+ * @param index Index of the record in the file.
+ *
+ * @return Parsed record.
+ *
+ */
+const struct sgrp *um_loader_get_gshadow(const um_loader_t *loader, size_t index);
+
+/**
+ * Free the loader, its records and file mappings.
+ *
+ * @param loader Loader to free.
+ *
+ */
+void um_loader_free(um_loader_t *loader);
+
+#endif // UMGMT_LOADER_H
\ No newline at end of file
@@ -0,0 +1,42 @@
+/**
+ * @file membership.h
+ * @brief Internal API for linking group members and admins with their users.
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#ifndef UMGMT_MEMBERSHIP_H
+#define UMGMT_MEMBERSHIP_H
+
+#include "types.h"
+
+/**
+ * Link group member/admin element into the group list of its user.
+ *
+ * @param element Element to link - the user field must be set.
+ *
+ */
+void um_user_link_membership(um_group_user_element_t *element);
+
+/**
+ * Unlink group member/admin element from the group list of its user.
+ *
+ * @param element Element to unlink.
+ *
+ */
+void um_user_unlink_membership(um_group_user_element_t *element);
+
+/**
+ * Remove group member/admin element from both the group and the user and free it.
+ *
+ * @param element Element to remove.
+ *
+ */
+void um_group_drop_membership(um_group_user_element_t *element);
+
+#endif // UMGMT_MEMBERSHIP_H
\ No newline at end of file
@@ -0,0 +1,88 @@
+/**
+ * @file owner.h
+ * @brief Internal API for keeping database indexes in sync with the setters of stored users and groups.
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#ifndef UMGMT_OWNER_H
+#define UMGMT_OWNER_H
+
+#include "types.h"
+
+#include <sys/types.h>
+
+/**
+ * Set the database which stores the user.
+ *
+ * @param user User to use.
+ * @param db Database whose indexes hold the user - NULL once the user is removed from it.
+ *
+ */
+void um_user_set_owner(um_user_t *user, um_db_t *db);
+
+/**
+ * Get the database which stores the user.
+ *
+ * @param user User to use.
+ *
+ * @return Database set by um_user_set_owner().
+ *
+ */
+um_db_t *um_user_get_owner(const um_user_t *user);
+
+/**
+ * Set the database which stores the group.
+ *
+ * @param group Group to use.
+ * @param db Database whose indexes hold the group - NULL once the group is removed from it.
+ *
+ */
+void um_group_set_owner(um_group_t *group, um_db_t *db);
+
+/**
+ * Get the database which stores the group.
+ *
+ * @param group Group to use.
+ *
+ * @return Database set by um_group_set_owner().
+ *
+ */
+um_db_t *um_group_get_owner(const um_group_t *group);
+
+/**
+ * Move a stored user to new index keys. Called by the setters before the name or UID of the user is replaced,
+ * so the current name still finds the user.
+ * The name key points to the given string - the caller stores it as the new name of the user.
+ *
+ * @param db Database which stores the user.
+ * @param user User to use.
+ * @param name New name of the user.
+ * @param uid New UID of the user.
+ *
+ * @return Error code - 0 on success, -1 on allocation failure, missing name or a name used by another user.
+ *
+ */
+int um_db_rekey_user(um_db_t *db, um_user_t *user, const char *name, uid_t uid);
+
+/**
+ * Move a stored group to new index keys. Called by the setters before the name or GID of the group is replaced,
+ * so the current name still finds the group.
+ * The name key points to the given string - the caller stores it as the new name of the group.
+ *
+ * @param db Database which stores the group.
+ * @param group Group to use.
+ * @param name New name of the group.
+ * @param gid New GID of the group.
+ *
+ * @return Error code - 0 on success, -1 on allocation failure, missing name or a name used by another group.
+ *
+ */
+int um_db_rekey_group(um_db_t *db, um_group_t *group, const char *name, gid_t gid);
+
+#endif // UMGMT_OWNER_H
\ No newline at end of file
@@ -0,0 +1,673 @@
+/**
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "parser.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// number of fields in the account file formats
+#define UM_PARSER_PASSWD_FIELDS 7
+#define UM_PARSER_SHADOW_FIELDS 9
+#define UM_PARSER_SHADOW_OLD_FIELDS 2
+#define UM_PARSER_GROUP_FIELDS 4
+#define UM_PARSER_GSHADOW_FIELDS 4
+
+// initial read buffer size of streamed files
+#ifndef UM_PARSER_STREAM_SIZE
+#define UM_PARSER_STREAM_SIZE (64 * 1024)
+#endif
+
+static char *um_parser_next_line(um_parser_t *parser);
+static bool um_parser_fill(um_parser_t *parser);
+static size_t um_parser_split(char *line, char **fields, size_t count);
+static int um_parser_parse_id(const char *str, id_t *id);
+static int um_parser_parse_long(const char *str, long int *value);
+static int um_parser_parse_ulong(const char *str, unsigned long int *value);
+static char **um_parser_split_list(um_parser_t *parser, int list, char *str);
+
+/**
+ * Map account file for parsing.
+ *
+ * @param parser Parser to initialize.
+ * @param path Path of the file.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_parser_open(um_parser_t *parser, const char *path)
+{
+    int fd = -1;
+    struct stat st = {0};
+    size_t size = 0;
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    void *map = NULL;
+
+    *parser = (um_parser_t){0};
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    if (fstat(fd, &st))
+    {
+        goto error_out;
+    }
+
+    size = (size_t)st.st_size;
+
+    // reserve zeroed memory one page past the data, lines can then be terminated in place even at the end of the file
+    parser->map_size = (size / page_size + 1) * page_size;
+    map = mmap(NULL, parser->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+    {
+        goto error_out;
+    }
+    parser->map = (char *)map;
+
+    // private writable mapping - tokenizing never modifies the file
+    if (size && mmap(parser->map, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        goto error_out;
+    }
+
+    if (size)
+    {
+        madvise(parser->map, size, MADV_SEQUENTIAL);
+    }
+
+    close(fd);
+
+    parser->pos = parser->map;
+    parser->end = parser->map + size;
+
+    return 0;
+
+error_out:
+    close(fd);
+    um_parser_close(parser);
+
+    return -1;
+}
+
+/**
+ * Open account file for parsing through a fixed size buffer.
+ * Memory used by the parser does not depend on the size of the file, records are valid only until the next call.
+ *
+ * @param parser Parser to initialize.
+ * @param path Path of the file.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_parser_open_stream(um_parser_t *parser, const char *path)
+{
+    *parser = (um_parser_t){0};
+
+    parser->buf = (char *)malloc(UM_PARSER_STREAM_SIZE + 1);
+    if (!parser->buf)
+    {
+        return -1;
+    }
+
+    parser->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (parser->fd < 0)
+    {
+        free(parser->buf);
+        *parser = (um_parser_t){0};
+        return -1;
+    }
+
+    posix_fadvise(parser->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    parser->buf_size = UM_PARSER_STREAM_SIZE;
+    parser->pos = parser->buf;
+    parser->end = parser->buf;
+
+    return 0;
+}
+
+/**
+ * Start parsing a streamed file from the beginning again.
+ *
+ * @param parser Parser opened by um_parser_open_stream().
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_parser_rewind(um_parser_t *parser)
+{
+    if (lseek(parser->fd, 0, SEEK_SET) != 0)
+    {
+        parser->failed = true;
+        return -1;
+    }
+
+    parser->pos = parser->buf;
+    parser->end = parser->buf;
+    parser->eof = false;
+    parser->failed = false;
+
+    return 0;
+}
+
+/**
+ * Split the remaining data of the parser into chunks which start at line boundaries.
+ * Chunks share the mapping of the parser and can be used from different threads. Each chunk has its own name lists
+ * and has to be closed by um_parser_close() before the parser itself, which unmaps the data.
+ *
+ * @param parser Parser to split.
+ * @param chunks Array of count parsers to initialize.
+ * @param count Maximum number of chunks.
+ *
+ * @return Number of initialized chunks - fewer than count if the data has too few lines.
+ *
+ */
+size_t um_parser_split_chunks(const um_parser_t *parser, um_parser_t *chunks, size_t count)
+{
+    size_t used = 0;
+    size_t size = (size_t)(parser->end - parser->pos);
+    char *pos = parser->pos;
+    char *end = NULL;
+    char *newline = NULL;
+
+    for (size_t i = 0; i < count && pos < parser->end; i++)
+    {
+        end = parser->pos + size / count * (i + 1);
+
+        // move the boundary past the end of the line, the last chunk takes the rest
+        if (end < pos)
+        {
+            end = pos;
+        }
+        newline = (char *)memchr(end, '\n', (size_t)(parser->end - end));
+        end = (newline && i + 1 < count) ? newline + 1 : parser->end;
+
+        chunks[used++] = (um_parser_t){
+            .pos = pos,
+            .end = end,
+        };
+        pos = end;
+    }
+
+    return used;
+}
+
+/**
+ * Parse the next /etc/passwd record. Malformed lines, empty lines and comments are skipped.
+ *
+ * @param parser Parser to use.
+ * @param pwd Parsed record.
+ *
+ * @return 1 if a record was parsed, 0 at the end of the file.
+ *
+ */
+int um_parser_next_passwd(um_parser_t *parser, struct passwd *pwd)
+{
+    char *line = NULL;
+    char *fields[UM_PARSER_PASSWD_FIELDS] = {0};
+    id_t uid = 0, gid = 0;
+
+    while ((line = um_parser_next_line(parser)) != NULL)
+    {
+        if (um_parser_split(line, fields, UM_PARSER_PASSWD_FIELDS) != UM_PARSER_PASSWD_FIELDS ||
+            um_parser_parse_id(fields[2], &uid) || um_parser_parse_id(fields[3], &gid))
+        {
+            continue;
+        }
+
+        *pwd = (struct passwd){
+            .pw_name = fields[0],
+            .pw_passwd = fields[1],
+            .pw_uid = (uid_t)uid,
+            .pw_gid = (gid_t)gid,
+            .pw_gecos = fields[4],
+            .pw_dir = fields[5],
+            .pw_shell = fields[6],
+        };
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Parse the next /etc/shadow record. Malformed lines, empty lines and comments are skipped.
+ * Empty numeric fields are set to -1, same as in getspent().
+ *
+ * @param parser Parser to use.
+ * @param spwd Parsed record.
+ *
+ * @return 1 if a record was parsed, 0 at the end of the file.
+ *
+ */
+int um_parser_next_shadow(um_parser_t *parser, struct spwd *spwd)
+{
+    char *line = NULL;
+    char *fields[UM_PARSER_SHADOW_FIELDS] = {0};
+    size_t count = 0;
+
+    while ((line = um_parser_next_line(parser)) != NULL)
+    {
+        count = um_parser_split(line, fields, UM_PARSER_SHADOW_FIELDS);
+
+        *spwd = (struct spwd){
+            .sp_namp = fields[0],
+            .sp_pwdp = fields[1],
+            .sp_lstchg = -1,
+            .sp_min = -1,
+            .sp_max = -1,
+            .sp_warn = -1,
+            .sp_inact = -1,
+            .sp_expire = -1,
+            .sp_flag = ~0UL,
+        };
+
+        // old format only has the name and the password
+        if (count == UM_PARSER_SHADOW_OLD_FIELDS)
+        {
+            return 1;
+        }
+
+        if (count != UM_PARSER_SHADOW_FIELDS || um_parser_parse_long(fields[2], &spwd->sp_lstchg) ||
+            um_parser_parse_long(fields[3], &spwd->sp_min) || um_parser_parse_long(fields[4], &spwd->sp_max) ||
+            um_parser_parse_long(fields[5], &spwd->sp_warn) || um_parser_parse_long(fields[6], &spwd->sp_inact) ||
+            um_parser_parse_long(fields[7], &spwd->sp_expire) || um_parser_parse_ulong(fields[8], &spwd->sp_flag))
+        {
+            continue;
+        }
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Parse the next /etc/group record. Malformed lines, empty lines and comments are skipped.
+ *
+ * @param parser Parser to use.
+ * @param grp Parsed record.
+ *
+ * @return 1 if a record was parsed, 0 at the end of the file, -1 on allocation failure.
+ *
+ */
+int um_parser_next_group(um_parser_t *parser, struct group *grp)
+{
+    char *line = NULL;
+    char *fields[UM_PARSER_GROUP_FIELDS] = {0};
+    id_t gid = 0;
+
+    while ((line = um_parser_next_line(parser)) != NULL)
+    {
+        if (um_parser_split(line, fields, UM_PARSER_GROUP_FIELDS) != UM_PARSER_GROUP_FIELDS ||
+            um_parser_parse_id(fields[2], &gid))
+        {
+            continue;
+        }
+
+        *grp = (struct group){
+            .gr_name = fields[0],
+            .gr_passwd = fields[1],
+            .gr_gid = (gid_t)gid,
+            .gr_mem = um_parser_split_list(parser, 0, fields[3]),
+        };
+
+        return grp->gr_mem ? 1 : -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Parse the next /etc/gshadow record. Malformed lines, empty lines and comments are skipped.
+ *
+ * @param parser Parser to use.
+ * @param sgrp Parsed record.
+ *
+ * @return 1 if a record was parsed, 0 at the end of the file, -1 on allocation failure.
+ *
+ */
+int um_parser_next_gshadow(um_parser_t *parser, struct sgrp *sgrp)
+{
+    char *line = NULL;
+    char *fields[UM_PARSER_GSHADOW_FIELDS] = {0};
+
+    while ((line = um_parser_next_line(parser)) != NULL)
+    {
+        if (um_parser_split(line, fields, UM_PARSER_GSHADOW_FIELDS) != UM_PARSER_GSHADOW_FIELDS)
+        {
+            continue;
+        }
+
+        *sgrp = (struct sgrp){
+            .sg_namp = fields[0],
+            .sg_passwd = fields[1],
+            .sg_adm = um_parser_split_list(parser, 0, fields[2]),
+            .sg_mem = um_parser_split_list(parser, 1, fields[3]),
+        };
+
+        return (sgrp->sg_adm && sgrp->sg_mem) ? 1 : -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Unmap or close the file and free parser data.
+ *
+ * @param parser Parser to close.
+ *
+ */
+void um_parser_close(um_parser_t *parser)
+{
+    if (parser->map)
+    {
+        munmap(parser->map, parser->map_size);
+    }
+
+    if (parser->buf)
+    {
+        close(parser->fd);
+        free(parser->buf);
+    }
+
+    free(parser->lists[0]);
+    free(parser->lists[1]);
+
+    *parser = (um_parser_t){0};
+}
+
+/**
+ * Terminate and return the next line which is not empty or a comment.
+ *
+ * @param parser Parser to use.
+ *
+ * @return Next line - NULL at the end of the file.
+ *
+ */
+static char *um_parser_next_line(um_parser_t *parser)
+{
+    while (parser->pos < parser->end || um_parser_fill(parser))
+    {
+        char *line = parser->pos;
+        char *newline = (char *)memchr(line, '\n', (size_t)(parser->end - line));
+
+        // streamed lines cut by the end of the buffer are completed first, the data may move in the buffer
+        if (!newline && um_parser_fill(parser))
+        {
+            continue;
+        }
+        line = parser->pos;
+
+        // last line without a newline is already terminated by the zeroed memory after the data
+        if (newline)
+        {
+            *newline = 0;
+            parser->pos = newline + 1;
+        }
+        else
+        {
+            parser->pos = parser->end;
+        }
+
+        if (*line && *line != '#')
+        {
+            return line;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Read more data of a streamed file into the buffer.
+ * Data which was not parsed yet is moved to the start of the buffer, which is enlarged if it is full.
+ *
+ * @param parser Parser to use.
+ *
+ * @return True if any data was read - false for mapped files, at the end of the file and on failure.
+ *
+ */
+static bool um_parser_fill(um_parser_t *parser)
+{
+    size_t left = (size_t)(parser->end - parser->pos);
+    ssize_t length = 0;
+
+    if (!parser->buf || parser->eof)
+    {
+        return false;
+    }
+
+    memmove(parser->buf, parser->pos, left);
+
+    // a single line fills the whole buffer
+    if (left == parser->buf_size)
+    {
+        char *new_buf = (char *)realloc(parser->buf, parser->buf_size * 2 + 1);
+
+        if (!new_buf)
+        {
+            parser->pos = parser->buf;
+            parser->end = parser->buf;
+            *parser->end = 0;
+            parser->eof = true;
+            parser->failed = true;
+            return false;
+        }
+
+        parser->buf = new_buf;
+        parser->buf_size *= 2;
+    }
+
+    do
+    {
+        length = read(parser->fd, parser->buf + left, parser->buf_size - left);
+    } while (length < 0 && errno == EINTR);
+
+    // partial lines are dropped on read errors
+    parser->pos = parser->buf;
+    parser->end = parser->buf + (length < 0 ? 0 : left + (size_t)length);
+    *parser->end = 0;
+
+    if (length <= 0)
+    {
+        parser->eof = true;
+        parser->failed = length < 0;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Split line into ':' separated fields in place.
+ *
+ * @param line Line to split.
+ * @param fields Array of count field pointers to fill.
+ * @param count Maximum number of fields.
+ *
+ * @return Number of fields found - count + 1 if the line has more fields.
+ *
+ */
+static size_t um_parser_split(char *line, char **fields, size_t count)
+{
+    size_t found = 0;
+
+    while (found < count)
+    {
+        char *colon = strchr(line, ':');
+
+        fields[found++] = line;
+
+        if (!colon)
+        {
+            return found;
+        }
+
+        *colon = 0;
+        line = colon + 1;
+    }
+
+    return count + 1;
+}
+
+/**
+ * Parse UID or GID field.
+ *
+ * @param str Field to parse.
+ * @param id Parsed ID.
+ *
+ * @return Error code - 0 on success, -1 if the field is not a valid ID.
+ *
+ */
+static int um_parser_parse_id(const char *str, id_t *id)
+{
+    char *end = NULL;
+    unsigned long int value = 0;
+
+    if (*str < '0' || *str > '9')
+    {
+        return -1;
+    }
+
+    errno = 0;
+    value = strtoul(str, &end, 10);
+    if (errno || *end || value >= (id_t)-1)
+    {
+        return -1;
+    }
+
+    *id = (id_t)value;
+
+    return 0;
+}
+
+/**
+ * Parse signed numeric shadow field - empty field is parsed as -1.
+ *
+ * @param str Field to parse.
+ * @param value Parsed value.
+ *
+ * @return Error code - 0 on success, -1 if the field is not a valid number.
+ *
+ */
+static int um_parser_parse_long(const char *str, long int *value)
+{
+    char *end = NULL;
+
+    if (!*str)
+    {
+        *value = -1;
+        return 0;
+    }
+
+    errno = 0;
+    *value = strtol(str, &end, 10);
+
+    return (errno || *end) ? -1 : 0;
+}
+
+/**
+ * Parse unsigned numeric shadow field - empty field is parsed as all bits set.
+ *
+ * @param str Field to parse.
+ * @param value Parsed value.
+ *
+ * @return Error code - 0 on success, -1 if the field is not a valid number.
+ *
+ */
+static int um_parser_parse_ulong(const char *str, unsigned long int *value)
+{
+    char *end = NULL;
+
+    if (!*str)
+    {
+        *value = ~0UL;
+        return 0;
+    }
+
+    errno = 0;
+    *value = strtoul(str, &end, 10);
+
+    return (errno || *end) ? -1 : 0;
+}
+
+/**
+ * Split ',' separated name list in place. Empty names are skipped.
+ *
+ * @param parser Parser to use.
+ * @param list Index of the reusable list to fill.
+ * @param str Field to split.
+ *
+ * @return NULL terminated name list - NULL on allocation failure.
+ *
+ */
+static char **um_parser_split_list(um_parser_t *parser, int list, char *str)
+{
+    size_t count = 0;
+    size_t size = 2;
+
+    for (const char *iter = str; *iter; iter++)
+    {
+        if (*iter == ',')
+        {
+            ++size;
+        }
+    }
+
+    if (size > parser->sizes[list])
+    {
+        char **new_list = (char **)realloc(parser->lists[list], size * sizeof(char *));
+
+        if (!new_list)
+        {
+            return NULL;
+        }
+
+        parser->lists[list] = new_list;
+        parser->sizes[list] = size;
+    }
+
+    while (*str)
+    {
+        char *comma = strchr(str, ',');
+
+        if (comma)
+        {
+            *comma = 0;
+        }
+
+        if (*str)
+        {
+            parser->lists[list][count++] = str;
+        }
+
+        if (!comma)
+        {
+            break;
+        }
+
+        str = comma + 1;
+    }
+
+    parser->lists[list][count] = NULL;
+
+    return parser->lists[list];
+}
\ No newline at end of file
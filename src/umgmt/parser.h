@@ -0,0 +1,147 @@
+/**
+ * @file parser.h
+ * @brief Internal API for parsing account files without going through NSS.
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#ifndef UMGMT_PARSER_H
+#define UMGMT_PARSER_H
+
+#include <grp.h>
+#include <gshadow.h>
+#include <pwd.h>
+#include <shadow.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Account file parser.
+ * The file is mapped privately and tokenized in place - returned records point into the mapping and stay valid until
+ * the parser is closed. Member and admin lists are the only allocations and are reused between records.
+ * Streamed files are read through a fixed buffer instead, which only grows for lines longer than the buffer - records
+ * stay valid until the next call.
+ */
+typedef struct um_parser_s um_parser_t;
+
+struct um_parser_s
+{
+    char *map;       ///< File mapping - file data is always followed by a NUL byte.
+    size_t map_size; ///< Size of the mapping.
+    char *pos;       ///< Start of the next line.
+    char *end;       ///< End of the file data.
+    char **lists[2]; ///< Reusable NULL terminated name lists for group records.
+    size_t sizes[2]; ///< Capacities of the name lists.
+    char *buf;       ///< Read buffer of a streamed file - NULL for mapped files.
+    size_t buf_size; ///< Capacity of the read buffer without the terminating NUL byte.
+    int fd;          ///< Descriptor of a streamed file.
+    bool eof;        ///< Streamed file was read to the end.
+    bool failed;     ///< Streamed file could not be read - records stop as at the end of the file.
+};
+
+/**
+ * Map account file for parsing.
+ *
+ * @param parser Parser to initialize.
+ * @param path Path of the file.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_parser_open(um_parser_t *parser, const char *path);
+
+/**
+ * Open account file for parsing through a fixed size buffer.
+ * Memory used by the parser does not depend on the size of the file, records are valid only until the next call.
+ *
+ * @param parser Parser to initialize.
+ * @param path Path of the file.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_parser_open_stream(um_parser_t *parser, const char *path);
+
+/**
+ * Start parsing a streamed file from the beginning again.
+ *
+ * @param parser Parser opened by um_parser_open_stream().
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_parser_rewind(um_parser_t *parser);
+
+/**
+ * Split the remaining data of the parser into chunks which start at line boundaries.
+ * Chunks share the mapping of the parser and can be used from different threads. Each chunk has its own name lists
+ * and has to be closed by um_parser_close() before the parser itself, which unmaps the data.
+ *
+ * @param parser Parser to split.
+ * @param chunks Array of count parsers to initialize.
+ * @param count Maximum number of chunks.
+ *
+ * @return Number of initialized chunks - fewer than count if the data has too few lines.
+ *
+ */
+size_t um_parser_split_chunks(const um_parser_t *parser, um_parser_t *chunks, size_t count);
+
+/**
+ * Parse the next /etc/passwd record. Malformed lines, empty lines and comments are skipped.
+ *
+ * @param parser Parser to use.
+ * @param pwd Parsed record.
+ *
+ * @return 1 if a record was parsed, 0 at the end of the file.
+ *
+ */
+int um_parser_next_passwd(um_parser_t *parser, struct passwd *pwd);
+
+/**
+ * Parse the next /etc/shadow record. Malformed lines, empty lines and comments are skipped.
+ * Empty numeric fields are set to -1, same as in getspent().
+ *
+ * @param parser Parser to use.
+ * @param spwd Parsed record.
+ *
+ * @return 1 if a record was parsed, 0 at the end of the file.
+ *
+ */
+int um_parser_next_shadow(um_parser_t *parser, struct spwd *spwd);
+
+/**
+ * Parse the next /etc/group record. Malformed lines, empty lines and comments are skipped.
+ *
+ * @param parser Parser to use.
+ * @param grp Parsed record.
+ *
+ * @return 1 if a record was parsed, 0 at the end of the file, -1 on allocation failure.
+ *
+ */
+int um_parser_next_group(um_parser_t *parser, struct group *grp);
+
+/**
+ * Parse the next /etc/gshadow record. Malformed lines, empty lines and comments are skipped.
+ *
+ * @param parser Parser to use.
+ * @param sgrp Parsed record.
+ *
+ * @return 1 if a record was parsed, 0 at the end of the file, -1 on allocation failure.
+ *
+ */
+int um_parser_next_gshadow(um_parser_t *parser, struct sgrp *sgrp);
+
+/**
+ * Unmap or close the file and free parser data.
+ *
+ * @param parser Parser to close.
+ *
+ */
+void um_parser_close(um_parser_t *parser);
+
+#endif // UMGMT_PARSER_H
\ No newline at end of file
@@ -0,0 +1,1126 @@
+/**
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "proc.h"
+#include "user.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// report allocation failures instead of exiting the process
+#define HASH_NONFATAL_OOM 1
+#include <uthash.h>
+
+// initial capacity of the process list of an UID
+#define UM_PROC_INITIAL_CAPACITY 8
+
+// status data read per process - the Uid line is among the first lines
+#define UM_PROC_STATUS_SIZE 1024
+
+// passes over /proc after which processes which keep appearing are given up on
+#define UM_PROC_TERMINATE_ROUNDS 16
+
+// interval of checking processes without a pidfd
+#define UM_PROC_POLL_INTERVAL_MS 10
+
+typedef struct um_proc_entry_s um_proc_entry_t;
+typedef struct um_proc_target_s um_proc_target_t;
+
+/**
+ * UID set entry with the processes found for the UID.
+ */
+struct um_proc_entry_s
+{
+    uid_t uid;         ///< UID to look for - set key.
+    pid_t *pids;       ///< Found processes.
+    size_t count;      ///< Number of found processes.
+    size_t capacity;   ///< Capacity of the process array.
+    bool sliced;       ///< Processes were taken from the user slice of the UID.
+    UT_hash_handle hh; ///< UID set handle.
+};
+
+/**
+ * Process being terminated.
+ */
+struct um_proc_target_s
+{
+    pid_t pid;   ///< Process ID.
+    uid_t uid;   ///< UID the process was found for.
+    int pidfd;   ///< Descriptor pinning the process - -1 without pidfd support.
+    bool exited; ///< Process is gone.
+    bool killed; ///< Process was killed with its cgroup.
+};
+
+struct um_proc_scan_s
+{
+    um_proc_entry_t *entries;
+    char *root;
+    char *cgroup_root;
+    bool cgroup_kill;
+    um_proc_uid_t uid_type;
+};
+
+static int um_proc_set_path(char **path, const char *new_path);
+static int um_proc_scan_cgroups(um_proc_scan_t *scan, int proc_fd, size_t *missing);
+static int um_proc_read_cgroup(const um_proc_scan_t *scan, int proc_fd, int cgroup_fd, um_proc_entry_t *entry);
+static int um_proc_read_cgroup_procs(const um_proc_scan_t *scan, int proc_fd, int fd, um_proc_entry_t *entry);
+static int um_proc_add_cgroup_pid(const um_proc_scan_t *scan, int proc_fd, unsigned long int value,
+                                  um_proc_entry_t *entry);
+static size_t um_proc_cgroup_kill(const um_proc_scan_t *scan, um_proc_target_t *targets, size_t count);
+static bool um_proc_parse_pid(const char *name, pid_t *pid);
+static int um_proc_read_uid(const um_proc_scan_t *scan, int proc_fd, const char *pid, uid_t *uid);
+static int um_proc_parse_status_uid(const char *status, int field, uid_t *uid);
+static int um_proc_entry_push(um_proc_entry_t *entry, pid_t pid);
+static int um_proc_collect_targets(const um_proc_scan_t *scan, int proc_fd, um_proc_target_t **targets, size_t *count);
+static int um_proc_signal(um_proc_target_t *target, int sig);
+static size_t um_proc_wait(um_proc_target_t *targets, size_t count, unsigned int timeout_ms);
+static void um_proc_close_targets(um_proc_target_t *targets, size_t count);
+static int um_proc_pidfd_open(pid_t pid);
+static int um_proc_pidfd_send_signal(int pidfd, int sig);
+static unsigned long int um_proc_now_ms(void);
+
+/**
+ * Allocate new process scan with an empty UID set.
+ *
+ * @return New allocated scan - NULL on allocation failure.
+ *
+ */
+um_proc_scan_t *um_proc_scan_new(void)
+{
+    um_proc_scan_t *scan = (um_proc_scan_t *)malloc(sizeof(um_proc_scan_t));
+
+    if (!scan)
+    {
+        return NULL;
+    }
+
+    *scan = (um_proc_scan_t){0};
+
+    return scan;
+}
+
+/**
+ * Set the directory procfs is mounted on - useful for containers with their own /proc mount.
+ *
+ * @param scan Scan to use.
+ * @param root Mount point - NULL for /proc.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_proc_scan_set_root(um_proc_scan_t *scan, const char *root)
+{
+    return um_proc_set_path(&scan->root, root);
+}
+
+/**
+ * Enable the cgroup fast path - processes are taken from the user-<uid>.slice cgroups systemd creates for logged in
+ * users, instead of scanning all of /proc. Scans then take time proportional to the number of processes of the users,
+ * but do not find processes of those users outside of the slices, such as services running as the user. The UIDs of
+ * the processes are still checked. UIDs without a slice, including all UIDs if the hierarchy has no user.slice cgroup,
+ * are looked up by the /proc scan - it is only made if any UID in the set has no slice.
+ * The fast path is disabled by default.
+ *
+ * @param scan Scan to use.
+ * @param root Mount point of the cgroup v2 hierarchy, usually /sys/fs/cgroup - NULL to disable the fast path.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_proc_scan_set_cgroup_root(um_proc_scan_t *scan, const char *root)
+{
+    return um_proc_set_path(&scan->cgroup_root, root);
+}
+
+/**
+ * Let um_proc_scan_terminate() kill user slices with cgroup.kill instead of sending SIGKILL to each process.
+ * cgroup.kill kills every process in the slice, including processes of the user's sessions which run as other users,
+ * such as root shells started with sudo - only enable it if those should be killed as well. Needs the cgroup fast path,
+ * slices without cgroup.kill support are killed process by process. Disabled by default.
+ *
+ * @param scan Scan to use.
+ * @param enable True to kill the slices as a whole.
+ *
+ */
+void um_proc_scan_set_cgroup_kill(um_proc_scan_t *scan, bool enable)
+{
+    scan->cgroup_kill = enable;
+}
+
+/**
+ * Set the UID processes are matched by.
+ *
+ * @param scan Scan to use.
+ * @param uid_type UID to match - UM_PROC_UID_REAL by default.
+ *
+ */
+void um_proc_scan_set_uid_type(um_proc_scan_t *scan, um_proc_uid_t uid_type)
+{
+    scan->uid_type = uid_type;
+}
+
+/**
+ * Add UID to the set of UIDs to look for. Adding an UID twice has no effect.
+ *
+ * @param scan Scan to use.
+ * @param uid UID to add.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_proc_scan_add_uid(um_proc_scan_t *scan, uid_t uid)
+{
+    um_proc_entry_t *entry = NULL;
+
+    HASH_FIND(hh, scan->entries, &uid, sizeof(uid_t), entry);
+    if (entry)
+    {
+        return 0;
+    }
+
+    entry = (um_proc_entry_t *)malloc(sizeof(um_proc_entry_t));
+    if (!entry)
+    {
+        return -1;
+    }
+
+    *entry = (um_proc_entry_t){0};
+    entry->uid = uid;
+
+    HASH_ADD(hh, scan->entries, uid, sizeof(uid_t), entry);
+    if (!entry->hh.tbl)
+    {
+        free(entry);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Add UID of the user to the set of UIDs to look for.
+ *
+ * @param scan Scan to use.
+ * @param user User to add.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_proc_scan_add_user(um_proc_scan_t *scan, const um_user_t *user)
+{
+    return um_proc_scan_add_uid(scan, um_user_get_uid(user));
+}
+
+/**
+ * Find processes of all UIDs in the set. All processes are visited once and each process is matched against the set
+ * in constant time, so the scan takes time proportional to the number of processes, regardless of the number of UIDs.
+ * Status files are read with a single read() relative to the procfs directory descriptor, and are not read at all when
+ * matching by UM_PROC_UID_OWNER. With the cgroup fast path only processes in the user slices are visited, /proc is
+ * scanned only for UIDs without a slice. Results of a previous run are replaced.
+ *
+ * @param scan Scan to run.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_proc_scan_run(um_proc_scan_t *scan)
+{
+    int error = 0;
+    DIR *proc_d = NULL;
+    struct dirent *proc = NULL;
+    um_proc_entry_t *entry = NULL, *tmp_entry = NULL;
+    pid_t pid = 0;
+    uid_t uid = 0;
+    size_t missing = 0;
+
+    HASH_ITER(hh, scan->entries, entry, tmp_entry)
+    {
+        entry->count = 0;
+        entry->sliced = false;
+    }
+
+    proc_d = opendir(scan->root ? scan->root : "/proc");
+    if (!proc_d)
+    {
+        return -1;
+    }
+
+    // systemd keeps processes of logged in users in their own slices
+    if (scan->cgroup_root)
+    {
+        error = um_proc_scan_cgroups(scan, dirfd(proc_d), &missing);
+        if (error || !missing)
+        {
+            closedir(proc_d);
+            return error;
+        }
+    }
+
+    while (!error && (proc = readdir(proc_d)) != NULL)
+    {
+        // processes which exit during the scan are skipped
+        if (!um_proc_parse_pid(proc->d_name, &pid) || um_proc_read_uid(scan, dirfd(proc_d), proc->d_name, &uid))
+        {
+            continue;
+        }
+
+        // processes of UIDs with a slice were taken from it
+        HASH_FIND(hh, scan->entries, &uid, sizeof(uid_t), entry);
+        if (entry && !entry->sliced)
+        {
+            error = um_proc_entry_push(entry, pid);
+        }
+    }
+
+    closedir(proc_d);
+
+    return error;
+}
+
+/**
+ * Get processes found for the UID by the last run.
+ *
+ * @param scan Scan to use.
+ * @param uid UID to get the processes of.
+ * @param count Set to the number of found processes.
+ *
+ * @return Array of found process IDs - NULL if no processes were found or the UID is not in the set.
+ *
+ */
+const pid_t *um_proc_scan_get_pids(const um_proc_scan_t *scan, uid_t uid, size_t *count)
+{
+    um_proc_entry_t *entry = NULL;
+
+    *count = 0;
+
+    HASH_FIND(hh, scan->entries, &uid, sizeof(uid_t), entry);
+    if (!entry || !entry->count)
+    {
+        return NULL;
+    }
+
+    *count = entry->count;
+
+    return entry->pids;
+}
+
+/**
+ * Terminate all processes of the UIDs in the set.
+ * Found processes are pinned by pidfds and checked again after that, so a process ID reused by another process is
+ * never signaled. All processes are sent SIGTERM and given the grace period to exit - the rest is sent SIGKILL. The
+ * scan is repeated until no processes are found, processes which appear after the first pass are killed right away.
+ * Kernels without pidfd support fall back to kill() and polling. SIGKILL is replaced by cgroup.kill of the user slices
+ * only if enabled by um_proc_scan_set_cgroup_kill().
+ *
+ * @param scan Scan to use.
+ * @param grace_ms Time given to processes to exit after SIGTERM in milliseconds, also the longest wait for SIGKILL.
+ * @param stats Filled with counts and timing - can be NULL.
+ *
+ * @return Error code - 0 on success, -1 if a process could not be signaled or processes keep appearing.
+ *
+ */
+int um_proc_scan_terminate(um_proc_scan_t *scan, unsigned int grace_ms, um_proc_kill_stats_t *stats)
+{
+    int error = -1;
+    int proc_fd = -1;
+    um_proc_kill_stats_t result = {0};
+    um_proc_target_t *targets = NULL;
+    size_t count = 0;
+    size_t alive = 0;
+    bool failed = false;
+    unsigned long int start = um_proc_now_ms();
+
+    proc_fd = open(scan->root ? scan->root : "/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (proc_fd < 0)
+    {
+        return -1;
+    }
+
+    for (int round = 0; !failed && round < UM_PROC_TERMINATE_ROUNDS; round++)
+    {
+        result.scans++;
+        if (um_proc_scan_run(scan) || um_proc_collect_targets(scan, proc_fd, &targets, &count))
+        {
+            break;
+        }
+
+        if (!count)
+        {
+            error = 0;
+            break;
+        }
+
+        // only the first pass is graceful - later processes were started while the user was being terminated
+        for (size_t i = 0; !failed && round == 0 && i < count; i++)
+        {
+            failed = um_proc_signal(&targets[i], SIGTERM) != 0;
+        }
+
+        alive = (!failed && round == 0) ? um_proc_wait(targets, count, grace_ms) : count;
+        result.terminated += count - alive;
+
+        // user slices are killed as a whole only on request, they can hold processes of other users
+        if (!failed && alive && scan->cgroup_root && scan->cgroup_kill)
+        {
+            result.killed += um_proc_cgroup_kill(scan, targets, count);
+        }
+
+        for (size_t i = 0; !failed && i < count; i++)
+        {
+            if (!targets[i].exited && !targets[i].killed)
+            {
+                failed = um_proc_signal(&targets[i], SIGKILL) != 0;
+                result.killed += failed ? 0 : 1;
+            }
+        }
+
+        // SIGKILL is not instant, processes still dying are found again by the next pass
+        if (!failed)
+        {
+            um_proc_wait(targets, count, grace_ms);
+        }
+
+        um_proc_close_targets(targets, count);
+        targets = NULL;
+        count = 0;
+    }
+
+    um_proc_close_targets(targets, count);
+    close(proc_fd);
+
+    result.elapsed_ms = um_proc_now_ms() - start;
+    if (stats)
+    {
+        *stats = result;
+    }
+
+    return error;
+}
+
+/**
+ * Free scan data.
+ *
+ * @param scan Scan to free.
+ *
+ */
+void um_proc_scan_free(um_proc_scan_t *scan)
+{
+    um_proc_entry_t *entry = NULL, *tmp_entry = NULL;
+
+    HASH_ITER(hh, scan->entries, entry, tmp_entry)
+    {
+        HASH_DEL(scan->entries, entry);
+        free(entry->pids);
+        free(entry);
+    }
+
+    free(scan->root);
+    free(scan->cgroup_root);
+    free(scan);
+}
+
+/**
+ * Replace a path of the scan.
+ *
+ * @param path Path to replace.
+ * @param new_path New path - NULL for the default.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_proc_set_path(char **path, const char *new_path)
+{
+    char *copy = NULL;
+
+    if (new_path)
+    {
+        copy = strdup(new_path);
+        if (!copy)
+        {
+            return -1;
+        }
+    }
+
+    free(*path);
+    *path = copy;
+
+    return 0;
+}
+
+/**
+ * Find processes of all UIDs in the set using their user slices.
+ * UIDs without a slice are left for the /proc scan.
+ *
+ * @param scan Scan to use.
+ * @param proc_fd Descriptor of the procfs directory.
+ * @param missing Set to the number of UIDs without a user slice - their processes need the /proc scan.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_proc_scan_cgroups(um_proc_scan_t *scan, int proc_fd, size_t *missing)
+{
+    int error = 0;
+    int slices_fd = -1;
+    int slice_fd = -1;
+    char path[PATH_MAX] = {0};
+    um_proc_entry_t *entry = NULL, *tmp_entry = NULL;
+
+    *missing = HASH_COUNT(scan->entries);
+
+    if (snprintf(path, sizeof(path), "%s/user.slice", scan->cgroup_root) >= (int)sizeof(path))
+    {
+        return 0;
+    }
+
+    slices_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (slices_fd < 0)
+    {
+        return 0;
+    }
+
+    HASH_ITER(hh, scan->entries, entry, tmp_entry)
+    {
+        snprintf(path, sizeof(path), "user-%u.slice", (unsigned int)entry->uid);
+
+        slice_fd = openat(slices_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (slice_fd < 0)
+        {
+            continue;
+        }
+
+        entry->sliced = true;
+        (*missing)--;
+
+        if (um_proc_read_cgroup(scan, proc_fd, slice_fd, entry))
+        {
+            error = -1;
+            break;
+        }
+    }
+
+    close(slices_fd);
+
+    return error;
+}
+
+/**
+ * Add processes of the cgroup and all its descendants which run as the UID of the entry.
+ *
+ * @param scan Scan to use.
+ * @param proc_fd Descriptor of the procfs directory.
+ * @param cgroup_fd Descriptor of the cgroup directory - closed by the function.
+ * @param entry UID set entry to add the processes to.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_proc_read_cgroup(const um_proc_scan_t *scan, int proc_fd, int cgroup_fd, um_proc_entry_t *entry)
+{
+    int error = 0;
+    int fd = -1;
+    DIR *cgroup_d = NULL;
+    struct dirent *child = NULL;
+
+    fd = openat(cgroup_fd, "cgroup.procs", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        error = um_proc_read_cgroup_procs(scan, proc_fd, fd, entry);
+        close(fd);
+    }
+
+    cgroup_d = fdopendir(cgroup_fd);
+    if (!cgroup_d)
+    {
+        close(cgroup_fd);
+        return -1;
+    }
+
+    // cgroups removed during the walk are skipped
+    while (!error && (child = readdir(cgroup_d)) != NULL)
+    {
+        if (child->d_type != DT_DIR || !strcmp(child->d_name, ".") || !strcmp(child->d_name, ".."))
+        {
+            continue;
+        }
+
+        fd = openat(dirfd(cgroup_d), child->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            error = um_proc_read_cgroup(scan, proc_fd, fd, entry);
+        }
+    }
+
+    closedir(cgroup_d);
+
+    return error;
+}
+
+/**
+ * Add processes listed in a cgroup.procs file which run as the UID of the entry.
+ *
+ * @param scan Scan to use.
+ * @param proc_fd Descriptor of the procfs directory.
+ * @param fd Descriptor of the cgroup.procs file.
+ * @param entry UID set entry to add the processes to.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_proc_read_cgroup_procs(const um_proc_scan_t *scan, int proc_fd, int fd, um_proc_entry_t *entry)
+{
+    char buf[UM_PROC_STATUS_SIZE] = {0};
+    ssize_t length = 0;
+    unsigned long int value = 0;
+    bool digits = false;
+
+    // one process ID per line, numbers can be split between reads
+    while ((length = read(fd, buf, sizeof(buf))) > 0)
+    {
+        for (ssize_t i = 0; i < length; i++)
+        {
+            if (buf[i] >= '0' && buf[i] <= '9')
+            {
+                value = value > INT32_MAX ? value : value * 10 + (unsigned long int)(buf[i] - '0');
+                digits = true;
+                continue;
+            }
+
+            if (digits && um_proc_add_cgroup_pid(scan, proc_fd, value, entry))
+            {
+                return -1;
+            }
+
+            value = 0;
+            digits = false;
+        }
+    }
+
+    if (digits && um_proc_add_cgroup_pid(scan, proc_fd, value, entry))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Add process from a cgroup if it runs as the UID of the entry.
+ *
+ * @param scan Scan to use.
+ * @param proc_fd Descriptor of the procfs directory.
+ * @param value Process ID.
+ * @param entry UID set entry to add the process to.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_proc_add_cgroup_pid(const um_proc_scan_t *scan, int proc_fd, unsigned long int value,
+                                  um_proc_entry_t *entry)
+{
+    char name[16] = {0};
+    uid_t uid = 0;
+
+    if (!value || value > INT32_MAX)
+    {
+        return 0;
+    }
+
+    // processes which exited or switched to another user are skipped
+    snprintf(name, sizeof(name), "%lu", value);
+    if (um_proc_read_uid(scan, proc_fd, name, &uid) || uid != entry->uid)
+    {
+        return 0;
+    }
+
+    return um_proc_entry_push(entry, (pid_t)value);
+}
+
+/**
+ * Kill user slices of the processes still running using cgroup.kill.
+ *
+ * @param scan Scan to use.
+ * @param targets Processes to kill - processes in killed slices are marked.
+ * @param count Number of processes.
+ *
+ * @return Number of processes killed with their slices.
+ *
+ */
+static size_t um_proc_cgroup_kill(const um_proc_scan_t *scan, um_proc_target_t *targets, size_t count)
+{
+    char path[PATH_MAX] = {0};
+    size_t killed = 0;
+    bool written = false;
+    int fd = -1;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (targets[i].exited || targets[i].killed)
+        {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/user.slice/user-%u.slice/cgroup.kill", scan->cgroup_root,
+                 (unsigned int)targets[i].uid);
+
+        // kernels before 5.14 do not have cgroup.kill
+        fd = open(path, O_WRONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            continue;
+        }
+
+        written = write(fd, "1", 1) == 1;
+        close(fd);
+
+        for (size_t j = i; written && j < count; j++)
+        {
+            if (!targets[j].exited && !targets[j].killed && targets[j].uid == targets[i].uid)
+            {
+                targets[j].killed = true;
+                killed++;
+            }
+        }
+    }
+
+    return killed;
+}
+
+/**
+ * Parse process directory name.
+ *
+ * @param name Directory entry name.
+ * @param pid Parsed process ID.
+ *
+ * @return True if the name is a process ID.
+ *
+ */
+static bool um_proc_parse_pid(const char *name, pid_t *pid)
+{
+    char *end = NULL;
+    long int value = 0;
+
+    if (*name < '1' || *name > '9')
+    {
+        return false;
+    }
+
+    errno = 0;
+    value = strtol(name, &end, 10);
+    if (errno || *end || value > INT32_MAX)
+    {
+        return false;
+    }
+
+    *pid = (pid_t)value;
+
+    return true;
+}
+
+/**
+ * Read the UID of the process the scan matches by.
+ *
+ * @param scan Scan to use.
+ * @param proc_fd Descriptor of the procfs directory.
+ * @param pid Process directory name.
+ * @param uid Read UID.
+ *
+ * @return Error code - 0 on success, -1 if the process does not exist anymore.
+ *
+ */
+static int um_proc_read_uid(const um_proc_scan_t *scan, int proc_fd, const char *pid, uid_t *uid)
+{
+    char status_path[32] = {0};
+    char buf[UM_PROC_STATUS_SIZE] = {0};
+    struct stat st = {0};
+    ssize_t length = 0;
+    int fd = -1;
+
+    if (scan->uid_type == UM_PROC_UID_OWNER)
+    {
+        if (fstatat(proc_fd, pid, &st, 0))
+        {
+            return -1;
+        }
+
+        *uid = st.st_uid;
+        return 0;
+    }
+
+    if (snprintf(status_path, sizeof(status_path), "%s/status", pid) >= (int)sizeof(status_path))
+    {
+        return -1;
+    }
+
+    fd = openat(proc_fd, status_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    // procfs generates the whole beginning of the file in one read
+    length = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+
+    if (length <= 0)
+    {
+        return -1;
+    }
+
+    buf[length] = 0;
+
+    return um_proc_parse_status_uid(buf, scan->uid_type == UM_PROC_UID_EFFECTIVE ? 1 : 0, uid);
+}
+
+/**
+ * Find UID in the Uid line of a status file - the line contains the real, effective, saved and filesystem UIDs.
+ *
+ * @param status Status file data.
+ * @param field Index of the UID in the line.
+ * @param uid Found UID.
+ *
+ * @return Error code - 0 on success, -1 if the line is missing or malformed.
+ *
+ */
+static int um_proc_parse_status_uid(const char *status, int field, uid_t *uid)
+{
+    const char *line = strncmp(status, "Uid:", 4) ? strstr(status, "\nUid:") : status;
+    char *end = NULL;
+    unsigned long int value = 0;
+
+    if (!line)
+    {
+        return -1;
+    }
+
+    // fields are separated by tabs
+    end = (char *)line + (line == status ? 4 : 5);
+    for (int i = 0; i <= field; i++)
+    {
+        const char *start = end;
+
+        if (*start != '\t')
+        {
+            return -1;
+        }
+
+        errno = 0;
+        value = strtoul(start, &end, 10);
+        if (errno || end == start || value > UINT32_MAX)
+        {
+            return -1;
+        }
+    }
+
+    *uid = (uid_t)value;
+
+    return 0;
+}
+
+/**
+ * Append process to the processes found for an UID.
+ *
+ * @param entry UID set entry to use.
+ * @param pid Process ID to append.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_proc_entry_push(um_proc_entry_t *entry, pid_t pid)
+{
+    pid_t *pids = NULL;
+    size_t capacity = 0;
+
+    if (entry->count == entry->capacity)
+    {
+        capacity = entry->capacity ? entry->capacity * 2 : UM_PROC_INITIAL_CAPACITY;
+        pids = (pid_t *)realloc(entry->pids, capacity * sizeof(pid_t));
+        if (!pids)
+        {
+            return -1;
+        }
+
+        entry->pids = pids;
+        entry->capacity = capacity;
+    }
+
+    entry->pids[entry->count++] = pid;
+
+    return 0;
+}
+
+/**
+ * Pin the processes found by the last run with pidfds.
+ * Processes which no longer run as the UID they were found for are skipped, even if the new UID is in the set.
+ *
+ * @param scan Scan to use.
+ * @param proc_fd Descriptor of the procfs directory.
+ * @param targets Set to the new allocated array of processes - NULL if none were found.
+ * @param count Set to the number of processes.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_proc_collect_targets(const um_proc_scan_t *scan, int proc_fd, um_proc_target_t **targets, size_t *count)
+{
+    um_proc_entry_t *entry = NULL, *tmp_entry = NULL;
+    um_proc_target_t *new_targets = NULL;
+    size_t total = 0;
+    size_t used = 0;
+    char name[16] = {0};
+    uid_t uid = 0;
+    int pidfd = -1;
+
+    *targets = NULL;
+    *count = 0;
+
+    HASH_ITER(hh, scan->entries, entry, tmp_entry)
+    {
+        total += entry->count;
+    }
+
+    if (!total)
+    {
+        return 0;
+    }
+
+    new_targets = (um_proc_target_t *)malloc(total * sizeof(um_proc_target_t));
+    if (!new_targets)
+    {
+        return -1;
+    }
+
+    HASH_ITER(hh, scan->entries, entry, tmp_entry)
+    {
+        for (size_t i = 0; i < entry->count; i++)
+        {
+            // exited processes are skipped, without pidfd support the process ID is used as is
+            pidfd = um_proc_pidfd_open(entry->pids[i]);
+            if (pidfd < 0 && errno != ENOSYS)
+            {
+                continue;
+            }
+
+            // the process ID could be reused before the pidfd was opened - the pinned process must run as the same UID
+            snprintf(name, sizeof(name), "%d", (int)entry->pids[i]);
+            if (um_proc_read_uid(scan, proc_fd, name, &uid) || uid != entry->uid)
+            {
+                if (pidfd >= 0)
+                {
+                    close(pidfd);
+                }
+                continue;
+            }
+
+            new_targets[used++] = (um_proc_target_t){
+                .pid = entry->pids[i],
+                .uid = entry->uid,
+                .pidfd = pidfd,
+            };
+        }
+    }
+
+    if (!used)
+    {
+        free(new_targets);
+        return 0;
+    }
+
+    *targets = new_targets;
+    *count = used;
+
+    return 0;
+}
+
+/**
+ * Send signal to the process.
+ *
+ * @param target Process to signal - marked as exited if it is gone.
+ * @param sig Signal to send.
+ *
+ * @return Error code - 0 on success or if the process is gone, -1 if the signal is not permitted.
+ *
+ */
+static int um_proc_signal(um_proc_target_t *target, int sig)
+{
+    int result = target->pidfd >= 0 ? um_proc_pidfd_send_signal(target->pidfd, sig) : kill(target->pid, sig);
+
+    if (result && errno == ESRCH)
+    {
+        target->exited = true;
+        return 0;
+    }
+
+    return result ? -1 : 0;
+}
+
+/**
+ * Wait until the processes exit.
+ *
+ * @param targets Processes to wait for - marked as exited when they are gone.
+ * @param count Number of processes.
+ * @param timeout_ms Longest time to wait in milliseconds.
+ *
+ * @return Number of processes still running.
+ *
+ */
+static size_t um_proc_wait(um_proc_target_t *targets, size_t count, unsigned int timeout_ms)
+{
+    struct pollfd *fds = (struct pollfd *)malloc(count * sizeof(struct pollfd));
+    unsigned long int deadline = um_proc_now_ms() + timeout_ms;
+    unsigned long int now = 0;
+    unsigned long int timeout = 0;
+    size_t alive = 0;
+    bool polling = false;
+
+    while (true)
+    {
+        alive = 0;
+        polling = false;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            // processes without a pidfd are checked by the null signal
+            if (!targets[i].exited && targets[i].pidfd < 0 && kill(targets[i].pid, 0) && errno == ESRCH)
+            {
+                targets[i].exited = true;
+            }
+
+            if (!targets[i].exited)
+            {
+                alive++;
+                polling = polling || targets[i].pidfd < 0;
+            }
+
+            // negative descriptors are ignored by poll()
+            if (fds)
+            {
+                fds[i] = (struct pollfd){
+                    .fd = targets[i].exited ? -1 : targets[i].pidfd,
+                    .events = POLLIN,
+                };
+            }
+        }
+
+        now = um_proc_now_ms();
+        if (!alive || now >= deadline)
+        {
+            break;
+        }
+
+        // pidfds become readable when the process exits, other processes are checked again after an interval
+        timeout = deadline - now;
+        if ((!fds || polling) && timeout > UM_PROC_POLL_INTERVAL_MS)
+        {
+            timeout = UM_PROC_POLL_INTERVAL_MS;
+        }
+        poll(fds, fds ? count : 0, (int)timeout);
+
+        for (size_t i = 0; fds && i < count; i++)
+        {
+            if (fds[i].fd >= 0 && fds[i].revents)
+            {
+                targets[i].exited = true;
+            }
+        }
+    }
+
+    free(fds);
+
+    return alive;
+}
+
+/**
+ * Close the pidfds of the processes and free the array.
+ *
+ * @param targets Processes to free - can be NULL.
+ * @param count Number of processes.
+ *
+ */
+static void um_proc_close_targets(um_proc_target_t *targets, size_t count)
+{
+    for (size_t i = 0; targets && i < count; i++)
+    {
+        if (targets[i].pidfd >= 0)
+        {
+            close(targets[i].pidfd);
+        }
+    }
+
+    free(targets);
+}
+
+/**
+ * Open pidfd referring to the process.
+ *
+ * @param pid Process ID.
+ *
+ * @return Process descriptor - -1 with errno set to ENOSYS if pidfds are not supported.
+ *
+ */
+static int um_proc_pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * Send signal to the process referred to by the pidfd.
+ *
+ * @param pidfd Process descriptor.
+ * @param sig Signal to send.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_proc_pidfd_send_signal(int pidfd, int sig)
+{
+#ifdef SYS_pidfd_send_signal
+    return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+#else
+    (void)pidfd;
+    (void)sig;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * Get monotonic time.
+ *
+ * @return Time in milliseconds.
+ *
+ */
+static unsigned long int um_proc_now_ms(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long int)ts.tv_sec * 1000 + (unsigned long int)ts.tv_nsec / 1000000;
+}
\ No newline at end of file
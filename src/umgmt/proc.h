@@ -0,0 +1,170 @@
+/**
+ * @file proc.h
+ * @brief API for finding processes of many users in a single pass over /proc.
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#ifndef UMGMT_PROC_H
+#define UMGMT_PROC_H
+
+#include "types.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * UID processes are matched by.
+ */
+typedef enum um_proc_uid_e
+{
+    UM_PROC_UID_REAL,      ///< Real UID from the status file - the user the process runs as.
+    UM_PROC_UID_EFFECTIVE, ///< Effective UID from the status file - the user the process acts as.
+    UM_PROC_UID_OWNER,     ///< Process directory owner - no file is read, but non-dumpable processes are owned by root.
+} um_proc_uid_t;
+
+/**
+ * Statistics of um_proc_scan_terminate().
+ */
+typedef struct um_proc_kill_stats_s
+{
+    size_t terminated;            ///< Processes which exited within the grace period after SIGTERM.
+    size_t killed;                ///< Processes sent SIGKILL.
+    size_t scans;                 ///< Passes over /proc.
+    unsigned long int elapsed_ms; ///< Total time spent in milliseconds.
+} um_proc_kill_stats_t;
+
+/**
+ * Allocate new process scan with an empty UID set.
+ *
+ * @return New allocated scan - NULL on allocation failure.
+ *
+ */
+um_proc_scan_t *um_proc_scan_new(void);
+
+/**
+ * Set the directory procfs is mounted on - useful for containers with their own /proc mount.
+ *
+ * @param scan Scan to use.
+ * @param root Mount point - NULL for /proc.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_proc_scan_set_root(um_proc_scan_t *scan, const char *root);
+
+/**
+ * Enable the cgroup fast path - processes are taken from the user-<uid>.slice cgroups systemd creates for logged in
+ * users, instead of scanning all of /proc. Scans then take time proportional to the number of processes of the users,
+ * but do not find processes of those users outside of the slices, such as services running as the user. The UIDs of
+ * the processes are still checked. UIDs without a slice, including all UIDs if the hierarchy has no user.slice cgroup,
+ * are looked up by the /proc scan - it is only made if any UID in the set has no slice.
+ * The fast path is disabled by default.
+ *
+ * @param scan Scan to use.
+ * @param root Mount point of the cgroup v2 hierarchy, usually /sys/fs/cgroup - NULL to disable the fast path.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_proc_scan_set_cgroup_root(um_proc_scan_t *scan, const char *root);
+/**
+ * Let um_proc_scan_terminate() kill user slices with cgroup.kill instead of sending SIGKILL to each process.
+ * cgroup.kill kills every process in the slice, including processes of the user's sessions which run as other users,
+ * such as root shells started with sudo - only enable it if those should be killed as well. Needs the cgroup fast path,
+ * slices without cgroup.kill support are killed process by process. Disabled by default.
+ *
+ * @param scan Scan to use.
+ * @param enable True to kill the slices as a whole.
+ *
+ */
+void um_proc_scan_set_cgroup_kill(um_proc_scan_t *scan, bool enable);
+
+/**
+ * Set the UID processes are matched by.
+ *
+ * @param scan Scan to use.
+ * @param uid_type UID to match - UM_PROC_UID_REAL by default.
+ *
+ */
+void um_proc_scan_set_uid_type(um_proc_scan_t *scan, um_proc_uid_t uid_type);
+
+/**
+ * Add UID to the set of UIDs to look for. Adding an UID twice has no effect.
+ *
+ * @param scan Scan to use.
+ * @param uid UID to add.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_proc_scan_add_uid(um_proc_scan_t *scan, uid_t uid);
+
+/**
+ * Add UID of the user to the set of UIDs to look for.
+ *
+ * @param scan Scan to use.
+ * @param user User to add.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_proc_scan_add_user(um_proc_scan_t *scan, const um_user_t *user);
+
+/**
+ * Find processes of all UIDs in the set. All processes are visited once and each process is matched against the set
+ * in constant time, so the scan takes time proportional to the number of processes, regardless of the number of UIDs.
+ * Status files are read with a single read() relative to the procfs directory descriptor, and are not read at all when
+ * matching by UM_PROC_UID_OWNER. With the cgroup fast path only processes in the user slices are visited, /proc is
+ * scanned only for UIDs without a slice. Results of a previous run are replaced.
+ *
+ * @param scan Scan to run.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+int um_proc_scan_run(um_proc_scan_t *scan);
+
+/**
+ * Get processes found for the UID by the last run.
+ *
+ * @param scan Scan to use.
+ * @param uid UID to get the processes of.
+ * @param count Set to the number of found processes.
+ *
+ * @return Array of found process IDs - NULL if no processes were found or the UID is not in the set.
+ *
+ */
+const pid_t *um_proc_scan_get_pids(const um_proc_scan_t *scan, uid_t uid, size_t *count);
+
+/**
+ * Terminate all processes of the UIDs in the set.
+ * Found processes are pinned by pidfds and checked again after that, so a process ID reused by another process is
+ * never signaled. All processes are sent SIGTERM and given the grace period to exit - the rest is sent SIGKILL. The
+ * scan is repeated until no processes are found, processes which appear after the first pass are killed right away.
+ * Kernels without pidfd support fall back to kill() and polling. SIGKILL is replaced by cgroup.kill of the user slices
+ * only if enabled by um_proc_scan_set_cgroup_kill().
+ *
+ * @param scan Scan to use.
+ * @param grace_ms Time given to processes to exit after SIGTERM in milliseconds, also the longest wait for SIGKILL.
+ * @param stats Filled with counts and timing - can be NULL.
+ *
+ * @return Error code - 0 on success, -1 if a process could not be signaled or processes keep appearing.
+ *
+ */
+int um_proc_scan_terminate(um_proc_scan_t *scan, unsigned int grace_ms, um_proc_kill_stats_t *stats);
+
+/**
+ * Free scan data.
+ *
+ * @param scan Scan to free.
+ *
+ */
+void um_proc_scan_free(um_proc_scan_t *scan);
+
+#endif // UMGMT_PROC_H
\ No newline at end of file
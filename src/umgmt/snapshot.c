@@ -0,0 +1,1638 @@
+/**
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "snapshot.h"
+#include "db.h"
+#include "user.h"
+#include "group.h"
+#include "source.h"
+#include "deferred.h"
+#include "dirty.h"
+
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utlist.h>
+
+// report allocation failures instead of exiting the process
+#define HASH_NONFATAL_OOM 1
+#include <uthash.h>
+
+/**
+ * Snapshot file format. All integers are in host byte order - snapshots are not meant to be moved between hosts.
+ *
+ * Layout: header, user records, group records, membership references, hash buckets and the string table. Sections are
+ * aligned to 8 bytes and located by offsets in the header. Records refer to strings by their offset in the string
+ * table and to each other by their index.
+ */
+#define UM_SNAPSHOT_MAGIC "UMGMTSNP"
+#define UM_SNAPSHOT_VERSION 1U
+#define UM_SNAPSHOT_BYTE_ORDER 0x01020304U
+#define UM_SNAPSHOT_ALIGN 8U
+
+/**
+ * Missing string, record or end of a hash chain.
+ */
+#define UM_SNAPSHOT_NONE UINT32_MAX
+
+/**
+ * Hash indexes of the snapshot.
+ */
+typedef enum um_snapshot_index_e
+{
+    UM_SNAPSHOT_INDEX_USER_NAME,  ///< Users by name.
+    UM_SNAPSHOT_INDEX_UID,        ///< Users by UID.
+    UM_SNAPSHOT_INDEX_GROUP_NAME, ///< Groups by name.
+    UM_SNAPSHOT_INDEX_GID,        ///< Groups by GID.
+    UM_SNAPSHOT_INDEX_COUNT,      ///< Number of indexes.
+} um_snapshot_index_t;
+
+typedef struct um_snapshot_source_s um_snapshot_source_t;
+typedef struct um_snapshot_header_s um_snapshot_header_t;
+typedef struct um_snapshot_string_s um_snapshot_string_t;
+typedef struct um_snapshot_user_ref_s um_snapshot_user_ref_t;
+typedef struct um_snapshot_writer_s um_snapshot_writer_t;
+
+/**
+ * Status of an account file when the snapshot was stored.
+ */
+struct um_snapshot_source_s
+{
+    uint64_t dev;       ///< Device of the file - 0 if the file did not exist.
+    uint64_t ino;       ///< Inode of the file - 0 if the file did not exist.
+    int64_t size;       ///< Size of the file.
+    int64_t mtime_sec;  ///< Modification time - seconds.
+    int64_t mtime_nsec; ///< Modification time - nanoseconds.
+    uint32_t path;      ///< Path of the file.
+    uint32_t reserved;  ///< Padding - zero.
+};
+
+struct um_snapshot_header_s
+{
+    char magic[8];                                   ///< UM_SNAPSHOT_MAGIC without the terminator.
+    uint32_t version;                                ///< UM_SNAPSHOT_VERSION.
+    uint32_t byte_order;                             ///< UM_SNAPSHOT_BYTE_ORDER as written by the host.
+    uint64_t size;                                   ///< Size of the whole file.
+    um_snapshot_source_t sources[UM_DB_FILE_COUNT];  ///< Account files the snapshot was made from.
+    uint32_t user_count;                             ///< Number of user records.
+    uint32_t group_count;                            ///< Number of group records.
+    uint32_t ref_count;                              ///< Number of membership references.
+    uint32_t strings_size;                           ///< Size of the string table.
+    uint32_t bucket_counts[UM_SNAPSHOT_INDEX_COUNT]; ///< Number of buckets of each index - powers of two.
+    uint64_t users;                                  ///< Offset of the user records.
+    uint64_t groups;                                 ///< Offset of the group records.
+    uint64_t refs;                                   ///< Offset of the membership references.
+    uint64_t buckets[UM_SNAPSHOT_INDEX_COUNT];       ///< Offsets of the index buckets.
+    uint64_t strings;                                ///< Offset of the string table.
+};
+
+struct um_snapshot_user_s
+{
+    uint32_t name;          ///< Name string.
+    uint32_t password;      ///< Password string.
+    uint32_t gecos;         ///< GECOS string.
+    uint32_t home_path;     ///< Home directory string.
+    uint32_t shell_path;    ///< Shell string.
+    uint32_t password_hash; ///< Password hash string.
+    uint32_t uid;           ///< User ID.
+    uint32_t gid;           ///< Primary group ID.
+    int64_t last_change;    ///< Date of the last password change.
+    int64_t change_min;     ///< Minimum password age.
+    int64_t change_max;     ///< Maximum password age.
+    int64_t warn_days;      ///< Password warning period.
+    int64_t inactive_days;  ///< Password inactivity period.
+    int64_t expiration;     ///< Account expiration date.
+    uint64_t flags;         ///< Reserved shadow field.
+    uint32_t groups;        ///< First reference to the groups the user is a member of.
+    uint32_t group_count;   ///< Number of groups the user is a member of.
+    uint32_t name_next;     ///< Next user in the name bucket.
+    uint32_t uid_next;      ///< Next user in the UID bucket.
+};
+
+struct um_snapshot_group_s
+{
+    uint32_t name;          ///< Name string.
+    uint32_t password;      ///< Password string.
+    uint32_t password_hash; ///< Password hash string.
+    uint32_t gid;           ///< Group ID.
+    uint32_t members;       ///< First reference to the members.
+    uint32_t member_count;  ///< Number of members.
+    uint32_t admins;        ///< First reference to the admins.
+    uint32_t admin_count;   ///< Number of admins.
+    uint32_t name_next;     ///< Next group in the name bucket.
+    uint32_t gid_next;      ///< Next group in the GID bucket.
+};
+
+struct um_snapshot_s
+{
+    void *data;
+    size_t size;
+    const um_snapshot_header_t *header;
+    const um_snapshot_user_t *users;
+    const um_snapshot_group_t *groups;
+    const uint32_t *refs;
+    const uint32_t *buckets[UM_SNAPSHOT_INDEX_COUNT];
+    const char *strings;
+};
+
+/**
+ * String table entry used while writing - equal strings are stored once.
+ */
+struct um_snapshot_string_s
+{
+    const char *str;   ///< String in the database.
+    uint32_t offset;   ///< Offset in the string table.
+    UT_hash_handle hh; ///< Index handle.
+};
+
+/**
+ * Position of a database user in the snapshot used while writing.
+ */
+struct um_snapshot_user_ref_s
+{
+    const um_user_t *user; ///< User in the database - index key.
+    uint32_t index;        ///< Index of the user record.
+    uint32_t fill;         ///< Number of group references written so far.
+    UT_hash_handle hh;     ///< Index handle.
+};
+
+/**
+ * Snapshot sections built in memory before they are written.
+ */
+struct um_snapshot_writer_s
+{
+    um_snapshot_header_t header;
+    um_snapshot_user_t *users;
+    um_snapshot_group_t *groups;
+    uint32_t *refs;
+    uint32_t *buckets[UM_SNAPSHOT_INDEX_COUNT];
+    char *strings;
+    size_t strings_capacity;
+    um_snapshot_string_t *string_index;
+    um_snapshot_user_ref_t *user_refs;
+    um_snapshot_user_ref_t *user_index;
+};
+
+static int um_snapshot_build(um_snapshot_writer_t *writer, const um_db_t *db);
+static int um_snapshot_build_groups(um_snapshot_writer_t *writer, const um_db_t *db);
+static int um_snapshot_build_indexes(um_snapshot_writer_t *writer);
+static void um_snapshot_build_layout(um_snapshot_writer_t *writer);
+static uint64_t um_snapshot_place(uint64_t *offset, uint64_t size);
+static int um_snapshot_add_string(um_snapshot_writer_t *writer, const char *str, uint32_t *offset);
+static um_snapshot_user_ref_t *um_snapshot_find_user_ref(const um_snapshot_writer_t *writer, const um_user_t *user);
+static int um_snapshot_write(const um_snapshot_writer_t *writer, const char *path);
+static int um_snapshot_write_section(FILE *file, uint64_t *position, uint64_t offset, const void *data, size_t size);
+static void um_snapshot_writer_free(um_snapshot_writer_t *writer);
+static int um_snapshot_check(um_snapshot_t *snapshot);
+static bool um_snapshot_check_section(const um_snapshot_t *snapshot, uint64_t offset, uint64_t count, size_t size);
+static const char *um_snapshot_get_string(const um_snapshot_t *snapshot, uint32_t offset);
+static uint32_t um_snapshot_hash_string(const char *str);
+static uint32_t um_snapshot_hash_id(uint32_t id);
+static uint32_t um_snapshot_get_bucket_count(uint32_t count);
+
+/**
+ * Store snapshot of the database.
+ * The snapshot contains all users and groups with their shadow data, name, UID and GID hash indexes and the status of
+ * the account files, so readers can use it until the files change. It is written to a temporary file which is renamed
+ * over the given path, so readers never see a partial snapshot. The file is readable by the owner only, as it contains
+ * password hashes.
+ *
+ * @param db Database to use - has to match the account files, so it is loaded or stored without further changes.
+ * @param path Path of the snapshot file.
+ *
+ * @return Error code - 0 on success, -1 if the database has unstored changes, skipped shadow data or on failure.
+ *
+ */
+int um_db_store_snapshot(um_db_t *db, const char *path)
+{
+    int error = 0;
+    um_snapshot_writer_t writer = {0};
+
+    // file status would not describe the data
+    if (um_db_is_modified(db) || um_db_load_deferred(db, UM_DIRTY_SHADOW | UM_DIRTY_GSHADOW))
+    {
+        return -1;
+    }
+
+    error = um_snapshot_build(&writer, db);
+    if (!error)
+    {
+        error = um_snapshot_write(&writer, path);
+    }
+
+    um_snapshot_writer_free(&writer);
+
+    return error;
+}
+
+/**
+ * Open snapshot for reading.
+ * The file is mapped and queried in place - opening checks only the file header and the account files, lookups do not
+ * parse or allocate anything.
+ *
+ * @param path Path of the snapshot file.
+ *
+ * @return Opened snapshot - NULL if the file is missing, malformed or older than the account files.
+ *
+ */
+um_snapshot_t *um_snapshot_open(const char *path)
+{
+    int fd = -1;
+    struct stat st = {0};
+    void *data = MAP_FAILED;
+    um_snapshot_t *snapshot = NULL;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(um_snapshot_header_t))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    // the mapping stays valid after a newer snapshot is renamed over the file
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    snapshot = (um_snapshot_t *)malloc(sizeof(um_snapshot_t));
+    if (!snapshot)
+    {
+        munmap(data, (size_t)st.st_size);
+        return NULL;
+    }
+
+    *snapshot = (um_snapshot_t){0};
+    snapshot->data = data;
+    snapshot->size = (size_t)st.st_size;
+    snapshot->header = (const um_snapshot_header_t *)data;
+
+    if (um_snapshot_check(snapshot) || !um_snapshot_is_current(snapshot))
+    {
+        um_snapshot_close(snapshot);
+        return NULL;
+    }
+
+    return snapshot;
+}
+
+/**
+ * Check if the account files are unchanged since the snapshot was stored.
+ * Files are compared by device, inode, size and modification time.
+ *
+ * @param snapshot Snapshot to check.
+ *
+ * @return True if the snapshot matches the account files.
+ *
+ */
+bool um_snapshot_is_current(const um_snapshot_t *snapshot)
+{
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        const um_snapshot_source_t *source = &snapshot->header->sources[i];
+        const char *path = um_snapshot_get_string(snapshot, source->path);
+        struct stat st = {0};
+
+        if (!path)
+        {
+            return false;
+        }
+
+        if (stat(path, &st))
+        {
+            // a file which did not exist has to be still missing
+            if (source->ino != 0)
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if (source->dev != (uint64_t)st.st_dev || source->ino != (uint64_t)st.st_ino ||
+            source->size != (int64_t)st.st_size || source->mtime_sec != (int64_t)st.st_mtim.tv_sec ||
+            source->mtime_nsec != (int64_t)st.st_mtim.tv_nsec)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Get the number of users in the snapshot.
+ *
+ * @param snapshot Snapshot to use.
+ *
+ * @return Number of users.
+ *
+ */
+size_t um_snapshot_get_user_count(const um_snapshot_t *snapshot)
+{
+    return snapshot->header->user_count;
+}
+
+/**
+ * Get user by its position in the snapshot - same order as in the database.
+ *
+ * @param snapshot Snapshot to use.
+ * @param index Position of the user.
+ *
+ * @return Found user - NULL if the index is out of range.
+ *
+ */
+const um_snapshot_user_t *um_snapshot_get_user_at(const um_snapshot_t *snapshot, size_t index)
+{
+    return index < snapshot->header->user_count ? &snapshot->users[index] : NULL;
+}
+
+/**
+ * Get user with the given name.
+ *
+ * @param snapshot Snapshot to use.
+ * @param name Name of the user.
+ *
+ * @return Found user - NULL if not found.
+ *
+ */
+const um_snapshot_user_t *um_snapshot_get_user(const um_snapshot_t *snapshot, const char *name)
+{
+    const um_snapshot_header_t *header = snapshot->header;
+    uint32_t bucket = um_snapshot_hash_string(name) & (header->bucket_counts[UM_SNAPSHOT_INDEX_USER_NAME] - 1);
+    uint32_t index = snapshot->buckets[UM_SNAPSHOT_INDEX_USER_NAME][bucket];
+
+    // chains are bounded by the record count, so a damaged file cannot cause an endless loop
+    for (uint32_t i = 0; i < header->user_count && index < header->user_count; i++)
+    {
+        const um_snapshot_user_t *user = &snapshot->users[index];
+        const char *user_name = um_snapshot_get_string(snapshot, user->name);
+
+        if (user_name && strcmp(user_name, name) == 0)
+        {
+            return user;
+        }
+
+        index = user->name_next;
+    }
+
+    return NULL;
+}
+
+/**
+ * Get the first user with the given UID.
+ *
+ * @param snapshot Snapshot to use.
+ * @param uid UID of the user.
+ *
+ * @return Found user - NULL if not found.
+ *
+ */
+const um_snapshot_user_t *um_snapshot_get_user_by_uid(const um_snapshot_t *snapshot, uid_t uid)
+{
+    const um_snapshot_header_t *header = snapshot->header;
+    uint32_t bucket = um_snapshot_hash_id(uid) & (header->bucket_counts[UM_SNAPSHOT_INDEX_UID] - 1);
+    uint32_t index = snapshot->buckets[UM_SNAPSHOT_INDEX_UID][bucket];
+
+    for (uint32_t i = 0; i < header->user_count && index < header->user_count; i++)
+    {
+        const um_snapshot_user_t *user = &snapshot->users[index];
+
+        if (user->uid == uid)
+        {
+            return user;
+        }
+
+        index = user->uid_next;
+    }
+
+    return NULL;
+}
+
+/**
+ * Get the number of groups in the snapshot.
+ *
+ * @param snapshot Snapshot to use.
+ *
+ * @return Number of groups.
+ *
+ */
+size_t um_snapshot_get_group_count(const um_snapshot_t *snapshot)
+{
+    return snapshot->header->group_count;
+}
+
+/**
+ * Get group by its position in the snapshot - same order as in the database.
+ *
+ * @param snapshot Snapshot to use.
+ * @param index Position of the group.
+ *
+ * @return Found group - NULL if the index is out of range.
+ *
+ */
+const um_snapshot_group_t *um_snapshot_get_group_at(const um_snapshot_t *snapshot, size_t index)
+{
+    return index < snapshot->header->group_count ? &snapshot->groups[index] : NULL;
+}
+
+/**
+ * Get group with the given name.
+ *
+ * @param snapshot Snapshot to use.
+ * @param name Name of the group.
+ *
+ * @return Found group - NULL if not found.
+ *
+ */
+const um_snapshot_group_t *um_snapshot_get_group(const um_snapshot_t *snapshot, const char *name)
+{
+    const um_snapshot_header_t *header = snapshot->header;
+    uint32_t bucket = um_snapshot_hash_string(name) & (header->bucket_counts[UM_SNAPSHOT_INDEX_GROUP_NAME] - 1);
+    uint32_t index = snapshot->buckets[UM_SNAPSHOT_INDEX_GROUP_NAME][bucket];
+
+    for (uint32_t i = 0; i < header->group_count && index < header->group_count; i++)
+    {
+        const um_snapshot_group_t *group = &snapshot->groups[index];
+        const char *group_name = um_snapshot_get_string(snapshot, group->name);
+
+        if (group_name && strcmp(group_name, name) == 0)
+        {
+            return group;
+        }
+
+        index = group->name_next;
+    }
+
+    return NULL;
+}
+
+/**
+ * Get the first group with the given GID.
+ *
+ * @param snapshot Snapshot to use.
+ * @param gid GID of the group.
+ *
+ * @return Found group - NULL if not found.
+ *
+ */
+const um_snapshot_group_t *um_snapshot_get_group_by_gid(const um_snapshot_t *snapshot, gid_t gid)
+{
+    const um_snapshot_header_t *header = snapshot->header;
+    uint32_t bucket = um_snapshot_hash_id(gid) & (header->bucket_counts[UM_SNAPSHOT_INDEX_GID] - 1);
+    uint32_t index = snapshot->buckets[UM_SNAPSHOT_INDEX_GID][bucket];
+
+    for (uint32_t i = 0; i < header->group_count && index < header->group_count; i++)
+    {
+        const um_snapshot_group_t *group = &snapshot->groups[index];
+
+        if (group->gid == gid)
+        {
+            return group;
+        }
+
+        index = group->gid_next;
+    }
+
+    return NULL;
+}
+
+/**
+ * Get user name.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Name - NULL if not set.
+ *
+ */
+const char *um_snapshot_user_get_name(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    return um_snapshot_get_string(snapshot, user->name);
+}
+
+/**
+ * Get user password.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Password - NULL if not set.
+ *
+ */
+const char *um_snapshot_user_get_password(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    return um_snapshot_get_string(snapshot, user->password);
+}
+
+/**
+ * Get user UID.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return UID.
+ *
+ */
+uid_t um_snapshot_user_get_uid(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    (void)snapshot;
+
+    return user->uid;
+}
+
+/**
+ * Get user primary GID.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Primary GID.
+ *
+ */
+gid_t um_snapshot_user_get_gid(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    (void)snapshot;
+
+    return user->gid;
+}
+
+/**
+ * Get user GECOS field.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return GECOS field - NULL if not set.
+ *
+ */
+const char *um_snapshot_user_get_gecos(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    return um_snapshot_get_string(snapshot, user->gecos);
+}
+
+/**
+ * Get user home directory path.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Home directory path - NULL if not set.
+ *
+ */
+const char *um_snapshot_user_get_home_path(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    return um_snapshot_get_string(snapshot, user->home_path);
+}
+
+/**
+ * Get user shell path.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Shell path - NULL if not set.
+ *
+ */
+const char *um_snapshot_user_get_shell_path(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    return um_snapshot_get_string(snapshot, user->shell_path);
+}
+
+/**
+ * Get user password hash.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Password hash - NULL if not set.
+ *
+ */
+const char *um_snapshot_user_get_password_hash(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    return um_snapshot_get_string(snapshot, user->password_hash);
+}
+
+/**
+ * Get user date of the last password change.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Date of the last password change.
+ *
+ */
+long int um_snapshot_user_get_last_change(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    (void)snapshot;
+
+    return (long int)user->last_change;
+}
+
+/**
+ * Get user minimum password age.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Minimum password age.
+ *
+ */
+long int um_snapshot_user_get_change_min(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    (void)snapshot;
+
+    return (long int)user->change_min;
+}
+
+/**
+ * Get user maximum password age.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Maximum password age.
+ *
+ */
+long int um_snapshot_user_get_change_max(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    (void)snapshot;
+
+    return (long int)user->change_max;
+}
+
+/**
+ * Get user password warning period.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Password warning period.
+ *
+ */
+long int um_snapshot_user_get_warn_days(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    (void)snapshot;
+
+    return (long int)user->warn_days;
+}
+
+/**
+ * Get user password inactivity period.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Password inactivity period.
+ *
+ */
+long int um_snapshot_user_get_inactive_days(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    (void)snapshot;
+
+    return (long int)user->inactive_days;
+}
+
+/**
+ * Get user account expiration date.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Account expiration date.
+ *
+ */
+long int um_snapshot_user_get_expiration(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    (void)snapshot;
+
+    return (long int)user->expiration;
+}
+
+/**
+ * Get user shadow flags.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Shadow flags.
+ *
+ */
+unsigned long int um_snapshot_user_get_flags(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    (void)snapshot;
+
+    return (unsigned long int)user->flags;
+}
+
+/**
+ * Get the number of groups the user is a member of. Groups the user only administers are not counted.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Number of groups.
+ *
+ */
+size_t um_snapshot_user_get_group_count(const um_snapshot_t *snapshot, const um_snapshot_user_t *user)
+{
+    (void)snapshot;
+
+    return user->group_count;
+}
+
+/**
+ * Get group the user is a member of.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ * @param index Position of the group in the user's group list.
+ *
+ * @return Found group - NULL if the index is out of range.
+ *
+ */
+const um_snapshot_group_t *um_snapshot_user_get_group(const um_snapshot_t *snapshot, const um_snapshot_user_t *user,
+                                                      size_t index)
+{
+    uint64_t ref = (uint64_t)user->groups + index;
+
+    if (index >= user->group_count || ref >= snapshot->header->ref_count)
+    {
+        return NULL;
+    }
+
+    return um_snapshot_get_group_at(snapshot, snapshot->refs[ref]);
+}
+
+/**
+ * Get group name.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ *
+ * @return Name - NULL if not set.
+ *
+ */
+const char *um_snapshot_group_get_name(const um_snapshot_t *snapshot, const um_snapshot_group_t *group)
+{
+    return um_snapshot_get_string(snapshot, group->name);
+}
+
+/**
+ * Get group password.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ *
+ * @return Password - NULL if not set.
+ *
+ */
+const char *um_snapshot_group_get_password(const um_snapshot_t *snapshot, const um_snapshot_group_t *group)
+{
+    return um_snapshot_get_string(snapshot, group->password);
+}
+
+/**
+ * Get group GID.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ *
+ * @return GID.
+ *
+ */
+gid_t um_snapshot_group_get_gid(const um_snapshot_t *snapshot, const um_snapshot_group_t *group)
+{
+    (void)snapshot;
+
+    return group->gid;
+}
+
+/**
+ * Get group password hash.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ *
+ * @return Password hash - NULL if not set.
+ *
+ */
+const char *um_snapshot_group_get_password_hash(const um_snapshot_t *snapshot, const um_snapshot_group_t *group)
+{
+    return um_snapshot_get_string(snapshot, group->password_hash);
+}
+
+/**
+ * Get the number of group members.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ *
+ * @return Number of members.
+ *
+ */
+size_t um_snapshot_group_get_member_count(const um_snapshot_t *snapshot, const um_snapshot_group_t *group)
+{
+    (void)snapshot;
+
+    return group->member_count;
+}
+
+/**
+ * Get group member.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ * @param index Position of the member.
+ *
+ * @return Found user - NULL if the index is out of range.
+ *
+ */
+const um_snapshot_user_t *um_snapshot_group_get_member(const um_snapshot_t *snapshot, const um_snapshot_group_t *group,
+                                                       size_t index)
+{
+    uint64_t ref = (uint64_t)group->members + index;
+
+    if (index >= group->member_count || ref >= snapshot->header->ref_count)
+    {
+        return NULL;
+    }
+
+    return um_snapshot_get_user_at(snapshot, snapshot->refs[ref]);
+}
+
+/**
+ * Get the number of group admins.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ *
+ * @return Number of admins.
+ *
+ */
+size_t um_snapshot_group_get_admin_count(const um_snapshot_t *snapshot, const um_snapshot_group_t *group)
+{
+    (void)snapshot;
+
+    return group->admin_count;
+}
+
+/**
+ * Get group admin.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ * @param index Position of the admin.
+ *
+ * @return Found user - NULL if the index is out of range.
+ *
+ */
+const um_snapshot_user_t *um_snapshot_group_get_admin(const um_snapshot_t *snapshot, const um_snapshot_group_t *group,
+                                                      size_t index)
+{
+    uint64_t ref = (uint64_t)group->admins + index;
+
+    if (index >= group->admin_count || ref >= snapshot->header->ref_count)
+    {
+        return NULL;
+    }
+
+    return um_snapshot_get_user_at(snapshot, snapshot->refs[ref]);
+}
+
+/**
+ * Unmap the snapshot and free its data.
+ *
+ * @param snapshot Snapshot to close.
+ *
+ */
+void um_snapshot_close(um_snapshot_t *snapshot)
+{
+    munmap(snapshot->data, snapshot->size);
+    free(snapshot);
+}
+
+/**
+ * Build all snapshot sections from the database.
+ *
+ * @param writer Writer to fill.
+ * @param db Database to use.
+ *
+ * @return Error code - 0 on success, -1 on allocation failure or too large database.
+ *
+ */
+static int um_snapshot_build(um_snapshot_writer_t *writer, const um_db_t *db)
+{
+    um_snapshot_header_t *header = &writer->header;
+    const um_user_element_t *user_iter = NULL;
+    const um_group_element_t *group_iter = NULL;
+    size_t user_count = 0;
+    size_t group_count = 0;
+    uint32_t index = 0;
+
+    LL_COUNT(um_db_get_user_list_head(db), user_iter, user_count);
+    LL_COUNT(um_db_get_group_list_head(db), group_iter, group_count);
+
+    if (user_count >= UM_SNAPSHOT_NONE || group_count >= UM_SNAPSHOT_NONE)
+    {
+        return -1;
+    }
+
+    header->user_count = (uint32_t)user_count;
+    header->group_count = (uint32_t)group_count;
+
+    // one spare element keeps the allocations valid for an empty database
+    writer->users = (um_snapshot_user_t *)calloc(user_count + 1, sizeof(um_snapshot_user_t));
+    writer->groups = (um_snapshot_group_t *)calloc(group_count + 1, sizeof(um_snapshot_group_t));
+    writer->user_refs = (um_snapshot_user_ref_t *)calloc(user_count + 1, sizeof(um_snapshot_user_ref_t));
+    if (!writer->users || !writer->groups || !writer->user_refs)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        const struct stat *st = um_db_get_source_stat(db, (um_db_file_t)i);
+        um_snapshot_source_t *source = &header->sources[i];
+
+        if (um_snapshot_add_string(writer, um_db_get_path(db, (um_db_file_t)i), &source->path))
+        {
+            return -1;
+        }
+
+        source->dev = (uint64_t)st->st_dev;
+        source->ino = (uint64_t)st->st_ino;
+        source->size = (int64_t)st->st_size;
+        source->mtime_sec = (int64_t)st->st_mtim.tv_sec;
+        source->mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+    }
+
+    LL_FOREACH(um_db_get_user_list_head(db), user_iter)
+    {
+        const um_user_t *user = user_iter->user;
+        um_snapshot_user_t *record = &writer->users[index];
+        um_snapshot_user_ref_t *ref = &writer->user_refs[index];
+
+        if (um_snapshot_add_string(writer, um_user_get_name(user), &record->name) ||
+            um_snapshot_add_string(writer, um_user_get_password(user), &record->password) ||
+            um_snapshot_add_string(writer, um_user_get_gecos(user), &record->gecos) ||
+            um_snapshot_add_string(writer, um_user_get_home_path(user), &record->home_path) ||
+            um_snapshot_add_string(writer, um_user_get_shell_path(user), &record->shell_path) ||
+            um_snapshot_add_string(writer, um_user_get_password_hash(user), &record->password_hash))
+        {
+            return -1;
+        }
+
+        record->uid = (uint32_t)um_user_get_uid(user);
+        record->gid = (uint32_t)um_user_get_gid(user);
+        record->last_change = um_user_get_last_change(user);
+        record->change_min = um_user_get_change_min(user);
+        record->change_max = um_user_get_change_max(user);
+        record->warn_days = um_user_get_warn_days(user);
+        record->inactive_days = um_user_get_inactive_days(user);
+        record->expiration = um_user_get_expiration(user);
+        record->flags = um_user_get_flags(user);
+
+        ref->user = user;
+        ref->index = index;
+        HASH_ADD(hh, writer->user_index, user, sizeof(ref->user), ref);
+        if (!ref->hh.tbl)
+        {
+            return -1;
+        }
+
+        ++index;
+    }
+
+    index = 0;
+    LL_FOREACH(um_db_get_group_list_head(db), group_iter)
+    {
+        const um_group_t *group = group_iter->group;
+        um_snapshot_group_t *record = &writer->groups[index];
+
+        if (um_snapshot_add_string(writer, um_group_get_name(group), &record->name) ||
+            um_snapshot_add_string(writer, um_group_get_password(group), &record->password) ||
+            um_snapshot_add_string(writer, um_group_get_password_hash(group), &record->password_hash))
+        {
+            return -1;
+        }
+
+        record->gid = (uint32_t)um_group_get_gid(group);
+
+        ++index;
+    }
+
+    if (um_snapshot_build_groups(writer, db) || um_snapshot_build_indexes(writer))
+    {
+        return -1;
+    }
+
+    um_snapshot_build_layout(writer);
+
+    return 0;
+}
+
+/**
+ * Build membership references - member and admin lists of each group followed by the group lists of the users.
+ * Members which are not users of the database are left out.
+ *
+ * @param writer Writer to use - user and group records have to be built.
+ * @param db Database to use.
+ *
+ * @return Error code - 0 on success, -1 on allocation failure or too many references.
+ *
+ */
+static int um_snapshot_build_groups(um_snapshot_writer_t *writer, const um_db_t *db)
+{
+    const um_group_element_t *group_iter = NULL;
+    const um_group_user_element_t *member_iter = NULL;
+    um_snapshot_user_ref_t *ref = NULL;
+    size_t group_refs = 0;
+    size_t user_refs = 0;
+    size_t position = 0;
+    uint32_t index = 0;
+
+    // count references to size the user group lists
+    LL_FOREACH(um_db_get_group_list_head(db), group_iter)
+    {
+        LL_FOREACH(um_group_get_members_head(group_iter->group), member_iter)
+        {
+            ref = um_snapshot_find_user_ref(writer, member_iter->user);
+            if (ref)
+            {
+                ++writer->users[ref->index].group_count;
+                ++group_refs;
+                ++user_refs;
+            }
+        }
+
+        LL_FOREACH(um_group_get_admin_head(group_iter->group), member_iter)
+        {
+            if (um_snapshot_find_user_ref(writer, member_iter->user))
+            {
+                ++group_refs;
+            }
+        }
+    }
+
+    if (group_refs + user_refs >= UM_SNAPSHOT_NONE)
+    {
+        return -1;
+    }
+
+    writer->header.ref_count = (uint32_t)(group_refs + user_refs);
+    writer->refs = (uint32_t *)calloc(group_refs + user_refs + 1, sizeof(uint32_t));
+    if (!writer->refs)
+    {
+        return -1;
+    }
+
+    position = group_refs;
+    for (uint32_t i = 0; i < writer->header.user_count; i++)
+    {
+        writer->users[i].groups = (uint32_t)position;
+        position += writer->users[i].group_count;
+    }
+
+    position = 0;
+    LL_FOREACH(um_db_get_group_list_head(db), group_iter)
+    {
+        um_snapshot_group_t *record = &writer->groups[index];
+
+        record->members = (uint32_t)position;
+        LL_FOREACH(um_group_get_members_head(group_iter->group), member_iter)
+        {
+            ref = um_snapshot_find_user_ref(writer, member_iter->user);
+            if (ref)
+            {
+                writer->refs[position++] = ref->index;
+                writer->refs[writer->users[ref->index].groups + ref->fill++] = index;
+            }
+        }
+        record->member_count = (uint32_t)position - record->members;
+
+        record->admins = (uint32_t)position;
+        LL_FOREACH(um_group_get_admin_head(group_iter->group), member_iter)
+        {
+            ref = um_snapshot_find_user_ref(writer, member_iter->user);
+            if (ref)
+            {
+                writer->refs[position++] = ref->index;
+            }
+        }
+        record->admin_count = (uint32_t)position - record->admins;
+
+        ++index;
+    }
+
+    return 0;
+}
+
+/**
+ * Build name, UID and GID hash indexes.
+ * Records are inserted in reverse order, so the first of the records with the same key is found first.
+ *
+ * @param writer Writer to use - user and group records have to be built.
+ *
+ * @return Error code - 0 on success, -1 on allocation failure.
+ *
+ */
+static int um_snapshot_build_indexes(um_snapshot_writer_t *writer)
+{
+    um_snapshot_header_t *header = &writer->header;
+    uint32_t *buckets = NULL;
+    uint32_t mask = 0;
+
+    header->bucket_counts[UM_SNAPSHOT_INDEX_USER_NAME] = um_snapshot_get_bucket_count(header->user_count);
+    header->bucket_counts[UM_SNAPSHOT_INDEX_UID] = um_snapshot_get_bucket_count(header->user_count);
+    header->bucket_counts[UM_SNAPSHOT_INDEX_GROUP_NAME] = um_snapshot_get_bucket_count(header->group_count);
+    header->bucket_counts[UM_SNAPSHOT_INDEX_GID] = um_snapshot_get_bucket_count(header->group_count);
+
+    for (int i = 0; i < UM_SNAPSHOT_INDEX_COUNT; i++)
+    {
+        writer->buckets[i] = (uint32_t *)malloc(header->bucket_counts[i] * sizeof(uint32_t));
+        if (!writer->buckets[i])
+        {
+            return -1;
+        }
+
+        for (uint32_t j = 0; j < header->bucket_counts[i]; j++)
+        {
+            writer->buckets[i][j] = UM_SNAPSHOT_NONE;
+        }
+    }
+
+    for (uint32_t i = header->user_count; i-- > 0;)
+    {
+        um_snapshot_user_t *user = &writer->users[i];
+        const char *name = writer->strings + user->name;
+
+        buckets = writer->buckets[UM_SNAPSHOT_INDEX_USER_NAME];
+        mask = header->bucket_counts[UM_SNAPSHOT_INDEX_USER_NAME] - 1;
+        user->name_next = buckets[um_snapshot_hash_string(name) & mask];
+        buckets[um_snapshot_hash_string(name) & mask] = i;
+
+        buckets = writer->buckets[UM_SNAPSHOT_INDEX_UID];
+        mask = header->bucket_counts[UM_SNAPSHOT_INDEX_UID] - 1;
+        user->uid_next = buckets[um_snapshot_hash_id(user->uid) & mask];
+        buckets[um_snapshot_hash_id(user->uid) & mask] = i;
+    }
+
+    for (uint32_t i = header->group_count; i-- > 0;)
+    {
+        um_snapshot_group_t *group = &writer->groups[i];
+        const char *name = writer->strings + group->name;
+
+        buckets = writer->buckets[UM_SNAPSHOT_INDEX_GROUP_NAME];
+        mask = header->bucket_counts[UM_SNAPSHOT_INDEX_GROUP_NAME] - 1;
+        group->name_next = buckets[um_snapshot_hash_string(name) & mask];
+        buckets[um_snapshot_hash_string(name) & mask] = i;
+
+        buckets = writer->buckets[UM_SNAPSHOT_INDEX_GID];
+        mask = header->bucket_counts[UM_SNAPSHOT_INDEX_GID] - 1;
+        group->gid_next = buckets[um_snapshot_hash_id(group->gid) & mask];
+        buckets[um_snapshot_hash_id(group->gid) & mask] = i;
+    }
+
+    return 0;
+}
+
+/**
+ * Fill the header with section offsets and the total size.
+ *
+ * @param writer Writer to use - all sections have to be built.
+ *
+ */
+static void um_snapshot_build_layout(um_snapshot_writer_t *writer)
+{
+    um_snapshot_header_t *header = &writer->header;
+    uint64_t offset = sizeof(um_snapshot_header_t);
+
+    memcpy(header->magic, UM_SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->version = UM_SNAPSHOT_VERSION;
+    header->byte_order = UM_SNAPSHOT_BYTE_ORDER;
+
+    header->users = um_snapshot_place(&offset, (uint64_t)header->user_count * sizeof(um_snapshot_user_t));
+    header->groups = um_snapshot_place(&offset, (uint64_t)header->group_count * sizeof(um_snapshot_group_t));
+    header->refs = um_snapshot_place(&offset, (uint64_t)header->ref_count * sizeof(uint32_t));
+    for (int i = 0; i < UM_SNAPSHOT_INDEX_COUNT; i++)
+    {
+        header->buckets[i] = um_snapshot_place(&offset, (uint64_t)header->bucket_counts[i] * sizeof(uint32_t));
+    }
+    header->strings = um_snapshot_place(&offset, header->strings_size);
+
+    header->size = offset;
+}
+
+/**
+ * Place section at the next aligned offset.
+ *
+ * @param offset End of the previous section - moved past the placed section.
+ * @param size Size of the section.
+ *
+ * @return Offset of the section.
+ *
+ */
+static uint64_t um_snapshot_place(uint64_t *offset, uint64_t size)
+{
+    uint64_t start = (*offset + UM_SNAPSHOT_ALIGN - 1) & ~(uint64_t)(UM_SNAPSHOT_ALIGN - 1);
+
+    *offset = start + size;
+
+    return start;
+}
+
+/**
+ * Add string to the string table - equal strings are stored once.
+ *
+ * @param writer Writer to use.
+ * @param str String to add - NULL is stored as a missing string.
+ * @param offset Offset of the string in the table.
+ *
+ * @return Error code - 0 on success, -1 on allocation failure or too large string table.
+ *
+ */
+static int um_snapshot_add_string(um_snapshot_writer_t *writer, const char *str, uint32_t *offset)
+{
+    um_snapshot_string_t *entry = NULL;
+    size_t length = 0;
+
+    if (!str)
+    {
+        *offset = UM_SNAPSHOT_NONE;
+        return 0;
+    }
+
+    length = strlen(str);
+
+    HASH_FIND(hh, writer->string_index, str, (unsigned)length, entry);
+    if (entry)
+    {
+        *offset = entry->offset;
+        return 0;
+    }
+
+    if (length >= UM_SNAPSHOT_NONE - 1 - writer->header.strings_size)
+    {
+        return -1;
+    }
+
+    // grow the table geometrically
+    if (writer->header.strings_size + length + 1 > writer->strings_capacity)
+    {
+        size_t capacity = writer->strings_capacity ? writer->strings_capacity : 4096;
+        char *strings = NULL;
+
+        while (capacity < writer->header.strings_size + length + 1)
+        {
+            capacity *= 2;
+        }
+
+        strings = (char *)realloc(writer->strings, capacity);
+        if (!strings)
+        {
+            return -1;
+        }
+
+        writer->strings = strings;
+        writer->strings_capacity = capacity;
+    }
+
+    entry = (um_snapshot_string_t *)malloc(sizeof(um_snapshot_string_t));
+    if (!entry)
+    {
+        return -1;
+    }
+
+    *entry = (um_snapshot_string_t){0};
+    entry->str = str;
+    entry->offset = writer->header.strings_size;
+
+    HASH_ADD_KEYPTR(hh, writer->string_index, entry->str, (unsigned)length, entry);
+    if (!entry->hh.tbl)
+    {
+        free(entry);
+        return -1;
+    }
+
+    memcpy(writer->strings + entry->offset, str, length + 1);
+    writer->header.strings_size += (uint32_t)length + 1;
+    *offset = entry->offset;
+
+    return 0;
+}
+
+/**
+ * Find the snapshot position of a database user.
+ *
+ * @param writer Writer to use.
+ * @param user User to find.
+ *
+ * @return Found position - NULL if the user is not in the database.
+ *
+ */
+static um_snapshot_user_ref_t *um_snapshot_find_user_ref(const um_snapshot_writer_t *writer, const um_user_t *user)
+{
+    um_snapshot_user_ref_t *ref = NULL;
+
+    HASH_FIND(hh, writer->user_index, &user, sizeof(user), ref);
+
+    return ref;
+}
+
+/**
+ * Write the built snapshot to a temporary file and rename it over the given path.
+ *
+ * @param writer Writer to use - the layout has to be built.
+ * @param path Path of the snapshot file.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_snapshot_write(const um_snapshot_writer_t *writer, const char *path)
+{
+    const um_snapshot_header_t *header = &writer->header;
+    char tmp_path[PATH_MAX] = {0};
+    uint64_t position = 0;
+    FILE *file = NULL;
+    int fd = -1;
+    int error = 0;
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s+XXXXXX", path) >= (int)sizeof(tmp_path))
+    {
+        return -1;
+    }
+
+    fd = mkstemp(tmp_path);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    file = fdopen(fd, "w");
+    if (!file)
+    {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+
+    error = um_snapshot_write_section(file, &position, 0, header, sizeof(um_snapshot_header_t)) ||
+            um_snapshot_write_section(file, &position, header->users, writer->users,
+                                      header->user_count * sizeof(um_snapshot_user_t)) ||
+            um_snapshot_write_section(file, &position, header->groups, writer->groups,
+                                      header->group_count * sizeof(um_snapshot_group_t)) ||
+            um_snapshot_write_section(file, &position, header->refs, writer->refs,
+                                      header->ref_count * sizeof(uint32_t));
+
+    for (int i = 0; i < UM_SNAPSHOT_INDEX_COUNT && !error; i++)
+    {
+        error = um_snapshot_write_section(file, &position, header->buckets[i], writer->buckets[i],
+                                          header->bucket_counts[i] * sizeof(uint32_t));
+    }
+
+    if (!error)
+    {
+        error = um_snapshot_write_section(file, &position, header->strings, writer->strings, header->strings_size);
+    }
+
+    // the snapshot has to be complete on disk before it replaces the old one
+    if (!error)
+    {
+        error = fflush(file) != 0 || fsync(fd) != 0;
+    }
+
+    if (fclose(file) != 0 || error || rename(tmp_path, path) != 0)
+    {
+        unlink(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Write a section of the snapshot, padding the file up to the section offset.
+ *
+ * @param file File to write to.
+ * @param position Current position in the file - updated after the write.
+ * @param offset Offset of the section.
+ * @param data Section data.
+ * @param size Size of the section.
+ *
+ * @return Error code - 0 on success.
+ *
+ */
+static int um_snapshot_write_section(FILE *file, uint64_t *position, uint64_t offset, const void *data, size_t size)
+{
+    static const char padding[UM_SNAPSHOT_ALIGN] = {0};
+
+    if (offset - *position > sizeof(padding) || fwrite(padding, 1, offset - *position, file) != offset - *position)
+    {
+        return -1;
+    }
+
+    if (size && fwrite(data, 1, size, file) != size)
+    {
+        return -1;
+    }
+
+    *position = offset + size;
+
+    return 0;
+}
+
+/**
+ * Free sections built by the writer.
+ *
+ * @param writer Writer to free.
+ *
+ */
+static void um_snapshot_writer_free(um_snapshot_writer_t *writer)
+{
+    um_snapshot_string_t *string_iter = NULL, *temp_string = NULL;
+
+    HASH_ITER(hh, writer->string_index, string_iter, temp_string)
+    {
+        HASH_DELETE(hh, writer->string_index, string_iter);
+        free(string_iter);
+    }
+
+    // user positions are stored in a single array
+    HASH_CLEAR(hh, writer->user_index);
+
+    for (int i = 0; i < UM_SNAPSHOT_INDEX_COUNT; i++)
+    {
+        free(writer->buckets[i]);
+    }
+
+    free(writer->users);
+    free(writer->groups);
+    free(writer->refs);
+    free(writer->strings);
+    free(writer->user_refs);
+}
+
+/**
+ * Check the header of a mapped snapshot and locate its sections - all sections have to be inside the file.
+ * Record contents are checked when they are used.
+ *
+ * @param snapshot Snapshot to check.
+ *
+ * @return Error code - 0 if the snapshot is usable, -1 otherwise.
+ *
+ */
+static int um_snapshot_check(um_snapshot_t *snapshot)
+{
+    const um_snapshot_header_t *header = snapshot->header;
+    const char *data = (const char *)snapshot->data;
+
+    if (memcmp(header->magic, UM_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != UM_SNAPSHOT_VERSION || header->byte_order != UM_SNAPSHOT_BYTE_ORDER ||
+        header->size != snapshot->size)
+    {
+        return -1;
+    }
+
+    if (!um_snapshot_check_section(snapshot, header->users, header->user_count, sizeof(um_snapshot_user_t)) ||
+        !um_snapshot_check_section(snapshot, header->groups, header->group_count, sizeof(um_snapshot_group_t)) ||
+        !um_snapshot_check_section(snapshot, header->refs, header->ref_count, sizeof(uint32_t)) ||
+        !um_snapshot_check_section(snapshot, header->strings, header->strings_size, sizeof(char)))
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < UM_SNAPSHOT_INDEX_COUNT; i++)
+    {
+        uint32_t count = header->bucket_counts[i];
+
+        // lookups mask the hash with the bucket count
+        if (count == 0 || (count & (count - 1)) != 0 ||
+            !um_snapshot_check_section(snapshot, header->buckets[i], count, sizeof(uint32_t)))
+        {
+            return -1;
+        }
+
+        snapshot->buckets[i] = (const uint32_t *)(data + header->buckets[i]);
+    }
+
+    // every string offset inside the table is then terminated
+    if (header->strings_size == 0 || data[header->strings + header->strings_size - 1] != 0)
+    {
+        return -1;
+    }
+
+    snapshot->users = (const um_snapshot_user_t *)(data + header->users);
+    snapshot->groups = (const um_snapshot_group_t *)(data + header->groups);
+    snapshot->refs = (const uint32_t *)(data + header->refs);
+    snapshot->strings = data + header->strings;
+
+    return 0;
+}
+
+/**
+ * Check that a section of the snapshot is aligned and inside the file.
+ *
+ * @param snapshot Snapshot to use.
+ * @param offset Offset of the section.
+ * @param count Number of elements in the section.
+ * @param size Size of a single element.
+ *
+ * @return True if the section is valid.
+ *
+ */
+static bool um_snapshot_check_section(const um_snapshot_t *snapshot, uint64_t offset, uint64_t count, size_t size)
+{
+    return offset % UM_SNAPSHOT_ALIGN == 0 && offset <= snapshot->size && count <= (snapshot->size - offset) / size;
+}
+
+/**
+ * Get string from the string table.
+ *
+ * @param snapshot Snapshot to use.
+ * @param offset Offset of the string.
+ *
+ * @return Found string - NULL for a missing string or an offset outside of the table.
+ *
+ */
+static const char *um_snapshot_get_string(const um_snapshot_t *snapshot, uint32_t offset)
+{
+    return offset < snapshot->header->strings_size ? snapshot->strings + offset : NULL;
+}
+
+/**
+ * Hash string using FNV-1a.
+ *
+ * @param str String to hash.
+ *
+ * @return Hash value.
+ *
+ */
+static uint32_t um_snapshot_hash_string(const char *str)
+{
+    uint32_t hash = 2166136261U;
+
+    for (const unsigned char *iter = (const unsigned char *)str; *iter; iter++)
+    {
+        hash ^= *iter;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+/**
+ * Hash user or group ID - consecutive IDs are spread over the buckets.
+ *
+ * @param id ID to hash.
+ *
+ * @return Hash value.
+ *
+ */
+static uint32_t um_snapshot_hash_id(uint32_t id)
+{
+    id ^= id >> 16;
+    id *= 0x45d9f3bU;
+    id ^= id >> 16;
+
+    return id;
+}
+
+/**
+ * Get the number of hash buckets for the given number of records - a power of two with a load factor up to 1.
+ *
+ * @param count Number of records.
+ *
+ * @return Number of buckets.
+ *
+ */
+static uint32_t um_snapshot_get_bucket_count(uint32_t count)
+{
+    uint32_t buckets = 1;
+
+    while (buckets < count && buckets < (1U << 31))
+    {
+        buckets <<= 1;
+    }
+
+    return buckets;
+}
\ No newline at end of file
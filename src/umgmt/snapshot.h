@@ -0,0 +1,435 @@
+/**
+ * @file snapshot.h
+ * @brief API for read-only database snapshots shared between processes.
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#ifndef UMGMT_SNAPSHOT_H
+#define UMGMT_SNAPSHOT_H
+
+#include "types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Store snapshot of the database.
+ * The snapshot contains all users and groups with their shadow data, name, UID and GID hash indexes and the status of
+ * the account files, so readers can use it until the files change. It is written to a temporary file which is renamed
+ * over the given path, so readers never see a partial snapshot. The file is readable by the owner only, as it contains
+ * password hashes.
+ *
+ * @param db Database to use - has to match the account files, so it is loaded or stored without further changes.
+ * @param path Path of the snapshot file.
+ *
+ * @return Error code - 0 on success, -1 if the database has unstored changes, skipped shadow data or on failure.
+ *
+ */
+int um_db_store_snapshot(um_db_t *db, const char *path);
+
+/**
+ * Open snapshot for reading.
+ * The file is mapped and queried in place - opening checks only the file header and the account files, lookups do not
+ * parse or allocate anything.
+ *
+ * @param path Path of the snapshot file.
+ *
+ * @return Opened snapshot - NULL if the file is missing, malformed or older than the account files.
+ *
+ */
+um_snapshot_t *um_snapshot_open(const char *path);
+
+/**
+ * Check if the account files are unchanged since the snapshot was stored.
+ * Files are compared by device, inode, size and modification time.
+ *
+ * @param snapshot Snapshot to check.
+ *
+ * @return True if the snapshot matches the account files.
+ *
+ */
+bool um_snapshot_is_current(const um_snapshot_t *snapshot);
+
+/**
+ * Get the number of users in the snapshot.
+ *
+ * @param snapshot Snapshot to use.
+ *
+ * @return Number of users.
+ *
+ */
+size_t um_snapshot_get_user_count(const um_snapshot_t *snapshot);
+
+/**
+ * Get user by its position in the snapshot - same order as in the database.
+ *
+ * @param snapshot Snapshot to use.
+ * @param index Position of the user.
+ *
+ * @return Found user - NULL if the index is out of range.
+ *
+ */
+const um_snapshot_user_t *um_snapshot_get_user_at(const um_snapshot_t *snapshot, size_t index);
+
+/**
+ * Get user with the given name.
+ *
+ * @param snapshot Snapshot to use.
+ * @param name Name of the user.
+ *
+ * @return Found user - NULL if not found.
+ *
+ */
+const um_snapshot_user_t *um_snapshot_get_user(const um_snapshot_t *snapshot, const char *name);
+
+/**
+ * Get the first user with the given UID.
+ *
+ * @param snapshot Snapshot to use.
+ * @param uid UID of the user.
+ *
+ * @return Found user - NULL if not found.
+ *
+ */
+const um_snapshot_user_t *um_snapshot_get_user_by_uid(const um_snapshot_t *snapshot, uid_t uid);
+
+/**
+ * Get the number of groups in the snapshot.
+ *
+ * @param snapshot Snapshot to use.
+ *
+ * @return Number of groups.
+ *
+ */
+size_t um_snapshot_get_group_count(const um_snapshot_t *snapshot);
+
+/**
+ * Get group by its position in the snapshot - same order as in the database.
+ *
+ * @param snapshot Snapshot to use.
+ * @param index Position of the group.
+ *
+ * @return Found group - NULL if the index is out of range.
+ *
+ */
+const um_snapshot_group_t *um_snapshot_get_group_at(const um_snapshot_t *snapshot, size_t index);
+
+/**
+ * Get group with the given name.
+ *
+ * @param snapshot Snapshot to use.
+ * @param name Name of the group.
+ *
+ * @return Found group - NULL if not found.
+ *
+ */
+const um_snapshot_group_t *um_snapshot_get_group(const um_snapshot_t *snapshot, const char *name);
+
+/**
+ * Get the first group with the given GID.
+ *
+ * @param snapshot Snapshot to use.
+ * @param gid GID of the group.
+ *
+ * @return Found group - NULL if not found.
+ *
+ */
+const um_snapshot_group_t *um_snapshot_get_group_by_gid(const um_snapshot_t *snapshot, gid_t gid);
+
+/**
+ * Get user name.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Name - NULL if not set.
+ *
+ */
+const char *um_snapshot_user_get_name(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get user password.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Password - NULL if not set.
+ *
+ */
+const char *um_snapshot_user_get_password(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get user UID.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return UID.
+ *
+ */
+uid_t um_snapshot_user_get_uid(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get user primary GID.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Primary GID.
+ *
+ */
+gid_t um_snapshot_user_get_gid(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get user GECOS field.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return GECOS field - NULL if not set.
+ *
+ */
+const char *um_snapshot_user_get_gecos(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get user home directory path.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Home directory path - NULL if not set.
+ *
+ */
+const char *um_snapshot_user_get_home_path(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get user shell path.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Shell path - NULL if not set.
+ *
+ */
+const char *um_snapshot_user_get_shell_path(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get user password hash.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Password hash - NULL if not set.
+ *
+ */
+const char *um_snapshot_user_get_password_hash(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get user date of the last password change.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Date of the last password change.
+ *
+ */
+long int um_snapshot_user_get_last_change(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get user minimum password age.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Minimum password age.
+ *
+ */
+long int um_snapshot_user_get_change_min(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get user maximum password age.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Maximum password age.
+ *
+ */
+long int um_snapshot_user_get_change_max(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get user password warning period.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Password warning period.
+ *
+ */
+long int um_snapshot_user_get_warn_days(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get user password inactivity period.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Password inactivity period.
+ *
+ */
+long int um_snapshot_user_get_inactive_days(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get user account expiration date.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Account expiration date.
+ *
+ */
+long int um_snapshot_user_get_expiration(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get user shadow flags.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Shadow flags.
+ *
+ */
+unsigned long int um_snapshot_user_get_flags(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get the number of groups the user is a member of. Groups the user only administers are not counted.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ *
+ * @return Number of groups.
+ *
+ */
+size_t um_snapshot_user_get_group_count(const um_snapshot_t *snapshot, const um_snapshot_user_t *user);
+
+/**
+ * Get group the user is a member of.
+ *
+ * @param snapshot Snapshot to use.
+ * @param user User to use.
+ * @param index Position of the group in the user's group list.
+ *
+ * @return Found group - NULL if the index is out of range.
+ *
+ */
+const um_snapshot_group_t *um_snapshot_user_get_group(const um_snapshot_t *snapshot, const um_snapshot_user_t *user,
+                                                      size_t index);
+
+/**
+ * Get group name.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ *
+ * @return Name - NULL if not set.
+ *
+ */
+const char *um_snapshot_group_get_name(const um_snapshot_t *snapshot, const um_snapshot_group_t *group);
+
+/**
+ * Get group password.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ *
+ * @return Password - NULL if not set.
+ *
+ */
+const char *um_snapshot_group_get_password(const um_snapshot_t *snapshot, const um_snapshot_group_t *group);
+
+/**
+ * Get group GID.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ *
+ * @return GID.
+ *
+ */
+gid_t um_snapshot_group_get_gid(const um_snapshot_t *snapshot, const um_snapshot_group_t *group);
+
+/**
+ * Get group password hash.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ *
+ * @return Password hash - NULL if not set.
+ *
+ */
+const char *um_snapshot_group_get_password_hash(const um_snapshot_t *snapshot, const um_snapshot_group_t *group);
+
+/**
+ * Get the number of group members.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ *
+ * @return Number of members.
+ *
+ */
+size_t um_snapshot_group_get_member_count(const um_snapshot_t *snapshot, const um_snapshot_group_t *group);
+
+/**
+ * Get group member.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ * @param index Position of the member.
+ *
+ * @return Found user - NULL if the index is out of range.
+ *
+ */
+const um_snapshot_user_t *um_snapshot_group_get_member(const um_snapshot_t *snapshot, const um_snapshot_group_t *group,
+                                                       size_t index);
+
+/**
+ * Get the number of group admins.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ *
+ * @return Number of admins.
+ *
+ */
+size_t um_snapshot_group_get_admin_count(const um_snapshot_t *snapshot, const um_snapshot_group_t *group);
+
+/**
+ * Get group admin.
+ *
+ * @param snapshot Snapshot to use.
+ * @param group Group to use.
+ * @param index Position of the admin.
+ *
+ * @return Found user - NULL if the index is out of range.
+ *
+ */
+const um_snapshot_user_t *um_snapshot_group_get_admin(const um_snapshot_t *snapshot, const um_snapshot_group_t *group,
+                                                      size_t index);
+
+/**
+ * Unmap the snapshot and free its data.
+ *
+ * @param snapshot Snapshot to close.
+ *
+ */
+void um_snapshot_close(um_snapshot_t *snapshot);
+
+#endif // UMGMT_SNAPSHOT_H
\ No newline at end of file
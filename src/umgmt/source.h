@@ -0,0 +1,43 @@
+/**
+ * @file source.h
+ * @brief Internal API for the state of the account files backing a database.
+ *
+ * Copyright (c) 2022 Sartura Ltd.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#ifndef UMGMT_SOURCE_H
+#define UMGMT_SOURCE_H
+
+#include "db.h"
+
+#include <stdbool.h>
+#include <sys/stat.h>
+
+/**
+ * Get the status of an account file at the time the database was last loaded or stored.
+ * Files are checked before they are read, so a file changed during the load never looks unchanged.
+ *
+ * @param db Database to use.
+ * @param file Account file to get the status for.
+ *
+ * @return File status - all zero if the file did not exist.
+ *
+ */
+const struct stat *um_db_get_source_stat(const um_db_t *db, um_db_file_t file);
+
+/**
+ * Check if the database has changes which are not stored to the account files.
+ *
+ * @param db Database to check.
+ *
+ * @return True if any user, group or the lists changed since the last load or store.
+ *
+ */
+bool um_db_is_modified(const um_db_t *db);
+
+#endif // UMGMT_SOURCE_H
\ No newline at end of file
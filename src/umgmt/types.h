@@ -13,6 +13,8 @@
 #ifndef UMGMT_TYPES_H
 #define UMGMT_TYPES_H
 
+#include <stdbool.h>
+
 /**
  * Abstract user type - containing information from /etc/passwd and /etc/shadow.
  */
@@ -53,31 +55,63 @@ typedef struct um_group_db_s um_group_db_t;
  */
 typedef struct um_db_s um_db_t;
 
+typedef struct um_snapshot_s um_snapshot_t;
+
+typedef struct um_snapshot_user_s um_snapshot_user_t;
+
+typedef struct um_snapshot_group_s um_snapshot_group_t;
+
+/**
+ * Process scan - finds processes of a set of UIDs in a single pass over /proc.
+ */
+typedef struct um_proc_scan_s um_proc_scan_t;
+
+/**
+ * User cursor - reads users from the account files one at a time.
+ */
+typedef struct um_user_iter_s um_user_iter_t;
+
+/**
+ * Group cursor - reads groups from the account files one at a time.
+ */
+typedef struct um_group_iter_s um_group_iter_t;
+
 /**
  * User list element.
+ * Lists are doubly linked - the head element's prev link points to the list tail.
  */
 struct um_user_element_s
 {
     um_user_t *user;         ///< Allocated abstract user data type.
     um_user_element_t *next; ///< Link to the next list node.
+    um_user_element_t *prev; ///< Link to the previous list node.
 };
 
 /**
  * Group list element.
+ * Lists are doubly linked - the head element's prev link points to the list tail.
  */
 struct um_group_element_s
 {
     um_group_t *group;        ///< Allocated abstract group data type.
     um_group_element_t *next; ///< Link to the next list node.
+    um_group_element_t *prev; ///< Link to the previous list node.
 };
 
 /**
  * Group member/admin list element.
+ * Lists are doubly linked - the head element's prev link points to the list tail.
+ * Each element is also linked into the user's group list using the user_next and user_prev links.
  */
 struct um_group_user_element_s
 {
-    const um_user_t *user;         ///< Allocated abstract user data type - single member.
-    um_group_user_element_t *next; ///< Link to the next list node.
+    um_user_t *user;                    ///< Allocated abstract user data type - single member.
+    um_group_t *group;                  ///< Group the user belongs to.
+    bool admin;                         ///< Element is a part of the admin list instead of the member list.
+    um_group_user_element_t *next;      ///< Link to the next list node.
+    um_group_user_element_t *prev;      ///< Link to the previous list node.
+    um_group_user_element_t *user_next; ///< Link to the next node in the user's group list.
+    um_group_user_element_t *user_prev; ///< Link to the previous node in the user's group list.
 };
 
 #endif // UMGMT_TYPES_H
\ No newline at end of file
@@ -9,10 +9,17 @@
  *     https://opensource.org/licenses/BSD-3-Clause
  */
 #include "user.h"
+#include "arena.h"
+#include "dirty.h"
+#include "intern.h"
+#include "deferred.h"
+#include "owner.h"
+#include "group.h"
+#include "membership.h"
+#include "proc.h"
+#include "parser.h"
+#include "db.h"
 
-#include "user.h"
-
-#include <dirent.h>
 #include <linux/limits.h>
 #include <pwd.h>
 #include <shadow.h>
@@ -21,6 +28,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/types.h>
+#include <utlist.h>
+
+// time given to processes of an user to exit after SIGTERM
+#define UM_USER_KILL_GRACE_MS 1000
 
 typedef struct um_shadow_data_s um_shadow_data_t;
 
@@ -46,9 +57,32 @@ struct um_user_s
     char *home_path;
     char *shell_path;
     um_shadow_data_t shadow;
+    um_group_user_element_t *groups_head;
+    unsigned int dirty;
+    um_arena_t *arena;
+    um_intern_t *intern;
+    um_db_t *deferred;
+    um_db_t *owner;
+};
+
+/**
+ * User cursor - the user view is reused for every user.
+ */
+struct um_user_iter_s
+{
+    um_parser_t passwd; ///< Streamed passwd file.
+    um_parser_t shadow; ///< Streamed shadow file.
+    bool has_shadow;    ///< Shadow file is read.
+    size_t shadow_pos;  ///< Number of shadow records read since the start of the file.
+    um_user_t user;     ///< View of the current user.
 };
 
 static int user_processes(const um_user_t *user, bool *has_running, const bool kill_proc);
+static char *um_user_strdup(um_user_t *user, const char *str);
+static void um_user_release(um_user_t *user, char *str);
+static char *um_user_share(um_user_t *user, const char *str);
+static void um_user_load_deferred(const um_user_t *user, unsigned int files);
+static int um_user_iter_find_shadow(um_user_iter_t *iter, const char *name, struct spwd *spwd);
 
 /**
  * Allocate new user.
@@ -70,6 +104,30 @@ um_user_t *um_user_new(void)
     return new_user;
 }
 
+/**
+ * Allocate new user in the arena.
+ * Strings set on the user are copied into the arena as well and nothing is freed before the arena itself.
+ *
+ * @param arena Arena to use.
+ *
+ * @return New allocated user.
+ *
+ */
+um_user_t *um_user_new_in(um_arena_t *arena)
+{
+    um_user_t *new_user = (um_user_t *)um_arena_alloc(arena, sizeof(um_user_t));
+
+    if (!new_user)
+    {
+        return NULL;
+    }
+
+    *new_user = (um_user_t){0};
+    new_user->arena = arena;
+
+    return new_user;
+}
+
 /**
  * Set the name for the user.
  *
@@ -81,21 +139,44 @@ um_user_t *um_user_new(void)
  */
 int um_user_set_name(um_user_t *user, const char *name)
 {
-    if (user->name)
-    {
-        free(user->name);
-        user->name = 0;
-    }
+    um_group_user_element_t *iter = NULL;
+    char *new_name = NULL;
+
+    // deferred records are matched by name
+    um_user_load_deferred(user, UM_DIRTY_SHADOW | UM_DIRTY_GSHADOW);
 
     if (name)
     {
-        user->name = strdup(name);
-        if (!user->name)
+        new_name = um_user_strdup(user, name);
+        if (!new_name)
         {
             return -1;
         }
     }
 
+    // the name index of the database is moved to the new name while the old one can still be found
+    if (user->owner && um_db_rekey_user(user->owner, user, new_name, user->uid))
+    {
+        if (new_name)
+        {
+            um_user_release(user, new_name);
+        }
+        return -1;
+    }
+
+    // member and admin lists refer to users by name
+    user->dirty |= UM_DIRTY_PASSWD | UM_DIRTY_SHADOW;
+    DL_FOREACH2(user->groups_head, iter, user_next)
+    {
+        um_group_set_dirty(iter->group, iter->admin ? UM_DIRTY_GSHADOW : UM_DIRTY_GROUP | UM_DIRTY_GSHADOW);
+    }
+
+    if (user->name)
+    {
+        um_user_release(user, user->name);
+    }
+    user->name = new_name;
+
     return 0;
 }
 
@@ -110,15 +191,17 @@ int um_user_set_name(um_user_t *user, const char *name)
  */
 int um_user_set_password(um_user_t *user, const char *password)
 {
+    user->dirty |= UM_DIRTY_PASSWD;
+
     if (user->password)
     {
-        free(user->password);
+        um_user_release(user, user->password);
         user->password = 0;
     }
 
     if (password)
     {
-        user->password = strdup(password);
+        user->password = um_user_share(user, password);
         if (!user->password)
         {
             return -1;
@@ -134,10 +217,20 @@ int um_user_set_password(um_user_t *user, const char *password)
  * @param user User to use.
  * @param uid UID to set.
  *
+ * @return Error code - 0 on success, -1 if the UID index of the database storing the user could not be updated.
+ *
  */
-void um_user_set_uid(um_user_t *user, uid_t uid)
+int um_user_set_uid(um_user_t *user, uid_t uid)
 {
+    if (user->owner && um_db_rekey_user(user->owner, user, user->name, uid))
+    {
+        return -1;
+    }
+
+    user->dirty |= UM_DIRTY_PASSWD;
     user->uid = uid;
+
+    return 0;
 }
 
 /**
@@ -149,6 +242,7 @@ void um_user_set_uid(um_user_t *user, uid_t uid)
  */
 void um_user_set_gid(um_user_t *user, gid_t gid)
 {
+    user->dirty |= UM_DIRTY_PASSWD;
     user->gid = gid;
 }
 
@@ -163,15 +257,17 @@ void um_user_set_gid(um_user_t *user, gid_t gid)
  */
 int um_user_set_gecos(um_user_t *user, const char *gecos)
 {
+    user->dirty |= UM_DIRTY_PASSWD;
+
     if (user->gecos)
     {
-        free(user->gecos);
+        um_user_release(user, user->gecos);
         user->gecos = 0;
     }
 
     if (gecos)
     {
-        user->gecos = strdup(gecos);
+        user->gecos = um_user_strdup(user, gecos);
         if (!user->gecos)
         {
             return -1;
@@ -192,15 +288,17 @@ int um_user_set_gecos(um_user_t *user, const char *gecos)
  */
 int um_user_set_home_path(um_user_t *user, const char *path)
 {
+    user->dirty |= UM_DIRTY_PASSWD;
+
     if (user->home_path)
     {
-        free(user->home_path);
+        um_user_release(user, user->home_path);
         user->home_path = 0;
     }
 
     if (path)
     {
-        user->home_path = strdup(path);
+        user->home_path = um_user_strdup(user, path);
         if (!user->home_path)
         {
             return -1;
@@ -221,15 +319,17 @@ int um_user_set_home_path(um_user_t *user, const char *path)
  */
 int um_user_set_shell_path(um_user_t *user, const char *path)
 {
+    user->dirty |= UM_DIRTY_PASSWD;
+
     if (user->shell_path)
     {
-        free(user->shell_path);
+        um_user_release(user, user->shell_path);
         user->shell_path = 0;
     }
 
     if (path)
     {
-        user->shell_path = strdup(path);
+        user->shell_path = um_user_share(user, path);
         if (!user->shell_path)
         {
             return -1;
@@ -250,15 +350,20 @@ int um_user_set_shell_path(um_user_t *user, const char *path)
  */
 int um_user_set_password_hash(um_user_t *user, const char *password_hash)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+    user->dirty |= UM_DIRTY_SHADOW;
+
     if (user->shadow.password_hash)
     {
-        free(user->shadow.password_hash);
+        um_user_release(user, user->shadow.password_hash);
         user->shadow.password_hash = 0;
     }
 
     if (password_hash)
     {
-        user->shadow.password_hash = strdup(password_hash);
+        // only placeholders such as "!" or "*" repeat across records, real hashes are salted
+        user->shadow.password_hash =
+            strchr(password_hash, '$') ? um_user_strdup(user, password_hash) : um_user_share(user, password_hash);
         if (!user->shadow.password_hash)
         {
             return -1;
@@ -277,6 +382,8 @@ int um_user_set_password_hash(um_user_t *user, const char *password_hash)
  */
 void um_user_set_last_change(um_user_t *user, long int last_change)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+    user->dirty |= UM_DIRTY_SHADOW;
     user->shadow.last_change = last_change;
 }
 
@@ -289,6 +396,8 @@ void um_user_set_last_change(um_user_t *user, long int last_change)
  */
 void um_user_set_change_min(um_user_t *user, long int change_min)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+    user->dirty |= UM_DIRTY_SHADOW;
     user->shadow.change_min = change_min;
 }
 
@@ -301,6 +410,8 @@ void um_user_set_change_min(um_user_t *user, long int change_min)
  */
 void um_user_set_change_max(um_user_t *user, long int change_max)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+    user->dirty |= UM_DIRTY_SHADOW;
     user->shadow.change_max = change_max;
 }
 
@@ -313,6 +424,8 @@ void um_user_set_change_max(um_user_t *user, long int change_max)
  */
 void um_user_set_warn_days(um_user_t *user, long int warn_days)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+    user->dirty |= UM_DIRTY_SHADOW;
     user->shadow.warn_days = warn_days;
 }
 
@@ -325,6 +438,8 @@ void um_user_set_warn_days(um_user_t *user, long int warn_days)
  */
 void um_user_set_inactive_days(um_user_t *user, long int inactive_days)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+    user->dirty |= UM_DIRTY_SHADOW;
     user->shadow.inactive_days = inactive_days;
 }
 
@@ -337,6 +452,8 @@ void um_user_set_inactive_days(um_user_t *user, long int inactive_days)
  */
 void um_user_set_expiration(um_user_t *user, long int expiration)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+    user->dirty |= UM_DIRTY_SHADOW;
     user->shadow.expiration = expiration;
 }
 
@@ -349,6 +466,8 @@ void um_user_set_expiration(um_user_t *user, long int expiration)
  */
 void um_user_set_flags(um_user_t *user, unsigned long int flags)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+    user->dirty |= UM_DIRTY_SHADOW;
     user->shadow.flags = flags;
 }
 
@@ -453,6 +572,8 @@ const char *um_user_get_shell_path(const um_user_t *user)
  */
 const char *um_user_get_password_hash(const um_user_t *user)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+
     return user->shadow.password_hash;
 }
 
@@ -466,6 +587,8 @@ const char *um_user_get_password_hash(const um_user_t *user)
  */
 long int um_user_get_last_change(const um_user_t *user)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+
     return user->shadow.last_change;
 }
 
@@ -479,6 +602,8 @@ long int um_user_get_last_change(const um_user_t *user)
  */
 long int um_user_get_change_min(const um_user_t *user)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+
     return user->shadow.change_min;
 }
 
@@ -492,6 +617,8 @@ long int um_user_get_change_min(const um_user_t *user)
  */
 long int um_user_get_change_max(const um_user_t *user)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+
     return user->shadow.change_max;
 }
 
@@ -505,6 +632,8 @@ long int um_user_get_change_max(const um_user_t *user)
  */
 long int um_user_get_warn_days(const um_user_t *user)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+
     return user->shadow.warn_days;
 }
 
@@ -518,6 +647,8 @@ long int um_user_get_warn_days(const um_user_t *user)
  */
 long int um_user_get_inactive_days(const um_user_t *user)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+
     return user->shadow.inactive_days;
 }
 
@@ -531,6 +662,8 @@ long int um_user_get_inactive_days(const um_user_t *user)
  */
 long int um_user_get_expiration(const um_user_t *user)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+
     return user->shadow.expiration;
 }
 
@@ -544,9 +677,136 @@ long int um_user_get_expiration(const um_user_t *user)
  */
 unsigned long int um_user_get_flags(const um_user_t *user)
 {
+    um_user_load_deferred(user, UM_DIRTY_SHADOW);
+
     return user->shadow.flags;
 }
 
+/**
+ * Get head of the list of groups the user is a member or an admin of.
+ * List is linked using the user_next link of the elements.
+ *
+ * @param user User to use.
+ *
+ * @return User's group list head.
+ *
+ */
+const um_group_user_element_t *um_user_get_groups_head(const um_user_t *user)
+{
+    // admin lists are stored in gshadow
+    um_user_load_deferred(user, UM_DIRTY_GSHADOW);
+
+    return user->groups_head;
+}
+
+/**
+ * Link group member/admin element into the group list of its user.
+ *
+ * @param element Element to link - the user field must be set.
+ *
+ */
+void um_user_link_membership(um_group_user_element_t *element)
+{
+    DL_APPEND2(element->user->groups_head, element, user_prev, user_next);
+}
+
+/**
+ * Unlink group member/admin element from the group list of its user.
+ *
+ * @param element Element to unlink.
+ *
+ */
+void um_user_unlink_membership(um_group_user_element_t *element)
+{
+    DL_DELETE2(element->user->groups_head, element, user_prev, user_next);
+}
+
+/**
+ * Get the mask of account files changed since the user was last stored.
+ *
+ * @param user User to use.
+ *
+ * @return Dirty mask.
+ *
+ */
+unsigned int um_user_get_dirty(const um_user_t *user)
+{
+    return user->dirty;
+}
+
+/**
+ * Clear the dirty mask of the user.
+ *
+ * @param user User to use.
+ *
+ */
+void um_user_clear_dirty(um_user_t *user)
+{
+    user->dirty = 0;
+}
+
+/**
+ * Mark account files of the user as changed.
+ *
+ * @param user User to use.
+ * @param mask Dirty mask bits to set.
+ *
+ */
+void um_user_set_dirty(um_user_t *user, unsigned int mask)
+{
+    user->dirty |= mask;
+}
+
+/**
+ * Set the database which holds deferred shadow data of the user.
+ *
+ * @param user User to use.
+ * @param db Database to read the data from on first access - NULL once the user does not wait for any data.
+ *
+ */
+void um_user_set_deferred(um_user_t *user, um_db_t *db)
+{
+    user->deferred = db;
+}
+
+/**
+ * Get the database which holds deferred shadow data of the user.
+ *
+ * @param user User to use.
+ *
+ * @return Database set by um_user_set_deferred().
+ *
+ */
+um_db_t *um_user_get_deferred(const um_user_t *user)
+{
+    return user->deferred;
+}
+
+/**
+ * Set the database which stores the user.
+ *
+ * @param user User to use.
+ * @param db Database whose indexes hold the user - NULL once the user is removed from it.
+ *
+ */
+void um_user_set_owner(um_user_t *user, um_db_t *db)
+{
+    user->owner = db;
+}
+
+/**
+ * Get the database which stores the user.
+ *
+ * @param user User to use.
+ *
+ * @return Database set by um_user_set_owner().
+ *
+ */
+um_db_t *um_user_get_owner(const um_user_t *user)
+{
+    return user->owner;
+}
+
 /**
  * Check if an user has any running processes / check if user is logged in
  *
@@ -562,6 +822,7 @@ int um_user_has_running_proc(const um_user_t *user, bool *running)
 
 /**
  * Kill all of user's processes
+ * Processes are sent SIGTERM and given one second to exit before SIGKILL - see um_proc_scan_terminate().
  *
  * @param user User to use.
  *
@@ -588,135 +849,353 @@ int um_user_kill_all_proc(const um_user_t *user)
 static int user_processes(const um_user_t *user, bool *has_running, const bool kill_proc)
 {
     int error = 0;
-    DIR *proc_d = NULL;
-    FILE *status_f = NULL;
-    struct dirent *proc = NULL;
-    char nums[] = "1234567890";
-    char status_path[NAME_MAX] = {0};
-    char buf[1024] = {0};
-    unsigned long proc_ruid = 0;
-    pid_t proc_id = 0;
-
-    proc_d = opendir("/proc");
-    if (proc_d == NULL)
+    um_proc_scan_t *scan = NULL;
+    size_t count = 0;
+
+    scan = um_proc_scan_new();
+    if (scan == NULL)
     {
-        goto error_out;
+        return -1;
     }
 
-    // stays unchanged if 'kill_proc == true'
-    *has_running = false;
+    if (um_proc_scan_add_uid(scan, user->uid))
+    {
+        goto error_out;
+    }
 
-    while ((proc = readdir(proc_d)) != NULL)
+    // SIGTERM first, SIGKILL for processes still running after the grace period
+    if (kill_proc == true)
     {
-        if (strcmp(proc->d_name, ".") && strcmp(proc->d_name, ".."))
+        if (um_proc_scan_terminate(scan, UM_USER_KILL_GRACE_MS, NULL) != 0)
         {
-            // check if directory name has only numbers
-            if (proc->d_type == DT_DIR && (strspn(proc->d_name, nums) == strlen(proc->d_name)))
-            {
-                if (snprintf(status_path, NAME_MAX, "/proc/%s/status", proc->d_name) < 0)
-                {
-                    goto error_out;
-                }
-
-                proc_id = (pid_t)strtol(proc->d_name, NULL, 10);
-                if (proc_id == 0)
-                {
-                    goto error_out;
-                }
-
-                status_f = fopen(status_path, "r");
-                if (status_f == NULL)
-                {
-                    goto error_out;
-                }
-
-                while (fgets(buf, sizeof(buf), status_f) == buf)
-                {
-                    if (sscanf(buf, "Uid:\t%lu", &proc_ruid) == 1)
-                    {
-                        if (proc_ruid == user->uid)
-                        {
-                            if (kill_proc == false)
-                            {
-                                *has_running = true;
-                                error = 0;
-                                goto out;
-                            }
-                            else if (kill_proc == true)
-                            {
-                                if (kill(proc_id, SIGTERM) != 0)
-                                {
-                                    if (kill(proc_id, SIGKILL) != 0)
-                                    {
-                                        goto error_out;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-                fclose(status_f);
-                status_f = NULL;
-            }
+            goto error_out;
         }
+        goto out;
+    }
+
+    if (um_proc_scan_run(scan) != 0)
+    {
+        goto error_out;
     }
 
+    // stays unchanged if 'kill_proc == true'
+    um_proc_scan_get_pids(scan, user->uid, &count);
+    *has_running = count > 0;
+
+    goto out;
+
 error_out:
     error = -1;
 
 out:
-    if (proc_d)
+    um_proc_scan_free(scan);
+
+    return error;
+}
+
+/**
+ * Open a cursor over the users in the account files of the database, without loading the database.
+ * Only the paths of the database are used - see um_db_set_root() and um_db_set_path(). Files are read incrementally
+ * through fixed size buffers, so the memory used does not depend on the number of users.
+ *
+ * Shadow records are matched by name while reading - in constant time if shadow lists the users in the same order as
+ * passwd, which is how the shadow tools keep it, and by a pass over shadow otherwise.
+ *
+ * @param db Database with the paths of the account files.
+ * @param flags UM_DB_LOAD_SKIP_SHADOW to read only passwd - shadow fields stay unset, other flags are ignored.
+ *
+ * @return New cursor - NULL if the files can not be opened.
+ *
+ */
+um_user_iter_t *um_user_iter_open(const um_db_t *db, unsigned int flags)
+{
+    um_user_iter_t *iter = (um_user_iter_t *)malloc(sizeof(um_user_iter_t));
+
+    if (!iter)
     {
-        closedir(proc_d);
+        return NULL;
     }
-    if (status_f)
+
+    *iter = (um_user_iter_t){0};
+
+    if (um_parser_open_stream(&iter->passwd, um_db_get_path(db, UM_DB_FILE_PASSWD)))
     {
-        fclose(status_f);
+        free(iter);
+        return NULL;
     }
 
-    return error;
+    if (!(flags & UM_DB_LOAD_SKIP_SHADOW))
+    {
+        if (um_parser_open_stream(&iter->shadow, um_db_get_path(db, UM_DB_FILE_SHADOW)))
+        {
+            um_parser_close(&iter->passwd);
+            free(iter);
+            return NULL;
+        }
+        iter->has_shadow = true;
+    }
+
+    return iter;
+}
+
+/**
+ * Read the next user.
+ * The user is a borrowed view valid until the next call or closing the cursor - it must not be modified, freed or
+ * added to a database, and has no group list. Copy the needed fields to keep them.
+ *
+ * @param iter Cursor to use.
+ * @param user Set to the next user.
+ *
+ * @return 1 if a user was read, 0 after the last user, -1 on failure.
+ *
+ */
+int um_user_iter_next(um_user_iter_t *iter, const um_user_t **user)
+{
+    struct passwd pwd = {0};
+    struct spwd spwd = {0};
+    int result = um_parser_next_passwd(&iter->passwd, &pwd);
+
+    *user = NULL;
+
+    if (result <= 0)
+    {
+        return iter->passwd.failed ? -1 : 0;
+    }
+
+    // the view points into the read buffers
+    iter->user = (um_user_t){
+        .name = pwd.pw_name,
+        .password = pwd.pw_passwd,
+        .uid = pwd.pw_uid,
+        .gid = pwd.pw_gid,
+        .gecos = pwd.pw_gecos,
+        .home_path = pwd.pw_dir,
+        .shell_path = pwd.pw_shell,
+    };
+
+    if (iter->has_shadow)
+    {
+        result = um_user_iter_find_shadow(iter, pwd.pw_name, &spwd);
+        if (result < 0)
+        {
+            return -1;
+        }
+
+        if (result > 0)
+        {
+            iter->user.shadow = (um_shadow_data_t){
+                .password_hash = spwd.sp_pwdp,
+                .last_change = spwd.sp_lstchg,
+                .change_min = spwd.sp_min,
+                .change_max = spwd.sp_max,
+                .warn_days = spwd.sp_warn,
+                .inactive_days = spwd.sp_inact,
+                .expiration = spwd.sp_expire,
+                .flags = spwd.sp_flag,
+            };
+        }
+    }
+
+    *user = &iter->user;
+
+    return 1;
+}
+
+/**
+ * Close the cursor and the account files.
+ *
+ * @param iter Cursor to close.
+ *
+ */
+void um_user_iter_close(um_user_iter_t *iter)
+{
+    um_parser_close(&iter->passwd);
+    if (iter->has_shadow)
+    {
+        um_parser_close(&iter->shadow);
+    }
+    free(iter);
 }
 
 /**
  * Free user data.
+ * The user is removed from the member and admin lists of all groups it belongs to.
  *
  * @param user User to free.
  *
  */
 void um_user_free(um_user_t *user)
 {
+    // remove the user from all groups it belongs to
+    while (user->groups_head)
+    {
+        um_group_drop_membership(user->groups_head);
+    }
+
+    // arena data is released together with the arena
+    if (user->arena)
+    {
+        return;
+    }
+
     // free all fields
 
     if (user->name)
     {
-        free(user->name);
+        um_user_release(user, user->name);
     }
 
     if (user->password)
     {
-        free(user->password);
+        um_user_release(user, user->password);
     }
 
     if (user->gecos)
     {
-        free(user->gecos);
+        um_user_release(user, user->gecos);
     }
 
     if (user->home_path)
     {
-        free(user->home_path);
+        um_user_release(user, user->home_path);
     }
 
     if (user->shell_path)
     {
-        free(user->shell_path);
+        um_user_release(user, user->shell_path);
     }
 
     if (user->shadow.password_hash)
     {
-        free(user->shadow.password_hash);
+        um_user_release(user, user->shadow.password_hash);
     }
 
     // free allocated struct
     free(user);
+}
+
+/**
+ * Copy string for the user - into the arena if the user was allocated in one.
+ *
+ * @param user User to use.
+ * @param str String to copy.
+ *
+ * @return Copied string - NULL on allocation failure.
+ *
+ */
+static char *um_user_strdup(um_user_t *user, const char *str)
+{
+    return user->arena ? um_arena_strdup(user->arena, str) : strdup(str);
+}
+
+/**
+ * Free string of the user - strings in the arena or the interning table are left for their owner.
+ *
+ * @param user User to use.
+ * @param str String to free.
+ *
+ */
+static void um_user_release(um_user_t *user, char *str)
+{
+    if (!user->arena && !(user->intern && um_intern_owns(user->intern, str)))
+    {
+        free(str);
+    }
+}
+
+/**
+ * Get shared copy of a frequently repeated string - private copy if the user has no interning table.
+ *
+ * @param user User to use.
+ * @param str String to copy.
+ *
+ * @return Copied string - NULL on allocation failure.
+ *
+ */
+static char *um_user_share(um_user_t *user, const char *str)
+{
+    if (user->intern)
+    {
+        const char *shared = um_intern_string(user->intern, str);
+
+        if (shared)
+        {
+            return (char *)shared;
+        }
+    }
+
+    return um_user_strdup(user, str);
+}
+
+/**
+ * Share the password, shell path and password hash placeholders of the user using the table.
+ * Only values set after the call are shared.
+ *
+ * @param user User to use.
+ * @param intern Table to use.
+ *
+ */
+void um_user_set_intern(um_user_t *user, um_intern_t *intern)
+{
+    user->intern = intern;
+}
+
+/**
+ * Read deferred account files of the database the user was loaded with before the data is used.
+ * Getters cannot report errors - fields of files which failed to load stay unset.
+ *
+ * @param user User to use.
+ * @param files Dirty mask bits of the files to read.
+ *
+ */
+static void um_user_load_deferred(const um_user_t *user, unsigned int files)
+{
+    if (user->deferred)
+    {
+        um_db_load_deferred(user->deferred, files);
+    }
+}
+
+/**
+ * Find the shadow record of the user read by the cursor.
+ * Search starts after the previously found record and wraps around to the start of the file once, so files in the
+ * same order as passwd are read only once in total.
+ *
+ * @param iter Cursor to use.
+ * @param name Name of the user.
+ * @param spwd Found record.
+ *
+ * @return 1 if the record was found, 0 if the user has no shadow record, -1 on failure.
+ *
+ */
+static int um_user_iter_find_shadow(um_user_iter_t *iter, const char *name, struct spwd *spwd)
+{
+    size_t start = iter->shadow_pos;
+
+    while (um_parser_next_shadow(&iter->shadow, spwd) > 0)
+    {
+        iter->shadow_pos++;
+        if (!strcmp(spwd->sp_namp, name))
+        {
+            return 1;
+        }
+    }
+
+    if (iter->shadow.failed || um_parser_rewind(&iter->shadow))
+    {
+        return -1;
+    }
+
+    // records before the start position, the search ends where it started
+    iter->shadow_pos = 0;
+    while (iter->shadow_pos < start && um_parser_next_shadow(&iter->shadow, spwd) > 0)
+    {
+        iter->shadow_pos++;
+        if (!strcmp(spwd->sp_namp, name))
+        {
+            return 1;
+        }
+    }
+
+    return iter->shadow.failed ? -1 : 0;
 }
\ No newline at end of file
@@ -54,8 +54,10 @@ int um_user_set_password(um_user_t *user, const char *password);
  * @param user User to use.
  * @param uid UID to set.
  *
+ * @return Error code - 0 on success, -1 if the UID index of the database storing the user could not be updated.
+ *
  */
-void um_user_set_uid(um_user_t *user, uid_t uid);
+int um_user_set_uid(um_user_t *user, uid_t uid);
 
 /**
  * Set GID for the user.
@@ -325,6 +327,7 @@ int um_user_has_running_proc(const um_user_t *user, bool *running);
 
 /**
  * Kill all of user's processes. Recommended before user deletion on system
+ * Processes are sent SIGTERM and given one second to exit before SIGKILL - see um_proc_scan_terminate().
  *
  * @param user User to use.
  *
@@ -343,8 +346,57 @@ int um_user_kill_all_proc(const um_user_t *user);
  */
 unsigned long int um_user_get_flags(const um_user_t *user);
 
+/**
+ * Get head of the list of groups the user is a member or an admin of.
+ * List is linked using the user_next link of the elements.
+ *
+ * @param user User to use.
+ *
+ * @return User's group list head.
+ *
+ */
+const um_group_user_element_t *um_user_get_groups_head(const um_user_t *user);
+
+/**
+ * Open a cursor over the users in the account files of the database, without loading the database.
+ * Only the paths of the database are used - see um_db_set_root() and um_db_set_path(). Files are read incrementally
+ * through fixed size buffers, so the memory used does not depend on the number of users.
+ *
+ * Shadow records are matched by name while reading - in constant time if shadow lists the users in the same order as
+ * passwd, which is how the shadow tools keep it, and by a pass over shadow otherwise.
+ *
+ * @param db Database with the paths of the account files.
+ * @param flags UM_DB_LOAD_SKIP_SHADOW to read only passwd - shadow fields stay unset, other flags are ignored.
+ *
+ * @return New cursor - NULL if the files can not be opened.
+ *
+ */
+um_user_iter_t *um_user_iter_open(const um_db_t *db, unsigned int flags);
+
+/**
+ * Read the next user.
+ * The user is a borrowed view valid until the next call or closing the cursor - it must not be modified, freed or
+ * added to a database, and has no group list. Copy the needed fields to keep them.
+ *
+ * @param iter Cursor to use.
+ * @param user Set to the next user.
+ *
+ * @return 1 if a user was read, 0 after the last user, -1 on failure.
+ *
+ */
+int um_user_iter_next(um_user_iter_t *iter, const um_user_t **user);
+
+/**
+ * Close the cursor and the account files.
+ *
+ * @param iter Cursor to close.
+ *
+ */
+void um_user_iter_close(um_user_iter_t *iter);
+
 /**
  * Free user data.
+ * The user is removed from the member and admin lists of all groups it belongs to.
  *
  * @param user User to free.
  *
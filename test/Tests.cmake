@@ -69,4 +69,109 @@ target_link_libraries(
     ${CMAKE_PROJECT_NAME}
 )
 target_link_options(test_db PRIVATE ${GROUP_UTEST_LINKER_OPTIONS})
-add_test(NAME test_db COMMAND test_db)
\ No newline at end of file
+add_test(NAME test_db COMMAND test_db)
+
+# test ID pool
+add_executable(
+    test_idpool
+
+    test/test_idpool.c
+)
+
+target_link_libraries(
+    test_idpool
+
+    ${CMOCKA_LIBRARIES}
+    ${CMAKE_PROJECT_NAME}
+)
+add_test(NAME test_idpool COMMAND test_idpool)
+
+# test account file parser
+add_executable(
+    test_parser
+
+    test/test_parser.c
+)
+
+target_link_libraries(
+    test_parser
+
+    ${CMOCKA_LIBRARIES}
+    ${CMAKE_PROJECT_NAME}
+)
+add_test(NAME test_parser COMMAND test_parser)
+
+# test arena allocator
+add_executable(
+    test_arena
+
+    test/test_arena.c
+)
+
+target_link_libraries(
+    test_arena
+
+    ${CMOCKA_LIBRARIES}
+    ${CMAKE_PROJECT_NAME}
+)
+add_test(NAME test_arena COMMAND test_arena)
+
+# test string interning table
+add_executable(
+    test_intern
+
+    test/test_intern.c
+)
+
+target_link_libraries(
+    test_intern
+
+    ${CMOCKA_LIBRARIES}
+    ${CMAKE_PROJECT_NAME}
+)
+add_test(NAME test_intern COMMAND test_intern)
+
+# test database snapshots
+add_executable(
+    test_snapshot
+
+    test/test_snapshot.c
+)
+
+target_link_libraries(
+    test_snapshot
+
+    ${CMOCKA_LIBRARIES}
+    ${CMAKE_PROJECT_NAME}
+)
+add_test(NAME test_snapshot COMMAND test_snapshot)
+
+# test parallel account file loader
+add_executable(
+    test_loader
+
+    test/test_loader.c
+)
+
+target_link_libraries(
+    test_loader
+
+    ${CMOCKA_LIBRARIES}
+    ${CMAKE_PROJECT_NAME}
+)
+add_test(NAME test_loader COMMAND test_loader)
+
+# test process scan
+add_executable(
+    test_proc
+
+    test/test_proc.c
+)
+
+target_link_libraries(
+    test_proc
+
+    ${CMOCKA_LIBRARIES}
+    ${CMAKE_PROJECT_NAME}
+)
+add_test(NAME test_proc COMMAND test_proc)
\ No newline at end of file
@@ -1,13 +1,30 @@
 #include "common.h"
 
+static bool passthrough = false;
+
+void common_set_passthrough(bool enabled)
+{
+    passthrough = enabled;
+}
+
 void *__wrap_malloc(size_t size)
 {
+    if (passthrough)
+    {
+        return __real_malloc(size);
+    }
+
     check_expected(size);
     return mock_ptr_type(void *);
 }
 
 char *__wrap_strdup(const char *s)
 {
+    if (passthrough)
+    {
+        return __real_strdup(s);
+    }
+
     check_expected(s);
     return mock_ptr_type(char *);
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <stdarg.h>
 #include <stddef.h>
 #include <setjmp.h>
+#include <stdbool.h>
 #include <cmocka.h>
 
 // malloc
@@ -14,4 +15,7 @@ extern void *__real_malloc(size_t size);
 char *__wrap_strdup(const char *s);
 extern char *__real_strdup(const char *s);
 
+// forward wrapped calls to the real functions without checking expectations
+void common_set_passthrough(bool enabled);
+
 #endif // UMTM_COMMON_UTEST_H
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+
+#include "umgmt/arena.c"
+
+static void test_arena_alloc(void **state);
+static void test_arena_large(void **state);
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_arena_alloc),
+        cmocka_unit_test(test_arena_large),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+static void test_arena_alloc(void **state)
+{
+    (void)state;
+
+    um_arena_t *arena = um_arena_new();
+    char *str = NULL;
+    void *ptr = NULL;
+
+    assert_non_null(arena);
+
+    // strings are packed, other allocations are aligned for any type
+    str = um_arena_strdup(arena, "/bin/sh");
+    assert_string_equal(str, "/bin/sh");
+    ptr = um_arena_alloc(arena, 24);
+    assert_non_null(ptr);
+    assert_int_equal((uintptr_t)ptr % alignof(max_align_t), 0);
+    assert_ptr_equal(arena->head->next, NULL);
+
+    // chunks grow once filled
+    for (int i = 0; i < 10000; i++)
+    {
+        assert_non_null(um_arena_alloc(arena, 64));
+    }
+    assert_non_null(arena->head->next);
+    assert_true(arena->head->size > UM_ARENA_MIN_CHUNK_SIZE);
+    assert_string_equal(str, "/bin/sh");
+
+    um_arena_free(arena);
+}
+
+static void test_arena_large(void **state)
+{
+    (void)state;
+
+    um_arena_t *arena = um_arena_new();
+    char *data = NULL;
+
+    assert_non_null(arena);
+
+    // allocations larger than a chunk get a chunk of their own
+    data = (char *)um_arena_alloc(arena, UM_ARENA_MAX_CHUNK_SIZE + 1);
+    assert_non_null(data);
+    data[UM_ARENA_MAX_CHUNK_SIZE] = 1;
+    assert_int_equal(arena->head->size, UM_ARENA_MAX_CHUNK_SIZE + 1);
+
+    assert_null(um_arena_alloc(arena, SIZE_MAX));
+
+    um_arena_free(arena);
+}
\ No newline at end of file
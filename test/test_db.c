@@ -14,11 +14,50 @@
 static void test_db_new_correct(void **state);
 static void test_db_new_incorrect(void **state);
 
+static void test_db_user_index(void **state);
+static void test_db_group_index(void **state);
+static void test_db_id_index(void **state);
+static void test_db_new_id(void **state);
+static void test_db_reserve_ids(void **state);
+static void test_db_add_batch(void **state);
+static void test_db_user_groups(void **state);
+static void test_db_file_replace(void **state);
+static void test_db_dirty(void **state);
+static void test_db_root(void **state);
+static void test_db_load_arena(void **state);
+static void test_db_intern(void **state);
+static void test_db_load_deferred(void **state);
+static void test_db_refresh(void **state);
+static void test_db_iter(void **state);
+static void test_db_query(void **state);
+static void test_db_sorted(void **state);
+
+static void create_root(char *root);
+static void remove_root(const char *root);
+static void write_root_file(const char *root, const char *name, const char *contents);
+
 int main(void)
 {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_db_new_correct),
         cmocka_unit_test(test_db_new_incorrect),
+        cmocka_unit_test(test_db_user_index),
+        cmocka_unit_test(test_db_group_index),
+        cmocka_unit_test(test_db_id_index),
+        cmocka_unit_test(test_db_new_id),
+        cmocka_unit_test(test_db_reserve_ids),
+        cmocka_unit_test(test_db_add_batch),
+        cmocka_unit_test(test_db_user_groups),
+        cmocka_unit_test(test_db_file_replace),
+        cmocka_unit_test(test_db_dirty),
+        cmocka_unit_test(test_db_root),
+        cmocka_unit_test(test_db_load_arena),
+        cmocka_unit_test(test_db_intern),
+        cmocka_unit_test(test_db_load_deferred),
+        cmocka_unit_test(test_db_refresh),
+        cmocka_unit_test(test_db_iter),
+        cmocka_unit_test(test_db_query),
+        cmocka_unit_test(test_db_sorted),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -57,4 +96,1120 @@ static void test_db_new_incorrect(void **state)
 
     db = um_db_new();
     assert_null(db);
+}
+
+static void test_db_user_index(void **state)
+{
+    (void)state;
+
+    um_db_t *db = NULL;
+    um_user_t *alice = NULL, *bob = NULL, *carol = NULL, *duplicate = NULL;
+
+    common_set_passthrough(true);
+
+    db = um_db_new();
+    assert_non_null(db);
+
+    alice = um_user_new();
+    bob = um_user_new();
+    duplicate = um_user_new();
+    assert_int_equal(um_user_set_name(alice, "alice"), 0);
+    assert_int_equal(um_user_set_name(bob, "bob"), 0);
+    assert_int_equal(um_user_set_name(duplicate, "alice"), 0);
+
+    assert_int_equal(um_db_add_user(db, alice), 0);
+    assert_int_equal(um_db_add_user(db, bob), 0);
+
+    // duplicate names are rejected
+    assert_int_equal(um_db_add_user(db, duplicate), -1);
+
+    assert_ptr_equal(um_db_get_user(db, "alice"), alice);
+    assert_ptr_equal(um_db_get_user(db, "bob"), bob);
+    assert_null(um_db_get_user(db, "carol"));
+
+    assert_int_equal(um_db_delete_user(db, "alice"), 0);
+    assert_null(um_db_get_user(db, "alice"));
+    assert_ptr_equal(um_db_get_user(db, "bob"), bob);
+    assert_ptr_equal(um_db_get_user_list_head(db)->user, bob);
+
+    // index follows renames of stored users
+    assert_int_equal(um_user_set_name(bob, "robert"), 0);
+    assert_null(um_db_get_user(db, "bob"));
+    assert_ptr_equal(um_db_get_user(db, "robert"), bob);
+    assert_int_equal(um_user_set_name(bob, "robert"), 0);
+    assert_ptr_equal(um_db_get_user(db, "robert"), bob);
+
+    // names of other stored users are rejected, the user keeps its name
+    carol = um_user_new();
+    assert_int_equal(um_user_set_name(carol, "carol"), 0);
+    assert_int_equal(um_db_add_user(db, carol), 0);
+    assert_int_equal(um_user_set_name(bob, "carol"), -1);
+    assert_int_equal(um_user_set_name(bob, NULL), -1);
+    assert_string_equal(um_user_get_name(bob), "robert");
+    assert_ptr_equal(um_db_get_user(db, "robert"), bob);
+    assert_ptr_equal(um_db_get_user(db, "carol"), carol);
+
+    um_db_free(db);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_group_index(void **state)
+{
+    (void)state;
+
+    um_db_t *db = NULL;
+    um_group_t *wheel = NULL, *users = NULL;
+
+    common_set_passthrough(true);
+
+    db = um_db_new();
+    assert_non_null(db);
+
+    wheel = um_group_new();
+    users = um_group_new();
+    assert_int_equal(um_group_set_name(wheel, "wheel"), 0);
+    assert_int_equal(um_group_set_name(users, "users"), 0);
+
+    assert_int_equal(um_db_add_group(db, wheel), 0);
+    assert_int_equal(um_db_add_group(db, users), 0);
+
+    assert_ptr_equal(um_db_get_group(db, "wheel"), wheel);
+    assert_ptr_equal(um_db_get_group(db, "users"), users);
+    assert_null(um_db_get_group(db, "audio"));
+
+    assert_int_equal(um_db_delete_group(db, "users"), 0);
+    assert_null(um_db_get_group(db, "users"));
+    assert_ptr_equal(um_db_get_group(db, "wheel"), wheel);
+
+    // index follows renames of stored groups
+    assert_int_equal(um_group_set_name(wheel, "admin"), 0);
+    assert_null(um_db_get_group(db, "wheel"));
+    assert_ptr_equal(um_db_get_group(db, "admin"), wheel);
+
+    um_db_free(db);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_id_index(void **state)
+{
+    (void)state;
+
+    um_db_t *db = NULL;
+    um_user_t *root = NULL, *toor = NULL, *alice = NULL;
+    um_group_t *wheel = NULL;
+    um_user_t *found[2] = {0};
+
+    common_set_passthrough(true);
+
+    db = um_db_new();
+    assert_non_null(db);
+
+    root = um_user_new();
+    toor = um_user_new();
+    alice = um_user_new();
+    assert_int_equal(um_user_set_name(root, "root"), 0);
+    assert_int_equal(um_user_set_name(toor, "toor"), 0);
+    assert_int_equal(um_user_set_name(alice, "alice"), 0);
+    um_user_set_uid(alice, 1000);
+
+    assert_int_equal(um_db_add_user(db, root), 0);
+    assert_int_equal(um_db_add_user(db, toor), 0);
+    assert_int_equal(um_db_add_user(db, alice), 0);
+
+    // first user in list order wins, all duplicates can be listed
+    assert_ptr_equal(um_db_get_user_by_uid(db, 0), root);
+    assert_ptr_equal(um_db_get_user_by_uid(db, 1000), alice);
+    assert_null(um_db_get_user_by_uid(db, 1001));
+
+    assert_int_equal(um_db_get_users_by_uid(db, 0, found, 2), 2);
+    assert_ptr_equal(found[0], root);
+    assert_ptr_equal(found[1], toor);
+    assert_int_equal(um_db_get_users_by_uid(db, 0, NULL, 0), 2);
+
+    assert_int_equal(um_db_delete_user(db, "root"), 0);
+    assert_ptr_equal(um_db_get_user_by_uid(db, 0), toor);
+    assert_int_equal(um_db_get_users_by_uid(db, 0, found, 2), 1);
+
+    // index follows UID changes of stored users
+    assert_int_equal(um_user_set_uid(alice, 1001), 0);
+    assert_null(um_db_get_user_by_uid(db, 1000));
+    assert_ptr_equal(um_db_get_user_by_uid(db, 1001), alice);
+    assert_int_equal(um_user_get_uid(alice), 1001);
+
+    // users moved to a shared UID keep list order
+    assert_int_equal(um_user_set_uid(alice, 0), 0);
+    assert_int_equal(um_user_set_uid(toor, 5), 0);
+    assert_ptr_equal(um_db_get_user_by_uid(db, 0), alice);
+    assert_int_equal(um_user_set_uid(toor, 0), 0);
+    assert_null(um_db_get_user_by_uid(db, 5));
+    assert_int_equal(um_db_get_users_by_uid(db, 0, found, 2), 2);
+    assert_ptr_equal(found[0], toor);
+    assert_ptr_equal(found[1], alice);
+
+    wheel = um_group_new();
+    assert_int_equal(um_group_set_name(wheel, "wheel"), 0);
+    um_group_set_gid(wheel, 10);
+    assert_int_equal(um_db_add_group(db, wheel), 0);
+
+    assert_ptr_equal(um_db_get_group_by_gid(db, 10), wheel);
+    assert_null(um_db_get_group_by_gid(db, 11));
+
+    // index follows GID changes of stored groups
+    assert_int_equal(um_group_set_gid(wheel, 11), 0);
+    assert_null(um_db_get_group_by_gid(db, 10));
+    assert_ptr_equal(um_db_get_group_by_gid(db, 11), wheel);
+
+    assert_int_equal(um_db_delete_group(db, "wheel"), 0);
+    assert_null(um_db_get_group_by_gid(db, 11));
+
+    um_db_free(db);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_new_id(void **state)
+{
+    (void)state;
+
+    um_db_t *db = NULL;
+    const char *names[] = {"user1", "user2", "user3"};
+    const uid_t uids[] = {1000, 1001, 1005};
+    um_group_t *group = NULL;
+
+    common_set_passthrough(true);
+
+    db = um_db_new();
+    assert_non_null(db);
+
+    // empty database starts at the range beginning
+    assert_int_equal(um_db_get_new_uid(db), 1000);
+
+    for (size_t i = 0; i < sizeof(uids) / sizeof(uids[0]); i++)
+    {
+        um_user_t *user = um_user_new();
+
+        assert_int_equal(um_user_set_name(user, names[i]), 0);
+        um_user_set_uid(user, uids[i]);
+        assert_int_equal(um_db_add_user(db, user), 0);
+    }
+
+    // IDs outside of the range are not considered
+    assert_int_equal(um_db_get_new_uid(db), 1006);
+
+    um_db_set_id_policy(db, UM_DB_ID_POLICY_LOWEST_FREE);
+    assert_int_equal(um_db_get_new_uid(db), 1002);
+
+    // pool is updated on delete
+    um_db_set_id_policy(db, UM_DB_ID_POLICY_NEXT_MAX);
+    assert_int_equal(um_db_delete_user(db, "user3"), 0);
+    assert_int_equal(um_db_get_new_uid(db), 1002);
+
+    // pool follows UID changes of stored users
+    assert_int_equal(um_user_set_uid(um_db_get_user(db, "user2"), 1002), 0);
+    assert_int_equal(um_db_get_new_uid(db), 1003);
+    um_db_set_id_policy(db, UM_DB_ID_POLICY_LOWEST_FREE);
+    assert_int_equal(um_db_get_new_uid(db), 1001);
+    um_db_set_id_policy(db, UM_DB_ID_POLICY_NEXT_MAX);
+
+    // GIDs are taken from groups
+    assert_int_equal(um_db_set_gid_range(db, 10, 11), 0);
+    assert_int_equal(um_db_set_gid_range(db, 11, 10), -1);
+
+    group = um_group_new();
+    assert_int_equal(um_group_set_name(group, "group1"), 0);
+    um_group_set_gid(group, 11);
+    assert_int_equal(um_db_add_group(db, group), 0);
+    assert_int_equal(um_db_get_new_gid(db), 10);
+
+    group = um_group_new();
+    assert_int_equal(um_group_set_name(group, "group2"), 0);
+    um_group_set_gid(group, 10);
+    assert_int_equal(um_db_add_group(db, group), 0);
+    assert_int_equal(um_db_get_new_gid(db), (gid_t)-1);
+
+    // GID moved out of the range becomes free
+    assert_int_equal(um_group_set_gid(group, 12), 0);
+    assert_int_equal(um_db_get_new_gid(db), 10);
+
+    um_db_free(db);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_reserve_ids(void **state)
+{
+    (void)state;
+
+    um_db_t *db = NULL;
+    um_user_t *user = NULL;
+    uid_t uids[4] = {0};
+    gid_t gids[3] = {0};
+
+    common_set_passthrough(true);
+
+    db = um_db_new();
+    assert_non_null(db);
+
+    assert_int_equal(um_db_set_uid_range(db, 100, 109), 0);
+    um_db_set_id_policy(db, UM_DB_ID_POLICY_LOWEST_FREE);
+
+    user = um_user_new();
+    assert_int_equal(um_user_set_name(user, "user1"), 0);
+    um_user_set_uid(user, 102);
+    assert_int_equal(um_db_add_user(db, user), 0);
+
+    // contiguous run skips the used UID
+    assert_int_equal(um_db_reserve_uids(db, uids, 3, true), 0);
+    assert_int_equal(uids[0], 103);
+    assert_int_equal(uids[1], 104);
+    assert_int_equal(uids[2], 105);
+
+    // arbitrary UIDs fill the gaps
+    assert_int_equal(um_db_reserve_uids(db, uids, 4, false), 0);
+    assert_int_equal(uids[0], 100);
+    assert_int_equal(uids[1], 101);
+    assert_int_equal(uids[2], 106);
+    assert_int_equal(uids[3], 107);
+
+    // not enough UIDs left - nothing is reserved
+    assert_int_equal(um_db_reserve_uids(db, uids, 3, false), -1);
+    assert_int_equal(um_db_get_new_uid(db), 108);
+
+    // released UIDs become free, reservations survive reindexing
+    um_db_release_uids(db, (const uid_t[]){100, 102}, 2);
+    assert_int_equal(um_db_reindex(db), 0);
+    assert_int_equal(um_db_get_new_uid(db), 100);
+
+    // adding a user takes over the reservation
+    user = um_user_new();
+    assert_int_equal(um_user_set_name(user, "user2"), 0);
+    um_user_set_uid(user, 101);
+    assert_int_equal(um_db_add_user(db, user), 0);
+    assert_int_equal(um_db_delete_user(db, "user2"), 0);
+    assert_int_equal(um_db_get_new_uid(db), 100);
+    assert_int_equal(um_db_reserve_uids(db, uids, 2, true), 0);
+    assert_int_equal(uids[0], 100);
+    assert_int_equal(uids[1], 101);
+
+    assert_int_equal(um_db_reserve_gids(db, gids, 3, true), 0);
+    assert_int_equal(gids[0], 1000);
+    assert_int_equal(gids[2], 1002);
+    assert_int_equal(um_db_get_new_gid(db), 1003);
+
+    um_db_free(db);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_add_batch(void **state)
+{
+    (void)state;
+
+    um_db_t *db = NULL;
+    um_user_t *users[3] = {0};
+    um_group_t *groups[2] = {0};
+    int errors[3] = {0};
+    const char *user_names[] = {"user1", "user2", "user1"};
+
+    common_set_passthrough(true);
+
+    db = um_db_new();
+    assert_non_null(db);
+
+    for (size_t i = 0; i < 3; i++)
+    {
+        users[i] = um_user_new();
+        assert_int_equal(um_user_set_name(users[i], user_names[i]), 0);
+        um_user_set_uid(users[i], (uid_t)(1000 + i));
+    }
+
+    // duplicate name fails on its own and stays owned by the caller
+    assert_int_equal(um_db_add_users(db, users, 3, errors), -1);
+    assert_int_equal(errors[0], 0);
+    assert_int_equal(errors[1], 0);
+    assert_int_equal(errors[2], -1);
+    assert_ptr_equal(um_db_get_user(db, "user1"), users[0]);
+    assert_ptr_equal(um_db_get_user_by_uid(db, 1001), users[1]);
+    assert_null(um_db_get_user_by_uid(db, 1002));
+    assert_ptr_equal(um_db_get_user_list_head(db)->next->user, users[1]);
+    um_user_free(users[2]);
+
+    // batch nodes can be deleted individually
+    assert_int_equal(um_db_delete_user(db, "user1"), 0);
+    assert_null(um_db_get_user(db, "user1"));
+    assert_ptr_equal(um_db_get_user_list_head(db)->user, users[1]);
+
+    for (size_t i = 0; i < 2; i++)
+    {
+        groups[i] = um_group_new();
+        assert_int_equal(um_group_set_name(groups[i], i ? "group2" : "group1"), 0);
+        um_group_set_gid(groups[i], (gid_t)(2000 + i));
+    }
+
+    assert_int_equal(um_db_add_groups(db, groups, 2, NULL), 0);
+    assert_ptr_equal(um_db_get_group(db, "group2"), groups[1]);
+    assert_ptr_equal(um_db_get_group_by_gid(db, 2000), groups[0]);
+    assert_int_equal(um_db_get_new_gid(db), 2002);
+
+    um_db_free(db);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_user_groups(void **state)
+{
+    (void)state;
+
+    um_db_t *db = NULL;
+    um_user_t *user = NULL;
+    um_group_t *group1 = NULL, *group2 = NULL;
+    const um_group_user_element_t *head = NULL;
+
+    common_set_passthrough(true);
+
+    db = um_db_new();
+    assert_non_null(db);
+
+    user = um_user_new();
+    assert_int_equal(um_user_set_name(user, "user1"), 0);
+    assert_int_equal(um_db_add_user(db, user), 0);
+
+    group1 = um_group_new();
+    assert_int_equal(um_group_set_name(group1, "group1"), 0);
+    assert_int_equal(um_db_add_group(db, group1), 0);
+
+    group2 = um_group_new();
+    assert_int_equal(um_group_set_name(group2, "group2"), 0);
+    assert_int_equal(um_db_add_group(db, group2), 0);
+
+    assert_null(um_db_get_user_groups(db, "user1"));
+    assert_null(um_db_get_user_groups(db, "user2"));
+
+    assert_int_equal(um_group_add_member(group1, user), 0);
+    assert_int_equal(um_group_add_admin(group2, user), 0);
+
+    // groups are listed with their role in insertion order
+    head = um_db_get_user_groups(db, "user1");
+    assert_non_null(head);
+    assert_ptr_equal(head->group, group1);
+    assert_false(head->admin);
+    assert_ptr_equal(head->user_next->group, group2);
+    assert_true(head->user_next->admin);
+    assert_null(head->user_next->user_next);
+
+    // deleting a group drops it from the user's groups
+    assert_int_equal(um_db_delete_group(db, "group1"), 0);
+    head = um_db_get_user_groups(db, "user1");
+    assert_ptr_equal(head->group, group2);
+    assert_null(head->user_next);
+
+    // deleting a user removes it from the groups
+    assert_int_equal(um_group_add_member(group2, user), 0);
+    assert_int_equal(um_db_delete_user(db, "user1"), 0);
+    assert_null(um_group_get_members_head(group2));
+    assert_null(um_group_get_admin_head(group2));
+
+    um_db_free(db);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_file_replace(void **state)
+{
+    (void)state;
+
+    char dir[] = "/tmp/umgmt-test-XXXXXX";
+    char path[PATH_MAX] = {0};
+    char backup_path[PATH_MAX] = {0};
+    char buffer[16] = {0};
+    um_db_output_t file = {0};
+    struct stat st = {0};
+    FILE *fp = NULL;
+
+    common_set_passthrough(true);
+
+    assert_non_null(mkdtemp(dir));
+    snprintf(path, sizeof(path), "%s/passwd", dir);
+    snprintf(backup_path, sizeof(backup_path), "%s/passwd-", dir);
+
+    fp = fopen(path, "w");
+    assert_non_null(fp);
+    fputs("old\n", fp);
+    fclose(fp);
+    assert_int_equal(chmod(path, 0640), 0);
+
+    // discarded file leaves the original untouched
+    assert_int_equal(um_db_output_open(&file, path), 0);
+    fputs("discarded\n", file.file);
+    um_db_output_discard(&file);
+    assert_int_equal(access(backup_path, F_OK), -1);
+
+    assert_int_equal(um_db_output_open(&file, path), 0);
+    fputs("new\n", file.file);
+    assert_int_equal(um_db_output_sync(&file), 0);
+    assert_int_equal(um_db_output_commit(&file), 0);
+    assert_int_equal(um_db_sync_dir(path), 0);
+    um_db_output_discard(&file);
+
+    // new contents replace the file with the original mode, previous contents are kept as a backup
+    fp = fopen(path, "r");
+    assert_non_null(fp);
+    assert_non_null(fgets(buffer, sizeof(buffer), fp));
+    assert_string_equal(buffer, "new\n");
+    fclose(fp);
+    assert_int_equal(stat(path, &st), 0);
+    assert_int_equal(st.st_mode & 07777, 0640);
+
+    fp = fopen(backup_path, "r");
+    assert_non_null(fp);
+    assert_non_null(fgets(buffer, sizeof(buffer), fp));
+    assert_string_equal(buffer, "old\n");
+    fclose(fp);
+
+    unlink(backup_path);
+    unlink(path);
+    assert_int_equal(rmdir(dir), 0);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_dirty(void **state)
+{
+    (void)state;
+
+    um_db_t *db = NULL;
+    um_user_t *user = NULL;
+    um_group_t *group = NULL;
+
+    common_set_passthrough(true);
+
+    db = um_db_new();
+    assert_non_null(db);
+    assert_int_equal(um_db_collect_dirty(db), 0);
+
+    // nothing changed - incremental store does not touch any file
+    assert_int_equal(um_db_store_ex(db, UM_DB_STORE_INCREMENTAL), 0);
+
+    user = um_user_new();
+    assert_int_equal(um_user_set_name(user, "user1"), 0);
+    assert_int_equal(um_db_add_user(db, user), 0);
+    group = um_group_new();
+    assert_int_equal(um_group_set_name(group, "group1"), 0);
+    assert_int_equal(um_db_add_group(db, group), 0);
+    assert_int_equal(um_db_collect_dirty(db), UM_DIRTY_PASSWD | UM_DIRTY_SHADOW | UM_DIRTY_GROUP | UM_DIRTY_GSHADOW);
+
+    um_db_clear_dirty(db);
+    assert_int_equal(um_user_set_shell_path(user, "/bin/sh"), 0);
+    assert_int_equal(um_db_collect_dirty(db), UM_DIRTY_PASSWD);
+
+    um_db_clear_dirty(db);
+    um_user_set_expiration(user, 1);
+    assert_int_equal(um_db_collect_dirty(db), UM_DIRTY_SHADOW);
+
+    um_db_clear_dirty(db);
+    um_group_set_gid(group, 1000);
+    assert_int_equal(um_db_collect_dirty(db), UM_DIRTY_GROUP);
+
+    // admins are listed only in gshadow, renaming the user rewrites the lists
+    assert_int_equal(um_group_add_admin(group, user), 0);
+    um_db_clear_dirty(db);
+    assert_int_equal(um_user_set_name(user, "user2"), 0);
+    assert_int_equal(um_db_collect_dirty(db), UM_DIRTY_PASSWD | UM_DIRTY_SHADOW | UM_DIRTY_GSHADOW);
+
+    um_db_clear_dirty(db);
+    assert_int_equal(um_db_delete_user(db, "user2"), 0);
+    assert_int_equal(um_db_collect_dirty(db), UM_DIRTY_PASSWD | UM_DIRTY_SHADOW | UM_DIRTY_GSHADOW);
+
+    um_db_free(db);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_root(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-root-XXXXXX";
+    char path[PATH_MAX] = {0};
+    um_db_t *db = NULL;
+    um_group_t *group = NULL;
+
+    common_set_passthrough(true);
+
+    create_root(root);
+
+    db = um_db_new();
+    assert_non_null(db);
+    assert_string_equal(um_db_get_path(db, UM_DB_FILE_SHADOW), "/etc/shadow");
+    assert_int_equal(um_db_set_root(db, root), 0);
+    snprintf(path, sizeof(path), "%s/etc/shadow", root);
+    assert_string_equal(um_db_get_path(db, UM_DB_FILE_SHADOW), path);
+
+    // custom paths are loaded without NSS
+    assert_int_equal(um_db_load(db), 0);
+    assert_int_equal(um_user_get_uid(um_db_get_user(db, "user1")), 1000);
+    assert_string_equal(um_user_get_password_hash(um_db_get_user(db, "user1")), "!");
+    group = um_db_get_group(db, "users");
+    assert_ptr_equal(um_group_get_members_head(group)->user, um_db_get_user(db, "user1"));
+    assert_ptr_equal(um_group_get_admin_head(group)->user, um_db_get_user(db, "root"));
+
+    assert_int_equal(um_user_set_shell_path(um_db_get_user(db, "user1"), "/bin/bash"), 0);
+    assert_int_equal(um_db_store_ex(db, UM_DB_STORE_INCREMENTAL), 0);
+    um_db_free(db);
+
+    // only the changed file is rewritten
+    snprintf(path, sizeof(path), "%s/etc/passwd-", root);
+    assert_int_equal(access(path, F_OK), 0);
+    snprintf(path, sizeof(path), "%s/etc/shadow-", root);
+    assert_int_equal(access(path, F_OK), -1);
+
+    db = um_db_new();
+    assert_non_null(db);
+    assert_int_equal(um_db_set_root(db, root), 0);
+    assert_int_equal(um_db_load(db), 0);
+    assert_string_equal(um_user_get_shell_path(um_db_get_user(db, "user1")), "/bin/bash");
+    assert_int_equal(um_db_store(db), 0);
+    um_db_free(db);
+
+    remove_root(root);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_load_arena(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-root-XXXXXX";
+    um_db_t *db = NULL;
+    um_user_t *user = NULL;
+    um_group_t *group = NULL;
+
+    common_set_passthrough(true);
+
+    create_root(root);
+
+    db = um_db_new();
+    assert_non_null(db);
+    assert_int_equal(um_db_set_root(db, root), 0);
+    assert_int_equal(um_db_load_ex(db, UM_DB_LOAD_ARENA), 0);
+
+    user = um_db_get_user(db, "user1");
+    group = um_db_get_group(db, "users");
+    assert_string_equal(um_user_get_home_path(user), "/home/user1");
+    assert_ptr_equal(um_group_get_members_head(group)->user, user);
+
+    // arena records are modified and deleted like any other
+    assert_int_equal(um_user_set_shell_path(user, "/bin/bash"), 0);
+    assert_string_equal(um_user_get_shell_path(user), "/bin/bash");
+    assert_int_equal(um_db_delete_user(db, "user1"), 0);
+    assert_null(um_group_get_members_head(group));
+
+    // heap records can be mixed in
+    user = um_user_new();
+    assert_int_equal(um_user_set_name(user, "user2"), 0);
+    assert_int_equal(um_db_add_user(db, user), 0);
+    assert_int_equal(um_group_add_member(group, user), 0);
+    assert_int_equal(um_db_delete_group(db, "users"), 0);
+    assert_null(um_user_get_groups_head(user));
+
+    um_db_free(db);
+
+    remove_root(root);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_intern(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-root-XXXXXX";
+    um_db_t *db = NULL;
+    um_user_t *root_user = NULL;
+    um_user_t *user = NULL;
+
+    common_set_passthrough(true);
+
+    create_root(root);
+
+    db = um_db_new();
+    assert_non_null(db);
+    assert_int_equal(um_db_set_root(db, root), 0);
+    assert_int_equal(um_db_load(db), 0);
+
+    // repeated values are stored once
+    root_user = um_db_get_user(db, "root");
+    user = um_db_get_user(db, "user1");
+    assert_ptr_equal(um_user_get_password(root_user), um_user_get_password(user));
+    assert_ptr_equal(um_group_get_password(um_db_get_group(db, "root")), um_user_get_password(user));
+
+    // setters share values with the loaded records, real hashes stay private
+    assert_int_equal(um_user_set_shell_path(user, "/bin/bash"), 0);
+    assert_ptr_equal(um_user_get_shell_path(root_user), um_user_get_shell_path(user));
+    assert_int_equal(um_user_set_password_hash(user, "$6$salt$hash"), 0);
+    assert_false(um_intern_owns(db->intern, um_user_get_password_hash(user)));
+    assert_int_equal(um_user_set_password_hash(user, "*"), 0);
+    assert_ptr_equal(um_user_get_password_hash(root_user), um_user_get_password_hash(user));
+
+    // shared values outlive deleted records
+    assert_int_equal(um_db_delete_user(db, "user1"), 0);
+    assert_string_equal(um_user_get_shell_path(root_user), "/bin/bash");
+
+    um_db_free(db);
+
+    remove_root(root);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_load_deferred(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-root-XXXXXX";
+    um_db_t *db = NULL;
+    um_user_t *user = NULL;
+    um_group_t *group = NULL;
+
+    common_set_passthrough(true);
+
+    create_root(root);
+
+    // shadow files are read on first use, members come from the group file
+    db = um_db_new();
+    assert_non_null(db);
+    assert_int_equal(um_db_set_root(db, root), 0);
+    assert_int_equal(um_db_load_ex(db, UM_DB_LOAD_DEFER_SHADOW), 0);
+    user = um_db_get_user(db, "user1");
+    group = um_db_get_group(db, "users");
+    assert_int_equal(db->deferred, UM_DIRTY_SHADOW | UM_DIRTY_GSHADOW);
+    assert_ptr_equal(um_group_get_members_head(group)->user, user);
+    assert_string_equal(um_user_get_password_hash(user), "!");
+    assert_int_equal(um_user_get_change_max(user), 99999);
+    assert_int_equal(db->deferred, UM_DIRTY_GSHADOW);
+    assert_ptr_equal(um_group_get_admin_head(group)->user, um_db_get_user(db, "root"));
+    assert_int_equal(db->deferred, 0);
+    assert_int_equal(um_db_collect_dirty(db), 0);
+    um_db_free(db);
+
+    // users added before the shadow file is read keep their own data
+    db = um_db_new();
+    assert_non_null(db);
+    assert_int_equal(um_db_set_root(db, root), 0);
+    assert_int_equal(um_db_load_ex(db, UM_DB_LOAD_DEFER_SHADOW), 0);
+    assert_int_equal(um_db_delete_user(db, "user1"), 0);
+    user = um_user_new();
+    assert_int_equal(um_user_set_name(user, "user1"), 0);
+    assert_int_equal(um_db_add_user(db, user), 0);
+    assert_string_equal(um_user_get_password_hash(um_db_get_user(db, "root")), "*");
+    assert_null(um_user_get_password_hash(user));
+    assert_int_equal(um_db_store(db), 0);
+    um_db_free(db);
+
+    // skipped files cannot be stored
+    db = um_db_new();
+    assert_non_null(db);
+    assert_int_equal(um_db_set_root(db, root), 0);
+    assert_int_equal(um_db_load_ex(db, UM_DB_LOAD_SKIP_SHADOW), 0);
+    user = um_db_get_user(db, "root");
+    assert_null(um_user_get_password_hash(user));
+    assert_null(um_group_get_admin_head(um_db_get_group(db, "users")));
+    assert_int_equal(um_user_set_shell_path(user, "/bin/sh"), 0);
+    assert_int_equal(um_db_store_ex(db, UM_DB_STORE_INCREMENTAL), 0);
+    assert_int_equal(um_db_store(db), -1);
+    um_db_free(db);
+
+    remove_root(root);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_refresh(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-root-XXXXXX";
+    um_db_t *db = NULL;
+    um_user_t *root_user = NULL;
+    um_user_t *user = NULL;
+    um_group_t *group = NULL;
+    const char *home = NULL;
+    bool changed = true;
+
+    common_set_passthrough(true);
+
+    create_root(root);
+
+    db = um_db_new();
+    assert_non_null(db);
+    assert_int_equal(um_db_set_root(db, root), 0);
+    assert_int_equal(um_db_load(db), 0);
+    root_user = um_db_get_user(db, "root");
+    user = um_db_get_user(db, "user1");
+    group = um_db_get_group(db, "users");
+    home = um_user_get_home_path(root_user);
+
+    // nothing to read
+    assert_int_equal(um_db_refresh(db, &changed), 0);
+    assert_false(changed);
+
+    // changed and new users are merged in place
+    write_root_file(root, "passwd",
+                    "root:x:0:0:root:/root:/bin/bash\nuser1:x:1000:1000::/home/user1:/bin/bash\n"
+                    "user2:x:1001:1000::/home/user2:/bin/sh\n");
+    write_root_file(root, "shadow", "root:*:19000:0:99999:7:::\nuser1:!:19000:0:99999:7:::\nuser2:!!:19001::::::\n");
+    assert_int_equal(um_db_refresh(db, &changed), 0);
+    assert_true(changed);
+    assert_ptr_equal(um_db_get_user(db, "root"), root_user);
+    assert_ptr_equal(um_user_get_home_path(root_user), home);
+    assert_ptr_equal(um_db_get_user(db, "user1"), user);
+    assert_string_equal(um_user_get_shell_path(user), "/bin/bash");
+    assert_non_null(um_db_get_user(db, "user2"));
+    assert_string_equal(um_user_get_password_hash(um_db_get_user(db, "user2")), "!!");
+    assert_ptr_equal(um_db_get_user_by_uid(db, 1001), um_db_get_user(db, "user2"));
+    assert_ptr_equal(um_group_get_members_head(group)->user, user);
+    assert_false(um_db_is_modified(db));
+
+    // removed users and admins are dropped
+    write_root_file(root, "passwd", "root:x:0:0:root:/root:/bin/bash\nuser1:x:1000:1000::/home/user1:/bin/sh\n");
+    write_root_file(root, "gshadow", "root:*::\nusers:!::user1\n");
+    assert_int_equal(um_db_refresh(db, &changed), 0);
+    assert_true(changed);
+    assert_null(um_db_get_user(db, "user2"));
+    assert_ptr_equal(um_db_get_group(db, "users"), group);
+    assert_null(um_group_get_admin_head(group));
+    assert_ptr_equal(um_group_get_members_head(group)->user, user);
+
+    // unstored changes are not overwritten
+    assert_int_equal(um_user_set_shell_path(user, "/bin/zsh"), 0);
+    assert_int_equal(um_db_refresh(db, NULL), -1);
+    assert_int_equal(um_db_store(db), 0);
+
+    // watched databases read files after an event only
+    assert_true(um_db_watch(db) >= 0);
+    assert_int_equal(um_db_refresh(db, &changed), 0);
+    assert_false(changed);
+    write_root_file(root, "group", "root:x:0:\nusers:x:1000:user1\nstaff:x:50:\n");
+    assert_int_equal(um_db_refresh(db, &changed), 0);
+    assert_true(changed);
+    assert_non_null(um_db_get_group(db, "staff"));
+    assert_ptr_equal(um_db_get_group(db, "users"), group);
+
+    um_db_free(db);
+
+    remove_root(root);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_iter(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-root-XXXXXX";
+    um_db_t *db = NULL;
+    um_user_iter_t *user_iter = NULL;
+    um_group_iter_t *group_iter = NULL;
+    const um_user_t *user = NULL;
+    const um_group_t *group = NULL;
+
+    common_set_passthrough(true);
+
+    create_root(root);
+
+    // shadow records out of order and missing
+    write_root_file(root, "passwd",
+                    "root:x:0:0:root:/root:/bin/bash\nuser1:x:1000:1000::/home/user1:/bin/sh\n"
+                    "user2:x:1001:1000::/home/user2:/bin/sh\nuser3:x:1002:1000::/home/user3:/bin/sh\n");
+    write_root_file(root, "shadow", "root:*:19000:0:99999:7:::\nuser2:!!:19001::::::\nuser1:!:19000:0:99999:7:::\n");
+    write_root_file(root, "group", "root:x:0:\nusers:x:1000:user1\nstaff:x:50:user2\n");
+
+    db = um_db_new();
+    assert_non_null(db);
+    assert_int_equal(um_db_set_root(db, root), 0);
+
+    user_iter = um_user_iter_open(db, 0);
+    assert_non_null(user_iter);
+    assert_int_equal(um_user_iter_next(user_iter, &user), 1);
+    assert_string_equal(um_user_get_name(user), "root");
+    assert_string_equal(um_user_get_password_hash(user), "*");
+    assert_int_equal(um_user_iter_next(user_iter, &user), 1);
+    assert_string_equal(um_user_get_name(user), "user1");
+    assert_int_equal(um_user_get_uid(user), 1000);
+    assert_string_equal(um_user_get_home_path(user), "/home/user1");
+    assert_string_equal(um_user_get_password_hash(user), "!");
+    assert_int_equal(um_user_get_change_max(user), 99999);
+    assert_int_equal(um_user_iter_next(user_iter, &user), 1);
+    assert_string_equal(um_user_get_name(user), "user2");
+    assert_string_equal(um_user_get_password_hash(user), "!!");
+    assert_int_equal(um_user_get_change_max(user), -1);
+    assert_int_equal(um_user_iter_next(user_iter, &user), 1);
+    assert_string_equal(um_user_get_name(user), "user3");
+    assert_null(um_user_get_password_hash(user));
+    assert_int_equal(um_user_iter_next(user_iter, &user), 0);
+    assert_null(user);
+    um_user_iter_close(user_iter);
+
+    // members come from gshadow where the group has a record
+    group_iter = um_group_iter_open(db, 0);
+    assert_non_null(group_iter);
+    assert_int_equal(um_group_iter_next(group_iter, &group), 1);
+    assert_string_equal(um_group_get_name(group), "root");
+    assert_string_equal(um_group_get_password_hash(group), "*");
+    assert_null(um_group_iter_get_members(group_iter)[0]);
+    assert_int_equal(um_group_iter_next(group_iter, &group), 1);
+    assert_string_equal(um_group_get_name(group), "users");
+    assert_int_equal(um_group_get_gid(group), 1000);
+    assert_string_equal(um_group_iter_get_members(group_iter)[0], "user1");
+    assert_string_equal(um_group_iter_get_admins(group_iter)[0], "root");
+    assert_null(um_group_get_members_head(group));
+    assert_int_equal(um_group_iter_next(group_iter, &group), 1);
+    assert_string_equal(um_group_get_name(group), "staff");
+    assert_null(um_group_get_password_hash(group));
+    assert_string_equal(um_group_iter_get_members(group_iter)[0], "user2");
+    assert_null(um_group_iter_get_admins(group_iter)[0]);
+    assert_int_equal(um_group_iter_next(group_iter, &group), 0);
+    um_group_iter_close(group_iter);
+
+    // shadow is not opened without shadow data
+    assert_int_equal(unlink(um_db_get_path(db, UM_DB_FILE_SHADOW)), 0);
+    assert_null(um_user_iter_open(db, 0));
+    user_iter = um_user_iter_open(db, UM_DB_LOAD_SKIP_SHADOW);
+    assert_non_null(user_iter);
+    assert_int_equal(um_user_iter_next(user_iter, &user), 1);
+    assert_null(um_user_get_password_hash(user));
+    um_user_iter_close(user_iter);
+
+    um_db_free(db);
+
+    remove_root(root);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_query(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-root-XXXXXX";
+    um_db_t *db = NULL;
+    um_user_t *users[4] = {0};
+    um_db_user_query_t query = {0};
+
+    common_set_passthrough(true);
+
+    create_root(root);
+    write_root_file(root, "passwd",
+                    "root:x:0:0:root:/root:/bin/bash\nuser2:x:1001:1000::/home/user2:/bin/bash\n"
+                    "user1:x:1000:1000::/home/user1:/bin/sh\nsvc:x:500:500::/var/lib/svc:/usr/sbin/nologin\n");
+    write_root_file(root, "shadow",
+                    "root:*:19000:0:99999:7:::\nuser2:$6$hash:19000:0:99999:7::20000:\n"
+                    "user1:!$6$hash:19000:0:99999:7::100:\nsvc:!:19000::::::\n");
+    write_root_file(root, "gshadow", "root:*::\nusers:!:root:user1,user2\n");
+
+    db = um_db_new();
+    assert_non_null(db);
+    assert_int_equal(um_db_set_root(db, root), 0);
+    assert_int_equal(um_db_load(db), 0);
+
+    // ranges come in UID order, results beyond the array are counted
+    query.match = UM_DB_QUERY_UID_RANGE;
+    query.uid_min = 1000;
+    query.uid_max = 1001;
+    assert_int_equal(um_db_query_users(db, &query, users, 4), 2);
+    assert_ptr_equal(users[0], um_db_get_user(db, "user1"));
+    assert_ptr_equal(users[1], um_db_get_user(db, "user2"));
+    query.uid_min = 1;
+    query.uid_max = 100000;
+    assert_int_equal(um_db_query_users(db, &query, users, 1), 3);
+    assert_ptr_equal(users[0], um_db_get_user(db, "svc"));
+
+    query = (um_db_user_query_t){.match = UM_DB_QUERY_GID | UM_DB_QUERY_SHELL, .gid = 1000, .shell = "/bin/bash"};
+    assert_int_equal(um_db_query_users(db, &query, users, 4), 1);
+    assert_ptr_equal(users[0], um_db_get_user(db, "user2"));
+
+    query = (um_db_user_query_t){.match = UM_DB_QUERY_HOME_PREFIX, .home_prefix = "/home/"};
+    assert_int_equal(um_db_query_users(db, &query, NULL, 0), 2);
+
+    query = (um_db_user_query_t){.match = UM_DB_QUERY_LOCKED, .locked = true};
+    assert_int_equal(um_db_query_users(db, &query, users, 4), 2);
+    assert_ptr_equal(users[0], um_db_get_user(db, "user1"));
+    assert_ptr_equal(users[1], um_db_get_user(db, "svc"));
+
+    // accounts without an expiration date never expire
+    query = (um_db_user_query_t){.match = UM_DB_QUERY_EXPIRED, .expired = true, .today = 19500};
+    assert_int_equal(um_db_query_users(db, &query, users, 4), 1);
+    assert_ptr_equal(users[0], um_db_get_user(db, "user1"));
+    query.expired = false;
+    assert_int_equal(um_db_query_users(db, &query, NULL, 0), 3);
+
+    // group queries check the members only, admins which are not members do not match
+    assert_ptr_equal(um_group_get_admin_head(um_db_get_group(db, "users"))->user, um_db_get_user(db, "root"));
+    query = (um_db_user_query_t){.match = UM_DB_QUERY_GROUP, .group = "users"};
+    assert_int_equal(um_db_query_users(db, &query, users, 4), 2);
+    assert_true(users[0] != um_db_get_user(db, "root") && users[1] != um_db_get_user(db, "root"));
+    query.match |= UM_DB_QUERY_LOCKED;
+    assert_int_equal(um_db_query_users(db, &query, users, 4), 1);
+    assert_ptr_equal(users[0], um_db_get_user(db, "user2"));
+    query.group = "missing";
+    assert_int_equal(um_db_query_users(db, &query, users, 4), 0);
+
+    um_db_free(db);
+
+    remove_root(root);
+
+    common_set_passthrough(false);
+}
+
+static void test_db_sorted(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-root-XXXXXX";
+    char path[PATH_MAX] = {0};
+    char buffer[128] = {0};
+    const char *const lines[] = {"root:", "new:", "dup:", "user1:"};
+    um_db_t *db = NULL;
+    um_user_t *users[4] = {0};
+    um_group_t *groups[2] = {0};
+    um_user_t *user = NULL;
+    size_t count = 0;
+    FILE *fp = NULL;
+
+    common_set_passthrough(true);
+
+    create_root(root);
+    write_root_file(root, "passwd",
+                    "user2:x:1001:1000::/home/user2:/bin/sh\nroot:x:0:0:root:/root:/bin/bash\n"
+                    "user1:x:1000:1000::/home/user1:/bin/sh\ndup:x:1000:1000::/home/user1:/bin/sh\n");
+    write_root_file(root, "group", "users:x:1000:user1\nroot:x:0:\n");
+    write_root_file(root, "gshadow", "users:!::user1\nroot:*::\n");
+
+    db = um_db_new();
+    assert_non_null(db);
+    assert_int_equal(um_db_set_root(db, root), 0);
+    assert_int_equal(um_db_load(db), 0);
+
+    // users sharing a UID keep their list order
+    assert_int_equal(um_db_get_users_by_uid_range(db, 0, (uid_t)-1, users, 4, &count), 0);
+    assert_int_equal(count, 4);
+    assert_ptr_equal(users[0], um_db_get_user(db, "root"));
+    assert_ptr_equal(users[1], um_db_get_user(db, "user1"));
+    assert_ptr_equal(users[2], um_db_get_user(db, "dup"));
+    assert_ptr_equal(users[3], um_db_get_user(db, "user2"));
+    assert_int_equal(um_db_get_users_by_uid_range(db, 1, 999, users, 4, &count), 0);
+    assert_int_equal(count, 0);
+    assert_int_equal(um_db_get_groups_by_gid_range(db, 0, 999, groups, 2, &count), 0);
+    assert_int_equal(count, 1);
+    assert_ptr_equal(groups[0], um_db_get_group(db, "root"));
+
+    // the index follows added and deleted users
+    user = um_user_new();
+    assert_non_null(user);
+    assert_int_equal(um_user_set_name(user, "new"), 0);
+    assert_int_equal(um_user_set_password(user, "x"), 0);
+    assert_int_equal(um_user_set_password_hash(user, "!"), 0);
+    um_user_set_uid(user, 5);
+    assert_int_equal(um_db_add_user(db, user), 0);
+    assert_int_equal(um_db_get_users_by_uid_range(db, 1, 999, users, 4, &count), 0);
+    assert_int_equal(count, 1);
+    assert_ptr_equal(users[0], user);
+    assert_int_equal(um_db_delete_user(db, "user2"), 0);
+    assert_int_equal(um_db_get_users_by_uid_range(db, 1000, 1001, NULL, 0, &count), 0);
+    assert_int_equal(count, 2);
+
+    // the index follows ID changes of stored users and groups
+    assert_int_equal(um_user_set_uid(um_db_get_user(db, "user1"), 2000), 0);
+    assert_int_equal(um_db_get_users_by_uid_range(db, 1000, 1001, users, 4, &count), 0);
+    assert_int_equal(count, 1);
+    assert_ptr_equal(users[0], um_db_get_user(db, "dup"));
+    assert_int_equal(um_db_get_users_by_uid_range(db, 1500, (uid_t)-1, users, 4, &count), 0);
+    assert_int_equal(count, 1);
+    assert_ptr_equal(users[0], um_db_get_user(db, "user1"));
+    assert_int_equal(um_group_set_gid(um_db_get_group(db, "root"), 2000), 0);
+    assert_int_equal(um_db_get_groups_by_gid_range(db, 0, 999, groups, 2, &count), 0);
+    assert_int_equal(count, 0);
+
+    // files are written in ID order
+    assert_int_equal(um_db_store_ex(db, UM_DB_STORE_SORTED), 0);
+    snprintf(path, sizeof(path), "%s/etc/passwd", root);
+    fp = fopen(path, "r");
+    assert_non_null(fp);
+    for (size_t i = 0; i < 4; i++)
+    {
+        assert_non_null(fgets(buffer, sizeof(buffer), fp));
+        assert_int_equal(strncmp(buffer, lines[i], strlen(lines[i])), 0);
+    }
+    assert_null(fgets(buffer, sizeof(buffer), fp));
+    fclose(fp);
+    snprintf(path, sizeof(path), "%s/etc/gshadow", root);
+    fp = fopen(path, "r");
+    assert_non_null(fp);
+    assert_non_null(fgets(buffer, sizeof(buffer), fp));
+    assert_string_equal(buffer, "users:!::user1\n");
+    fclose(fp);
+
+    um_db_free(db);
+
+    remove_root(root);
+
+    common_set_passthrough(false);
+}
+
+static void create_root(char *root)
+{
+    char path[PATH_MAX] = {0};
+    const char *const files[UM_DB_FILE_COUNT][2] = {
+        [UM_DB_FILE_PASSWD] = {"passwd", "root:x:0:0:root:/root:/bin/bash\nuser1:x:1000:1000::/home/user1:/bin/sh\n"},
+        [UM_DB_FILE_SHADOW] = {"shadow", "root:*:19000:0:99999:7:::\nuser1:!:19000:0:99999:7:::\n"},
+        [UM_DB_FILE_GROUP] = {"group", "root:x:0:\nusers:x:1000:user1\n"},
+        [UM_DB_FILE_GSHADOW] = {"gshadow", "root:*::\nusers:!:root:user1\n"},
+    };
+    FILE *file = NULL;
+
+    assert_non_null(mkdtemp(root));
+    snprintf(path, sizeof(path), "%s/etc", root);
+    assert_int_equal(mkdir(path, 0755), 0);
+
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        snprintf(path, sizeof(path), "%s/etc/%s", root, files[i][0]);
+        file = fopen(path, "w");
+        assert_non_null(file);
+        fputs(files[i][1], file);
+        fclose(file);
+    }
+}
+
+static void remove_root(const char *root)
+{
+    char path[PATH_MAX] = {0};
+    const char *const names[] = {"passwd", "shadow", "group", "gshadow"};
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/etc/%s", root, names[i]);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/etc/%s-", root, names[i]);
+        unlink(path);
+    }
+
+    snprintf(path, sizeof(path), "%s/etc", root);
+    assert_int_equal(rmdir(path), 0);
+    assert_int_equal(rmdir(root), 0);
+}
+
+static void write_root_file(const char *root, const char *name, const char *contents)
+{
+    char path[PATH_MAX] = {0};
+    FILE *file = NULL;
+
+    snprintf(path, sizeof(path), "%s/etc/%s", root, name);
+    file = fopen(path, "w");
+    assert_non_null(file);
+    fputs(contents, file);
+    fclose(file);
 }
\ No newline at end of file
@@ -25,6 +25,11 @@ static void test_group_set_password_incorrect(void **state);
 static void test_group_set_password_hash_correct(void **state);
 static void test_group_set_password_hash_incorrect(void **state);
 
+static void test_group_add_member_correct(void **state);
+static void test_group_add_member_incorrect(void **state);
+
+static void test_group_remove_member(void **state);
+
 int main(void)
 {
     const struct CMUnitTest tests[] = {
@@ -36,6 +41,9 @@ int main(void)
         cmocka_unit_test(test_group_set_password_incorrect),
         cmocka_unit_test(test_group_set_password_hash_correct),
         cmocka_unit_test(test_group_set_password_hash_incorrect),
+        cmocka_unit_test(test_group_add_member_correct),
+        cmocka_unit_test(test_group_add_member_incorrect),
+        cmocka_unit_test(test_group_remove_member),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -230,4 +238,131 @@ static void test_group_set_password_hash_incorrect(void **state)
     assert_int_equal(error, -1);
 
     um_group_free(group);
+}
+
+static void test_group_add_member_correct(void **state)
+{
+    (void)state;
+
+    int error = 0;
+    um_group_t *group = NULL;
+    um_user_t *user1 = um_user_new();
+    um_user_t *user2 = um_user_new();
+    const um_group_user_element_t *head = NULL;
+
+    assert_non_null(user1);
+    assert_non_null(user2);
+
+    expect_value(__wrap_malloc, size, UM_GROUP_T_SIZE);
+    will_return(__wrap_malloc, __real_malloc(UM_GROUP_T_SIZE));
+
+    group = um_group_new();
+    assert_non_null(group);
+
+    expect_value(__wrap_malloc, size, sizeof(um_group_user_element_t));
+    will_return(__wrap_malloc, __real_malloc(sizeof(um_group_user_element_t)));
+
+    error = um_group_add_member(group, user1);
+    assert_int_equal(error, 0);
+
+    expect_value(__wrap_malloc, size, sizeof(um_group_user_element_t));
+    will_return(__wrap_malloc, __real_malloc(sizeof(um_group_user_element_t)));
+
+    error = um_group_add_member(group, user2);
+    assert_int_equal(error, 0);
+
+    // members are kept in insertion order, head links to the tail
+    head = um_group_get_members_head(group);
+    assert_ptr_equal(head->user, user1);
+    assert_ptr_equal(head->next->user, user2);
+    assert_null(head->next->next);
+    assert_ptr_equal(head->prev, head->next);
+
+    // members are linked into the user's group list
+    assert_ptr_equal(um_user_get_groups_head(user1), head);
+    assert_ptr_equal(head->group, group);
+    assert_false(head->admin);
+
+    um_group_free(group);
+    assert_null(um_user_get_groups_head(user1));
+    assert_null(um_user_get_groups_head(user2));
+    um_user_free(user1);
+    um_user_free(user2);
+}
+
+static void test_group_add_member_incorrect(void **state)
+{
+    (void)state;
+
+    int error = 0;
+    um_group_t *group = NULL;
+    um_user_t *user = um_user_new();
+
+    assert_non_null(user);
+
+    expect_value(__wrap_malloc, size, UM_GROUP_T_SIZE);
+    will_return(__wrap_malloc, __real_malloc(UM_GROUP_T_SIZE));
+
+    group = um_group_new();
+    assert_non_null(group);
+
+    expect_value(__wrap_malloc, size, sizeof(um_group_user_element_t));
+    will_return(__wrap_malloc, NULL);
+
+    error = um_group_add_member(group, user);
+    assert_int_equal(error, -1);
+    assert_null(um_group_get_members_head(group));
+
+    um_group_free(group);
+    um_user_free(user);
+}
+
+static void test_group_remove_member(void **state)
+{
+    (void)state;
+
+    um_group_t *group = NULL;
+    um_user_t *user1 = um_user_new();
+    um_user_t *user2 = um_user_new();
+    const um_group_user_element_t *head = NULL;
+
+    assert_non_null(user1);
+    assert_non_null(user2);
+
+    expect_value(__wrap_malloc, size, UM_GROUP_T_SIZE);
+    will_return(__wrap_malloc, __real_malloc(UM_GROUP_T_SIZE));
+
+    group = um_group_new();
+    assert_non_null(group);
+
+    for (int i = 0; i < 3; i++)
+    {
+        expect_value(__wrap_malloc, size, sizeof(um_group_user_element_t));
+        will_return(__wrap_malloc, __real_malloc(sizeof(um_group_user_element_t)));
+    }
+
+    assert_int_equal(um_group_add_member(group, user1), 0);
+    assert_int_equal(um_group_add_member(group, user2), 0);
+    assert_int_equal(um_group_add_admin(group, user1), 0);
+
+    // roles are removed separately
+    assert_int_equal(um_group_remove_member(group, user1), 0);
+    assert_int_equal(um_group_remove_member(group, user1), -1);
+    head = um_group_get_members_head(group);
+    assert_ptr_equal(head->user, user2);
+    assert_null(head->next);
+    assert_ptr_equal(um_group_get_admin_head(group)->user, user1);
+    assert_true(um_user_get_groups_head(user1)->admin);
+
+    assert_int_equal(um_group_remove_admin(group, user2), -1);
+    assert_int_equal(um_group_remove_admin(group, user1), 0);
+    assert_null(um_group_get_admin_head(group));
+    assert_null(um_user_get_groups_head(user1));
+
+    // freeing the user removes the remaining membership
+    um_user_free(user2);
+    assert_null(um_group_get_members_head(group));
+
+    um_group_free(group);
+    um_user_free(user1);
 }
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "umgmt/idpool.c"
+
+static void test_idpool_new_correct(void **state);
+static void test_idpool_new_incorrect(void **state);
+
+static void test_idpool_next_free(void **state);
+static void test_idpool_last_used(void **state);
+static void test_idpool_exhausted(void **state);
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_idpool_new_correct),
+        cmocka_unit_test(test_idpool_new_incorrect),
+        cmocka_unit_test(test_idpool_next_free),
+        cmocka_unit_test(test_idpool_last_used),
+        cmocka_unit_test(test_idpool_exhausted),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+static void test_idpool_new_correct(void **state)
+{
+    (void)state;
+
+    id_t id = 0;
+    um_id_pool_t *pool = um_id_pool_new(1000, 65533);
+
+    assert_non_null(pool);
+    assert_int_equal(um_id_pool_get_min(pool), 1000);
+    assert_int_equal(um_id_pool_get_max(pool), 65533);
+
+    // all IDs are free
+    assert_false(um_id_pool_is_set(pool, 1000));
+    assert_int_equal(um_id_pool_last_used(pool, &id), -1);
+    assert_int_equal(um_id_pool_next_free(pool, 0, &id), 0);
+    assert_int_equal(id, 1000);
+
+    um_id_pool_free(pool);
+}
+
+static void test_idpool_new_incorrect(void **state)
+{
+    (void)state;
+
+    assert_null(um_id_pool_new(10, 9));
+    assert_null(um_id_pool_new(0, UM_ID_POOL_MAX_SIZE));
+}
+
+static void test_idpool_next_free(void **state)
+{
+    (void)state;
+
+    id_t id = 0;
+    um_id_pool_t *pool = um_id_pool_new(1000, 65533);
+
+    assert_non_null(pool);
+
+    // fill more than one summary word so the search has to climb levels
+    for (id_t i = 1000; i < 1000 + 64 * 64 + 5; i++)
+    {
+        um_id_pool_set(pool, i);
+    }
+
+    assert_int_equal(um_id_pool_next_free(pool, 1000, &id), 0);
+    assert_int_equal(id, 1000 + 64 * 64 + 5);
+
+    um_id_pool_clear(pool, 1500);
+    assert_int_equal(um_id_pool_next_free(pool, 1000, &id), 0);
+    assert_int_equal(id, 1500);
+    assert_int_equal(um_id_pool_next_free(pool, 1501, &id), 0);
+    assert_int_equal(id, 1000 + 64 * 64 + 5);
+
+    // IDs outside of the range are ignored
+    um_id_pool_set(pool, 999);
+    um_id_pool_set(pool, 65534);
+    assert_false(um_id_pool_is_set(pool, 999));
+    assert_false(um_id_pool_is_set(pool, 65534));
+
+    um_id_pool_free(pool);
+}
+
+static void test_idpool_last_used(void **state)
+{
+    (void)state;
+
+    id_t id = 0;
+    um_id_pool_t *pool = um_id_pool_new(1000, 65533);
+
+    assert_non_null(pool);
+
+    um_id_pool_set(pool, 1001);
+    um_id_pool_set(pool, 40000);
+    assert_int_equal(um_id_pool_last_used(pool, &id), 0);
+    assert_int_equal(id, 40000);
+
+    um_id_pool_clear(pool, 40000);
+    assert_int_equal(um_id_pool_last_used(pool, &id), 0);
+    assert_int_equal(id, 1001);
+
+    um_id_pool_clear(pool, 1001);
+    assert_int_equal(um_id_pool_last_used(pool, &id), -1);
+
+    um_id_pool_free(pool);
+}
+
+static void test_idpool_exhausted(void **state)
+{
+    (void)state;
+
+    id_t id = 0;
+    um_id_pool_t *pool = um_id_pool_new(10, 140);
+
+    assert_non_null(pool);
+
+    for (id_t i = 10; i <= 140; i++)
+    {
+        um_id_pool_set(pool, i);
+    }
+
+    assert_int_equal(um_id_pool_next_free(pool, 10, &id), -1);
+    assert_int_equal(um_id_pool_last_used(pool, &id), 0);
+    assert_int_equal(id, 140);
+
+    um_id_pool_clear(pool, 140);
+    assert_int_equal(um_id_pool_next_free(pool, 10, &id), 0);
+    assert_int_equal(id, 140);
+
+    um_id_pool_free(pool);
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "umgmt/intern.c"
+
+static void test_intern_string(void **state);
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_intern_string),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+static void test_intern_string(void **state)
+{
+    (void)state;
+
+    char buffer[] = "/bin/sh";
+    um_intern_t *intern = um_intern_new();
+    const char *str = NULL;
+
+    assert_non_null(intern);
+
+    // equal strings share one copy
+    str = um_intern_string(intern, "/bin/sh");
+    assert_non_null(str);
+    assert_string_equal(str, "/bin/sh");
+    assert_ptr_equal(um_intern_string(intern, buffer), str);
+    assert_ptr_not_equal(um_intern_string(intern, "/bin/bash"), str);
+
+    // only the stored copies are owned by the table
+    assert_true(um_intern_owns(intern, str));
+    assert_false(um_intern_owns(intern, buffer));
+    assert_false(um_intern_owns(intern, "x"));
+
+    um_intern_free(intern);
+}
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include <umgmt.h>
+
+#include "umgmt/loader.c"
+
+#define USER_COUNT 500
+
+static void test_loader_chunks(void **state);
+static void test_loader_db(void **state);
+
+static void write_files(char paths[UM_DB_FILE_COUNT][32]);
+static void remove_files(char paths[UM_DB_FILE_COUNT][32]);
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_loader_chunks),
+        cmocka_unit_test(test_loader_db),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+static void test_loader_chunks(void **state)
+{
+    (void)state;
+
+    char paths[UM_DB_FILE_COUNT][32] = {0};
+    const char *path_list[UM_DB_FILE_COUNT] = {0};
+    char name[32] = {0};
+    um_loader_t *loader = NULL;
+    const struct group *grp = NULL;
+    const struct sgrp *sgrp = NULL;
+
+    write_files(paths);
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        path_list[i] = paths[i];
+    }
+
+    // small chunks split every file across all threads
+    loader = um_loader_new(4);
+    assert_non_null(loader);
+    um_loader_set_chunk_size(loader, 256);
+    assert_int_equal(um_loader_read(loader, path_list, 0xf), 0);
+    assert_true(loader->chunk_count > UM_DB_FILE_COUNT);
+
+    // records keep the file order across chunk boundaries
+    assert_int_equal(um_loader_get_count(loader, UM_DB_FILE_PASSWD), USER_COUNT);
+    assert_int_equal(um_loader_get_count(loader, UM_DB_FILE_SHADOW), USER_COUNT);
+    for (size_t i = 0; i < USER_COUNT; i++)
+    {
+        snprintf(name, sizeof(name), "user%zu", i);
+        assert_string_equal(um_loader_get_passwd(loader, i)->pw_name, name);
+        assert_int_equal(um_loader_get_passwd(loader, i)->pw_uid, 1000 + i);
+        assert_string_equal(um_loader_get_shadow(loader, i)->sp_namp, name);
+    }
+
+    // lists are copied out of the reused parser lists
+    assert_int_equal(um_loader_get_count(loader, UM_DB_FILE_GROUP), USER_COUNT / 10);
+    assert_int_equal(um_loader_get_count(loader, UM_DB_FILE_GSHADOW), USER_COUNT / 10);
+    for (size_t i = 0; i < USER_COUNT / 10; i++)
+    {
+        grp = um_loader_get_group(loader, i);
+        sgrp = um_loader_get_gshadow(loader, i);
+        snprintf(name, sizeof(name), "user%zu", i * 10);
+        assert_string_equal(grp->gr_mem[0], name);
+        assert_null(grp->gr_mem[2]);
+        assert_string_equal(sgrp->sg_adm[0], name);
+        assert_null(sgrp->sg_adm[1]);
+        assert_string_equal(sgrp->sg_mem[0], name);
+        assert_null(sgrp->sg_mem[2]);
+    }
+
+    um_loader_free(loader);
+
+    // missing files fail the read
+    path_list[UM_DB_FILE_SHADOW] = "/nonexistent/shadow";
+    loader = um_loader_new(0);
+    assert_non_null(loader);
+    assert_int_equal(um_loader_read(loader, path_list, 0xf), -1);
+    um_loader_free(loader);
+
+    remove_files(paths);
+}
+
+static void test_loader_db(void **state)
+{
+    (void)state;
+
+    char paths[UM_DB_FILE_COUNT][32] = {0};
+    um_db_t *dbs[2] = {NULL};
+    const um_user_element_t *users[2] = {NULL};
+    const um_group_element_t *groups[2] = {NULL};
+    const um_group_user_element_t *members[2] = {NULL};
+
+    write_files(paths);
+
+    for (int i = 0; i < 2; i++)
+    {
+        dbs[i] = um_db_new();
+        assert_non_null(dbs[i]);
+        for (int j = 0; j < UM_DB_FILE_COUNT; j++)
+        {
+            assert_int_equal(um_db_set_path(dbs[i], (um_db_file_t)j, paths[j]), 0);
+        }
+    }
+
+    // parallel load gives the same database as the sequential one
+    um_db_set_load_threads(dbs[1], 3);
+    assert_int_equal(um_db_load_ex(dbs[0], UM_DB_LOAD_NATIVE), 0);
+    assert_int_equal(um_db_load_ex(dbs[1], UM_DB_LOAD_PARALLEL), 0);
+
+    users[0] = um_db_get_user_list_head(dbs[0]);
+    users[1] = um_db_get_user_list_head(dbs[1]);
+    while (users[0] && users[1])
+    {
+        assert_string_equal(um_user_get_name(users[0]->user), um_user_get_name(users[1]->user));
+        assert_string_equal(um_user_get_password_hash(users[0]->user), um_user_get_password_hash(users[1]->user));
+        users[0] = users[0]->next;
+        users[1] = users[1]->next;
+    }
+    assert_null(users[0]);
+    assert_null(users[1]);
+
+    groups[0] = um_db_get_group_list_head(dbs[0]);
+    groups[1] = um_db_get_group_list_head(dbs[1]);
+    while (groups[0] && groups[1])
+    {
+        assert_string_equal(um_group_get_name(groups[0]->group), um_group_get_name(groups[1]->group));
+        members[0] = um_group_get_members_head(groups[0]->group);
+        members[1] = um_group_get_members_head(groups[1]->group);
+        while (members[0] && members[1])
+        {
+            assert_string_equal(um_user_get_name(members[0]->user), um_user_get_name(members[1]->user));
+            members[0] = members[0]->next;
+            members[1] = members[1]->next;
+        }
+        assert_null(members[0]);
+        assert_null(members[1]);
+        groups[0] = groups[0]->next;
+        groups[1] = groups[1]->next;
+    }
+    assert_null(groups[0]);
+    assert_null(groups[1]);
+
+    um_db_free(dbs[0]);
+    um_db_free(dbs[1]);
+
+    remove_files(paths);
+}
+
+static void write_files(char paths[UM_DB_FILE_COUNT][32])
+{
+    const char *const names[UM_DB_FILE_COUNT] = {"passwd", "shadow", "group", "gshadow"};
+    FILE *files[UM_DB_FILE_COUNT] = {NULL};
+    int fd = -1;
+
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        snprintf(paths[i], 32, "/tmp/umgmt-%s-XXXXXX", names[i]);
+        fd = mkstemp(paths[i]);
+        assert_true(fd >= 0);
+        files[i] = fdopen(fd, "w");
+        assert_non_null(files[i]);
+    }
+
+    for (int i = 0; i < USER_COUNT; i++)
+    {
+        fprintf(files[UM_DB_FILE_PASSWD], "user%d:x:%d:100::/home/user%d:/bin/sh\n", i, 1000 + i, i);
+        fprintf(files[UM_DB_FILE_SHADOW], "user%d:$6$%d:19000:0:99999:7:::\n", i, i);
+    }
+
+    // each group has two members and the first one as the admin
+    for (int i = 0; i < USER_COUNT / 10; i++)
+    {
+        fprintf(files[UM_DB_FILE_GROUP], "group%d:x:%d:user%d,user%d\n", i, 2000 + i, i * 10, i * 10 + 1);
+        fprintf(files[UM_DB_FILE_GSHADOW], "group%d:!:user%d:user%d,user%d\n", i, i * 10, i * 10, i * 10 + 1);
+    }
+
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        fclose(files[i]);
+    }
+}
+
+static void remove_files(char paths[UM_DB_FILE_COUNT][32])
+{
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        unlink(paths[i]);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+// small buffer to cut lines between reads
+#define UM_PARSER_STREAM_SIZE 16
+
+#include "umgmt/parser.c"
+
+static void test_parser_passwd(void **state);
+static void test_parser_shadow(void **state);
+static void test_parser_gshadow(void **state);
+static void test_parser_empty(void **state);
+static void test_parser_stream(void **state);
+
+static void write_file(char *path, const char *data);
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_parser_passwd),
+        cmocka_unit_test(test_parser_shadow),
+        cmocka_unit_test(test_parser_gshadow),
+        cmocka_unit_test(test_parser_empty),
+        cmocka_unit_test(test_parser_stream),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+static void test_parser_passwd(void **state)
+{
+    (void)state;
+
+    char path[] = "/tmp/umgmt-passwd-XXXXXX";
+    um_parser_t parser = {0};
+    struct passwd pwd = {0};
+
+    // comments, empty and malformed lines are skipped, last line has no newline
+    write_file(path, "root:x:0:0:root:/root:/bin/bash\n"
+                     "# comment\n"
+                     "\n"
+                     "broken:x:1:1:/home\n"
+                     "baduid:x:abc:1::/:/bin/sh\n"
+                     "user:x:1000:100:User,,,:/home/user:");
+
+    assert_int_equal(um_parser_open(&parser, path), 0);
+
+    assert_int_equal(um_parser_next_passwd(&parser, &pwd), 1);
+    assert_string_equal(pwd.pw_name, "root");
+    assert_string_equal(pwd.pw_shell, "/bin/bash");
+    assert_int_equal(pwd.pw_uid, 0);
+
+    assert_int_equal(um_parser_next_passwd(&parser, &pwd), 1);
+    assert_string_equal(pwd.pw_name, "user");
+    assert_int_equal(pwd.pw_uid, 1000);
+    assert_int_equal(pwd.pw_gid, 100);
+    assert_string_equal(pwd.pw_gecos, "User,,,");
+    assert_string_equal(pwd.pw_dir, "/home/user");
+    assert_string_equal(pwd.pw_shell, "");
+
+    assert_int_equal(um_parser_next_passwd(&parser, &pwd), 0);
+
+    um_parser_close(&parser);
+    unlink(path);
+}
+
+static void test_parser_shadow(void **state)
+{
+    (void)state;
+
+    char path[] = "/tmp/umgmt-shadow-XXXXXX";
+    um_parser_t parser = {0};
+    struct spwd spwd = {0};
+
+    write_file(path, "root:$6$salt$hash:19000:0:99999:7:::\n"
+                     "old:*\n"
+                     "bad:*:x::::::\n");
+
+    assert_int_equal(um_parser_open(&parser, path), 0);
+
+    // empty numeric fields are -1, same as getspent()
+    assert_int_equal(um_parser_next_shadow(&parser, &spwd), 1);
+    assert_string_equal(spwd.sp_namp, "root");
+    assert_string_equal(spwd.sp_pwdp, "$6$salt$hash");
+    assert_int_equal(spwd.sp_lstchg, 19000);
+    assert_int_equal(spwd.sp_max, 99999);
+    assert_int_equal(spwd.sp_warn, 7);
+    assert_int_equal(spwd.sp_inact, -1);
+    assert_int_equal(spwd.sp_expire, -1);
+    assert_true(spwd.sp_flag == ~0UL);
+
+    assert_int_equal(um_parser_next_shadow(&parser, &spwd), 1);
+    assert_string_equal(spwd.sp_namp, "old");
+    assert_int_equal(spwd.sp_lstchg, -1);
+
+    assert_int_equal(um_parser_next_shadow(&parser, &spwd), 0);
+
+    um_parser_close(&parser);
+    unlink(path);
+}
+
+static void test_parser_gshadow(void **state)
+{
+    (void)state;
+
+    char path[] = "/tmp/umgmt-gshadow-XXXXXX";
+    um_parser_t parser = {0};
+    struct sgrp sgrp = {0};
+
+    write_file(path, "sudo:!::user1,,user2\n"
+                     "admins:!:root:\n");
+
+    assert_int_equal(um_parser_open(&parser, path), 0);
+
+    assert_int_equal(um_parser_next_gshadow(&parser, &sgrp), 1);
+    assert_string_equal(sgrp.sg_namp, "sudo");
+    assert_null(sgrp.sg_adm[0]);
+    assert_string_equal(sgrp.sg_mem[0], "user1");
+    assert_string_equal(sgrp.sg_mem[1], "user2");
+    assert_null(sgrp.sg_mem[2]);
+
+    // lists are reused between records
+    assert_int_equal(um_parser_next_gshadow(&parser, &sgrp), 1);
+    assert_string_equal(sgrp.sg_namp, "admins");
+    assert_string_equal(sgrp.sg_adm[0], "root");
+    assert_null(sgrp.sg_adm[1]);
+    assert_null(sgrp.sg_mem[0]);
+
+    assert_int_equal(um_parser_next_gshadow(&parser, &sgrp), 0);
+
+    um_parser_close(&parser);
+    unlink(path);
+}
+
+static void test_parser_empty(void **state)
+{
+    (void)state;
+
+    char path[] = "/tmp/umgmt-group-XXXXXX";
+    um_parser_t parser = {0};
+    struct group grp = {0};
+
+    write_file(path, "");
+
+    assert_int_equal(um_parser_open(&parser, path), 0);
+    assert_int_equal(um_parser_next_group(&parser, &grp), 0);
+    um_parser_close(&parser);
+    unlink(path);
+
+    assert_int_equal(um_parser_open(&parser, path), -1);
+}
+
+static void test_parser_stream(void **state)
+{
+    (void)state;
+
+    char path[] = "/tmp/umgmt-group-XXXXXX";
+    um_parser_t parser = {0};
+    struct group grp = {0};
+
+    // lines are cut by the buffer and longer than the buffer, last line has no newline
+    write_file(path, "root:x:0:\n"
+                     "# comment longer than the buffer\n"
+                     "users:x:100:user1,user2,user3,user4\n"
+                     "wheel:x:10:root");
+
+    assert_int_equal(um_parser_open_stream(&parser, path), 0);
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        assert_int_equal(um_parser_next_group(&parser, &grp), 1);
+        assert_string_equal(grp.gr_name, "root");
+        assert_null(grp.gr_mem[0]);
+
+        assert_int_equal(um_parser_next_group(&parser, &grp), 1);
+        assert_string_equal(grp.gr_name, "users");
+        assert_int_equal(grp.gr_gid, 100);
+        assert_string_equal(grp.gr_mem[0], "user1");
+        assert_string_equal(grp.gr_mem[3], "user4");
+        assert_null(grp.gr_mem[4]);
+
+        assert_int_equal(um_parser_next_group(&parser, &grp), 1);
+        assert_string_equal(grp.gr_name, "wheel");
+        assert_string_equal(grp.gr_mem[0], "root");
+
+        assert_int_equal(um_parser_next_group(&parser, &grp), 0);
+        assert_false(parser.failed);
+
+        // the same records are read again after rewinding
+        assert_int_equal(um_parser_rewind(&parser), 0);
+    }
+
+    um_parser_close(&parser);
+    unlink(path);
+
+    assert_int_equal(um_parser_open_stream(&parser, path), -1);
+}
+
+static void write_file(char *path, const char *data)
+{
+    int fd = mkstemp(path);
+    FILE *file = NULL;
+
+    assert_true(fd >= 0);
+
+    file = fdopen(fd, "w");
+    assert_non_null(file);
+    fputs(data, file);
+    fclose(file);
+}
\ No newline at end of file
@@ -0,0 +1,400 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <umgmt.h>
+
+#include "umgmt/proc.c"
+
+static void test_proc_scan(void **state);
+static void test_proc_scan_uid_type(void **state);
+static void test_proc_scan_system(void **state);
+static void test_proc_terminate(void **state);
+static void test_proc_scan_cgroup(void **state);
+static void test_proc_collect_reused(void **state);
+
+static void add_process(const char *root, const char *pid, const char *status);
+static void remove_process(const char *root, const char *pid);
+static void add_cgroup(const char *root, const char *cgroup, const char *procs);
+static int remove_path(const char *path, const struct stat *st, int flag, struct FTW *ftw);
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_proc_scan),
+        cmocka_unit_test(test_proc_scan_uid_type),
+        cmocka_unit_test(test_proc_scan_system),
+        cmocka_unit_test(test_proc_terminate),
+        cmocka_unit_test(test_proc_scan_cgroup),
+        cmocka_unit_test(test_proc_collect_reused),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+static void test_proc_scan(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-proc-XXXXXX";
+    char path[PATH_MAX] = {0};
+    um_proc_scan_t *scan = NULL;
+    const pid_t *pids = NULL;
+    size_t count = 0;
+
+    assert_non_null(mkdtemp(root));
+    add_process(root, "100", "Name:\tsh\nUid:\t1000\t1000\t1000\t1000\n");
+    add_process(root, "101", "Name:\tsh\nUid:\t1001\t0\t0\t0\n");
+    add_process(root, "102", "Name:\tsh\nUid:\t2000\t2000\t2000\t2000\n");
+    add_process(root, "103", "Name:\tsh\nUid:\t1000\t1000\t1000\t1000\n");
+    add_process(root, "self", "Name:\tsh\nUid:\t1000\t1000\t1000\t1000\n");
+
+    // process which exited during the scan
+    snprintf(path, sizeof(path), "%s/104", root);
+    assert_int_equal(mkdir(path, 0755), 0);
+
+    scan = um_proc_scan_new();
+    assert_non_null(scan);
+    assert_int_equal(um_proc_scan_set_root(scan, root), 0);
+    assert_int_equal(um_proc_scan_add_uid(scan, 1000), 0);
+    assert_int_equal(um_proc_scan_add_uid(scan, 1001), 0);
+    assert_int_equal(um_proc_scan_add_uid(scan, 1000), 0);
+    assert_int_equal(um_proc_scan_add_uid(scan, 1002), 0);
+    assert_int_equal(um_proc_scan_run(scan), 0);
+
+    // real UIDs are matched, names which are not process IDs are skipped
+    pids = um_proc_scan_get_pids(scan, 1000, &count);
+    assert_int_equal(count, 2);
+    assert_true((pids[0] == 100 && pids[1] == 103) || (pids[0] == 103 && pids[1] == 100));
+    pids = um_proc_scan_get_pids(scan, 1001, &count);
+    assert_int_equal(count, 1);
+    assert_int_equal(pids[0], 101);
+    assert_null(um_proc_scan_get_pids(scan, 1002, &count));
+    assert_int_equal(count, 0);
+    assert_null(um_proc_scan_get_pids(scan, 2000, &count));
+
+    // results are replaced by the next run
+    remove_process(root, "100");
+    assert_int_equal(um_proc_scan_run(scan), 0);
+    pids = um_proc_scan_get_pids(scan, 1000, &count);
+    assert_int_equal(count, 1);
+    assert_int_equal(pids[0], 103);
+
+    um_proc_scan_free(scan);
+
+    remove_process(root, "101");
+    remove_process(root, "102");
+    remove_process(root, "103");
+    remove_process(root, "104");
+    remove_process(root, "self");
+    assert_int_equal(rmdir(root), 0);
+}
+
+static void test_proc_scan_uid_type(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-proc-XXXXXX";
+    um_proc_scan_t *scan = NULL;
+    const pid_t *pids = NULL;
+    size_t count = 0;
+    uid_t uid = 0;
+
+    assert_non_null(mkdtemp(root));
+    add_process(root, "100", "Name:\tsu\nUid:\t1000\t0\t0\t0\n");
+    add_process(root, "101", "Uid:\t1001\t1001\t1001\t1001\nGid:\t0\t0\t0\t0\n");
+    add_process(root, "102", "Name:\tbroken\nUid:\n");
+
+    scan = um_proc_scan_new();
+    assert_non_null(scan);
+    assert_int_equal(um_proc_scan_set_root(scan, root), 0);
+    assert_int_equal(um_proc_scan_add_uid(scan, 0), 0);
+    assert_int_equal(um_proc_scan_add_uid(scan, 1001), 0);
+    assert_int_equal(um_proc_scan_add_uid(scan, getuid()), 0);
+
+    // status files are parsed from a single read, malformed ones are skipped
+    um_proc_scan_set_uid_type(scan, UM_PROC_UID_EFFECTIVE);
+    assert_int_equal(um_proc_scan_run(scan), 0);
+    pids = um_proc_scan_get_pids(scan, 0, &count);
+    assert_int_equal(count, 1);
+    assert_int_equal(pids[0], 100);
+    pids = um_proc_scan_get_pids(scan, 1001, &count);
+    assert_int_equal(count, 1);
+    assert_int_equal(pids[0], 101);
+
+    // directory owners are used without reading the files
+    um_proc_scan_set_uid_type(scan, UM_PROC_UID_OWNER);
+    assert_int_equal(um_proc_scan_run(scan), 0);
+    uid = getuid();
+    assert_non_null(um_proc_scan_get_pids(scan, uid, &count));
+    assert_int_equal(count, 3);
+
+    um_proc_scan_free(scan);
+
+    remove_process(root, "100");
+    remove_process(root, "101");
+    remove_process(root, "102");
+    assert_int_equal(rmdir(root), 0);
+}
+
+static void test_proc_scan_system(void **state)
+{
+    (void)state;
+
+    um_proc_scan_t *scan = um_proc_scan_new();
+    const pid_t *pids = NULL;
+    size_t count = 0;
+    bool found = false;
+
+    // the test process itself is found in the real /proc
+    assert_non_null(scan);
+    assert_int_equal(um_proc_scan_add_uid(scan, getuid()), 0);
+    assert_int_equal(um_proc_scan_run(scan), 0);
+
+    pids = um_proc_scan_get_pids(scan, getuid(), &count);
+    for (size_t i = 0; i < count; i++)
+    {
+        found = found || pids[i] == getpid();
+    }
+    assert_true(found);
+
+    um_proc_scan_free(scan);
+}
+
+static void test_proc_terminate(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-proc-XXXXXX";
+    char names[2][16] = {0};
+    char path[PATH_MAX] = {0};
+    char procs[64] = {0};
+    struct stat st = {0};
+    int sync[2] = {-1, -1};
+    char ready = 0;
+    pid_t pids[2] = {0};
+    um_proc_scan_t *scan = NULL;
+    um_proc_kill_stats_t stats = {0};
+
+    // exited children are reaped right away, so their process IDs are gone
+    signal(SIGCHLD, SIG_IGN);
+    assert_int_equal(pipe(sync), 0);
+
+    // the second child survives SIGTERM
+    for (int i = 0; i < 2; i++)
+    {
+        pids[i] = fork();
+        assert_true(pids[i] >= 0);
+        if (pids[i] == 0)
+        {
+            if (i == 1)
+            {
+                signal(SIGTERM, SIG_IGN);
+            }
+            (void)!write(sync[1], "x", 1);
+            while (true)
+            {
+                pause();
+            }
+        }
+        assert_int_equal(read(sync[0], &ready, 1), 1);
+    }
+
+    // children are matched through a fake procfs as an unused UID
+    assert_non_null(mkdtemp(root));
+    for (int i = 0; i < 2; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "%d", (int)pids[i]);
+        add_process(root, names[i], "Name:\tchild\nUid:\t4242\t4242\t4242\t4242\n");
+    }
+
+    // slices are not killed as a whole unless requested
+    snprintf(procs, sizeof(procs), "%s\n%s\n", names[0], names[1]);
+    add_cgroup(root, "cgroup/user.slice/user-4242.slice", procs);
+    snprintf(path, sizeof(path), "%s/cgroup/user.slice/user-4242.slice/cgroup.kill", root);
+    close(open(path, O_WRONLY | O_CREAT, 0644));
+
+    scan = um_proc_scan_new();
+    assert_non_null(scan);
+    assert_int_equal(um_proc_scan_set_root(scan, root), 0);
+    snprintf(path, sizeof(path), "%s/cgroup", root);
+    assert_int_equal(um_proc_scan_set_cgroup_root(scan, path), 0);
+    assert_int_equal(um_proc_scan_add_uid(scan, 4242), 0);
+    assert_int_equal(um_proc_scan_terminate(scan, 200, &stats), 0);
+    assert_int_equal(stats.terminated, 1);
+    assert_int_equal(stats.killed, 1);
+    assert_true(stats.scans >= 2);
+    assert_true(stats.elapsed_ms >= 200);
+    assert_int_equal(kill(pids[0], 0), -1);
+    assert_int_equal(kill(pids[1], 0), -1);
+    snprintf(path, sizeof(path), "%s/cgroup/user.slice/user-4242.slice/cgroup.kill", root);
+    assert_int_equal(stat(path, &st), 0);
+    assert_int_equal(st.st_size, 0);
+    um_proc_scan_free(scan);
+
+    assert_int_equal(nftw(root, remove_path, 8, FTW_DEPTH | FTW_PHYS), 0);
+
+    close(sync[0]);
+    close(sync[1]);
+    signal(SIGCHLD, SIG_DFL);
+}
+
+static void test_proc_scan_cgroup(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-proc-XXXXXX";
+    char proc_root[PATH_MAX] = {0};
+    char path[PATH_MAX] = {0};
+    um_proc_scan_t *scan = NULL;
+    const pid_t *pids = NULL;
+    size_t count = 0;
+
+    assert_non_null(mkdtemp(root));
+    snprintf(proc_root, sizeof(proc_root), "%s/proc", root);
+    assert_int_equal(mkdir(proc_root, 0755), 0);
+    add_process(proc_root, "100", "Name:\tsh\nUid:\t4242\t4242\t4242\t4242\n");
+    add_process(proc_root, "101", "Name:\tsu\nUid:\t0\t0\t0\t0\n");
+    add_process(proc_root, "102", "Name:\tapp\nUid:\t4242\t4242\t4242\t4242\n");
+    add_process(proc_root, "103", "Name:\tcron\nUid:\t4242\t4242\t4242\t4242\n");
+    add_process(proc_root, "104", "Name:\tsh\nUid:\t4243\t4243\t4243\t4243\n");
+
+    add_cgroup(root, "cgroup/user.slice/user-4242.slice/session-1.scope", "100\n101\n105\n");
+    add_cgroup(root, "cgroup/user.slice/user-4242.slice/user@4242.service/app.slice/x.service", "102");
+
+    scan = um_proc_scan_new();
+    assert_non_null(scan);
+    assert_int_equal(um_proc_scan_set_root(scan, proc_root), 0);
+    snprintf(path, sizeof(path), "%s/cgroup", root);
+    assert_int_equal(um_proc_scan_set_cgroup_root(scan, path), 0);
+    assert_int_equal(um_proc_scan_add_uid(scan, 4242), 0);
+    assert_int_equal(um_proc_scan_add_uid(scan, 4243), 0);
+
+    // nested cgroups are walked, processes of other users and processes outside of the slice are skipped
+    assert_int_equal(um_proc_scan_run(scan), 0);
+    pids = um_proc_scan_get_pids(scan, 4242, &count);
+    assert_int_equal(count, 2);
+    assert_true((pids[0] == 100 && pids[1] == 102) || (pids[0] == 102 && pids[1] == 100));
+
+    // users without a slice are looked up in /proc
+    pids = um_proc_scan_get_pids(scan, 4243, &count);
+    assert_int_equal(count, 1);
+    assert_int_equal(pids[0], 104);
+
+    // hierarchies without user slices fall back to the /proc scan
+    snprintf(path, sizeof(path), "%s/cgroup/user.slice", root);
+    assert_int_equal(nftw(path, remove_path, 8, FTW_DEPTH | FTW_PHYS), 0);
+    assert_int_equal(um_proc_scan_run(scan), 0);
+    assert_non_null(um_proc_scan_get_pids(scan, 4242, &count));
+    assert_int_equal(count, 3);
+    assert_non_null(um_proc_scan_get_pids(scan, 4243, &count));
+    assert_int_equal(count, 1);
+
+    um_proc_scan_free(scan);
+
+    assert_int_equal(nftw(root, remove_path, 8, FTW_DEPTH | FTW_PHYS), 0);
+}
+
+static void test_proc_collect_reused(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-proc-XXXXXX";
+    char name[16] = {0};
+    int proc_fd = -1;
+    um_proc_scan_t *scan = NULL;
+    um_proc_target_t *targets = NULL;
+    size_t count = 0;
+
+    // the test process stands in for a process found as one user and reused by another one in the set
+    assert_non_null(mkdtemp(root));
+    snprintf(name, sizeof(name), "%d", (int)getpid());
+    add_process(root, name, "Name:\tsh\nUid:\t4242\t4242\t4242\t4242\n");
+
+    scan = um_proc_scan_new();
+    assert_non_null(scan);
+    assert_int_equal(um_proc_scan_set_root(scan, root), 0);
+    assert_int_equal(um_proc_scan_add_uid(scan, 4242), 0);
+    assert_int_equal(um_proc_scan_add_uid(scan, 4243), 0);
+    assert_int_equal(um_proc_scan_run(scan), 0);
+
+    proc_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    assert_true(proc_fd >= 0);
+
+    assert_int_equal(um_proc_collect_targets(scan, proc_fd, &targets, &count), 0);
+    assert_int_equal(count, 1);
+    assert_int_equal(targets[0].uid, 4242);
+    um_proc_close_targets(targets, count);
+
+    remove_process(root, name);
+    add_process(root, name, "Name:\tsh\nUid:\t4243\t4243\t4243\t4243\n");
+    assert_int_equal(um_proc_collect_targets(scan, proc_fd, &targets, &count), 0);
+    assert_int_equal(count, 0);
+    assert_null(targets);
+
+    close(proc_fd);
+    um_proc_scan_free(scan);
+
+    remove_process(root, name);
+    assert_int_equal(rmdir(root), 0);
+}
+
+static void add_process(const char *root, const char *pid, const char *status)
+{
+    char path[PATH_MAX] = {0};
+    FILE *file = NULL;
+
+    snprintf(path, sizeof(path), "%s/%s", root, pid);
+    assert_int_equal(mkdir(path, 0755), 0);
+
+    snprintf(path, sizeof(path), "%s/%s/status", root, pid);
+    file = fopen(path, "w");
+    assert_non_null(file);
+    fputs(status, file);
+    fclose(file);
+}
+
+static void remove_process(const char *root, const char *pid)
+{
+    char path[PATH_MAX] = {0};
+
+    snprintf(path, sizeof(path), "%s/%s/status", root, pid);
+    unlink(path);
+
+    snprintf(path, sizeof(path), "%s/%s", root, pid);
+    assert_int_equal(rmdir(path), 0);
+}
+
+static void add_cgroup(const char *root, const char *cgroup, const char *procs)
+{
+    char path[PATH_MAX] = {0};
+    FILE *file = NULL;
+
+    snprintf(path, sizeof(path), "%s/%s", root, cgroup);
+    for (char *slash = strchr(path + strlen(root) + 1, '/'); slash; slash = strchr(slash + 1, '/'))
+    {
+        *slash = '\0';
+        mkdir(path, 0755);
+        *slash = '/';
+    }
+    assert_int_equal(mkdir(path, 0755), 0);
+
+    snprintf(path, sizeof(path), "%s/%s/cgroup.procs", root, cgroup);
+    file = fopen(path, "w");
+    assert_non_null(file);
+    fputs(procs, file);
+    fclose(file);
+}
+
+static int remove_path(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    (void)st;
+    (void)ftw;
+
+    return flag == FTW_DP ? rmdir(path) : unlink(path);
+}
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <umgmt.h>
+
+#include "umgmt/snapshot.c"
+
+static void test_snapshot_query(void **state);
+static void test_snapshot_stale(void **state);
+
+static void create_root(char *root);
+static void remove_root(const char *root);
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_snapshot_query),
+        cmocka_unit_test(test_snapshot_stale),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+static void test_snapshot_query(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-root-XXXXXX";
+    char path[PATH_MAX] = {0};
+    um_db_t *db = NULL;
+    um_snapshot_t *snapshot = NULL;
+    const um_snapshot_user_t *user = NULL;
+    const um_snapshot_group_t *group = NULL;
+
+    create_root(root);
+    snprintf(path, sizeof(path), "%s/snapshot", root);
+
+    db = um_db_new();
+    assert_non_null(db);
+    assert_int_equal(um_db_set_root(db, root), 0);
+    assert_int_equal(um_db_load(db), 0);
+    assert_int_equal(um_db_store_snapshot(db, path), 0);
+    um_db_free(db);
+
+    snapshot = um_snapshot_open(path);
+    assert_non_null(snapshot);
+    assert_int_equal(um_snapshot_get_user_count(snapshot), 2);
+    assert_int_equal(um_snapshot_get_group_count(snapshot), 2);
+
+    // records keep the database order
+    user = um_snapshot_get_user_at(snapshot, 1);
+    assert_ptr_equal(um_snapshot_get_user(snapshot, "user1"), user);
+    assert_ptr_equal(um_snapshot_get_user_by_uid(snapshot, 1000), user);
+    assert_null(um_snapshot_get_user(snapshot, "user2"));
+    assert_null(um_snapshot_get_user_by_uid(snapshot, 1001));
+    assert_null(um_snapshot_get_user_at(snapshot, 2));
+
+    assert_string_equal(um_snapshot_user_get_home_path(snapshot, user), "/home/user1");
+    assert_string_equal(um_snapshot_user_get_shell_path(snapshot, user), "/bin/sh");
+    assert_string_equal(um_snapshot_user_get_password_hash(snapshot, user), "!");
+    assert_string_equal(um_snapshot_user_get_gecos(snapshot, user), "");
+    assert_int_equal(um_snapshot_user_get_last_change(snapshot, user), 19000);
+    assert_int_equal(um_snapshot_user_get_change_max(snapshot, user), 99999);
+
+    // memberships are resolved in both directions
+    group = um_snapshot_get_group(snapshot, "users");
+    assert_non_null(group);
+    assert_ptr_equal(um_snapshot_get_group_by_gid(snapshot, 1000), group);
+    assert_int_equal(um_snapshot_group_get_member_count(snapshot, group), 1);
+    assert_ptr_equal(um_snapshot_group_get_member(snapshot, group, 0), user);
+    assert_null(um_snapshot_group_get_member(snapshot, group, 1));
+    assert_int_equal(um_snapshot_group_get_admin_count(snapshot, group), 1);
+    assert_ptr_equal(um_snapshot_group_get_admin(snapshot, group, 0), um_snapshot_get_user(snapshot, "root"));
+    assert_int_equal(um_snapshot_user_get_group_count(snapshot, user), 1);
+    assert_ptr_equal(um_snapshot_user_get_group(snapshot, user, 0), group);
+    assert_int_equal(um_snapshot_user_get_group_count(snapshot, um_snapshot_get_user(snapshot, "root")), 0);
+
+    um_snapshot_close(snapshot);
+
+    unlink(path);
+    remove_root(root);
+}
+
+static void test_snapshot_stale(void **state)
+{
+    (void)state;
+
+    char root[] = "/tmp/umgmt-root-XXXXXX";
+    char path[PATH_MAX] = {0};
+    um_db_t *db = NULL;
+    um_snapshot_t *snapshot = NULL;
+    FILE *file = NULL;
+
+    create_root(root);
+    snprintf(path, sizeof(path), "%s/snapshot", root);
+
+    db = um_db_new();
+    assert_non_null(db);
+    assert_int_equal(um_db_set_root(db, root), 0);
+    assert_int_equal(um_db_load(db), 0);
+
+    // unstored changes are not visible in the files
+    assert_int_equal(um_user_set_shell_path(um_db_get_user(db, "user1"), "/bin/bash"), 0);
+    assert_int_equal(um_db_store_snapshot(db, path), -1);
+    assert_int_equal(um_db_store(db), 0);
+    assert_int_equal(um_db_store_snapshot(db, path), 0);
+    um_db_free(db);
+
+    snapshot = um_snapshot_open(path);
+    assert_non_null(snapshot);
+    assert_true(um_snapshot_is_current(snapshot));
+
+    // any change of the account files invalidates the snapshot
+    snprintf(path, sizeof(path), "%s/etc/group", root);
+    file = fopen(path, "a");
+    assert_non_null(file);
+    fputs("wheel:x:10:\n", file);
+    fclose(file);
+    assert_false(um_snapshot_is_current(snapshot));
+    um_snapshot_close(snapshot);
+
+    snprintf(path, sizeof(path), "%s/snapshot", root);
+    assert_null(um_snapshot_open(path));
+
+    // damaged files are rejected
+    assert_int_equal(truncate(path, sizeof(um_snapshot_header_t) + 8), 0);
+    assert_null(um_snapshot_open(path));
+
+    unlink(path);
+    remove_root(root);
+}
+
+static void create_root(char *root)
+{
+    char path[PATH_MAX] = {0};
+    const char *const files[UM_DB_FILE_COUNT][2] = {
+        [UM_DB_FILE_PASSWD] = {"passwd", "root:x:0:0:root:/root:/bin/bash\nuser1:x:1000:1000::/home/user1:/bin/sh\n"},
+        [UM_DB_FILE_SHADOW] = {"shadow", "root:*:19000:0:99999:7:::\nuser1:!:19000:0:99999:7:::\n"},
+        [UM_DB_FILE_GROUP] = {"group", "root:x:0:\nusers:x:1000:user1\n"},
+        [UM_DB_FILE_GSHADOW] = {"gshadow", "root:*::\nusers:!:root:user1\n"},
+    };
+    FILE *file = NULL;
+
+    assert_non_null(mkdtemp(root));
+    snprintf(path, sizeof(path), "%s/etc", root);
+    assert_int_equal(mkdir(path, 0755), 0);
+
+    for (int i = 0; i < UM_DB_FILE_COUNT; i++)
+    {
+        snprintf(path, sizeof(path), "%s/etc/%s", root, files[i][0]);
+        file = fopen(path, "w");
+        assert_non_null(file);
+        fputs(files[i][1], file);
+        fclose(file);
+    }
+}
+
+static void remove_root(const char *root)
+{
+    char path[PATH_MAX] = {0};
+    const char *const names[] = {"passwd", "shadow", "group", "gshadow"};
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/etc/%s", root, names[i]);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/etc/%s-", root, names[i]);
+        unlink(path);
+    }
+
+    snprintf(path, sizeof(path), "%s/etc", root);
+    assert_int_equal(rmdir(path), 0);
+    assert_int_equal(rmdir(root), 0);
+}
\ No newline at end of file